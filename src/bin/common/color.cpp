@@ -58,6 +58,12 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "opj_parallel.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 extern "C" {
 
@@ -99,6 +105,25 @@ static opj_image_t*  image_create(uint32_t numcmpts, uint32_t w, uint32_t h, uin
 }
 
 
+/* number of rows that a colour conversion worker converts at a time */
+const uint32_t color_rows_per_chunk = 16;
+
+/**
+Run a row conversion over image rows [0, h), handing out chunks of rows to up to numThreads workers.
+
+@param h			number of rows
+@param numThreads	maximum number of workers (the calling thread is one of them)
+@param convert		conversion, called as convert(y0, y1) on rows [y0, y1)
+*/
+template<typename F> static void color_convert_rows(uint32_t h, uint32_t numThreads, F convert)
+{
+	uint32_t num_chunks = (h + color_rows_per_chunk - 1) / color_rows_per_chunk;
+	opj_run_parallel(num_chunks, numThreads, [&](uint32_t, uint32_t chunk) {
+		uint32_t y0 = chunk * color_rows_per_chunk;
+		convert(y0, std::min<uint32_t>(y0 + color_rows_per_chunk, h));
+	});
+}
+
 static bool all_components_equal_subsampling(opj_image_t *image) {
 	if (image->numcomps == 0)
 		return true;
@@ -155,249 +180,221 @@ static void sycc_to_rgb(int offset, int upb, int y, int cb, int cr,
     *out_b = b;
 }
 
-static void sycc444_to_rgb(opj_image_t *img)
+#ifdef __SSE2__
+/* clamp 32 bit integers to [0, upb] */
+static inline __m128i sycc_clamp(__m128i v, __m128i upb)
 {
-	int *d0, *d1, *d2, *r, *g, *b;
-	const int *y, *cb, *cr;
-	size_t maxw, maxh, max, i;
-	int offset, upb;
-	opj_image_t* new_image = image_create(3, img->comps[0].w, img->comps[0].h, img->comps[0].prec);
-	if (!new_image)
-		return;
-
-	upb = (int)img->comps[0].prec;
-	offset = 1 << (upb - 1); upb = (1 << upb) - 1;
-
-	maxw = (size_t)img->comps[0].w;
-	maxh = (size_t)img->comps[0].h;
-	max = maxw * maxh;
-
-	y = img->comps[0].data;
-	cb = img->comps[1].data;
-	cr = img->comps[2].data;
+	v = _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_setzero_si128()));
+	__m128i over = _mm_cmpgt_epi32(v, upb);
+	return _mm_or_si128(_mm_and_si128(over, upb), _mm_andnot_si128(over, v));
+}
 
-	d0 = r = new_image->comps[0].data;
-	d1 = g = new_image->comps[1].data;
-	d2 = b = new_image->comps[2].data;
+/* truncate the products of four integers with a double constant, as (int)(k * (float)v) does */
+static inline __m128i sycc_mul_trunc(__m128i v, __m128d k)
+{
+	__m128i lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(v), k));
+	__m128i hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), k));
+	return _mm_unpacklo_epi64(lo, hi);
+}
 
-	new_image->comps[0].data = NULL;
-	new_image->comps[1].data = NULL;
-	new_image->comps[2].data = NULL;
+/* truncate the sums of products (int)(k1 * (float)v1 + k2 * (float)v2) of four integer pairs */
+static inline __m128i sycc_mul_add_trunc(__m128i v1, __m128d k1, __m128i v2, __m128d k2)
+{
+	__m128i lo = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(v1), k1),
+											_mm_mul_pd(_mm_cvtepi32_pd(v2), k2)));
+	__m128i hi = _mm_cvttpd_epi32(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v1, 8)), k1),
+											_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v2, 8)), k2)));
+	return _mm_unpacklo_epi64(lo, hi);
+}
+#endif
 
-	opj_image_destroy(new_image);
-	new_image = NULL;
-	
-	for (i = 0U; i < max; ++i)
-	{
-		sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-		++y; ++cb; ++cr; ++r; ++g; ++b;
+/**
+Convert a row of sYCC pixels with one chroma sample per pixel, with the same results as sycc_to_rgb.
+The output may overwrite the input.
+*/
+static void sycc_row_to_rgb(int offset, int upb, const int* y, const int* cb, const int* cr,
+							int* r, int* g, int* b, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i voffset = _mm_set1_epi32(offset);
+	const __m128i vupb = _mm_set1_epi32(upb);
+	const __m128d kr = _mm_set1_pd(1.402);
+	const __m128d kgb = _mm_set1_pd(0.344);
+	const __m128d kgr = _mm_set1_pd(0.714);
+	const __m128d kb = _mm_set1_pd(1.772);
+	for (; i + 4 <= len; i += 4) {
+		__m128i vy = _mm_loadu_si128((const __m128i*)(y + i));
+		__m128i vcb = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(cb + i)), voffset);
+		__m128i vcr = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(cr + i)), voffset);
+		__m128i vr = _mm_add_epi32(vy, sycc_mul_trunc(vcr, kr));
+		__m128i vg = _mm_sub_epi32(vy, sycc_mul_add_trunc(vcb, kgb, vcr, kgr));
+		__m128i vb = _mm_add_epi32(vy, sycc_mul_trunc(vcb, kb));
+		_mm_storeu_si128((__m128i*)(r + i), sycc_clamp(vr, vupb));
+		_mm_storeu_si128((__m128i*)(g + i), sycc_clamp(vg, vupb));
+		_mm_storeu_si128((__m128i*)(b + i), sycc_clamp(vb, vupb));
 	}
-	opj_image_all_components_data_free(img);
-	img->comps[0].data = d0;
-	img->comps[1].data = d1;
-	img->comps[2].data = d2;
-	img->color_space = OPJ_CLRSPC_SRGB;
-	return;
-}/* sycc444_to_rgb() */
-
+#endif
+	for (; i < len; ++i)
+		sycc_to_rgb(offset, upb, y[i], cb[i], cr[i], r + i, g + i, b + i);
+}
 
-static void sycc422_to_rgb(opj_image_t *img)
+/**
+Upsample a row of horizontally subsampled chroma, so that dst[i] = src[i / 2] for i < len.
+Only the first avail samples of src are read: later pixels repeat the last of them.
+*/
+static void sycc_upsample_row(const int* src, size_t avail, int* dst, size_t len)
 {
-	int *d0, *d1, *d2, *r, *g, *b;
-	const int *y, *cb, *cr;
-	size_t maxw, maxh, max, offx, loopmaxw;
-	int offset, upb;
-	size_t i;
-
-	opj_image_t* new_image = image_create(3, img->comps[0].w, img->comps[0].h, img->comps[0].prec);
-	if (!new_image)
+	size_t i = 0;
+	if (avail < (len + 1) / 2) {
+		for (; i < len; ++i)
+			dst[i] = src[std::min(i / 2, avail - 1)];
 		return;
+	}
+#ifdef __SSE2__
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i / 2));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi32(v, v));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi32(v, v));
+	}
+#endif
+	for (; i < len; ++i)
+		dst[i] = src[i / 2];
+}
 
-
-	upb = (int)img->comps[0].prec;
-	offset = 1 << (upb - 1); upb = (1 << upb) - 1;
-
-	maxw = (size_t)img->comps[0].w; maxh = (size_t)img->comps[0].h;
-	max = maxw * maxh;
-
-	y = img->comps[0].data;
-	cb = img->comps[1].data;
-	cr = img->comps[2].data;
-
-	d0 = r = new_image->comps[0].data;
-	d1 = g = new_image->comps[1].data;
-	d2 = b = new_image->comps[2].data;
-
-	new_image->comps[0].data = NULL;
-	new_image->comps[1].data = NULL;
-	new_image->comps[2].data = NULL;
-
-	opj_image_destroy(new_image);
-	new_image = NULL;
-
-
-	/* if img->x0 is odd, then first column shall use Cb/Cr = 0 */
-	offx = img->x0 & 1U;
-	loopmaxw = maxw - offx;
-
-	for (i = 0U; i < maxh; ++i)
-	{
-		size_t j;
-
-		if (offx > 0U) {
-			sycc_to_rgb(offset, upb, *y, 0, 0, r, g, b);
-			++y; ++r; ++g; ++b;
+/**
+Upsampled chroma plane: fills one row of full resolution chroma samples at a time,
+for a plane subsampled by two horizontally, and optionally vertically.
+
+The chroma that each pixel gets follows the original 4:2:2 and 4:2:0 conversion loops:
+if the image x0 (y0) is odd, the first column (row) gets zero chroma, and pixels are
+otherwise paired from the first even column (row), except for the first column of
+the second row of a pair, which takes the first chroma sample of the pair,
+and for a lone last row of a 4:2:0 image, whose pixels are paired from the first column.
+*/
+struct sycc_chroma_plane {
+	const int* data;
+	size_t stride;
+	size_t size;
+	size_t offx;
+	size_t offy;
+	bool vertical;
+
+	/**
+	Fill the chroma of row y (of the luma plane), of width w
+	*/
+	void row(size_t y, size_t w, size_t h, int* dst) const {
+		if (!w)
+			return;
+		if (vertical && offy && y == 0) {
+			std::fill(dst, dst + w, 0);
+			return;
 		}
-
-		for (j = 0U; j < (loopmaxw & ~(size_t)1U); j += 2U)
-		{
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b;
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b; ++cb; ++cr;
+		size_t cy = vertical ? (y - offy) / 2 : y;
+		bool second = vertical && ((y - offy) & 1);
+		bool lone = vertical && !second && ((h - offy) & 1) && y == h - 1;
+		size_t start = cy * stride;
+		if (start >= size) {
+			/* malformed plane: repeat its last sample */
+			std::fill(dst, dst + w, size ? data[size - 1] : 0);
+			return;
 		}
-		if (j < loopmaxw) {
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b; ++cb; ++cr;
+		const int* src = data + start;
+		size_t avail = size - start;
+		if (lone || !offx) {
+			sycc_upsample_row(src, avail, dst, w);
+			return;
 		}
+		dst[0] = second ? src[0] : 0;
+		sycc_upsample_row(src, avail, dst + 1, w - 1);
 	}
-	opj_image_all_components_data_free(img);
-
-	img->comps[0].data = d0;
-	img->comps[1].data = d1;
-	img->comps[2].data = d2;
-
-	img->comps[1].w = img->comps[2].w = img->comps[0].w;
-	img->comps[1].h = img->comps[2].h = img->comps[0].h;
-	img->comps[1].dx = img->comps[2].dx = img->comps[0].dx;
-	img->comps[1].dy = img->comps[2].dy = img->comps[0].dy;
-	img->color_space = OPJ_CLRSPC_SRGB;
-	return;
+};
 
-}/* sycc422_to_rgb() */
-
-
-static void sycc420_to_rgb(opj_image_t *img)
+static void sycc444_to_rgb(opj_image_t *img, uint32_t numThreads)
 {
-	int *d0, *d1, *d2, *r, *g, *b, *nr, *ng, *nb;
-	const int *y, *cb, *cr, *ny;
-	size_t maxw, maxh, max, offx, loopmaxw, offy, loopmaxh;
 	int offset, upb;
-	size_t i;
-	opj_image_t* new_image = image_create(3, img->comps[0].w, img->comps[0].h, img->comps[0].prec);
-	if (!new_image)
-		return;
+	size_t maxw = (size_t)img->comps[0].w;
 
 	upb = (int)img->comps[0].prec;
 	offset = 1 << (upb - 1); upb = (1 << upb) - 1;
 
-	maxw = (size_t)img->comps[0].w;
-	maxh = (size_t)img->comps[0].h;
-	max = maxw * maxh;
-
-	y = img->comps[0].data;
-	cb = img->comps[1].data;
-	cr = img->comps[2].data;
-
-	d0 = r = new_image->comps[0].data;
-	d1 = g = new_image->comps[1].data;
-	d2 = b = new_image->comps[2].data;
-
-	new_image->comps[0].data = NULL;
-	new_image->comps[1].data = NULL;
-	new_image->comps[2].data = NULL;
-
-	opj_image_destroy(new_image);
-	new_image = NULL;
+	int* y = img->comps[0].data;
+	int* cb = img->comps[1].data;
+	int* cr = img->comps[2].data;
 
-	/* if img->x0 is odd, then first column shall use Cb/Cr = 0 */
-	offx = img->x0 & 1U;
-	loopmaxw = maxw - offx;
-	/* if img->y0 is odd, then first line shall use Cb/Cr = 0 */
-	offy = img->y0 & 1U;
-	loopmaxh = maxh - offy;
-
-	if (offy > 0U) {
-		size_t j;
-
-		for (j = 0U; j < maxw; ++j)
-		{
-			sycc_to_rgb(offset, upb, *y, 0, 0, r, g, b);
-			++y; ++r; ++g; ++b;
+	/* each pixel only depends on its own samples, so the conversion is done in place */
+	color_convert_rows(img->comps[0].h, numThreads, [=](uint32_t y0, uint32_t y1) {
+		for (size_t j = y0; j < y1; ++j) {
+			size_t o = j * maxw;
+			sycc_row_to_rgb(offset, upb, y + o, cb + o, cr + o, y + o, cb + o, cr + o, maxw);
 		}
-	}
-
-	for (i = 0U; i < (loopmaxh & ~(size_t)1U); i += 2U)
-	{
-		size_t j;
-
-		ny = y + maxw;
-		nr = r + maxw; ng = g + maxw; nb = b + maxw;
+	});
+	img->color_space = OPJ_CLRSPC_SRGB;
+}/* sycc444_to_rgb() */
 
-		if (offx > 0U) {
-			sycc_to_rgb(offset, upb, *y, 0, 0, r, g, b);
-			++y; ++r; ++g; ++b;
-			sycc_to_rgb(offset, upb, *ny, *cb, *cr, nr, ng, nb);
-			++ny; ++nr; ++ng; ++nb;
-		}
+/**
+Convert 4:2:2 (vertical == false) or 4:2:0 (vertical == true) sYCC to RGB.
+Red overwrites the luma plane in place; only green and blue need full size planes.
+*/
+static void sycc42x_to_rgb(opj_image_t *img, bool vertical, uint32_t numThreads)
+{
+	int offset, upb;
+	size_t maxw = (size_t)img->comps[0].w;
+	size_t maxh = (size_t)img->comps[0].h;
 
-		for (j = 0U; j < (loopmaxw & ~(size_t)1U); j += 2U)
-		{
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b;
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b;
-
-			sycc_to_rgb(offset, upb, *ny, *cb, *cr, nr, ng, nb);
-			++ny; ++nr; ++ng; ++nb;
-			sycc_to_rgb(offset, upb, *ny, *cb, *cr, nr, ng, nb);
-			++ny; ++nr; ++ng; ++nb; ++cb; ++cr;
-		}
-		if (j < loopmaxw)
-		{
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-			++y; ++r; ++g; ++b;
+	upb = (int)img->comps[0].prec;
+	offset = 1 << (upb - 1); upb = (1 << upb) - 1;
 
-			sycc_to_rgb(offset, upb, *ny, *cb, *cr, nr, ng, nb);
-			++ny; ++nr; ++ng; ++nb; ++cb; ++cr;
-		}
-		y += maxw; r += maxw; g += maxw; b += maxw;
+	opj_image_comp_t green = img->comps[0];
+	opj_image_comp_t blue = img->comps[0];
+	green.data = NULL;
+	blue.data = NULL;
+	if (!opj_image_single_component_data_alloc(&green))
+		return;
+	if (!opj_image_single_component_data_alloc(&blue)) {
+		opj_image_single_component_data_free(&green);
+		return;
 	}
-	if (i < loopmaxh)
-	{
-		size_t j;
-
-		for (j = 0U; j < (maxw & ~(size_t)1U); j += 2U)
-		{
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
 
-			++y; ++r; ++g; ++b;
-
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
-
-			++y; ++r; ++g; ++b; ++cb; ++cr;
-		}
-		if (j < maxw)
-		{
-			sycc_to_rgb(offset, upb, *y, *cb, *cr, r, g, b);
+	sycc_chroma_plane cb, cr;
+	cb.data = img->comps[1].data;
+	cr.data = img->comps[2].data;
+	cb.stride = img->comps[1].w;
+	cr.stride = img->comps[2].w;
+	cb.size = (size_t)img->comps[1].w * img->comps[1].h;
+	cr.size = (size_t)img->comps[2].w * img->comps[2].h;
+	/* if img->x0 is odd, then first column shall use Cb/Cr = 0 */
+	cb.offx = cr.offx = img->x0 & 1U;
+	/* if img->y0 is odd, then first line shall use Cb/Cr = 0 */
+	cb.offy = cr.offy = vertical ? (img->y0 & 1U) : 0;
+	cb.vertical = cr.vertical = vertical;
+
+	int* y = img->comps[0].data;
+	int* g = green.data;
+	int* b = blue.data;
+	color_convert_rows((uint32_t)maxh, numThreads, [=](uint32_t y0, uint32_t y1) {
+		std::vector<int> cb_row(maxw), cr_row(maxw);
+		for (size_t j = y0; j < y1; ++j) {
+			size_t o = j * maxw;
+			cb.row(j, maxw, maxh, cb_row.data());
+			cr.row(j, maxw, maxh, cr_row.data());
+			sycc_row_to_rgb(offset, upb, y + o, cb_row.data(), cr_row.data(), y + o, g + o, b + o, maxw);
 		}
-	}
+	});
 
-	opj_image_all_components_data_free(img);
-	img->comps[0].data = d0;
-	img->comps[1].data = d1;
-	img->comps[2].data = d2;
+	opj_image_single_component_data_free(img->comps + 1);
+	opj_image_single_component_data_free(img->comps + 2);
+	img->comps[1].data = green.data;
+	img->comps[2].data = blue.data;
 
 	img->comps[1].w = img->comps[2].w = img->comps[0].w;
 	img->comps[1].h = img->comps[2].h = img->comps[0].h;
 	img->comps[1].dx = img->comps[2].dx = img->comps[0].dx;
 	img->comps[1].dy = img->comps[2].dy = img->comps[0].dy;
 	img->color_space = OPJ_CLRSPC_SRGB;
-	return;
-
-}/* sycc420_to_rgb() */
+}/* sycc42x_to_rgb() */
 
-void color_sycc_to_rgb(opj_image_t *img)
+void color_sycc_to_rgb(opj_image_t *img, uint32_t numThreads)
 {
     if(img->numcomps < 3) {
         img->color_space = OPJ_CLRSPC_GRAY;
@@ -410,21 +407,21 @@ void color_sycc_to_rgb(opj_image_t *img)
             && (img->comps[0].dy == 1)
             && (img->comps[1].dy == 2)
             && (img->comps[2].dy == 2)) { /* horizontal and vertical sub-sample */
-        sycc420_to_rgb(img);
+        sycc42x_to_rgb(img, true, numThreads);
     } else if((img->comps[0].dx == 1)
               && (img->comps[1].dx == 2)
               && (img->comps[2].dx == 2)
               && (img->comps[0].dy == 1)
               && (img->comps[1].dy == 1)
               && (img->comps[2].dy == 1)) { /* horizontal sub-sample only */
-        sycc422_to_rgb(img);
+        sycc42x_to_rgb(img, false, numThreads);
     } else if((img->comps[0].dx == 1)
               && (img->comps[1].dx == 1)
               && (img->comps[2].dx == 1)
               && (img->comps[0].dy == 1)
               && (img->comps[1].dy == 1)
               && (img->comps[2].dy == 1)) { /* no sub-sample */
-        sycc444_to_rgb(img);
+        sycc444_to_rgb(img, numThreads);
     } else {
         fprintf(stderr,"%s:%d:color_sycc_to_rgb\n\tCAN NOT CONVERT\n", __FILE__,__LINE__);
         return;
@@ -435,14 +432,143 @@ void color_sycc_to_rgb(opj_image_t *img)
 
 #if defined(OPJ_HAVE_LIBLCMS)
 
+/**
+Truncate a row of samples to 8 bits, as a cast to unsigned char does
+*/
+static void color_pack_8(const int32_t* src, uint8_t* dst, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	for (; i + 16 <= len; i += 16) {
+		__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask);
+		__m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i + 4)), mask);
+		__m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i + 8)), mask);
+		__m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i + 12)), mask);
+		_mm_storeu_si128((__m128i*)(dst + i),
+			_mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+#endif
+	for (; i < len; ++i)
+		dst[i] = (uint8_t)src[i];
+}
+
+/**
+Truncate a row of samples to 16 bits, as a cast to unsigned short does
+*/
+static void color_pack_16(const int32_t* src, uint16_t* dst, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= len; i += 8) {
+		/* sign extend the low 16 bits, so that the signed saturating pack keeps them unchanged */
+		__m128i a = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i*)(src + i)), 16), 16);
+		__m128i b = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), 16), 16);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < len; ++i)
+		dst[i] = (uint16_t)src[i];
+}
+
+/**
+Widen a row of 8 bit samples
+*/
+static void color_unpack_8(const uint8_t* src, int32_t* dst, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+	}
+#endif
+	for (; i < len; ++i)
+		dst[i] = src[i];
+}
+
+/**
+Widen a row of 16 bit samples
+*/
+static void color_unpack_16(const uint16_t* src, int32_t* dst, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(v, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(v, zero));
+	}
+#endif
+	for (; i < len; ++i)
+		dst[i] = src[i];
+}
+
+/**
+Transform rows of planar samples with a colour transform, in parallel chunks of rows.
+Each row of the input planes is truncated to the transform's input sample size,
+transformed as planar samples, and widened into the output planes; input and
+output planes may be the same.
+
+@param transform	transform with planar 8 or 16 bit input, and planar 8 or 16 bit RGB output
+@param in			input planes
+@param num_in		number of input planes
+@param in_bytes		bytes per transform input sample
+@param out			three output planes: the planes that are NULL are dropped
+@param out_bytes	bytes per transform output sample
+@param w			plane width
+@param h			plane height
+@param numThreads	number of threads
+*/
+static void color_transform_planes(cmsHTRANSFORM transform,
+									int32_t* const* in,
+									uint32_t num_in,
+									uint32_t in_bytes,
+									int32_t* const* out,
+									uint32_t out_bytes,
+									uint32_t w,
+									uint32_t h,
+									uint32_t numThreads)
+{
+	color_convert_rows(h, numThreads, [=](uint32_t y0, uint32_t y1) {
+		std::vector<uint8_t> inbuf((size_t)w * num_in * in_bytes);
+		std::vector<uint8_t> outbuf((size_t)w * 3 * out_bytes);
+		for (uint32_t y = y0; y < y1; ++y) {
+			size_t offset = (size_t)y * w;
+			for (uint32_t c = 0; c < num_in; ++c) {
+				if (in_bytes == 1)
+					color_pack_8(in[c] + offset, inbuf.data() + (size_t)c * w, w);
+				else
+					color_pack_16(in[c] + offset, (uint16_t*)inbuf.data() + (size_t)c * w, w);
+			}
+			cmsDoTransform(transform, inbuf.data(), outbuf.data(), (cmsUInt32Number)w);
+			for (uint32_t c = 0; c < 3; ++c) {
+				if (!out[c])
+					continue;
+				if (out_bytes == 1)
+					color_unpack_8(outbuf.data() + (size_t)c * w, out[c] + offset, w);
+				else
+					color_unpack_16((uint16_t*)outbuf.data() + (size_t)c * w, out[c] + offset, w);
+			}
+		}
+	});
+}
+
 /*#define DEBUG_PROFILE*/
-void color_apply_icc_profile(opj_image_t *image, bool forceRGB)
+void color_apply_icc_profile(opj_image_t *image, bool forceRGB, uint32_t numThreads)
 {
 	cmsHPROFILE in_prof = nullptr , out_prof=nullptr;
     cmsHTRANSFORM transform = NULL;
     cmsColorSpaceSignature in_space, out_space;
-    cmsUInt32Number intent, in_type, out_type, nr_samples;
-    int prec, i, max, max_w, max_h;
+    cmsUInt32Number intent, in_type, out_type;
+    int prec, max_w, max_h;
     OPJ_COLOR_SPACE oldspace;
     opj_image_t* new_image = NULL;
 
@@ -493,25 +619,30 @@ void color_apply_icc_profile(opj_image_t *image, bool forceRGB)
 			goto cleanup;
 
 		if( prec <= 8 ) {
-            in_type = TYPE_RGB_8;
-            out_type = TYPE_RGB_8;
+            in_type = TYPE_RGB_8_PLANAR;
+            out_type = TYPE_RGB_8_PLANAR;
         } else {
-            in_type = TYPE_RGB_16;
-            out_type = TYPE_RGB_16;
+            in_type = TYPE_RGB_16_PLANAR;
+            out_type = TYPE_RGB_16_PLANAR;
         }
         out_prof = cmsCreate_sRGBProfile();
         image->color_space = OPJ_CLRSPC_SRGB;
     } else if(out_space == cmsSigGrayData) { /* enumCS 17 */
         in_type = TYPE_GRAY_8;
-        out_type = TYPE_RGB_8;
+        out_type = TYPE_RGB_8_PLANAR;
         out_prof = cmsCreate_sRGBProfile();
 		if (forceRGB)
 			image->color_space = OPJ_CLRSPC_SRGB;
 		else 
 			image->color_space = OPJ_CLRSPC_GRAY;
     } else if(out_space == cmsSigYCbCrData) { /* enumCS 18 */
-        in_type = TYPE_YCbCr_16;
-        out_type = TYPE_RGB_16;
+		if (prec <= 8) {
+			in_type = TYPE_YCbCr_8_PLANAR;
+			out_type = TYPE_RGB_8_PLANAR;
+		} else {
+			in_type = TYPE_YCbCr_16_PLANAR;
+			out_type = TYPE_RGB_16_PLANAR;
+		}
         out_prof = cmsCreate_sRGBProfile();
         image->color_space = OPJ_CLRSPC_SRGB;
     } else {
@@ -568,154 +699,49 @@ void color_apply_icc_profile(opj_image_t *image, bool forceRGB)
     }
 
     if(image->numcomps > 2) { /* RGB, RGBA */
-        if( prec <= 8 ) {
-			int *r=nullptr, *g=nullptr, *b=nullptr;
-            unsigned char *inbuf=nullptr, *outbuf=nullptr, *in=nullptr, *out=nullptr;
-            max = max_w * max_h;
-            nr_samples = (cmsUInt32Number)max * 3 * (cmsUInt32Number)sizeof(unsigned char);
-            in = inbuf = (unsigned char*)malloc(nr_samples);
-			if (!in) {
-				goto cleanup;
-			}
-            out = outbuf = (unsigned char*)malloc(nr_samples);
-			if (!out) {
-				free(inbuf);
-				goto cleanup;
-			}
-
-            r = image->comps[0].data;
-            g = image->comps[1].data;
-            b = image->comps[2].data;
-
-            for(i = 0; i < max; ++i) {
-                *in++ = (unsigned char)*r++;
-                *in++ = (unsigned char)*g++;
-                *in++ = (unsigned char)*b++;
-            }
-
-            cmsDoTransform(transform, inbuf, outbuf, (cmsUInt32Number)max);
-
-            r = image->comps[0].data;
-            g = image->comps[1].data;
-            b = image->comps[2].data;
-
-            for(i = 0; i < max; ++i) {
-                *r++ = (int)*out++;
-                *g++ = (int)*out++;
-                *b++ = (int)*out++;
-            }
-			free(inbuf);
-			free(outbuf);
-        } else {
-			int *r = nullptr, *g = nullptr, *b = nullptr;
-            unsigned short *inbuf=nullptr, *outbuf=nullptr, *in=nullptr, *out=nullptr;
-            max = max_w * max_h;
-            nr_samples = (cmsUInt32Number)max * 3 * (cmsUInt32Number)sizeof(unsigned short);
-            in = inbuf = (unsigned short*)malloc(nr_samples);
-			if (!in)
-				goto cleanup;
-            out = outbuf = (unsigned short*)malloc(nr_samples);
-			if (!out) {
-				free(inbuf);
-				goto cleanup;
-			}
-
-            r = image->comps[0].data;
-            g = image->comps[1].data;
-            b = image->comps[2].data;
-
-            for(i = 0; i < max; ++i) {
-                *in++ = (unsigned short)*r++;
-                *in++ = (unsigned short)*g++;
-                *in++ = (unsigned short)*b++;
-            }
+		int32_t* planes[3] = { image->comps[0].data, image->comps[1].data, image->comps[2].data };
 
-            cmsDoTransform(transform, inbuf, outbuf, (cmsUInt32Number)max);
-
-            r = image->comps[0].data;
-            g = image->comps[1].data;
-            b = image->comps[2].data;
-
-            for(i = 0; i < max; ++i) {
-                *r++ = (int)*out++;
-                *g++ = (int)*out++;
-                *b++ = (int)*out++;
-            }
-            free(inbuf);
-            free(outbuf);
-        }
+		color_transform_planes(transform, planes, 3, T_BYTES(in_type),
+								planes, T_BYTES(out_type),
+								(uint32_t)max_w, (uint32_t)max_h, numThreads);
     } else { /* GRAY, GRAYA */
-		int *r = nullptr;
-		int *g = nullptr;
-		int *b = nullptr;
-		unsigned char *in = nullptr;
-		unsigned char * inbuf = nullptr;
-		unsigned char *out = nullptr;
-		unsigned char *outbuf = nullptr;
-
-        max = max_w * max_h;
-        nr_samples = (cmsUInt32Number)max * 3 * sizeof(unsigned char);
-		opj_image_comp_t *comps = (opj_image_comp_t*)realloc(image->comps, (image->numcomps + 2) * sizeof(opj_image_comp_t));
-		if (!comps)
-			goto cleanup;
-		image->comps = comps;
-
-        in = inbuf = (unsigned char*)malloc(nr_samples);
-		if (!in)
-			goto cleanup;
-        out = outbuf = (unsigned char*)malloc(nr_samples);
-		if (!out) {
-			free(inbuf);
-			goto cleanup;
-		}
+		/* without forced RGB, just keep the red channel as the grey channel */
+		if (forceRGB) {
+			opj_image_comp_t *comps = (opj_image_comp_t*)realloc(image->comps, (image->numcomps + 2) * sizeof(opj_image_comp_t));
+			if (!comps)
+				goto cleanup;
+			image->comps = comps;
 
-        new_image = image_create(2, image->comps[0].w, image->comps[0].h, image->comps[0].prec);
-		if (!new_image) {
-			free(inbuf);
-			free(outbuf);
-			goto cleanup;
-		}
+			new_image = image_create(2, image->comps[0].w, image->comps[0].h, image->comps[0].prec);
+			if (!new_image)
+				goto cleanup;
 
-        if(image->numcomps == 2)
-            image->comps[3] = image->comps[1];
+			if(image->numcomps == 2)
+				image->comps[3] = image->comps[1];
 
-        image->comps[1] = image->comps[0];
-        image->comps[2] = image->comps[0];
+			image->comps[1] = image->comps[0];
+			image->comps[2] = image->comps[0];
 
-        image->comps[1].data = new_image->comps[0].data;
-        image->comps[2].data = new_image->comps[1].data;
+			image->comps[1].data = new_image->comps[0].data;
+			image->comps[2].data = new_image->comps[1].data;
 
-        new_image->comps[0].data= NULL;
-        new_image->comps[1].data = NULL;
+			new_image->comps[0].data= NULL;
+			new_image->comps[1].data = NULL;
 
-        opj_image_destroy(new_image);
-        new_image = NULL;
+			opj_image_destroy(new_image);
+			new_image = NULL;
 
-		if (forceRGB)
 			image->numcomps += 2;
+		}
 
-        r = image->comps[0].data;
-        for(i = 0; i < max; ++i) {
-            *in++ = (unsigned char)*r++;
-        }
-        cmsDoTransform(transform, inbuf, outbuf, (cmsUInt32Number)max);
+		int32_t* in_planes[1] = { image->comps[0].data };
+		int32_t* out_planes[3] = { image->comps[0].data,
+									forceRGB ? image->comps[1].data : nullptr,
+									forceRGB ? image->comps[2].data : nullptr };
 
-        r = image->comps[0].data;
-        g = image->comps[1].data;
-        b = image->comps[2].data;
-
-        for(i = 0; i < max; ++i) {
-            *r++ = (int)*out++;
-			if (forceRGB) {
-				*g++ = (int)*out++;
-				*b++ = (int)*out++;
-			}
-			else { //just skip green and blue channels
-				out += 2;
-			}
-        }
-        free(inbuf);
-        free(outbuf);
+		color_transform_planes(transform, in_planes, 1, T_BYTES(in_type),
+								out_planes, T_BYTES(out_type),
+								(uint32_t)max_w, (uint32_t)max_h, numThreads);
 
     }/* if(image->numcomps */
 cleanup:
@@ -727,7 +753,7 @@ cleanup:
 		cmsDeleteTransform(transform);
 }/* color_apply_icc_profile() */
 
-void color_cielab_to_rgb(opj_image_t *image)
+void color_cielab_to_rgb(opj_image_t *image, uint32_t numThreads)
 {
     int *row;
     int enumcs, numcomps;
@@ -746,27 +772,28 @@ void color_cielab_to_rgb(opj_image_t *image)
     enumcs = row[0];
 
     if(enumcs == 14) { /* CIELab */
-        int *L, *a, *b, *red, *green, *blue;
-        int *src0, *src1, *src2, *dst0, *dst1, *dst2;
+        int *dst0, *dst1, *dst2;
         double rl, ol, ra, oa, rb, ob, prec0, prec1, prec2;
         double minL, maxL, mina, maxa, minb, maxb;
+        double rangeL, rangea, rangeb, maxvalL, maxvala, maxvalb;
         unsigned int default_type;
-        unsigned int i, max;
+        uint32_t w, h;
         cmsHPROFILE in, out;
         cmsHTRANSFORM transform;
-        cmsUInt16Number RGB[3];
-        cmsCIELab Lab;
         opj_image_t* new_image = image_create(3, image->comps[0].w, image->comps[0].h, image->comps[0].prec);
+		if (!new_image)
+			return;
 
         in = cmsCreateLab4Profile(NULL);
         out = cmsCreate_sRGBProfile();
 
-        transform = cmsCreateTransform(in, TYPE_Lab_DBL, out, TYPE_RGB_16, INTENT_PERCEPTUAL, 0);
+        transform = cmsCreateTransform(in, TYPE_Lab_DBL, out, TYPE_RGB_16_PLANAR, INTENT_PERCEPTUAL, 0);
 
         cmsCloseProfile(in);
         cmsCloseProfile(out);
 
         if(transform == NULL) {
+			opj_image_destroy(new_image);
             return;
         }
         prec0 = (double)image->comps[0].prec;
@@ -791,15 +818,9 @@ void color_cielab_to_rgb(opj_image_t *image)
             ob = row[7];
         }
 
-        L = src0 = image->comps[0].data;
-        a = src1 = image->comps[1].data;
-        b = src2 = image->comps[2].data;
-
-        max = image->comps[0].w * image->comps[0].h;
-
-        red = dst0	= new_image->comps[0].data;
-        green = dst1 = new_image->comps[1].data;
-        blue = dst2	 = new_image->comps[2].data;
+        dst0 = new_image->comps[0].data;
+        dst1 = new_image->comps[1].data;
+        dst2 = new_image->comps[2].data;
 
         new_image->comps[0].data=NULL;
         new_image->comps[1].data=NULL;
@@ -808,29 +829,45 @@ void color_cielab_to_rgb(opj_image_t *image)
         opj_image_destroy(new_image);
         new_image = NULL;
 
-        minL = -(rl * ol) / (pow(2, prec0) - 1);
+        maxvalL = pow(2, prec0) - 1;
+        maxvala = pow(2, prec1) - 1;
+        maxvalb = pow(2, prec2) - 1;
+
+        minL = -(rl * ol) / maxvalL;
         maxL = minL + rl;
+        rangeL = maxL - minL;
 
-        mina = -(ra * oa)/(pow(2, prec1)-1);
+        mina = -(ra * oa) / maxvala;
         maxa = mina + ra;
+        rangea = maxa - mina;
 
-        minb = -(rb * ob)/(pow(2, prec2)-1);
+        minb = -(rb * ob) / maxvalb;
         maxb = minb + rb;
+        rangeb = maxb - minb;
+
+        w = image->comps[0].w;
+        h = image->comps[0].h;
+        const int *L = image->comps[0].data;
+        const int *a = image->comps[1].data;
+        const int *b = image->comps[2].data;
+
+        color_convert_rows(h, numThreads, [=](uint32_t y0, uint32_t y1) {
+            std::vector<cmsCIELab> Lab(w);
+            std::vector<cmsUInt16Number> RGB((size_t)w * 3);
+            for (uint32_t y = y0; y < y1; ++y) {
+                size_t offset = (size_t)y * w;
+                for (uint32_t x = 0; x < w; ++x) {
+                    Lab[x].L = minL + (double)L[offset + x] * rangeL / maxvalL;
+                    Lab[x].a = mina + (double)a[offset + x] * rangea / maxvala;
+                    Lab[x].b = minb + (double)b[offset + x] * rangeb / maxvalb;
+                }
+                cmsDoTransform(transform, Lab.data(), RGB.data(), (cmsUInt32Number)w);
+                color_unpack_16(RGB.data(), dst0 + offset, w);
+                color_unpack_16(RGB.data() + w, dst1 + offset, w);
+                color_unpack_16(RGB.data() + 2 * (size_t)w, dst2 + offset, w);
+            }
+        });
 
-        for(i = 0; i < max; ++i) {
-            Lab.L = minL + (double)(*L) * (maxL - minL)/(pow(2, prec0)-1);
-            ++L;
-            Lab.a = mina + (double)(*a) * (maxa - mina)/(pow(2, prec1)-1);
-            ++a;
-            Lab.b = minb + (double)(*b) * (maxb - minb)/(pow(2, prec2)-1);
-            ++b;
-
-            cmsDoTransform(transform, &Lab, RGB, 1);
-
-            *red++ = RGB[0];
-            *green++ = RGB[1];
-            *blue++ = RGB[2];
-        }
         cmsDeleteTransform(transform);
         opj_image_all_components_data_free(image);
         image->comps[0].data = dst0;
@@ -851,11 +888,55 @@ void color_cielab_to_rgb(opj_image_t *image)
 #endif /* OPJ_HAVE_LIBLCMS */
 
 
-int color_cmyk_to_rgb(opj_image_t *image)
+/**
+Convert a row of CMYK samples to RGB, in place
+*/
+static void cmyk_row_to_rgb(int* c, int* m, int* y, const int* k,
+							float sC, float sM, float sY, float sK, size_t len)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128 one = _mm_set1_ps(1.0F);
+	const __m128 scale = _mm_set1_ps(255.0F);
+	const __m128 vsC = _mm_set1_ps(sC);
+	const __m128 vsM = _mm_set1_ps(sM);
+	const __m128 vsY = _mm_set1_ps(sY);
+	const __m128 vsK = _mm_set1_ps(sK);
+	for (; i + 4 <= len; i += 4) {
+		/* inverted CMYK values from 0 to 1 */
+		__m128 C = _mm_sub_ps(one, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(c + i))), vsC));
+		__m128 M = _mm_sub_ps(one, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(m + i))), vsM));
+		__m128 Y = _mm_sub_ps(one, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(y + i))), vsY));
+		__m128 K = _mm_sub_ps(one, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(k + i))), vsK));
+		_mm_storeu_si128((__m128i*)(c + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(scale, C), K)));
+		_mm_storeu_si128((__m128i*)(m + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(scale, M), K)));
+		_mm_storeu_si128((__m128i*)(y + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(scale, Y), K)));
+	}
+#endif
+	for (; i < len; ++i) {
+		/* CMYK values from 0 to 1 */
+		float C = (float)(c[i]) * sC;
+		float M = (float)(m[i]) * sM;
+		float Y = (float)(y[i]) * sY;
+		float K = (float)(k[i]) * sK;
+
+		/* Invert all CMYK values */
+		C = 1.0F - C;
+		M = 1.0F - M;
+		Y = 1.0F - Y;
+		K = 1.0F - K;
+
+		/* CMYK -> RGB : RGB results from 0 to 255 */
+		c[i] = (int)(255.0F * C * K); /* R */
+		m[i] = (int)(255.0F * M * K); /* G */
+		y[i] = (int)(255.0F * Y * K); /* B */
+	}
+}
+
+int color_cmyk_to_rgb(opj_image_t *image, uint32_t numThreads)
 {
-    float C, M, Y, K;
     float sC, sM, sY, sK;
-    unsigned int w, h, max, i;
+    unsigned int w, h, i;
 
     w = image->comps[0].w;
     h = image->comps[0].h;
@@ -863,32 +944,19 @@ int color_cmyk_to_rgb(opj_image_t *image)
     if( (image->numcomps < 4)  || !all_components_equal_subsampling(image))
 		return 1;
 
-
-    max = w * h;
-
     sC = 1.0F / (float)((1 << image->comps[0].prec) - 1);
     sM = 1.0F / (float)((1 << image->comps[1].prec) - 1);
     sY = 1.0F / (float)((1 << image->comps[2].prec) - 1);
     sK = 1.0F / (float)((1 << image->comps[3].prec) - 1);
 
-    for(i = 0; i < max; ++i) {
-        /* CMYK values from 0 to 1 */
-        C = (float)(image->comps[0].data[i]) * sC;
-        M = (float)(image->comps[1].data[i]) * sM;
-        Y = (float)(image->comps[2].data[i]) * sY;
-        K = (float)(image->comps[3].data[i]) * sK;
-
-        /* Invert all CMYK values */
-        C = 1.0F - C;
-        M = 1.0F - M;
-        Y = 1.0F - Y;
-        K = 1.0F - K;
-
-        /* CMYK -> RGB : RGB results from 0 to 255 */
-        image->comps[0].data[i] = (int)(255.0F * C * K); /* R */
-        image->comps[1].data[i] = (int)(255.0F * M * K); /* G */
-        image->comps[2].data[i] = (int)(255.0F * Y * K); /* B */
-    }
+	int* c = image->comps[0].data;
+	int* m = image->comps[1].data;
+	int* y = image->comps[2].data;
+	const int* k = image->comps[3].data;
+	color_convert_rows(h, numThreads, [=](uint32_t y0, uint32_t y1) {
+		size_t o = (size_t)y0 * w;
+		cmyk_row_to_rgb(c + o, m + o, y + o, k + o, sC, sM, sY, sK, (size_t)(y1 - y0) * w);
+	});
 
     opj_image_single_component_data_free(image->comps + 3);
     image->comps[0].prec = 8;
@@ -905,35 +973,42 @@ int color_cmyk_to_rgb(opj_image_t *image)
 
 }/* color_cmyk_to_rgb() */
 
-/*
- * This code has been adopted from sjpx_openjpeg.c of ghostscript
- */
-int color_esycc_to_rgb(opj_image_t *image)
+/**
+Convert a row of eYCC samples to RGB, in place
+*/
+static void esycc_row_to_rgb(int* py, int* pcb, int* pcr, int flip_cb, int flip_cr,
+							int max_value, size_t len)
 {
-    int y, cb, cr, sign1, sign2, val;
-    unsigned int w, h, max, i;
-    int flip_value = (1 << (image->comps[0].prec-1));
-    int max_value = (1 << image->comps[0].prec) - 1;
-
-    if( (image->numcomps < 3)  || !all_components_equal_subsampling(image))
-		return 1;
-	
-	w = image->comps[0].w;
-    h = image->comps[0].h;
-
-    sign1 = (int)image->comps[1].sgnd;
-    sign2 = (int)image->comps[2].sgnd;
-
-    max = w * h;
-
-    for(i = 0; i < max; ++i) {
-
-        y = image->comps[0].data[i];
-        cb = image->comps[1].data[i];
-        cr = image->comps[2].data[i];
-
-        if( !sign1) cb -= flip_value;
-        if( !sign2) cr -= flip_value;
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i vflip_cb = _mm_set1_epi32(flip_cb);
+	const __m128i vflip_cr = _mm_set1_epi32(flip_cr);
+	const __m128i vmax = _mm_set1_epi32(max_value);
+	const __m128 half = _mm_set1_ps(0.5F);
+	for (; i + 4 <= len; i += 4) {
+		__m128 y = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(py + i)));
+		__m128 cb = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(pcb + i)), vflip_cb));
+		__m128 cr = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(pcr + i)), vflip_cr));
+
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(0.0000368F), cb)),
+										_mm_mul_ps(_mm_set1_ps(1.40199F), cr)), half);
+		__m128 g = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.0003F), y),
+													_mm_mul_ps(_mm_set1_ps(0.344125F), cb)),
+										_mm_mul_ps(_mm_set1_ps(0.7141128F), cr)), half);
+		__m128 b = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.999823F), y),
+													_mm_mul_ps(_mm_set1_ps(1.77204F), cb)),
+										_mm_mul_ps(_mm_set1_ps(0.000008F), cr)), half);
+
+		_mm_storeu_si128((__m128i*)(py + i), sycc_clamp(_mm_cvttps_epi32(r), vmax));
+		_mm_storeu_si128((__m128i*)(pcb + i), sycc_clamp(_mm_cvttps_epi32(g), vmax));
+		_mm_storeu_si128((__m128i*)(pcr + i), sycc_clamp(_mm_cvttps_epi32(b), vmax));
+	}
+#endif
+	for (; i < len; ++i) {
+		int y = py[i];
+		int cb = pcb[i] - flip_cb;
+		int cr = pcr[i] - flip_cr;
+		int val;
 
         val = (int)
               ((float)y - (float)0.0000368 * (float)cb
@@ -941,7 +1016,7 @@ int color_esycc_to_rgb(opj_image_t *image)
 
         if(val > max_value) val = max_value;
         else if(val < 0) val = 0;
-        image->comps[0].data[i] = val;
+        py[i] = val;
 
         val = (int)
               ((float)1.0003 * (float)y - (float)0.344125 * (float)cb
@@ -949,7 +1024,7 @@ int color_esycc_to_rgb(opj_image_t *image)
 
         if(val > max_value) val = max_value;
         else if(val < 0) val = 0;
-        image->comps[1].data[i] = val;
+        pcb[i] = val;
 
         val = (int)
               ((float)0.999823 * (float)y + (float)1.77204 * (float)cb
@@ -957,8 +1032,38 @@ int color_esycc_to_rgb(opj_image_t *image)
 
         if(val > max_value) val = max_value;
         else if(val < 0) val = 0;
-        image->comps[2].data[i] = val;
-    }
+        pcr[i] = val;
+	}
+}
+
+/*
+ * This code has been adopted from sjpx_openjpeg.c of ghostscript
+ */
+int color_esycc_to_rgb(opj_image_t *image, uint32_t numThreads)
+{
+    int sign1, sign2;
+    unsigned int w, h;
+    int flip_value = (1 << (image->comps[0].prec-1));
+    int max_value = (1 << image->comps[0].prec) - 1;
+
+    if( (image->numcomps < 3)  || !all_components_equal_subsampling(image))
+		return 1;
+	
+	w = image->comps[0].w;
+    h = image->comps[0].h;
+
+    sign1 = (int)image->comps[1].sgnd;
+    sign2 = (int)image->comps[2].sgnd;
+
+	int flip_cb = sign1 ? 0 : flip_value;
+	int flip_cr = sign2 ? 0 : flip_value;
+	int* y = image->comps[0].data;
+	int* cb = image->comps[1].data;
+	int* cr = image->comps[2].data;
+	color_convert_rows(h, numThreads, [=](uint32_t y0, uint32_t y1) {
+		size_t o = (size_t)y0 * w;
+		esycc_row_to_rgb(y + o, cb + o, cr + o, flip_cb, flip_cr, max_value, (size_t)(y1 - y0) * w);
+	});
     image->color_space = OPJ_CLRSPC_SRGB;
 	return 0;
 
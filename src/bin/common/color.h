@@ -55,10 +55,10 @@
 
 #pragma once
 
-extern void color_sycc_to_rgb(opj_image_t *img);
-extern void color_apply_icc_profile(opj_image_t *image, bool forceRGB);
-extern void color_cielab_to_rgb(opj_image_t *image);
+extern void color_sycc_to_rgb(opj_image_t *img, uint32_t numThreads);
+extern void color_apply_icc_profile(opj_image_t *image, bool forceRGB, uint32_t numThreads);
+extern void color_cielab_to_rgb(opj_image_t *image, uint32_t numThreads);
 
-extern int color_cmyk_to_rgb(opj_image_t *image);
-extern int color_esycc_to_rgb(opj_image_t *image);
+extern int color_cmyk_to_rgb(opj_image_t *image, uint32_t numThreads);
+extern int color_esycc_to_rgb(opj_image_t *image, uint32_t numThreads);
 
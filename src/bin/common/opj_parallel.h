@@ -0,0 +1,114 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+Run jobs [0, num_jobs) on up to numThreads workers, the calling thread being one of them.
+Jobs are handed out in order, but may complete in any order.
+
+@param num_jobs		number of jobs
+@param numThreads	maximum number of workers
+@param job			job, called as job(worker, jobno); worker is in [0, number of workers),
+					and identifies the thread running the job, for per-worker state
+*/
+template<typename F> void opj_run_parallel(uint32_t num_jobs, uint32_t numThreads, F job)
+{
+	uint32_t num_workers = std::min<uint32_t>(std::max<uint32_t>(numThreads, 1), num_jobs);
+	if (num_workers <= 1) {
+		for (uint32_t jobno = 0; jobno < num_jobs; ++jobno)
+			job(0U, jobno);
+		return;
+	}
+	std::atomic<uint32_t> next_job(0);
+	auto worker = [&](uint32_t workerno) {
+		uint32_t jobno;
+		while ((jobno = next_job++) < num_jobs)
+			job(workerno, jobno);
+	};
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < num_workers; ++i)
+		threads.emplace_back(worker, i);
+	worker(0U);
+	for (auto& t : threads)
+		t.join();
+}
+
+/**
+Queue between two stages of a pipeline, holding at most capacity items:
+push blocks while the queue is full, and pop while it is empty.
+Once the producers are done, close the queue: pop then returns false when it is empty.
+*/
+template<typename T> class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1)), m_closed(false) {}
+
+	/**
+	Add an item, waiting for room in the queue.
+	@return false if the queue was closed
+	*/
+	bool push(T&& item) {
+		std::unique_lock<std::mutex> lk(m_mutex);
+		m_not_full.wait(lk, [this] { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed)
+			return false;
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	/**
+	Remove the oldest item, waiting for one to be pushed.
+	@return false if the queue is closed and empty
+	*/
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lk(m_mutex);
+		m_not_empty.wait(lk, [this] { return m_closed || !m_items.empty(); });
+		if (m_items.empty())
+			return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	/** Wake up all waiting threads: no more items will be pushed */
+	void close() {
+		std::lock_guard<std::mutex> lk(m_mutex);
+		m_closed = true;
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+private:
+	std::deque<T> m_items;
+	size_t m_capacity;
+	bool m_closed;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+};
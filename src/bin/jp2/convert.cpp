@@ -60,6 +60,10 @@
 #include <string.h>
 #include <ctype.h>
 #include <limits.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
 
 extern "C" {
 
@@ -1577,32 +1581,143 @@ static int has_prec(int val)
     return 16;
 }
 
-opj_image_t* pnmtoimage(const char *filename, opj_cparameters_t *parameters)
+/**
+PNM strip reader: the rows of ascii and binary PBM/PGM/PPM/PAM files are read in sequence
+*/
+class PNMStripReader : public StripReader {
+public:
+	PNMStripReader() : fp(NULL), image(NULL) {
+		memset(&header_info, 0, sizeof(struct pnm_header));
+	}
+	~PNMStripReader() {
+		if (fp)
+			fclose(fp);
+		opj_image_destroy(image);
+	}
+	opj_image_t* header() override {
+		return image;
+	}
+	bool read(opj_image_t* strip) override;
+
+	FILE *fp;
+	opj_image_t* image;
+	struct pnm_header header_info;
+	std::vector<uint8_t> row;
+};
+
+bool PNMStripReader::read(opj_image_t* strip)
+{
+	uint32_t numcomps = image->numcomps;
+	uint32_t w = image->comps[0].w;
+	uint32_t h = strip->comps[0].h;
+	int32_t* planes[4];
+	for (uint32_t compno = 0; compno < numcomps; compno++) {
+		auto comp = strip->comps + compno;
+		if (comp->w != w || comp->h != h || (h && !comp->data)) {
+			fprintf(stderr, "[ERROR] strip does not match the dimensions of component %u\n", compno);
+			return false;
+		}
+		planes[compno] = comp->data;
+	}
+	int format = header_info.format;
+	int maxval = header_info.maxval;
+	for (uint32_t y = 0; y < h; ++y) {
+		if ((format == 2) || (format == 3)) { /* ascii pixmap */
+			for (uint32_t x = 0; x < w; x++) {
+				for (uint32_t compno = 0; compno < numcomps; compno++) {
+					unsigned int index = 0;
+					if (fscanf(fp, "%u", &index) != 1)
+						fprintf(stderr, "\nWARNING: fscanf return a number of element different from the expected.\n");
+
+					planes[compno][x] = (int32_t)(index * 255) / maxval;
+				}
+			}
+		}
+		else if ((format == 5)
+			|| (format == 6)
+			|| ((format == 7)
+				&& (header_info.gray || header_info.graya
+					|| header_info.rgb || header_info.rgba))) { /* binary pixmap */
+			bool one = image->comps[0].prec < 9;
+			if (fread(row.data(), 1, row.size(), fp) != row.size()) {
+				fprintf(stderr, "\nError: fread return a number of element different from the expected.\n");
+				return false;
+			}
+			const uint8_t* in = row.data();
+			for (uint32_t x = 0; x < w; x++) {
+				for (uint32_t compno = 0; compno < numcomps; compno++) {
+					if (one) {
+						planes[compno][x] = *in++;
+					}
+					else {
+						/* netpbm: */
+						planes[compno][x] = (in[0] << 8) | in[1];
+						in += 2;
+					}
+				}
+			}
+		}
+		else if (format == 1) { /* ascii bitmap */
+			for (uint32_t x = 0; x < w; x++) {
+				unsigned int index;
+
+				if (fscanf(fp, "%u", &index) != 1)
+					fprintf(stderr, "\nWARNING: fscanf return a number of element different from the expected.\n");
+
+				planes[0][x] = (index ? 0 : 255);
+			}
+		}
+		else if (format == 4) {
+			int bit = -1;
+			unsigned char uc = 0;
+
+			for (uint32_t x = 0; x < w; ++x) {
+				if (bit == -1) {
+					bit = 7;
+					uc = (unsigned char)getc(fp);
+				}
+				planes[0][x] = (((uc >> bit) & 1) ? 0 : 255);
+				--bit;
+			}
+		}
+		else if ((format == 7 && header_info.bw)) { /*MONO*/
+			for (uint32_t x = 0; x < w; ++x) {
+				unsigned char uc = 0;
+				if (!fread(&uc, 1, 1, fp))
+					fprintf(stderr, "\nError: fread return a number of element different from the expected.\n");
+				planes[0][x] = (uc & 1) ? 0 : 255;
+			}
+			/* only the first component is read */
+			for (uint32_t compno = 1; compno < numcomps; compno++)
+				memset(planes[compno], 0, (size_t)w * sizeof(int32_t));
+		}
+		for (uint32_t compno = 0; compno < numcomps; compno++)
+			planes[compno] += w;
+	}
+	return true;
+}
+
+StripReader* pnm_strip_reader_open(const char *filename, opj_cparameters_t *parameters)
 {
-    int subsampling_dx = parameters->subsampling_dx;
-    int subsampling_dy = parameters->subsampling_dy;
+    uint32_t subsampling_dx = parameters->subsampling_dx;
+    uint32_t subsampling_dy = parameters->subsampling_dy;
 
-    FILE *fp = NULL;
-    uint32_t i, compno, numcomps, w, h, prec, format;
+    uint32_t i, numcomps, w, h, prec, format;
     OPJ_COLOR_SPACE color_space;
     opj_image_cmptparm_t cmptparm[4]; /* RGBA: max. 4 components */
-    opj_image_t * image = NULL;
-    struct pnm_header header_info;
+	std::unique_ptr<PNMStripReader> reader(new PNMStripReader());
 
-    if((fp = fopen(filename, "rb")) == NULL) {
+    if((reader->fp = fopen(filename, "rb")) == NULL) {
         fprintf(stderr, "pnmtoimage:Failed to open %s for reading!\n",filename);
         return NULL;
     }
-    memset(&header_info, 0, sizeof(struct pnm_header));
 
-    read_pnm_header(fp, &header_info);
+    read_pnm_header(reader->fp, &reader->header_info);
 
-    if(!header_info.ok) {
-        fclose(fp);
+    if(!reader->header_info.ok)
         return NULL;
-    }
 
-    format = header_info.format;
+    format = reader->header_info.format;
 
     switch(format) {
     case 1: /* ascii bitmap */
@@ -1621,11 +1736,10 @@ opj_image_t* pnmtoimage(const char *filename, opj_cparameters_t *parameters)
         break;
 
     case 7: /* arbitrary map */
-        numcomps = header_info.depth;
+        numcomps = reader->header_info.depth;
         break;
 
     default:
-        fclose(fp);
         return NULL;
     }
 
@@ -1635,14 +1749,12 @@ opj_image_t* pnmtoimage(const char *filename, opj_cparameters_t *parameters)
     else
         color_space = OPJ_CLRSPC_SRGB;/* RGB, RGBA */
 
-    prec = has_prec(header_info.maxval);
+    prec = has_prec(reader->header_info.maxval);
 
     if(prec < 8) prec = 8;
 
-    w = header_info.width;
-    h = header_info.height;
-    subsampling_dx = parameters->subsampling_dx;
-    subsampling_dy = parameters->subsampling_dy;
+    w = reader->header_info.width;
+    h = reader->header_info.height;
 
     memset(&cmptparm[0], 0, (size_t)numcomps * sizeof(opj_image_cmptparm_t));
 
@@ -1654,134 +1766,197 @@ opj_image_t* pnmtoimage(const char *filename, opj_cparameters_t *parameters)
         cmptparm[i].w = w;
         cmptparm[i].h = h;
     }
-    image = opj_image_create(numcomps, &cmptparm[0], color_space);
-
-    if(!image) {
-        fclose(fp);
+    reader->image = opj_image_tile_create(numcomps, &cmptparm[0], color_space);
+    if(!reader->image)
         return NULL;
-    }
 
-
-	if (!sanityCheckOnImage(image, numcomps)) {
-		fclose(fp);
-		return NULL;
-	}
     /* set image offset and reference grid */
+    opj_image_t* image = reader->image;
     image->x0 = parameters->image_offset_x0;
     image->y0 = parameters->image_offset_y0;
     image->x1 = (parameters->image_offset_x0 + (w - 1) * subsampling_dx + 1);
     image->y1 = (parameters->image_offset_y0 + (h - 1) * subsampling_dy + 1);
 
-    if((format == 2) || (format == 3)) { /* ascii pixmap */
-        unsigned int index;
+	/* binary pixmap row */
+	reader->row.resize((size_t)w * numcomps * (prec < 9 ? 1 : 2));
 
-        for (i = 0; i < w * h; i++) {
-            for(compno = 0; compno < numcomps; compno++) {
-                index = 0;
-                if (fscanf(fp, "%u", &index) != 1)
-                    fprintf(stderr, "\nWARNING: fscanf return a number of element different from the expected.\n");
+    return reader.release();
+}/* pnm_strip_reader_open() */
 
-                image->comps[compno].data[i] = (int32_t)(index * 255)/header_info.maxval;
-            }
-        }
-    } else if((format == 5)
-              || (format == 6)
-              ||((format == 7)
-                 && (   header_info.gray || header_info.graya
-                        || header_info.rgb || header_info.rgba))) { /* binary pixmap */
-        unsigned char c0, c1, one;
+opj_image_t* pnmtoimage(const char *filename, opj_cparameters_t *parameters)
+{
+	return read_image_strips(pnm_strip_reader_open(filename, parameters));
+}/* pnmtoimage() */
 
-        one = (prec < 9);
+opj_image_t* read_image_strips(StripReader* reader)
+{
+	if (!reader)
+		return NULL;
+	opj_image_t* header = reader->header();
+	std::vector<opj_image_cmptparm_t> cmptparm(header->numcomps);
+	for (uint32_t compno = 0; compno < header->numcomps; ++compno) {
+		auto comp = header->comps + compno;
+		memset(&cmptparm[compno], 0, sizeof(opj_image_cmptparm_t));
+		cmptparm[compno].dx = comp->dx;
+		cmptparm[compno].dy = comp->dy;
+		cmptparm[compno].w = comp->w;
+		cmptparm[compno].h = comp->h;
+		cmptparm[compno].x0 = comp->x0;
+		cmptparm[compno].y0 = comp->y0;
+		cmptparm[compno].prec = comp->prec;
+		cmptparm[compno].sgnd = comp->sgnd;
+	}
+	opj_image_t* image = opj_image_create(header->numcomps, cmptparm.data(), header->color_space);
+	if (image) {
+		image->x0 = header->x0;
+		image->y0 = header->y0;
+		image->x1 = header->x1;
+		image->y1 = header->y1;
+		for (uint32_t compno = 0; compno < header->numcomps; ++compno)
+			image->comps[compno].alpha = header->comps[compno].alpha;
+		/* the reader is done with the header */
+		image->icc_profile_buf = header->icc_profile_buf;
+		image->icc_profile_len = header->icc_profile_len;
+		header->icc_profile_buf = NULL;
+		header->icc_profile_len = 0;
+		if (!reader->read(image)) {
+			opj_image_destroy(image);
+			image = NULL;
+		}
+	}
+	delete reader;
+	return image;
+}
 
-        for (i = 0; i < w * h; i++) {
-            for(compno = 0; compno < numcomps; compno++) {
-                if ( !fread(&c0, 1, 1, fp) ) {
-                    fprintf(stderr, "\nError: fread return a number of element different from the expected.\n");
-                    opj_image_destroy(image);
-                    fclose(fp);
-                    return NULL;
-                }
-                if(one) {
-                    image->comps[compno].data[i] = c0;
-                } else {
-                    if ( !fread(&c1, 1, 1, fp) )
-                        fprintf(stderr, "\nError: fread return a number of element different from the expected.\n");
-                    /* netpbm: */
-                    image->comps[compno].data[i] = ((c0<<8) | c1);
-                }
-            }
-        }
-    } else if(format == 1) { /* ascii bitmap */
-        for (i = 0; i < w * h; i++) {
-            unsigned int index;
+/**
+PNM strip writer: RGB(A) and grey with alpha images are interleaved into a single PPM/PAM file,
+other images are written as one PGM file per component
+*/
+class PNMStripWriter : public StripWriter {
+public:
+	PNMStripWriter() : two(false), split(false), failed(false) {}
+	~PNMStripWriter() {
+		for (auto f : files) {
+			if (f)
+				fclose(f);
+		}
+	}
+	bool write(opj_image_t* strip) override;
+	bool close() override;
+
+	/* components written to the single file, in sample order, or one component per file */
+	std::vector<uint32_t> comps;
+	std::vector<FILE*> files;
+	std::vector<uint8_t> row;
+	/* two bytes per sample in the single file */
+	bool two;
+	bool split;
+	bool failed;
+};
 
-            if ( fscanf(fp, "%u", &index) != 1)
-                fprintf(stderr, "\nWARNING: fscanf return a number of element different from the expected.\n");
+static inline uint8_t* pnm_put_sample(uint8_t* out, int v, bool two)
+{
+	if (two) {
+		if (v > 65535) v = 65535;
+		else if (v < 0) v = 0;
 
-            image->comps[0].data[i] = (index?0:255);
-        }
-    } else if(format == 4) {
-        uint32_t x, y, bit;
-        unsigned char uc;
-
-        i = 0;
-        for(y = 0; y < h; ++y) {
-            bit = -1;
-            uc = 0;
-
-            for(x = 0; x < w; ++x) {
-                if(bit == -1) {
-                    bit = 7;
-                    uc = (unsigned char)getc(fp);
-                }
-                image->comps[0].data[i] = (((uc>>bit) & 1)?0:255);
-                --bit;
-                ++i;
-            }
-        }
-    } else if((format == 7 && header_info.bw)) { /*MONO*/
-        unsigned char uc;
+		/* netpbm: */
+		*out++ = (uint8_t)(v >> 8);
+		*out++ = (uint8_t)v;
+	}
+	else {
+		if (v > 255) v = 255;
+		else if (v < 0) v = 0;
+		*out++ = (uint8_t)v;
+	}
+	return out;
+}
 
-        for(i = 0; i < w * h; ++i) {
-            if ( !fread(&uc, 1, 1, fp) )
-                fprintf(stderr, "\nError: fread return a number of element different from the expected.\n");
-            image->comps[0].data[i] = (uc & 1)?0:255;
-        }
-    }
-    fclose(fp);
+bool PNMStripWriter::write(opj_image_t* strip)
+{
+	for (auto compno : comps) {
+		if (!strip->comps[compno].data && strip->comps[compno].h) {
+			fprintf(stderr, "[ERROR] null data for component %u\n", compno);
+			failed = true;
+			return false;
+		}
+	}
+	size_t w = strip->comps[0].w;
+	size_t h = strip->comps[0].h;
+	if (!split) {
+		int32_t const* planes[4];
+		int adjust[4];
+		for (size_t k = 0; k < comps.size(); ++k) {
+			auto comp = strip->comps + comps[k];
+			planes[k] = comp->data;
+			/* samples are only level shifted when written on two bytes */
+			adjust[k] = (two && comp->sgnd) ? 1 << (comp->prec - 1) : 0;
+		}
+		for (size_t y = 0; y < h; ++y) {
+			uint8_t* out = row.data();
+			for (size_t x = 0; x < w; ++x) {
+				for (size_t k = 0; k < comps.size(); ++k)
+					out = pnm_put_sample(out, planes[k][y * w + x] + adjust[k], two);
+			}
+			if (fwrite(row.data(), 1, (size_t)(out - row.data()), files[0]) != (size_t)(out - row.data())) {
+				failed = true;
+				return false;
+			}
+		}
+		return true;
+	}
+	for (size_t k = 0; k < comps.size(); ++k) {
+		auto comp = strip->comps + comps[k];
+		bool comp_two = comp->prec > 8;
+		int adjust = comp->sgnd ? 1 << (comp->prec - 1) : 0;
+		for (size_t y = 0; y < comp->h; ++y) {
+			uint8_t* out = row.data();
+			for (size_t x = 0; x < comp->w; ++x)
+				out = pnm_put_sample(out, comp->data[y * comp->w + x] + adjust, comp_two);
+			if (fwrite(row.data(), 1, (size_t)(out - row.data()), files[k]) != (size_t)(out - row.data())) {
+				failed = true;
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-    return image;
-}/* pnmtoimage() */
+bool PNMStripWriter::close()
+{
+	bool success = !failed;
+	for (auto& f : files) {
+		if (fclose(f))
+			success = false;
+		f = NULL;
+	}
+	return success;
+}
 
-int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
+StripWriter* pnm_strip_writer_open(opj_image_t * image, const char *outfile, int force_split)
 {
-	int *red = NULL;
-	int* green = NULL;
-	int* blue = NULL;
-	int* alpha = NULL;
     int wr, hr, max;
-    int i;
     unsigned int compno, ncomp;
-    int adjustR, adjustG, adjustB, adjustA;
-    int fails, two, want_gray, has_alpha, triple;
-    int prec, v;
+    int want_gray, has_alpha, triple;
+    int prec;
     FILE *fdest = NULL;
     const char *tmp = outfile;
-    char *destname;
-
-    alpha = NULL;
 
     if((prec = (int)image->comps[0].prec) > 16) {
         fprintf(stderr,"%s:%d:imagetopnm\n\tprecision %d is larger than 16"
                 "\n\t: refused.\n",__FILE__,__LINE__,prec);
-        return 1;
+        return NULL;
     }
-    two = has_alpha = 0;
-    fails = 1;
     ncomp = image->numcomps;
 
-	if (!sanityCheckOnImage(image, ncomp)) {
-		return fails;
+	if (ncomp == 0)
+		return NULL;
+	for (compno = 1; compno < ncomp; ++compno) {
+		if (image->comps[compno].w != image->comps[0].w ||
+					image->comps[compno].h != image->comps[0].h) {
+			printf("[Error]: dimensions of component %d differ from component 0", compno);
+			return NULL;
+		}
 	}
 
     while (*tmp) ++tmp;
@@ -1791,6 +1966,7 @@ int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
     if(want_gray)
 		ncomp = 1;
 
+	std::unique_ptr<PNMStripWriter> writer(new PNMStripWriter());
     if ((force_split == 0) &&
             (ncomp == 2 /* GRAYA */
              || (ncomp > 2 /* RGB, RGBA */
@@ -1808,21 +1984,21 @@ int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
 
         if (!fdest) {
             fprintf(stderr, "ERROR -> failed to open %s for writing\n", outfile);
-            return fails;
+            return NULL;
         }
-        two = (prec > 8);
+		writer->files.push_back(fdest);
+        writer->two = (prec > 8);
         triple = (ncomp > 2);
         wr = (int)image->comps[0].w;
         hr = (int)image->comps[0].h;
         max = (1<<prec) - 1;
         has_alpha = (ncomp == 4 || ncomp == 2);
 
-        red = image->comps[0].data;
-
+		writer->comps.push_back(0);
         if(triple) {
-            green = image->comps[1].data;
-            blue = image->comps[2].data;
-        } else green = blue = NULL;
+			writer->comps.push_back(1);
+			writer->comps.push_back(2);
+        }
 
         if(has_alpha) {
             const char *tt = (triple?"RGB_ALPHA":"GRAYSCALE_ALPHA");
@@ -1830,92 +2006,13 @@ int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
             fprintf(fdest, "P7\n# Grok-%s\nWIDTH %d\nHEIGHT %d\nDEPTH %u\n"
                     "MAXVAL %d\nTUPLTYPE %s\nENDHDR\n", opj_version(),
                     wr, hr, ncomp, max, tt);
-            alpha = image->comps[ncomp - 1].data;
-            adjustA = (image->comps[ncomp - 1].sgnd ?
-                       1 << (image->comps[ncomp - 1].prec - 1) : 0);
+			writer->comps.push_back(ncomp - 1);
         } else {
             fprintf(fdest, "P6\n# Grok-%s\n%d %d\n%d\n",
                     opj_version(), wr, hr, max);
-            adjustA = 0;
         }
-        adjustR = (image->comps[0].sgnd ? 1 << (image->comps[0].prec - 1) : 0);
-
-        if(triple) {
-            adjustG = (image->comps[1].sgnd ? 1 << (image->comps[1].prec - 1) : 0);
-            adjustB = (image->comps[2].sgnd ? 1 << (image->comps[2].prec - 1) : 0);
-        } else adjustG = adjustB = 0;
-
-        for(i = 0; i < wr * hr; ++i) {
-            if(two) {
-                v = *red + adjustR;
-                ++red;
-                if(v > 65535) v = 65535;
-                else if(v < 0) v = 0;
-
-                /* netpbm: */
-                fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-
-                if(triple) {
-                    v = *green + adjustG;
-                    ++green;
-                    if(v > 65535) v = 65535;
-                    else if(v < 0) v = 0;
-
-                    /* netpbm: */
-                    fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-
-                    v =  *blue + adjustB;
-                    ++blue;
-                    if(v > 65535) v = 65535;
-                    else if(v < 0) v = 0;
-
-                    /* netpbm: */
-                    fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-
-                }/* if(triple) */
-
-                if(has_alpha) {
-                    v = *alpha + adjustA;
-                    ++alpha;
-                    if(v > 65535) v = 65535;
-                    else if(v < 0) v = 0;
-
-                    /* netpbm: */
-                    fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-                }
-                continue;
-
-            }	/* if(two) */
-
-            /* prec <= 8: */
-            v = *red++;
-            if(v > 255) v = 255;
-            else if(v < 0) v = 0;
-
-            fprintf(fdest, "%c", (unsigned char)v);
-            if(triple) {
-                v = *green++;
-                if(v > 255) v = 255;
-                else if(v < 0) v = 0;
-
-                fprintf(fdest, "%c", (unsigned char)v);
-                v = *blue++;
-                if(v > 255) v = 255;
-                else if(v < 0) v = 0;
-
-                fprintf(fdest, "%c", (unsigned char)v);
-            }
-            if(has_alpha) {
-                v = *alpha++;
-                if(v > 255) v = 255;
-                else if(v < 0) v = 0;
-
-                fprintf(fdest, "%c", (unsigned char)v);
-            }
-        }	/* for(i */
-
-        fclose(fdest);
-        return 0;
+		writer->row.resize((size_t)image->comps[0].w * writer->comps.size() * (writer->two ? 2 : 1));
+		return writer.release();
     }
 
     /* YUV or MONO: */
@@ -1924,30 +2021,25 @@ int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
         fprintf(stderr,"WARNING -> [PGM file] Only the first component\n");
         fprintf(stderr,"           is written to the file\n");
     }
-    destname = (char*)malloc(strlen(outfile) + 8);
-	if (destname == NULL) {
-		fprintf(stderr, "imagetopnm: out of memory\n");
-		fclose(fdest);
-		return 1;
-	}
-
+	std::string destname;
+	writer->split = true;
     for (compno = 0; compno < ncomp; compno++) {
         if (ncomp > 1) {
             /*sprintf(destname, "%d.%s", compno, outfile);*/
             const size_t olen = strlen(outfile);
             const size_t dotpos = olen - 4;
 
-            strncpy(destname, outfile, dotpos);
-            sprintf(destname+dotpos, "_%u.pgm", compno);
+			destname = std::string(outfile, dotpos) + "_" + std::to_string(compno) + ".pgm";
         } else
-            sprintf(destname, "%s", outfile);
+			destname = outfile;
 
-        fdest = fopen(destname, "wb");
+        fdest = fopen(destname.c_str(), "wb");
         if (!fdest) {
-            fprintf(stderr, "ERROR -> failed to open %s for writing\n", destname);
-            free(destname);
-            return 1;
+            fprintf(stderr, "ERROR -> failed to open %s for writing\n", destname.c_str());
+            return NULL;
         }
+		writer->files.push_back(fdest);
+		writer->comps.push_back(compno);
         wr = (int)image->comps[compno].w;
         hr = (int)image->comps[compno].h;
         prec = (int)image->comps[compno].prec;
@@ -1955,64 +2047,131 @@ int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
 
         fprintf(fdest, "P5\n#Grok-%s\n%d %d\n%d\n",
                 opj_version(), wr, hr, max);
+		writer->row.resize(std::max(writer->row.size(), (size_t)wr * (prec > 8 ? 2 : 1)));
+    }
 
-        red = image->comps[compno].data;
-        adjustR =
-            (image->comps[compno].sgnd ? 1 << (image->comps[compno].prec - 1) : 0);
-
-        if(prec > 8) {
-            for (i = 0; i < wr * hr; i++) {
-                v = *red + adjustR;
-                ++red;
-                if(v > 65535) v = 65535;
-                else if(v < 0) v = 0;
-
-                /* netpbm: */
-                fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-
-                if(has_alpha) {
-                    v = *alpha++;
-                    if(v > 65535) v = 65535;
-                    else if(v < 0) v = 0;
-
-                    /* netpbm: */
-                    fprintf(fdest, "%c%c",(unsigned char)(v>>8), (unsigned char)v);
-                }
-            }/* for(i */
-        } else { /* prec <= 8 */
-            for(i = 0; i < wr * hr; ++i) {
-                v = *red + adjustR;
-                ++red;
-                if(v > 255) v = 255;
-                else if(v < 0) v = 0;
-
-                fprintf(fdest, "%c", (unsigned char)v);
-            }
-        }
-        fclose(fdest);
-    } /* for (compno */
-    free(destname);
+	return writer.release();
+}/* pnm_strip_writer_open() */
 
-    return 0;
+int imagetopnm(opj_image_t * image, const char *outfile, int force_split)
+{
+	return write_image_strips(pnm_strip_writer_open(image, outfile, force_split), image);
 }/* imagetopnm() */
 
+int write_image_strips(StripWriter* writer, opj_image_t* image)
+{
+	if (!writer)
+		return 1;
+	bool success = writer->write(image);
+	success = writer->close() && success;
+	delete writer;
+	return success ? 0 : 1;
+}
+
 /* -->> -->> -->> -->>
 
     RAW IMAGE FORMAT
 
  <<-- <<-- <<-- <<-- */
-static opj_image_t* rawtoimage_common(const char *filename, opj_cparameters_t *parameters, bool big_endian)
+static inline uint32_t uint_ceildiv(uint32_t a, uint32_t b)
+{
+    return (uint32_t)(((uint64_t)a + b - 1) / b);
+}
+
+/* seek from the start of a file, past 2GB where the platform allows it */
+static bool seek_from_start(FILE* f, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/**
+RAW strip reader: components are stored one after the other, so each component
+is read through its own file handle
+*/
+class RawStripReader : public StripReader {
+public:
+	RawStripReader() : image(NULL), big_endian(false), sgnd(false), two(false) {}
+	~RawStripReader() {
+		for (auto f : files) {
+			if (f)
+				fclose(f);
+		}
+		opj_image_destroy(image);
+	}
+	opj_image_t* header() override {
+		return image;
+	}
+	bool read(opj_image_t* strip) override;
+
+	std::vector<FILE*> files;
+	/* rows read so far, for each component */
+	std::vector<uint32_t> rows;
+	std::vector<uint8_t> row;
+	opj_image_t* image;
+	bool big_endian;
+	bool sgnd;
+	/* two bytes per sample */
+	bool two;
+};
+
+bool RawStripReader::read(opj_image_t* strip)
+{
+	for (uint32_t compno = 0; compno < image->numcomps; compno++) {
+		auto comp = strip->comps + compno;
+		uint32_t w = image->comps[compno].w;
+		if (comp->w != w || rows[compno] + comp->h > image->comps[compno].h || (comp->h && !comp->data)) {
+			fprintf(stderr, "[ERROR] strip does not match the dimensions of component %u\n", compno);
+			return false;
+		}
+		int32_t* out = comp->data;
+		for (uint32_t y = 0; y < comp->h; ++y) {
+			if (fread(row.data(), two ? 2 : 1, w, files[compno]) != w) {
+				fprintf(stderr,"Error reading raw file. End of file probably reached.\n");
+				return false;
+			}
+			if (!two) {
+				for (uint32_t x = 0; x < w; ++x)
+					out[x] = sgnd ? (char)row[x] : row[x];
+			} else {
+				for (uint32_t x = 0; x < w; ++x) {
+					uint8_t temp1 = row[2 * x];
+					uint8_t temp2 = row[2 * x + 1];
+					unsigned short value;
+					if( big_endian ) {
+						value = (unsigned short)((temp1 << 8) + temp2);
+					} else {
+						value = (unsigned short)((temp2 << 8) + temp1);
+					}
+					out[x] = sgnd ? (short)value : value;
+				}
+			}
+			out += w;
+		}
+		rows[compno] += comp->h;
+	}
+	uint32_t last = image->numcomps - 1;
+	if (rows[last] == image->comps[last].h && strip->comps[last].h) {
+		unsigned short ch;
+		if (fread(&ch, 1, 1, files[last])) {
+			fprintf(stderr,"Warning. End of raw file not reached... processing anyway\n");
+		}
+	}
+	return true;
+}
+
+StripReader* raw_strip_reader_open(const char *filename, opj_cparameters_t *parameters, bool big_endian)
 {
 	raw_cparameters_t *raw_cp = &parameters->raw_cp;
     uint32_t subsampling_dx = parameters->subsampling_dx;
 	uint32_t subsampling_dy = parameters->subsampling_dy;
 
-    FILE *f = NULL;
-	uint32_t i, compno, numcomps, w, h;
+	uint32_t i, numcomps, w, h;
     OPJ_COLOR_SPACE color_space;
-    opj_image_cmptparm_t *cmptparm;
-    opj_image_t * image = NULL;
-    unsigned short ch;
+	std::unique_ptr<RawStripReader> reader(new RawStripReader());
 
     if(! (raw_cp->rawWidth && raw_cp->rawHeight && raw_cp->rawComp && raw_cp->rawBitDepth) ) {
         fprintf(stderr,"\nError: invalid raw image parameters\n");
@@ -2024,11 +2183,8 @@ static opj_image_t* rawtoimage_common(const char *filename, opj_cparameters_t *p
         fprintf(stderr,"Aborting.\n");
         return NULL;
     }
-
-    f = fopen(filename, "rb");
-    if (!f) {
-        fprintf(stderr, "Failed to open %s for reading !!\n", filename);
-        fprintf(stderr,"Aborting\n");
+    if (raw_cp->rawBitDepth > 16) {
+        fprintf(stderr,"Grok cannot encode raw components with bit depth higher than 16 bits.\n");
         return NULL;
     }
     numcomps = raw_cp->rawComp;
@@ -2045,99 +2201,63 @@ static opj_image_t* rawtoimage_common(const char *filename, opj_cparameters_t *p
     }
     w = raw_cp->rawWidth;
     h = raw_cp->rawHeight;
-    cmptparm = (opj_image_cmptparm_t*) calloc(numcomps,sizeof(opj_image_cmptparm_t));
-    if (!cmptparm) {
-        fprintf(stderr, "Failed to allocate image components parameters !!\n");
-        fprintf(stderr,"Aborting\n");
-        fclose(f);
-        return NULL;
-    }
+	std::vector<opj_image_cmptparm_t> cmptparm(numcomps);
+	memset(cmptparm.data(), 0, numcomps * sizeof(opj_image_cmptparm_t));
     /* initialize image components */
     for(i = 0; i < numcomps; i++) {
         cmptparm[i].prec = raw_cp->rawBitDepth;
         cmptparm[i].sgnd = raw_cp->rawSigned;
         cmptparm[i].dx = subsampling_dx * raw_cp->rawComps[i].dx;
         cmptparm[i].dy = subsampling_dy * raw_cp->rawComps[i].dy;
-        cmptparm[i].w = w;
-        cmptparm[i].h = h;
     }
-    /* create the image */
-    image = opj_image_create(numcomps, &cmptparm[0], color_space);
-    free(cmptparm);
-    if(!image) {
-        fclose(f);
+    /* create the image header */
+    reader->image = opj_image_tile_create(numcomps, cmptparm.data(), color_space);
+    if(!reader->image)
         return NULL;
-    }
+    opj_image_t* image = reader->image;
     /* set image offset and reference grid */
     image->x0 = parameters->image_offset_x0;
     image->y0 = parameters->image_offset_y0;
     image->x1 = parameters->image_offset_x0 + (w - 1) *	subsampling_dx + 1;
     image->y1 = parameters->image_offset_y0 + (h - 1) * subsampling_dy + 1;
 
-    if(raw_cp->rawBitDepth <= 8) {
-        unsigned char value = 0;
-        for(compno = 0; compno < numcomps; compno++) {
-			uint32_t nloop = (w*h)/(raw_cp->rawComps[compno].dx*raw_cp->rawComps[compno].dy);
-            for (i = 0; i < nloop; i++) {
-                if (!fread(&value, 1, 1, f)) {
-                    fprintf(stderr,"Error reading raw file. End of file probably reached.\n");
-                    opj_image_destroy(image);
-                    fclose(f);
-                    return NULL;
-                }
-                image->comps[compno].data[i] = raw_cp->rawSigned?(char)value:value;
-            }
-        }
-    } else if(raw_cp->rawBitDepth <= 16) {
-        unsigned short value;
-        for(compno = 0; compno < numcomps; compno++) {
-			uint32_t nloop = (w*h)/(raw_cp->rawComps[compno].dx*raw_cp->rawComps[compno].dy);
-            for (i = 0; i < nloop; i++) {
-                unsigned char temp1;
-                unsigned char temp2;
-                if (!fread(&temp1, 1, 1, f)) {
-                    fprintf(stderr,"Error reading raw file. End of file probably reached.\n");
-                    opj_image_destroy(image);
-                    fclose(f);
-                    return NULL;
-                }
-                if (!fread(&temp2, 1, 1, f)) {
-                    fprintf(stderr,"Error reading raw file. End of file probably reached.\n");
-                    opj_image_destroy(image);
-                    fclose(f);
-                    return NULL;
-                }
-                if( big_endian ) {
-                    value = (unsigned short)((temp1 << 8) + temp2);
-                } else {
-                    value = (unsigned short)((temp2 << 8) + temp1);
-                }
-                image->comps[compno].data[i] = raw_cp->rawSigned?(short)value:value;
-            }
-        }
-    } else {
-        fprintf(stderr,"Grok cannot encode raw components with bit depth higher than 16 bits.\n");
-        opj_image_destroy(image);
-        fclose(f);
-        return NULL;
-    }
-
-    if (fread(&ch, 1, 1, f)) {
-        fprintf(stderr,"Warning. End of raw file not reached... processing anyway\n");
-    }
-    fclose(f);
+	/* component dimensions on the reference grid, which sub-sampled components are stored with */
+	reader->big_endian = big_endian;
+	reader->sgnd = raw_cp->rawSigned != 0;
+	reader->two = raw_cp->rawBitDepth > 8;
+	uint64_t offset = 0;
+	for (i = 0; i < numcomps; i++) {
+		auto comp = image->comps + i;
+		comp->w = uint_ceildiv(image->x1, comp->dx) - uint_ceildiv(image->x0, comp->dx);
+		comp->h = uint_ceildiv(image->y1, comp->dy) - uint_ceildiv(image->y0, comp->dy);
+
+		FILE* f = fopen(filename, "rb");
+		if (!f) {
+			fprintf(stderr, "Failed to open %s for reading !!\n", filename);
+			fprintf(stderr,"Aborting\n");
+			return NULL;
+		}
+		reader->files.push_back(f);
+		if (offset && !seek_from_start(f, offset)) {
+			fprintf(stderr,"Error reading raw file. End of file probably reached.\n");
+			return NULL;
+		}
+		offset += (uint64_t)comp->w * comp->h * (reader->two ? 2 : 1);
+		reader->row.resize(std::max(reader->row.size(), (size_t)comp->w * (reader->two ? 2 : 1)));
+	}
+	reader->rows.resize(numcomps, 0);
 
-    return image;
+    return reader.release();
 }
 
 opj_image_t* rawltoimage(const char *filename, opj_cparameters_t *parameters)
 {
-    return rawtoimage_common(filename, parameters, false);
+    return read_image_strips(raw_strip_reader_open(filename, parameters, false));
 }
 
 opj_image_t* rawtoimage(const char *filename, opj_cparameters_t *parameters)
 {
-    return rawtoimage_common(filename, parameters, true);
+    return read_image_strips(raw_strip_reader_open(filename, parameters, true));
 }
 
 static int imagetoraw_common(opj_image_t * image, const char *outfile, bool big_endian)
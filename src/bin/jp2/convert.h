@@ -106,7 +106,7 @@ extern "C" {
 
 	/* TIFF conversion*/
 	opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, bool applyICC);
-	int imagetotif(opj_image_t *image, const char *outfile, uint32_t compression);
+	int imagetotif(opj_image_t *image, const char *outfile, uint32_t compression, uint32_t numThreads);
 	/**
 	Load a single image component encoded in PGX file format
 	@param filename Name of the PGX file to load
@@ -126,10 +126,74 @@ extern "C" {
 	opj_image_t* rawltoimage(const char *filename, opj_cparameters_t *parameters);
 
 	/* PNG conversion*/
-	extern int imagetopng(opj_image_t *image, const char *write_idf, int32_t compressionLevel);
+	/* PNG compression presets, as zlib compression levels: the fast preset also uses a single row filter */
+#define PNG_COMPRESSION_FAST 1
+#define PNG_COMPRESSION_DEFAULT 6
+#define PNG_COMPRESSION_SMALL 9
+	extern int imagetopng(opj_image_t *image, const char *write_idf, int32_t compressionLevel, uint32_t numThreads);
 	extern opj_image_t* pngtoimage(const char *filename, opj_cparameters_t *parameters);
 
-}
+	/**
+	Image file writer that is handed the image one strip (band of complete rows) at a time,
+	so that a decoded image can be written out without ever being held in memory in full.
+
+	A writer is opened with the image header, which only needs component data if the image is
+	written in one go, and writes the file header straight away.
+	*/
+	class StripWriter {
+	public:
+		virtual ~StripWriter() {}
+		/**
+		Write the rows of a strip; strips must be written top to bottom.
+		The strip samples may be modified (clipped and scaled to the output precision).
+		*/
+		virtual bool write(opj_image_t* strip) = 0;
+		/**
+		Finish the file; returns false if the file could not be completed,
+		or if a previous write failed
+		*/
+		virtual bool close() = 0;
+	};
+
+	/* Strip writers: return NULL, after reporting the reason, if the image can't be written in that format */
+	StripWriter* pnm_strip_writer_open(opj_image_t *image, const char *outfile, int force_split);
+	StripWriter* tif_strip_writer_open(opj_image_t *image, const char *outfile, uint32_t compression, uint32_t numThreads);
+	StripWriter* png_strip_writer_open(opj_image_t *image, const char *write_idf, int32_t compressionLevel, uint32_t numThreads);
+
+	/**
+	Write a whole image, as a single strip, with a strip writer, and destroy the writer.
+	@return 0 on success, as the imagetoxxx functions
+	*/
+	int write_image_strips(StripWriter* writer, opj_image_t* image);
 
+	/**
+	Image file reader that fills the image one strip (band of complete rows) at a time,
+	so that an image can be encoded without ever being held in memory in full.
+	A reader is opened on the file, and reads the file header straight away.
+	*/
+	class StripReader {
+	public:
+		virtual ~StripReader() {}
+		/**
+		Image header: components have their dimensions, but no data
+		*/
+		virtual opj_image_t* header() = 0;
+		/**
+		Read the next comps[i].h rows of each component into the strip;
+		strips must be read top to bottom, and hold complete rows of comps[i].w samples.
+		*/
+		virtual bool read(opj_image_t* strip) = 0;
+	};
+
+	/* Strip readers: return NULL, after reporting the reason, if the file can't be read */
+	StripReader* pnm_strip_reader_open(const char *filename, opj_cparameters_t *parameters);
+	StripReader* tif_strip_reader_open(const char *filename, opj_cparameters_t *parameters);
+	StripReader* raw_strip_reader_open(const char *filename, opj_cparameters_t *parameters, bool big_endian);
 
+	/**
+	Read a whole image, as a single strip, with a strip reader, and destroy the reader.
+	@return the image, or NULL if it could not be read, as the xxxtoimage functions
+	*/
+	opj_image_t* read_image_strips(StripReader* reader);
 
+}
@@ -81,6 +81,10 @@ extern "C" {
 #include <codecvt>
 #include <cassert>
 #include <locale>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include "opj_parallel.h"
 
 #define PNG_MAGIC "\x89PNG\x0d\x0a\x1a\x0a"
 #define MAGIC_SIZE 8
@@ -326,24 +330,376 @@ static void convert_32s16u_C1R(const int32_t* pSrc, uint8_t* pDst, size_t length
         *pDst++ = (uint8_t)val;
     }
 }
-int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLevel)
+/* target size of the filtered rows that are deflated into one IDAT chunk */
+const size_t png_target_block_size = 128 * 1024;
+/* deflate window: each block is primed with the filtered bytes that precede it */
+const size_t png_window_size = 32 * 1024;
+/* number of rows that a PNG packing worker packs at a time */
+const uint32_t png_rows_per_chunk = 16;
+
+static inline png_byte paeth_predictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return (png_byte)a;
+	return (png_byte)((pb <= pc) ? b : c);
+}
+
+/**
+Filter a packed row
+
+@param type		PNG_FILTER_VALUE_xxx filter type
+@param row		packed row
+@param prev		packed row above, all zeros for the first row
+@param len		row size in bytes
+@param bpp		bytes per complete pixel, rounded up to 1
+@param dst		filtered row, without the filter type byte
+*/
+static void filter_row(int type, const png_byte* row, const png_byte* prev, size_t len, size_t bpp, png_byte* dst)
+{
+	size_t i;
+	switch (type) {
+	case PNG_FILTER_VALUE_SUB:
+		for (i = 0; i < bpp; ++i)
+			dst[i] = row[i];
+		for (; i < len; ++i)
+			dst[i] = (png_byte)(row[i] - row[i - bpp]);
+		break;
+	case PNG_FILTER_VALUE_UP:
+		for (i = 0; i < len; ++i)
+			dst[i] = (png_byte)(row[i] - prev[i]);
+		break;
+	case PNG_FILTER_VALUE_AVG:
+		for (i = 0; i < bpp; ++i)
+			dst[i] = (png_byte)(row[i] - (prev[i] >> 1));
+		for (; i < len; ++i)
+			dst[i] = (png_byte)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+		break;
+	case PNG_FILTER_VALUE_PAETH:
+		for (i = 0; i < bpp; ++i)
+			dst[i] = (png_byte)(row[i] - prev[i]);
+		for (; i < len; ++i)
+			dst[i] = (png_byte)(row[i] - paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]));
+		break;
+	default:
+		memcpy(dst, row, len);
+		break;
+	}
+}
+
+/**
+Sum of the filtered bytes taken as signed values: as libpng does,
+the filter that gives the smallest sum is chosen for a row
+*/
+static size_t filter_cost(const png_byte* filtered, size_t len)
+{
+	size_t sum = 0;
+	for (size_t i = 0; i < len; ++i)
+		sum += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+	return sum;
+}
+
+/**
+PNG strip writer: rows are packed, filtered and deflated here in blocks of rows,
+which are shared out between threads, one batch of blocks at a time.
+
+Each block is deflated as a raw deflate stream primed with the preceding
+32 KiB of filtered data, and flushed to a byte boundary, so that the blocks
+can be stitched together into the zlib stream of the IDAT chunks,
+with one IDAT chunk per block.
+*/
+class PNGStripWriter : public StripWriter {
+public:
+	PNGStripWriter() : writer(NULL),
+						png(NULL),
+						info(NULL),
+						nr_comp(0),
+						prec(0),
+						out_prec(0),
+						width(0),
+						height(0),
+						row_bytes(0),
+						bpp(0),
+						level(Z_DEFAULT_COMPRESSION),
+						filter(-1),
+						rows_per_block(0),
+						blocks_per_batch(0),
+						batch_rows(0),
+						rows_written(0),
+						adler(0),
+						numThreads(1),
+						cvtPxToCx(NULL),
+						cvt32sToPack(NULL),
+						completed(false),
+						failed(false)
+	{}
+	~PNGStripWriter() {
+		if (png) {
+			png_destroy_write_struct(&png, &info);
+		}
+		if (writer)
+			fclose(writer);
+		if (!completed)
+			(void)remove(path.c_str()); /* ignore return value */
+	}
+	bool write(opj_image_t* strip) override;
+	bool close() override;
+
+	/**
+	Filter, deflate and write out the blocks of the current batch of rows
+	*/
+	bool flush();
+
+	std::string path;
+	FILE * writer;
+	png_structp png;
+	png_infop info;
+	int nr_comp;
+	/* precision of the image, and precision written to the file */
+	uint32_t prec;
+	uint32_t out_prec;
+	uint32_t width;
+	uint32_t height;
+	size_t row_bytes;
+	size_t bpp;
+	/* zlib compression level */
+	int level;
+	/* filter type of all rows, or -1 to choose the filter of each row */
+	int filter;
+	uint32_t rows_per_block;
+	uint32_t blocks_per_batch;
+	/* packed rows of the current batch */
+	std::vector<png_byte> rows;
+	uint32_t batch_rows;
+	/* last packed row before the batch: all zeros before the first row */
+	std::vector<png_byte> prev_row;
+	/* filtered rows of the current batch, each one preceded by its filter type */
+	std::vector<png_byte> filtered;
+	/* filtered bytes that precede the batch, up to the size of the deflate window */
+	std::vector<png_byte> window;
+	/* deflated blocks of the current batch, and their Adler-32 checksums */
+	std::vector<std::vector<png_byte> > blocks;
+	std::vector<uLong> block_adler;
+	uint32_t rows_written;
+	/* Adler-32 checksum of the filtered rows written so far */
+	uLong adler;
+	uint32_t numThreads;
+	/* interleaved samples of a row, for each packing worker */
+	std::vector<std::vector<int32_t> > buffer32s;
+	/* candidate filtered row, for each filtering worker */
+	std::vector<std::vector<png_byte> > scratch;
+	convert_32s_PXCX cvtPxToCx;
+	convert_32sXXx_C1R cvt32sToPack;
+	bool completed;
+	bool failed;
+};
+
+bool PNGStripWriter::write(opj_image_t* strip)
+{
+	int32_t const* planes[4];
+	int i;
+	if (failed)
+		return false;
+	for (i = 0; i < nr_comp; ++i) {
+		if (!strip->comps[i].data && strip->comps[i].h) {
+			failed = true;
+			return false;
+		}
+		planes[i] = strip->comps[i].data;
+	}
+	for (i = 0; i < nr_comp; ++i) {
+		clip_component(&(strip->comps[i]), prec);
+		scale_component(&(strip->comps[i]), out_prec);
+	}
+
+	// handle libpng errors
+	if (setjmp(png_jmpbuf(png))) {
+		failed = true;
+		return false;
+	}
+	int32_t adjust = strip->comps[0].sgnd ? 1 << (out_prec - 1) : 0;
+	uint32_t h = strip->comps[0].h;
+	uint32_t batch_capacity = blocks_per_batch * rows_per_block;
+	uint32_t y = 0;
+	while (y < h) {
+		uint32_t num_rows = std::min<uint32_t>(h - y, batch_capacity - batch_rows);
+		png_byte* dest = rows.data() + batch_rows * row_bytes;
+		uint32_t num_chunks = (num_rows + png_rows_per_chunk - 1) / png_rows_per_chunk;
+		opj_run_parallel(num_chunks, numThreads, [&](uint32_t worker, uint32_t chunk) {
+			int32_t const* row_planes[4];
+			int32_t* buf = buffer32s[worker].data();
+			uint32_t r0 = chunk * png_rows_per_chunk;
+			uint32_t r1 = std::min<uint32_t>(r0 + png_rows_per_chunk, num_rows);
+			for (uint32_t r = r0; r < r1; ++r) {
+				for (int k = 0; k < nr_comp; ++k)
+					row_planes[k] = planes[k] + (size_t)(y + r) * width;
+				cvtPxToCx(row_planes, buf, width, adjust);
+				cvt32sToPack(buf, dest + r * row_bytes, (size_t)width * (size_t)nr_comp);
+			}
+		});
+		batch_rows += num_rows;
+		y += num_rows;
+		if (batch_rows == batch_capacity && !flush())
+			return false;
+	}
+	return true;
+}
+
+bool PNGStripWriter::flush()
+{
+	uint32_t num_blocks = (batch_rows + rows_per_block - 1) / rows_per_block;
+	size_t filtered_row_bytes = row_bytes + 1;
+	bool last_batch = rows_written + batch_rows == height;
+
+	// filter
+	opj_run_parallel(num_blocks, numThreads, [&](uint32_t worker, uint32_t blockno) {
+		uint32_t r0 = blockno * rows_per_block;
+		uint32_t r1 = std::min<uint32_t>(r0 + rows_per_block, batch_rows);
+		png_byte* candidate = scratch[worker].data();
+		for (uint32_t r = r0; r < r1; ++r) {
+			const png_byte* row = rows.data() + r * row_bytes;
+			const png_byte* prev = r ? row - row_bytes : prev_row.data();
+			png_byte* dst = filtered.data() + r * filtered_row_bytes;
+			int type = filter;
+			if (type < 0) {
+				size_t best_cost = (size_t)-1;
+				for (int t = PNG_FILTER_VALUE_NONE; t < PNG_FILTER_VALUE_LAST; ++t) {
+					filter_row(t, row, prev, row_bytes, bpp, candidate);
+					size_t cost = filter_cost(candidate, row_bytes);
+					if (cost < best_cost) {
+						best_cost = cost;
+						type = t;
+						memcpy(dst + 1, candidate, row_bytes);
+					}
+				}
+			}
+			else {
+				filter_row(type, row, prev, row_bytes, bpp, dst + 1);
+			}
+			dst[0] = (png_byte)type;
+		}
+	});
+
+	// deflate
+	std::atomic<bool> deflated(true);
+	int strategy = filter == PNG_FILTER_VALUE_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+	opj_run_parallel(num_blocks, numThreads, [&](uint32_t, uint32_t blockno) {
+		size_t begin = blockno * rows_per_block * filtered_row_bytes;
+		size_t end = std::min<size_t>(begin + rows_per_block * filtered_row_bytes, batch_rows * filtered_row_bytes);
+		bool last = last_batch && blockno == num_blocks - 1;
+		auto& out = blocks[blockno];
+		block_adler[blockno] = adler32(adler32(0L, Z_NULL, 0), filtered.data() + begin, (uInt)(end - begin));
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+			deflated = false;
+			return;
+		}
+		/* prime the block with the filtered bytes that precede it */
+		const png_byte* dict = begin ? filtered.data() + begin - std::min(begin, png_window_size) : window.data();
+		size_t dict_len = begin ? std::min(begin, png_window_size) : window.size();
+		if (dict_len)
+			deflateSetDictionary(&zs, dict, (uInt)dict_len);
+		/* room for a sync flush marker, as well as the stream */
+		out.resize(deflateBound(&zs, (uLong)(end - begin)) + 16);
+		zs.next_in = filtered.data() + begin;
+		zs.avail_in = (uInt)(end - begin);
+		zs.next_out = out.data();
+		zs.avail_out = (uInt)out.size();
+		int rc = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+		if ((last ? rc != Z_STREAM_END : rc != Z_OK) || zs.avail_in)
+			deflated = false;
+		out.resize(zs.total_out);
+		deflateEnd(&zs);
+	});
+	if (!deflated) {
+		fprintf(stderr, "imagetopng: failed to compress image data.\n");
+		failed = true;
+		return false;
+	}
+
+	// stitch the blocks into the zlib stream
+	for (uint32_t blockno = 0; blockno < num_blocks; ++blockno) {
+		auto& out = blocks[blockno];
+		if (rows_written == 0 && blockno == 0) {
+			/* zlib header: 32 KiB window, with the compression level hint that zlib would write */
+			int flevel = (level == Z_DEFAULT_COMPRESSION) ? 2 : (level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+			png_byte header[2] = { 0x78, (png_byte)(flevel << 6) };
+			header[1] = (png_byte)(header[1] + 31 - ((header[0] << 8) + header[1]) % 31);
+			out.insert(out.begin(), header, header + 2);
+			adler = block_adler[blockno];
+		}
+		else {
+			size_t begin = blockno * rows_per_block * filtered_row_bytes;
+			size_t end = std::min<size_t>(begin + rows_per_block * filtered_row_bytes, batch_rows * filtered_row_bytes);
+			adler = adler32_combine(adler, block_adler[blockno], (z_off_t)(end - begin));
+		}
+		if (last_batch && blockno == num_blocks - 1) {
+			for (int shift = 24; shift >= 0; shift -= 8)
+				out.push_back((png_byte)(adler >> shift));
+		}
+		png_write_chunk(png, (png_const_bytep)"IDAT", out.data(), out.size());
+	}
+
+	// keep the deflate window and the last row for the next batch
+	size_t batch_bytes = batch_rows * filtered_row_bytes;
+	if (batch_bytes >= png_window_size) {
+		window.assign(filtered.data() + batch_bytes - png_window_size, filtered.data() + batch_bytes);
+	}
+	else {
+		window.insert(window.end(), filtered.data(), filtered.data() + batch_bytes);
+		if (window.size() > png_window_size)
+			window.erase(window.begin(), window.end() - png_window_size);
+	}
+	memcpy(prev_row.data(), rows.data() + (batch_rows - 1) * row_bytes, row_bytes);
+	rows_written += batch_rows;
+	batch_rows = 0;
+	return true;
+}
+
+bool PNGStripWriter::close()
+{
+	if (!failed) {
+		// handle libpng errors
+		if (setjmp(png_jmpbuf(png))) {
+			failed = true;
+		}
+		else if (batch_rows && !flush()) {
+			failed = true;
+		}
+		else if (rows_written != height) {
+			fprintf(stderr, "imagetopng: image is missing rows.\n");
+			failed = true;
+		}
+		else {
+			/* libpng only knows of IDAT chunks that it writes itself */
+			png_write_chunk(png, (png_const_bytep)"IEND", NULL, 0);
+		}
+	}
+	png_destroy_write_struct(&png, &info);
+	png = NULL;
+	if (fclose(writer))
+		failed = true;
+	writer = NULL;
+	completed = !failed;
+	return completed;
+}
+
+StripWriter* png_strip_writer_open(opj_image_t * image, const char *write_idf, int32_t compressionLevel, uint32_t numThreads)
 {
-    FILE * volatile writer = NULL;
-    png_structp png = NULL;
-    png_infop info = NULL;
-    png_bytep volatile row_buf = NULL;
     int nr_comp, color_type;
-    volatile int prec;
+    int prec;
     png_color_8 sig_bit;
-    int32_t const* planes[4];
     int i;
-    int32_t* volatile buffer32s = NULL;
-
-    volatile int fails = 1;
+	png_structp png;
+	png_infop info;
 
     memset(&sig_bit, 0, sizeof(sig_bit));
     prec = (int)image->comps[0].prec;
-    planes[0] = image->comps[0].data;
     nr_comp = (int)image->numcomps;
 
     if (nr_comp > 4) {
@@ -362,25 +718,16 @@ int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLe
         if (image->comps[0].sgnd != image->comps[i].sgnd) {
             break;
         }
-        planes[i] = image->comps[i].data;
     }
     if (i != nr_comp) {
         fprintf(stderr,"imagetopng: All components shall have the same subsampling, same bit depth, same sign.\n");
         fprintf(stderr,"\tAborting\n");
-        return 1;
-    }
-    for (i = 0; i < nr_comp; ++i) {
-        clip_component(&(image->comps[i]), image->comps[0].prec);
+        return NULL;
     }
+	/* samples are scaled to the precision written to the file in PNGStripWriter::write */
     if(prec > 8 && prec < 16) {
-        for (i = 0; i < nr_comp; ++i) {
-            scale_component(&(image->comps[i]), 16);
-        }
         prec = 16;
     } else if(prec < 8 && nr_comp > 1) { /* GRAY_ALPHA, RGB, RGB_ALPHA */
-        for (i = 0; i < nr_comp; ++i) {
-            scale_component(&(image->comps[i]), 8);
-        }
         prec = 8;
     } else if((prec > 1) && (prec < 8) && ((prec == 6) || ((prec & 1)==1))) { /* GRAY with non native precision */
         if ((prec == 5) || (prec == 6)) {
@@ -388,19 +735,30 @@ int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLe
         } else {
             prec++;
         }
-        for (i = 0; i < nr_comp; ++i) {
-            scale_component(&(image->comps[i]), (uint32_t)prec);
-        }
     }
 
     if(prec != 1 && prec != 2 && prec != 4 && prec != 8 && prec != 16) {
         fprintf(stderr,"imagetopng: can not create %s\n\twrong bit_depth %d\n", write_idf, prec);
-        return fails;
+        return NULL;
     }
+	if (compressionLevel == DECOMPRESS_COMPRESSION_LEVEL_DEFAULT)
+		compressionLevel = PNG_COMPRESSION_DEFAULT;
+	if (compressionLevel < Z_DEFAULT_COMPRESSION || compressionLevel > Z_BEST_COMPRESSION) {
+		fprintf(stderr, "imagetopng: invalid compression level %d\n", compressionLevel);
+		return NULL;
+	}
+
+	FILE* writer = fopen(write_idf, "wb");
 
-    writer = fopen(write_idf, "wb");
+    if(writer == NULL) return NULL;
 
-    if(writer == NULL) return fails;
+	/* from here on, the writer closes and removes the file if it fails */
+	PNGStripWriter* strip_writer = new PNGStripWriter();
+	strip_writer->path = write_idf;
+	strip_writer->writer = writer;
+	strip_writer->nr_comp = nr_comp;
+	strip_writer->prec = image->comps[0].prec;
+	strip_writer->out_prec = (uint32_t)prec;
 
     /* Create and initialize the png_struct with the desired error handler
      * functions.  If you want to use the default stderr and longjump method,
@@ -408,18 +766,18 @@ int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLe
      * the library version is compatible with the one used at compile time,
      * in case we are using dynamically linked libraries.  REQUIRED.
      */
-    png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+    png = strip_writer->png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
                                   NULL, NULL, NULL);
 
+    if(png == NULL) goto fin;
+
 	// allow Microsoft/HP 3144-byte sRGB profile, normally skipped by library 
 	// because it deems it broken. (a controversial decision)
 	png_set_option(png, PNG_SKIP_sRGB_CHECK_PROFILE, PNG_OPTION_ON);
 
-    if(png == NULL) goto fin;
-
     /* Allocate/initialize the image information data.  REQUIRED
      */
-    info = png_create_info_struct(png);
+    info = strip_writer->info = png_create_info_struct(png);
 
     if(info == NULL) goto fin;
 
@@ -449,8 +807,6 @@ int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLe
      * color_type == PNG_COLOR_TYPE_RGB_ALPHA) && bit_depth < 8
      *
      */
-    png_set_compression_level(png, (compressionLevel == DECOMPRESS_COMPRESSION_LEVEL_DEFAULT) ? Z_BEST_COMPRESSION : compressionLevel);
-
     if(nr_comp >= 3) { /* RGB(A) */
         color_type = PNG_COLOR_TYPE_RGB;
         sig_bit.red = sig_bit.green = sig_bit.blue = (png_byte)prec;
@@ -517,72 +873,56 @@ int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLe
             fprintf(stderr, "Invalid PNG row size\n");
             goto fin;
         }
-        row_buf = (png_bytep)malloc(png_row_size);
-        if (row_buf == NULL) {
-            fprintf(stderr, "Can't allocate memory for PNG row\n");
-            goto fin;
-        }
-        buffer32s = (int32_t*)malloc((size_t)image->comps[0].w * (size_t)nr_comp * sizeof(int32_t));
-        if (buffer32s == NULL) {
-            fprintf(stderr, "Can't allocate memory for interleaved 32s row\n");
-            goto fin;
-        }
+		strip_writer->width = image->comps[0].w;
+		strip_writer->height = image->comps[0].h;
+		strip_writer->row_bytes = png_row_size;
+		strip_writer->bpp = std::max<size_t>(((size_t)nr_comp * (size_t)prec) / 8U, 1U);
+		strip_writer->level = compressionLevel;
+		/* as libpng does, low bit depths are not filtered; fast levels use a single filter */
+		if (prec < 8 || compressionLevel == Z_NO_COMPRESSION)
+			strip_writer->filter = PNG_FILTER_VALUE_NONE;
+		else if (compressionLevel != Z_DEFAULT_COMPRESSION && compressionLevel <= PNG_COMPRESSION_FAST)
+			strip_writer->filter = PNG_FILTER_VALUE_UP;
+		strip_writer->numThreads = std::max<uint32_t>(numThreads, 1);
+		strip_writer->rows_per_block = (uint32_t)std::min<size_t>(std::max<size_t>(png_target_block_size / (png_row_size + 1), 1), strip_writer->height);
+		strip_writer->blocks_per_batch = strip_writer->numThreads > 1 ? 4 * strip_writer->numThreads : 1;
+		size_t batch_capacity = (size_t)strip_writer->blocks_per_batch * strip_writer->rows_per_block;
+		strip_writer->rows.resize(batch_capacity * png_row_size);
+		strip_writer->filtered.resize(batch_capacity * (png_row_size + 1));
+		strip_writer->prev_row.resize(png_row_size);
+		strip_writer->blocks.resize(strip_writer->blocks_per_batch);
+		strip_writer->block_adler.resize(strip_writer->blocks_per_batch);
+		strip_writer->buffer32s.resize(strip_writer->numThreads);
+		for (auto& buf : strip_writer->buffer32s)
+			buf.resize((size_t)image->comps[0].w * (size_t)nr_comp);
+		strip_writer->scratch.resize(strip_writer->numThreads);
+		for (auto& buf : strip_writer->scratch)
+			buf.resize(png_row_size);
     }
 
-    /* convert */
-    {
-        size_t width= image->comps[0].w;
-        uint32_t y;
-        convert_32s_PXCX cvtPxToCx = convert_32s_PXCX_LUT[nr_comp];
-        convert_32sXXx_C1R cvt32sToPack = NULL;
-        int32_t adjust = image->comps[0].sgnd ? 1 << (prec - 1) : 0;
-        png_bytep row_buf_cpy = row_buf;
-        int32_t* buffer32s_cpy = buffer32s;
-
-        switch (prec) {
-        case 1:
-        case 2:
-        case 4:
-        case 8:
-            cvt32sToPack = convert_32sXXu_C1R_LUT[prec];
-            break;
-        case 16:
-            cvt32sToPack = convert_32s16u_C1R;
-            break;
-        default:
-            /* never here */
-			return 1;
-            break;
-        }
-
-        for(y = 0; y < image->comps[0].h; ++y) {
-            cvtPxToCx(planes, buffer32s_cpy, width, adjust);
-            cvt32sToPack(buffer32s_cpy, row_buf_cpy, width * (size_t)nr_comp);
-            png_write_row(png, row_buf_cpy);
-            planes[0] += width;
-            planes[1] += width;
-            planes[2] += width;
-            planes[3] += width;
-        }
+    strip_writer->cvtPxToCx = convert_32s_PXCX_LUT[nr_comp];
+    switch (prec) {
+    case 1:
+    case 2:
+    case 4:
+    case 8:
+        strip_writer->cvt32sToPack = convert_32sXXu_C1R_LUT[prec];
+        break;
+    case 16:
+        strip_writer->cvt32sToPack = convert_32s16u_C1R;
+        break;
+    default:
+        /* never here */
+        goto fin;
     }
-
-    png_write_end(png, info);
-
-    fails = 0;
+	return strip_writer;
 
 fin:
-    if(png) {
-        png_destroy_write_struct(&png, &info);
-    }
-    if(row_buf) {
-        free(row_buf);
-    }
-    if(buffer32s) {
-        free(buffer32s);
-    }
-    fclose(writer);
+	delete strip_writer;
+	return NULL;
+}/* png_strip_writer_open() */
 
-    if(fails) (void)remove(write_idf); /* ignore return value */
-
-    return fails;
+int imagetopng(opj_image_t * image, const char *write_idf, int32_t compressionLevel, uint32_t numThreads)
+{
+	return write_image_strips(png_strip_writer_open(image, write_idf, compressionLevel, numThreads), image);
 }/* imagetopng() */
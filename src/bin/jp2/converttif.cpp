@@ -73,8 +73,17 @@ extern "C" {
 #include "color.h"
 }
 
+#ifdef ZIP_SUPPORT
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <memory>
+#include <string>
+#include <vector>
+#include "opj_parallel.h"
 
 /* -->> -->> -->> -->>
 
@@ -583,27 +592,183 @@ static void tif_32sto16u(const int32_t* pSrc, uint16_t* pDst, size_t length)
     }
 }
 
-int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
+/* target size of an uncompressed TIFF strip written by the strip writer */
+const tsize_t tif_target_strip_size = 64 * 1024;
+/* number of rows that a TIFF packing worker packs at a time */
+const uint32_t tif_rows_per_chunk = 16;
+
+/**
+TIFF strip writer: image rows are packed into multi-row TIFF strips, and written out
+in batches of strips. The packing of the rows, and the deflate compression of
+the strips of a batch, are shared out between threads; strips are then written in order.
+*/
+class TIFStripWriter : public StripWriter {
+public:
+	TIFStripWriter() : tif(nullptr),
+						numcomps(0),
+						prec(0),
+						adjust(0),
+						width(0),
+						row_stride(0),
+						rows_per_strip(0),
+						strips_per_batch(0),
+						batch_rows(0),
+						strip(0),
+						numThreads(1),
+						deflate(false),
+						swab16(false),
+						cvtPxToCx(nullptr),
+						cvt32sToTif(nullptr),
+						failed(false)
+	{}
+	~TIFStripWriter() {
+		if (tif)
+			TIFFClose(tif);
+	}
+	bool write(opj_image_t* strip) override;
+	bool close() override;
+
+	/**
+	Compress and write out the strips of the current batch
+	*/
+	bool flush();
+
+	TIFF *tif;
+	uint32_t numcomps;
+	uint32_t prec;
+	int32_t adjust;
+	uint32_t width;
+	tsize_t row_stride;
+	uint32_t rows_per_strip;
+	uint32_t strips_per_batch;
+	/* packed rows of the current batch of strips */
+	std::vector<uint8_t> batch;
+	uint32_t batch_rows;
+	/* compressed strips of the current batch */
+	std::vector<std::vector<uint8_t> > compressed;
+	/* next TIFF strip to write */
+	tstrip_t strip;
+	uint32_t numThreads;
+	/* strips are deflated here, and written raw */
+	bool deflate;
+	/* 16 bit samples are byte swapped in the file */
+	bool swab16;
+	/* interleaved samples of a row, for each packing worker */
+	std::vector<std::vector<int32_t> > buffer32s;
+	convert_32s_PXCX cvtPxToCx;
+	convert_32sXXx_C1R cvt32sToTif;
+	bool failed;
+};
+
+bool TIFStripWriter::write(opj_image_t* strip)
+{
+	int32_t const* planes[4];
+	uint32_t h = strip->comps[0].h;
+
+	if (failed)
+		return false;
+	//check for null image components
+	for (uint32_t i = 0; i < numcomps; ++i) {
+		auto comp = strip->comps[i];
+		if (!comp.data && comp.h) {
+			failed = true;
+			return false;
+		}
+		planes[i] = comp.data;
+	}
+	for (uint32_t i = 0U; i < numcomps; ++i) {
+		clip_component(&(strip->comps[i]), prec);
+	}
+	uint32_t batch_capacity = strips_per_batch * rows_per_strip;
+	uint32_t y = 0;
+	while (y < h) {
+		uint32_t num_rows = std::min<uint32_t>(h - y, batch_capacity - batch_rows);
+		uint8_t* dest = batch.data() + (size_t)batch_rows * row_stride;
+		uint32_t num_chunks = (num_rows + tif_rows_per_chunk - 1) / tif_rows_per_chunk;
+		opj_run_parallel(num_chunks, numThreads, [&](uint32_t worker, uint32_t chunk) {
+			int32_t const* row_planes[4];
+			int32_t* buf = buffer32s[worker].data();
+			uint32_t r0 = chunk * tif_rows_per_chunk;
+			uint32_t r1 = std::min<uint32_t>(r0 + tif_rows_per_chunk, num_rows);
+			for (uint32_t r = r0; r < r1; ++r) {
+				for (uint32_t k = 0; k < numcomps; ++k)
+					row_planes[k] = planes[k] + (size_t)(y + r) * width;
+				cvtPxToCx(row_planes, buf, width, adjust);
+				cvt32sToTif(buf, dest + (size_t)r * row_stride, (size_t)width * numcomps);
+			}
+		});
+		batch_rows += num_rows;
+		y += num_rows;
+		if (batch_rows == batch_capacity && !flush())
+			return false;
+	}
+	return true;
+}
+
+bool TIFStripWriter::flush()
+{
+	uint32_t num_strips = (batch_rows + rows_per_strip - 1) / rows_per_strip;
+	tsize_t strip_size = (tsize_t)rows_per_strip * row_stride;
+	auto strip_bytes = [&](uint32_t i) {
+		return std::min<tsize_t>(strip_size, (tsize_t)batch_rows * row_stride - i * strip_size);
+	};
+#ifdef ZIP_SUPPORT
+	if (deflate) {
+		std::atomic<bool> deflated(true);
+		opj_run_parallel(num_strips, numThreads, [&](uint32_t, uint32_t i) {
+			auto& out = compressed[i];
+			uLong src_len = (uLong)strip_bytes(i);
+			/* raw strips skip the byte swapping that libtiff applies to encoded strips */
+			if (swab16)
+				TIFFSwabArrayOfShort((uint16*)(batch.data() + i * strip_size), (tmsize_t)(src_len / 2));
+			uLongf dest_len = compressBound(src_len);
+			out.resize(dest_len);
+			if (compress2(out.data(), &dest_len, batch.data() + i * strip_size, src_len,
+							Z_DEFAULT_COMPRESSION) != Z_OK)
+				deflated = false;
+			out.resize(dest_len);
+		});
+		if (!deflated) {
+			fprintf(stderr, "imagetotif: failed to compress strip.\n");
+			failed = true;
+		}
+	}
+#endif
+	for (uint32_t i = 0; i < num_strips && !failed; ++i) {
+		tsize_t written;
+		if (deflate)
+			written = TIFFWriteRawStrip(tif, strip++, compressed[i].data(), (tsize_t)compressed[i].size());
+		else
+			written = TIFFWriteEncodedStrip(tif, strip++, batch.data() + i * strip_size, strip_bytes(i));
+		if (written < 0)
+			failed = true;
+	}
+	batch_rows = 0;
+	return !failed;
+}
+
+bool TIFStripWriter::close()
+{
+	if (tif && !failed && batch_rows)
+		flush();
+	if (tif)
+		TIFFClose(tif);
+	tif = nullptr;
+	return !failed;
+}
+
+StripWriter* tif_strip_writer_open(opj_image_t * image, const char *outfile, uint32_t compression, uint32_t numThreads)
 {
     int tiPhoto;
-    TIFF *tif=nullptr;
-    tdata_t buf=nullptr;
-    tsize_t strip_size, rowStride;
-    int32_t* buffer32s = NULL;
-    int32_t const* planes[4];
-    convert_32s_PXCX cvtPxToCx = NULL;
-    convert_32sXXx_C1R cvt32sToTif = NULL;
-	bool success = true;
 	int32_t firstAlpha = -1;
 
-    planes[0] = image->comps[0].data;
     uint32_t numcomps = image->numcomps;
 	size_t numAlphaChannels = 0;;
     if (image->color_space == OPJ_CLRSPC_CMYK) {
         if (numcomps < 4U) {
             fprintf(stderr,"imagetotif: CMYK images shall be composed of at least 4 planes.\n");
             fprintf(stderr,"\tAborting\n");
-            return 1;
+            return nullptr;
         }
         tiPhoto = PHOTOMETRIC_SEPARATED;
         if (numcomps > 4U) {
@@ -628,20 +793,9 @@ int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
 	uint32_t tif_bps = bps;
 	if (bps == 0) {
 		fprintf(stderr, "imagetotif: image precision is zero.\n");
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
 
-
-
-	//check for null image components
-	for (uint32_t i = 0; i < numcomps; ++i) {
-		auto comp = image->comps[i];
-		if (!comp.data) {
-			success = false;
-			goto cleanup;
-		}
-	}
 	uint32_t i;
     for (i = 1U; i < numcomps; ++i) {
         if (image->comps[0].dx != image->comps[i].dx) {
@@ -656,13 +810,11 @@ int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
         if (image->comps[0].sgnd != image->comps[i].sgnd) {
             break;
         }
-        planes[i] = image->comps[i].data;
     }
     if (i != numcomps) {
         fprintf(stderr,"imagetotif: All components shall have the same subsampling, same bit depth.\n");
         fprintf(stderr,"\tAborting\n");
-		success = false;
-		goto cleanup;
+		return nullptr;
     }
 
 
@@ -673,59 +825,58 @@ int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
 	{
 		fprintf(stderr, "imagetotif: Bits=%d, Only 1 to 16 bits implemented\n", bps);
 		fprintf(stderr, "\tAborting\n");
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
-    tif = TIFFOpen(outfile, "wb");
+	std::unique_ptr<TIFStripWriter> writer(new TIFStripWriter());
+    TIFF* tif = writer->tif = TIFFOpen(outfile, "wb");
     if (!tif) {
         fprintf(stderr, "imagetotif:failed to open %s for writing\n", outfile);
-		success = false;
-		goto cleanup;
+		return nullptr;
     }
-    for (i = 0U; i < numcomps; ++i) {
-        clip_component(&(image->comps[i]), image->comps[0].prec);
-    }
-    cvtPxToCx = convert_32s_PXCX_LUT[numcomps];
+	writer->numcomps = numcomps;
+	writer->prec = image->comps[0].prec;
+	writer->adjust = (int32_t)adjust;
+    writer->cvtPxToCx = convert_32s_PXCX_LUT[numcomps];
     switch (tif_bps) {
     case 1:
     case 2:
     case 4:
     case 6:
     case 8:
-        cvt32sToTif = convert_32sXXu_C1R_LUT[tif_bps];
+        writer->cvt32sToTif = convert_32sXXu_C1R_LUT[tif_bps];
         break;
 	case 3:
-		cvt32sToTif = tif_32sto3u;
+		writer->cvt32sToTif = tif_32sto3u;
 		break;
 	case 5:
-		cvt32sToTif = tif_32sto5u;
+		writer->cvt32sToTif = tif_32sto5u;
 		break;
 	case 7:
-		cvt32sToTif = tif_32sto7u;
+		writer->cvt32sToTif = tif_32sto7u;
 		break;
 	case 9:
-		cvt32sToTif = tif_32sto9u;
+		writer->cvt32sToTif = tif_32sto9u;
 		break;
     case 10:
-        cvt32sToTif = tif_32sto10u;
+        writer->cvt32sToTif = tif_32sto10u;
         break;
 	case 11:
-		cvt32sToTif = tif_32sto11u;
+		writer->cvt32sToTif = tif_32sto11u;
 		break;
     case 12:
-        cvt32sToTif = tif_32sto12u;
+        writer->cvt32sToTif = tif_32sto12u;
         break;
 	case 13:
-		cvt32sToTif = tif_32sto13u;
+		writer->cvt32sToTif = tif_32sto13u;
 		break;
     case 14:
-        cvt32sToTif = tif_32sto14u;
+        writer->cvt32sToTif = tif_32sto14u;
         break;
 	case 15:
-		cvt32sToTif = tif_32sto15u;
+		writer->cvt32sToTif = tif_32sto15u;
 		break;
     case 16:
-        cvt32sToTif = (convert_32sXXx_C1R)tif_32sto16u;
+        writer->cvt32sToTif = (convert_32sXXx_C1R)tif_32sto16u;
         break;
     default:
         /* never here */
@@ -740,10 +891,14 @@ int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
     TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
     TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
     TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, tiPhoto);
-    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    tsize_t rowStride = (width * numcomps * tif_bps + 7U) / 8U;
+    writer->rows_per_strip = (uint32_t)std::min<tsize_t>(std::max<tsize_t>(tif_target_strip_size / rowStride, 1), height);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, writer->rows_per_strip);
 	if (compression == COMPRESSION_ADOBE_DEFLATE) {
 #ifdef ZIP_SUPPORT
 		TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);  // zip compression
+		writer->deflate = true;
+		writer->swab16 = tif_bps == 16 && TIFFIsByteSwapped(tif);
 #endif
 	}
 
@@ -785,43 +940,26 @@ int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression)
 	
 
 
-    strip_size = TIFFStripSize(tif);
-    rowStride = (width * numcomps * tif_bps + 7U) / 8U;
-    if (rowStride != strip_size) {
+    if (rowStride * writer->rows_per_strip != TIFFStripSize(tif)) {
         fprintf(stderr, "Invalid TIFF strip size\n");
-		success = false;
-		goto cleanup;
-    }
-    buf = _TIFFmalloc(strip_size);
-    if (buf == NULL) {
-		success = false;
-		goto cleanup;
-    }
-    buffer32s = (int32_t *)malloc((size_t)width * numcomps * sizeof(int32_t));
-    if (buffer32s == NULL) {
-		success = false;
-		goto cleanup;
+		return nullptr;
     }
-
-    for (i = 0; i < image->comps[0].h; ++i) {
-        cvtPxToCx(planes, buffer32s, (size_t)width, adjust);
-        cvt32sToTif(buffer32s, (uint8_t *)buf, (size_t)width * numcomps);
-        (void)TIFFWriteEncodedStrip(tif, i, (void*)buf, strip_size);
-        planes[0] += width;
-        planes[1] += width;
-        planes[2] += width;
-        planes[3] += width;
-    }
-
-cleanup:
-	if (buf)
-		_TIFFfree((void*)buf);
-	if (tif)
-		TIFFClose(tif);
-	if (buffer32s)
-		free(buffer32s);
-
-    return success ? 0 : 1;
+	writer->width = width;
+	writer->row_stride = rowStride;
+	writer->numThreads = std::max<uint32_t>(numThreads, 1);
+	writer->strips_per_batch = writer->numThreads > 1 ? 4 * writer->numThreads : 1;
+	writer->batch.resize((size_t)writer->strips_per_batch * writer->rows_per_strip * rowStride);
+	writer->compressed.resize(writer->strips_per_batch);
+	writer->buffer32s.resize(writer->numThreads);
+	for (auto& buf : writer->buffer32s)
+		buf.resize((size_t)width * numcomps);
+
+	return writer.release();
+}/* tif_strip_writer_open() */
+
+int imagetotif(opj_image_t * image, const char *outfile, uint32_t compression, uint32_t numThreads)
+{
+	return write_image_strips(tif_strip_writer_open(image, outfile, compression, numThreads), image);
 }/* imagetotif() */
 
 
@@ -1341,38 +1479,218 @@ static void set_resolution(double* res, float resx, float resy, short resUnit) {
  * libtiff/tif_getimage.c : 1,2,4,8,16 bitspersample accepted
  * CINEMA                 : 12 bit precision
  */
-opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, bool applyICC)
+
+/* size of the decoded TIFF strips that the strip reader aims to hold at a time, when multi-threaded */
+const tsize_t tif_target_batch_size = 4 * 1024 * 1024;
+
+/**
+TIFF strip reader: rows are read in sequence from the TIFF strips that hold them,
+with the decoded TIFF strips of each plane held one batch of strips at a time,
+so that planar files can be read one band at a time.
+
+When multi-threaded, the strips of a batch are decoded in parallel, each worker
+reading the file through its own TIFF handle.
+*/
+class TIFStripReader : public StripReader {
+public:
+	TIFStripReader() : tif(nullptr),
+						image(nullptr),
+						num_planes(1),
+						strip_size(0),
+						rows_per_strip(0),
+						num_row_strips(0),
+						row_stride(0),
+						spp(0),
+						bps(0),
+						separate(false),
+						invert(false),
+						is_cinema(false),
+						row(0),
+						numThreads(1),
+						strips_per_batch(1),
+						batch_first(0),
+						batch_count(0),
+						cvtTifTo32s(nullptr),
+						cvtCxToPx(nullptr)
+	{}
+	~TIFStripReader() {
+		for (auto& strip : strips) {
+			if (strip.buf)
+				_TIFFfree(strip.buf);
+		}
+		for (auto handle : handles)
+			TIFFClose(handle);
+		if (tif)
+			TIFFClose(tif);
+		opj_image_destroy(image);
+	}
+	opj_image_t* header() override {
+		return image;
+	}
+	bool read(opj_image_t* strip) override;
+
+	/**
+	Gets a row of a plane, decoding the batch of TIFF strips that holds it if needed
+	*/
+	const uint8_t* get_row(uint32_t plane_index, uint32_t row_index);
+
+	/**
+	Decode the strips of all planes for the batch of row strips that starts at first_row_strip
+	*/
+	void read_batch(uint32_t first_row_strip);
+
+	/* decoded TIFF strip */
+	struct Strip {
+		Strip() : buf(nullptr), size(0) {}
+		tdata_t buf;
+		tsize_t size;
+	};
+
+	TIFF *tif;
+	std::string filename;
+	/* TIFF handles of the workers other than the calling thread */
+	std::vector<TIFF*> handles;
+	opj_image_t* image;
+	/* number of planes: a single plane holds all samples of contiguous files */
+	uint32_t num_planes;
+	/* decoded strips of the current batch, indexed by row strip in the batch, then by plane */
+	std::vector<Strip> strips;
+	std::vector<int32_t> buffer32s;
+	tsize_t strip_size;
+	uint32_t rows_per_strip;
+	uint32_t num_row_strips;
+	tsize_t row_stride;
+	/* samples per row pixel, and bits per sample, in the file */
+	uint32_t spp;
+	uint32_t bps;
+	bool separate;
+	bool invert;
+	bool is_cinema;
+	/* next row to read */
+	uint32_t row;
+	uint32_t numThreads;
+	uint32_t strips_per_batch;
+	/* row strips of the current batch */
+	uint32_t batch_first;
+	uint32_t batch_count;
+	convert_XXx32s_C1R cvtTifTo32s;
+	convert_32s_CXPX cvtCxToPx;
+};
+
+void TIFStripReader::read_batch(uint32_t first_row_strip)
+{
+	uint32_t count = std::min<uint32_t>(strips_per_batch, num_row_strips - first_row_strip);
+	uint32_t num_jobs = count * num_planes;
+	uint32_t num_workers = std::min<uint32_t>(numThreads, num_jobs);
+	while (handles.size() + 1 < num_workers) {
+		TIFF* handle = TIFFOpen(filename.c_str(), "r");
+		if (!handle)
+			break;
+		handles.push_back(handle);
+	}
+	num_workers = std::min<uint32_t>(num_workers, (uint32_t)handles.size() + 1);
+	opj_run_parallel(num_jobs, num_workers, [&](uint32_t worker, uint32_t job) {
+		TIFF* handle = worker ? handles[worker - 1] : tif;
+		uint32_t row_strip = first_row_strip + job / num_planes;
+		auto strip = &strips[job];
+		if (!strip->buf)
+			strip->buf = _TIFFmalloc(strip_size);
+		strip->size = -1;
+		if (strip->buf) {
+			tstrip_t index = TIFFComputeStrip(handle, row_strip * rows_per_strip,
+												(tsample_t)(separate ? job % num_planes : 0));
+			strip->size = TIFFReadEncodedStrip(handle, index, strip->buf, strip_size);
+		}
+	});
+	batch_first = first_row_strip;
+	batch_count = count;
+}
+
+const uint8_t* TIFStripReader::get_row(uint32_t plane_index, uint32_t row_index)
+{
+	uint32_t row_strip = row_index / rows_per_strip;
+	if (row_strip < batch_first || row_strip >= batch_first + batch_count)
+		read_batch(row_strip);
+	auto strip = &strips[(row_strip - batch_first) * num_planes + plane_index];
+	if (strip->size < 1 || strip->size > strip_size) {
+		if (!strip->buf)
+			return nullptr;
+		fprintf(stderr, "tiftoimage: Bad value for ssize(%lld) "
+			"vs. strip_size(%lld).\n\tAborting.\n", (long long)strip->size, (long long)strip_size);
+		return nullptr;
+	}
+	tsize_t offset = (tsize_t)(row_index % rows_per_strip) * row_stride;
+	if (offset + row_stride > strip->size) {
+		fprintf(stderr, "tiftoimage: row %u is missing from strip %u.\n\tAborting.\n", row_index,
+			TIFFComputeStrip(tif, row_index, (tsample_t)(separate ? plane_index : 0)));
+		return nullptr;
+	}
+	return (const uint8_t*)strip->buf + offset;
+}
+
+bool TIFStripReader::read(opj_image_t* strip)
+{
+	uint32_t numcomps = image->numcomps;
+	uint32_t w = image->comps[0].w;
+	uint32_t h = strip->comps[0].h;
+	int32_t* comp_planes[4];
+	for (uint32_t compno = 0; compno < numcomps; compno++) {
+		auto comp = strip->comps + compno;
+		if (comp->w != w || comp->h != h || row + h > image->comps[0].h || (h && !comp->data)) {
+			fprintf(stderr, "[ERROR] strip does not match the dimensions of component %u\n", compno);
+			return false;
+		}
+		comp_planes[compno] = comp->data;
+	}
+	for (uint32_t y = 0; y < h; ++y, ++row) {
+		if (separate) {
+			for (uint32_t compno = 0; compno < numcomps; compno++) {
+				auto dat8 = get_row(compno, row);
+				if (!dat8)
+					return false;
+				cvtTifTo32s(dat8, comp_planes[compno], (size_t)w, invert);
+			}
+		}
+		else {
+			auto dat8 = get_row(0, row);
+			if (!dat8)
+				return false;
+			cvtTifTo32s(dat8, buffer32s.data(), (size_t)w * spp, invert);
+			cvtCxToPx(buffer32s.data(), comp_planes, (size_t)w);
+		}
+		for (uint32_t compno = 0; compno < numcomps; compno++)
+			comp_planes[compno] += w;
+	}
+	if (is_cinema) {
+		for (uint32_t compno = 0; compno < numcomps; ++compno) {
+			strip->comps[compno].prec = bps;
+			scale_component(strip->comps + compno, 12);
+		}
+	}
+	return true;
+}
+
+StripReader* tif_strip_reader_open(const char *filename, opj_cparameters_t *parameters)
 {
     uint32_t subsampling_dx = parameters->subsampling_dx;
 	uint32_t subsampling_dy = parameters->subsampling_dy;
-    TIFF *tif;
-    tdata_t buf = NULL;
-    tstrip_t strip;
-    tsize_t strip_size;
     OPJ_COLOR_SPACE color_space = OPJ_CLRSPC_UNKNOWN;
     opj_image_cmptparm_t cmptparm[4]; /* RGBA */
-    opj_image_t *image = NULL;
 	uint32_t numAlphaChannels = 0;
 	unsigned short tiBps=0, tiPhoto=0, tiSf=0, tiSpp=0, tiPC=0;
 	short tiResUnit=0;
 	float tiXRes=0, tiYRes=0;
-    uint32_t tiWidth=0, tiHeight=0;
+    uint32_t tiWidth=0, tiHeight=0, tiRowsPerStrip=0;
     bool is_cinema = OPJ_IS_CINEMA(parameters->rsiz);
-    convert_XXx32s_C1R cvtTifTo32s = NULL;
-    convert_32s_CXPX cvtCxToPx = NULL;
-    int32_t* buffer32s = NULL;
-    int32_t* planes[4];
-	tsize_t rowStride;
-	bool success = true;
+	std::unique_ptr<TIFStripReader> reader(new TIFStripReader());
 
-    tif = TIFFOpen(filename, "r");
+    TIFF* tif = TIFFOpen(filename, "r");
 
     if(!tif) {
         fprintf(stderr, "tiftoimage:Failed to open %s for reading\n", filename);
-        return 0;
+        return nullptr;
     }
-    tiBps = tiPhoto = tiSf = tiSpp = tiPC = 0;
-    tiWidth = tiHeight = 0;
+	reader->tif = tif;
 
     TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &tiWidth);
     TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &tiHeight);
@@ -1381,16 +1699,16 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
     TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &tiSpp);
     TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &tiPhoto);
     TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &tiPC);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &tiRowsPerStrip);
 
 	uint32_t w = tiWidth;
 	uint32_t h = tiHeight;
-	bool invert = tiPhoto == PHOTOMETRIC_MINISWHITE;
 	uint32_t numcomps = 0;
-	uint32_t currentPlane = 0;
 	uint32_t icclen = 0;
 	uint8_t* iccbuf = nullptr;
 	uint16* sampleinfo=nullptr;
 	uint16 extrasamples = 0;
+	reader->invert = tiPhoto == PHOTOMETRIC_MINISWHITE;
 
 
 	// if write_capture_resolution is enabled but capture_resolution equals 0,0, then
@@ -1421,32 +1739,26 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
 	if (tiSpp == 0 || tiSpp > 4) { /* should be 1 ... 4 */
 		fprintf(stderr, "tiftoimage: Bad value for samples per pixel == %hu.\n"
 			 "\tAborting.\n", tiSpp);
-		success = false;
-		goto cleanup;
-		
+		return nullptr;
 	}
 	if (tiBps > 16U || tiBps == 0) {
 		fprintf(stderr, "tiftoimage: Bad values for Bits == %d.\n"
 			 "\tMax. 16 Bits are allowed here.\n\tAborting.\n", tiBps);
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
 	
 	if (tiPhoto != PHOTOMETRIC_MINISBLACK && tiPhoto != PHOTOMETRIC_MINISWHITE &&  tiPhoto != PHOTOMETRIC_RGB) {
 		fprintf(stderr, "tiftoimage: Bad color format %d.\n"
 			 "\tOnly RGB(A) and GRAY(A) has been implemented\n", (int)tiPhoto);
 		fprintf(stderr, "\tAborting\n");
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
 
 	
 	if (tiWidth == 0 || tiHeight == 0) {
 		fprintf(stderr, "tiftoimage: Bad values for width(%u) "
 			 "and/or height(%u)\n\tAborting.\n", tiWidth, tiHeight);
-		success = false;
-		goto cleanup;
-
+		return nullptr;
 	}
 
 
@@ -1456,41 +1768,41 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
     case 4:
     case 6:
     case 8:
-        cvtTifTo32s = convert_XXu32s_C1R_LUT[tiBps];
+        reader->cvtTifTo32s = convert_XXu32s_C1R_LUT[tiBps];
         break;
     /* others are specific to TIFF */
 	case 3:
-		cvtTifTo32s = tif_3uto32s;
+		reader->cvtTifTo32s = tif_3uto32s;
 		break;
 	case 5:
-		cvtTifTo32s = tif_5uto32s;
+		reader->cvtTifTo32s = tif_5uto32s;
 		break;
 	case 7:
-		cvtTifTo32s = tif_7uto32s;
+		reader->cvtTifTo32s = tif_7uto32s;
 		break;
 	case 9:
-		cvtTifTo32s = tif_9uto32s;
+		reader->cvtTifTo32s = tif_9uto32s;
 		break;
     case 10:
-        cvtTifTo32s = tif_10uto32s;
+        reader->cvtTifTo32s = tif_10uto32s;
         break;
 	case 11:
-		cvtTifTo32s = tif_11uto32s;
+		reader->cvtTifTo32s = tif_11uto32s;
 		break;
     case 12:
-        cvtTifTo32s = tif_12uto32s;
+        reader->cvtTifTo32s = tif_12uto32s;
         break;
 	case 13:
-		cvtTifTo32s = tif_13uto32s;
+		reader->cvtTifTo32s = tif_13uto32s;
 		break;
     case 14:
-        cvtTifTo32s = tif_14uto32s;
+        reader->cvtTifTo32s = tif_14uto32s;
         break;
 	case 15:
-		cvtTifTo32s = tif_15uto32s;
+		reader->cvtTifTo32s = tif_15uto32s;
 		break;
     case 16:
-        cvtTifTo32s = (convert_XXx32s_C1R)tif_16uto32s;
+        reader->cvtTifTo32s = (convert_XXx32s_C1R)tif_16uto32s;
         break;
     default:
         /* never here */
@@ -1539,25 +1851,27 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
         color_space = OPJ_CLRSPC_GRAY;
     }
 
-    cvtCxToPx = convert_32s_CXPX_LUT[numcomps];
+    reader->cvtCxToPx = convert_32s_CXPX_LUT[numcomps];
     if (tiPC == PLANARCONFIG_SEPARATE) {
-        cvtCxToPx = convert_32s_CXPX_LUT[1]; /* override */
+        reader->separate = true;
         tiSpp = 1U; /* consider only one sample per plane */
     }
+	reader->spp = tiSpp;
+	reader->bps = tiBps;
+	reader->is_cinema = is_cinema;
 
     for(uint32_t j = 0; j < numcomps; j++) {
-        cmptparm[j].prec = tiBps;
+        cmptparm[j].prec = is_cinema ? 12 : tiBps;
         cmptparm[j].dx = subsampling_dx;
         cmptparm[j].dy = subsampling_dy;
         cmptparm[j].w = w;
         cmptparm[j].h = h;
     }
 
-    image = opj_image_create(numcomps, &cmptparm[0], color_space);
-    if(!image) {
-		success = false;
-		goto cleanup;
-    }
+    reader->image = opj_image_tile_create(numcomps, &cmptparm[0], color_space);
+    if(!reader->image)
+		return nullptr;
+	opj_image_t* image = reader->image;
     /* set image offset and reference grid */
     image->x0 = parameters->image_offset_x0;
 	image->x1 = !image->x0 ? (w - 1) * subsampling_dx + 1 :
@@ -1565,8 +1879,7 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
 	if (image->x1 <= image->x0) {
 		fprintf(stderr, "tiftoimage: Bad value for image->x1(%d) vs. "
 			"image->x0(%d)\n\tAborting.\n", image->x1, image->x0);
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
 
 	image->y0 = parameters->image_offset_y0;
@@ -1576,12 +1889,10 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
 	if (image->y1 <= image->y0) {
 		fprintf(stderr, "tiftoimage: Bad value for image->y1(%d) vs. "
 			 "image->y0(%d)\n\tAborting.\n", image->y1, image->y0);
-		success = false;
-		goto cleanup;
+		return nullptr;
 	}
 
     for(uint32_t j = 0; j < numcomps; j++) {
-        planes[j] = image->comps[j].data;
 		//only support single alpha channel when reading in from TIFF
 		if ( (j == numcomps - 1) && (numAlphaChannels > 0)) {
 			if (sampleinfo && sampleinfo[0] == EXTRASAMPLE_ASSOCALPHA)
@@ -1598,92 +1909,47 @@ opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, boo
 															icclen < 1000000000) {
 		image->icc_profile_len = icclen;
 		image->icc_profile_buf = (uint8_t*)malloc(icclen);
-		if (!image->icc_profile_buf) {
-			success = false;
-			goto cleanup;
-		}
+		if (!image->icc_profile_buf)
+			return nullptr;
 		memcpy(image->icc_profile_buf, iccbuf, icclen);
-#if defined(OPJ_HAVE_LIBLCMS)
-		if (applyICC) {
-			if (image->icc_profile_len) {
-				color_apply_icc_profile(image, false);
-			}
-			else {
-				color_cielab_to_rgb(image);
-			}
-			free(image->icc_profile_buf);
-			image->icc_profile_buf = NULL;
-			image->icc_profile_len = 0;
-		}
-#endif
 	}
 
-    strip_size = TIFFStripSize(tif);
-    buf = _TIFFmalloc(strip_size);
-    if (buf == NULL) {
-		success = false;
-		goto cleanup;
-    }
-    rowStride = (w * tiSpp * tiBps + 7U) / 8U;
-    buffer32s = (int32_t *)malloc((size_t)w * tiSpp * sizeof(int32_t));
-    if (buffer32s == NULL) {
-		success = false;
-		goto cleanup;
-    }
+    reader->strip_size = TIFFStripSize(tif);
+    reader->rows_per_strip = std::min(std::max(tiRowsPerStrip, 1U), h);
+    reader->row_stride = (w * tiSpp * tiBps + 7U) / 8U;
+    reader->num_row_strips = (h + reader->rows_per_strip - 1) / reader->rows_per_strip;
+    reader->num_planes = reader->separate ? numcomps : 1;
+	reader->numThreads = std::max<uint32_t>(parameters->numThreads, 1);
+	if (reader->numThreads > 1 && reader->strip_size > 0) {
+		reader->strips_per_batch = std::min<uint32_t>(reader->num_row_strips,
+			std::max<uint32_t>(reader->numThreads, (uint32_t)(tif_target_batch_size / reader->strip_size)));
+		reader->filename = filename;
+	}
+	reader->strips.resize((size_t)reader->strips_per_batch * reader->num_planes);
+    if (!reader->separate)
+        reader->buffer32s.resize((size_t)w * tiSpp);
 
-    strip = 0;
-    do {
-        planes[0] = image->comps[currentPlane].data; /* to manage planar data */
-        h= (int)tiHeight;
-        /* Read the Image components */
-        for(; (h > 0) && (strip < TIFFNumberOfStrips(tif)); strip++) {
-            const uint8_t *dat8;
-			tsize_t ssize=0;
-
-            ssize = TIFFReadEncodedStrip(tif, strip, buf, strip_size);
-			if (ssize < 1 || ssize > strip_size) {
-				fprintf(stderr, "tiftoimage: Bad value for ssize(%lld) "
-					 "vs. strip_size(%lld).\n\tAborting.\n", (long long)ssize, (long long)strip_size);
-				success = false;
-				goto cleanup;
-			}
-            dat8 = (const uint8_t*)buf;
-
-            while (ssize >= rowStride) {
-                cvtTifTo32s(dat8, buffer32s, (size_t)w * tiSpp, invert);
-                cvtCxToPx(buffer32s, planes, (size_t)w);
-                planes[0] += w;
-                planes[1] += w;
-                planes[2] += w;
-                planes[3] += w;
-                dat8  += rowStride;
-                ssize -= rowStride;
-                h--;
-            }
-        }
-        currentPlane++;
-    } while ((tiPC == PLANARCONFIG_SEPARATE) && (currentPlane < numcomps));
-
-cleanup:
-	if (buffer32s)
-		free(buffer32s);
-	if (buf)
-		_TIFFfree(buf);
-	if (tif)
-		TIFFClose(tif);
+	return reader.release();
+}/* tif_strip_reader_open() */
 
-	if (success) {
-		if (is_cinema) {
-			for (uint32_t j = 0; j < numcomps; ++j) {
-				scale_component(&(image->comps[j]), 12);
-			}
+opj_image_t* tiftoimage(const char *filename, opj_cparameters_t *parameters, bool applyICC)
+{
+	opj_image_t* image = read_image_strips(tif_strip_reader_open(filename, parameters));
+#if defined(OPJ_HAVE_LIBLCMS)
+	if (image && applyICC && image->icc_profile_buf) {
+		if (image->icc_profile_len) {
+			color_apply_icc_profile(image, false, parameters->numThreads);
 		}
-		return image;
+		else {
+			color_cielab_to_rgb(image, parameters->numThreads);
+		}
+		free(image->icc_profile_buf);
+		image->icc_profile_buf = NULL;
+		image->icc_profile_len = 0;
 	}
-
-	if (image)
-		opj_image_destroy(image);
-	return NULL;
-
+#else
+	(void)applyICC;
+#endif
+	return image;
 }/* tiftoimage() */
 
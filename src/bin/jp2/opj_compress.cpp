@@ -127,6 +127,9 @@ typedef struct img_folder {
 } img_fol_t;
 
 static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* info);
+static bool can_read_strips(opj_cparameters_t* parameters);
+static StripReader* open_strip_reader(opj_cparameters_t* parameters, const char* input_file_name);
+static bool read_strip(opj_image_t* strip, uint32_t strip_index, void* user_data);
 
 static void encode_help_display(void)
 {
@@ -206,10 +209,16 @@ static void encode_help_display(void)
     fprintf(stdout,"    Different psnr for successive layers (-q 30,40,50).\n");
     fprintf(stdout,"    Increasing PSNR values required.\n");
     fprintf(stdout,"    Options -r and -q cannot be used together.\n");
-	fprintf(stdout, "[-A|-RateControlAlgorithm] <0|1>\n");
+	fprintf(stdout, "[-A|-RateControlAlgorithm] <0|1|2>\n");
 	fprintf(stdout, "    Select algorithm used for rate control\n");
 	fprintf(stdout, "    0: Bisection search for optimal threshold using all code passes in code blocks. (default) (slightly higher PSRN than algorithm 1)\n");
 	fprintf(stdout, "    1: Bisection search for optimal threshold using only feasible truncation points, on convex hull.\n");
+	fprintf(stdout, "    2: Threshold search over a table of feasible truncation points sorted by slope, with one packet simulation per layer.\n");
+	fprintf(stdout, "       Much faster than algorithm 1 when there are many layers or code blocks.\n");
+	fprintf(stdout, "[-B|-EarlyTermination]\n");
+	fprintf(stdout, "    Stop coding each code block once its coding passes fall below the estimated\n");
+	fprintf(stdout, "    rate threshold of the last layer. Speeds up high compression ratio encodes, at a small PSNR cost.\n");
+	fprintf(stdout, "    Only used with -r, when the last layer is not lossless.\n");
     fprintf(stdout,"[-n|-Resolutions] <number of resolutions>\n");
     fprintf(stdout,"    Number of resolutions.\n");
     fprintf(stdout,"    It corresponds to the number of DWT decompositions +1. \n");
@@ -624,6 +633,9 @@ static int parse_cmdline_encoder_ex(int argc,
 			"Rate control algorithm",
 			false, 0, "unsigned integer", cmd);
 
+		SwitchArg earlyTerminationArg("B", "EarlyTermination",
+			"Early termination of T1 coding passes", cmd);
+
 		cmd.parse(argc, argv);
 
 		img_fol->set_out_format = 0;
@@ -641,6 +653,10 @@ static int parse_cmdline_encoder_ex(int argc,
 			parameters->rateControlAlgorithm = rateControlAlgoArg.getValue();
 		}
 
+		if (earlyTerminationArg.isSet()) {
+			parameters->earlyTermination = true;
+		}
+
 		if (numThreadsArg.isSet()) {
 			parameters->numThreads = numThreadsArg.getValue();
 		}
@@ -1497,6 +1513,56 @@ cleanup:
 
 img_fol_t img_fol_plugin, out_fol_plugin;
 
+/**
+Check whether the input image can be streamed into the encoder one row of tiles at a time:
+that only pays off for tiled encodes, and the input format must be one that
+can be read a band of rows at a time.
+*/
+static bool can_read_strips(opj_cparameters_t* parameters) {
+	if (!parameters->tile_size_on)
+		return false;
+	switch (parameters->decod_format) {
+	case PXM_DFMT:
+#ifdef OPJ_HAVE_LIBTIFF
+	case TIF_DFMT:
+#endif /* OPJ_HAVE_LIBTIFF */
+	case RAW_DFMT:
+	case RAWL_DFMT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+Open a strip reader on the input file
+@return the reader, or NULL if the file can't be read
+*/
+static StripReader* open_strip_reader(opj_cparameters_t* parameters, const char* input_file_name) {
+	switch (parameters->decod_format) {
+	case PXM_DFMT:
+		return pnm_strip_reader_open(input_file_name, parameters);
+#ifdef OPJ_HAVE_LIBTIFF
+	case TIF_DFMT:
+		return tif_strip_reader_open(input_file_name, parameters);
+#endif /* OPJ_HAVE_LIBTIFF */
+	case RAW_DFMT:
+		return raw_strip_reader_open(input_file_name, parameters, true);
+	case RAWL_DFMT:
+		return raw_strip_reader_open(input_file_name, parameters, false);
+	default:
+		return nullptr;
+	}
+}
+
+/**
+Strip callback for opj_encode_strips: fills the strip from the strip reader
+*/
+static bool read_strip(opj_image_t* strip, uint32_t strip_index, void* user_data) {
+	(void)strip_index;
+	return ((StripReader*)user_data)->read(strip);
+}
+
 static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* info) {
 	opj_cparameters_t* parameters = info->encoder_parameters;
 	bool bSuccess;
@@ -1531,6 +1597,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 	}
 
 	bool createdImage = false;
+	StripReader* reader = nullptr;
 	if (!image) {
 
 		parameters->decod_format = get_file_format((char*)info->input_file_name);
@@ -1551,10 +1618,18 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			return false;
 		}
 
-		/* decode the source image */
-		/* ----------------------- */
+		/* stream the source image into the encoder if possible, otherwise decode it */
+		/* -------------------------------------------------------------------------- */
 
-		switch (info->encoder_parameters->decod_format) {
+		if (!info->tile && can_read_strips(parameters)) {
+			reader = open_strip_reader(parameters, info->input_file_name);
+			if (!reader) {
+				fprintf(stderr, "Unable to load file\n");
+				return false;
+			}
+			image = reader->header();
+		}
+		else switch (info->encoder_parameters->decod_format) {
 		case PGX_DFMT:
 			image = pgxtoimage(info->input_file_name, info->encoder_parameters);
 			if (!image) {
@@ -1631,7 +1706,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			fprintf(stderr, "Unable to load file: no image generated.\n");
 			return false;
 		}
-		createdImage = true;
+		createdImage = !reader;
 	}
 
 	/* Decide if MCT should be used */
@@ -1642,11 +1717,13 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 		if ((parameters->tcp_mct == 1) && (image->numcomps < 3)) {
 			fprintf(stderr, "RGB->YCC conversion cannot be used:\n");
 			fprintf(stderr, "Input image has less than 3 components\n");
+			delete reader;
 			return false;
 		}
 		if ((parameters->tcp_mct == 2) && (!parameters->mct_data)) {
 			fprintf(stderr, "Custom MCT has been set but no array-based MCT\n");
 			fprintf(stderr, "has been provided. Aborting.\n");
+			delete reader;
 			return false;
 		}
 	}
@@ -1677,6 +1754,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 		fprintf(stderr, "skipping file..\n");
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 
@@ -1691,6 +1769,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			opj_destroy_codec(l_codec);
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 
@@ -1708,6 +1787,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			opj_destroy_codec(l_codec);
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 
@@ -1721,6 +1801,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			opj_destroy_codec(l_codec);
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 	if (bSuccess && bUseTiles) {
@@ -1737,13 +1818,17 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 					opj_destroy_codec(l_codec);
 				if (createdImage)
 					opj_image_destroy(image);
+				delete reader;
 				return false;
 			}
 		}
 		free(l_data);
 	}
 	else {
-		bSuccess = bSuccess && opj_encode_with_plugin(l_codec, info->tile, l_stream);
+		if (reader)
+			bSuccess = bSuccess && opj_encode_strips(l_codec, l_stream, read_strip, reader);
+		else
+			bSuccess = bSuccess && opj_encode_with_plugin(l_codec, info->tile, l_stream);
 		if (!bSuccess) {
 			fprintf(stderr, "failed to encode image: opj_encode\n");
 			if (l_stream)
@@ -1752,6 +1837,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 				opj_destroy_codec(l_codec);
 			if (createdImage)
 				opj_image_destroy(image);
+			delete reader;
 			return false;
 		}
 	}
@@ -1766,6 +1852,7 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 			opj_destroy_codec(l_codec);
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 
@@ -1784,11 +1871,13 @@ static bool plugin_compress_callback(opj_plugin_encode_user_callback_info_t* inf
 		remove(parameters->outfile);
 		if (createdImage)
 			opj_image_destroy(image);
+		delete reader;
 		return false;
 	}
 
 	if (createdImage)
 		opj_image_destroy(image);
+	delete reader;
 	return true;
 }
 
@@ -92,6 +92,16 @@ extern "C" {
 
 #define TCLAP_NAMESTARTSTRING "-"
 #include "tclap/CmdLine.h"
+#include "opj_parallel.h"
+
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace TCLAP;
 using namespace std;
@@ -113,6 +123,8 @@ typedef struct img_folder {
     char set_imgdir;
     /** Enable Cod Format for output*/
     char set_out_format;
+    /** Number of images decoded concurrently */
+    uint32_t num_jobs;
 
 } img_fol_t;
 
@@ -169,12 +181,24 @@ static void decode_help_display(void)
 		"    Path to T1 plugin.\n");
 	fprintf(stdout, "  [-H | -NumThreads] <number of threads>\n"
 		"    Number of threads used by T1 decode.\n");
+	fprintf(stdout, "  [-J | -BatchJobs] <number of images>\n"
+		"    Number of images decoded concurrently when -ImgDir is used. 0 uses one\n"
+		"    image per hardware thread. Unless -NumThreads is also set, each image is\n"
+		"    then decoded on a single thread. Files are read ahead, and decoded images\n"
+		"    written out, on other threads, while the next images decode. Default: 1.\n");
 	fprintf(stdout, "  [-c|-Compression] <compression>\n"
 		"    Compress output image data.Currently, this flag is only applicable when output format is set to `TIF`,\n"
 		"    and the only currently supported value is 8, corresponding to COMPRESSION_ADOBE_DEFLATE i.e.zip compression.\n"
 		"    The `zlib` library must be available for this compression setting.Default: 0 - no compression.\n");
 	fprintf(stdout, "   [L|-CompressionLevel] <compression level>\n"
-		"    \"Quality\" of compression. Currently only implemented for PNG format. Default - Z_BEST_COMPRESSION\n");
+		"    \"Quality\" of compression, from 0 to 9. Currently only implemented for PNG format.\n"
+		"    Overrides the level of -CompressionPreset. Default - 6\n");
+	fprintf(stdout, "  [-P | -CompressionPreset] <fast|default|small>\n"
+		"    PNG compression preset: fast (level 1, single row filter), default (level 6)\n"
+		"    or small (level 9). Rows are filtered and deflated in parallel with -NumThreads.\n");
+	fprintf(stdout, "  [-F | -FileStream]\n"
+		"    Read the input file with buffered file I/O. By default, the file is memory\n"
+		"    mapped and tile data is decoded in place, without being copied.\n");
 	fprintf(stdout, "  [-t | -TileIndex] <tile index>\n"
 		"    Index of tile to be decoded\n");
 	fprintf(stdout, "  [-d | -DecodeRegion] <x0,y0,x1,y1>\n"
@@ -525,6 +549,8 @@ int parse_cmdline_decoder(int argc,
 								"Upsample", cmd);
 		SwitchArg splitPnmArg("s", "split-pnm",
 								"Split PNM", cmd);
+		SwitchArg fileStreamArg("F", "FileStream",
+								"Read input with buffered file I/O instead of memory mapping it", cmd);
 
 		ValueArg<string> pluginPathArg("g", "PluginPath",
 										"Plugin path", 
@@ -532,6 +558,9 @@ int parse_cmdline_decoder(int argc,
 		ValueArg<uint32_t> numThreadsArg("H", "NumThreads", 
 										"Number of threads",
 										false, 8, "unsigned integer",cmd);
+		ValueArg<uint32_t> batchJobsArg("J", "BatchJobs",
+										"Number of images decoded concurrently",
+										false, 1, "unsigned integer", cmd);
 		ValueArg<string> inputFileArg("i", "InputFile", 
 										"Input file", 
 										false, "", "string",cmd);
@@ -559,6 +588,9 @@ int parse_cmdline_decoder(int argc,
 		ValueArg<int32_t> compressionLevelArg("L", "CompressionLevel",
 											"Compression Level",
 											false, -65535, "int", cmd);
+		ValueArg<string> compressionPresetArg("P", "CompressionPreset",
+											"Compression Preset",
+											false, "", "string", cmd);
 		ValueArg<uint32_t> durationArg("z", "Duration",
 			"Duration in seconds",
 			false, 0, "unsigned integer", cmd);
@@ -591,10 +623,26 @@ int parse_cmdline_decoder(int argc,
 		if (splitPnmArg.isSet()) {
 			parameters->split_pnm = true;
 		}
+		if (fileStreamArg.isSet()) {
+			parameters->file_stream = true;
+		}
 
 		if (compressionArg.isSet()) {
 			parameters->compression = compressionArg.getValue();
 		}
+		if (compressionPresetArg.isSet()) {
+			auto preset = compressionPresetArg.getValue();
+			if (preset == "fast")
+				parameters->compressionLevel = PNG_COMPRESSION_FAST;
+			else if (preset == "default")
+				parameters->compressionLevel = PNG_COMPRESSION_DEFAULT;
+			else if (preset == "small")
+				parameters->compressionLevel = PNG_COMPRESSION_SMALL;
+			else {
+				fprintf(stderr, "[ERROR] Unknown compression preset %s: expected fast, default or small\n", preset.c_str());
+				return 1;
+			}
+		}
 		if (compressionLevelArg.isSet()) {
 			parameters->compressionLevel = compressionLevelArg.getValue();
 		}
@@ -725,6 +773,15 @@ int parse_cmdline_decoder(int argc,
 		if (numThreadsArg.isSet()) {
 			parameters->core.numThreads = numThreadsArg.getValue();
 		}
+		img_fol->num_jobs = 1;
+		if (batchJobsArg.isSet()) {
+			img_fol->num_jobs = batchJobsArg.getValue();
+			if (img_fol->num_jobs == 0)
+				img_fol->num_jobs = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+			// with many images in flight, threads within an image only add overhead
+			if (img_fol->num_jobs > 1 && !numThreadsArg.isSet())
+				parameters->core.numThreads = 1;
+		}
 
 		if (decodeRegionArg.isSet()) {
 			size_t size_optarg = (size_t)strlen(decodeRegionArg.getValue().c_str()) + 1U;
@@ -1187,6 +1244,7 @@ struct DecompressInitParams {
 static int plugin_pre_decode_callback(opj_plugin_decode_callback_info_t* info);
 static int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info);
 static int plugin_main(int argc, char **argv, DecompressInitParams* initParams);
+static int decode_batch(DecompressInitParams* initParams, dircnt_t* dirptr, int32_t num_images);
 
 
 int main(int argc, char **argv)
@@ -1255,6 +1313,13 @@ int main(int argc, char **argv)
         num_images=1;
     }
 
+    if (initParams.img_fol.set_imgdir == 1 && initParams.img_fol.num_jobs > 1) {
+        int batch_rc = decode_batch(&initParams, dirptr, num_images);
+        destroy_parameters(&initParams.parameters);
+        opj_cleanup();
+        return batch_rc;
+    }
+
     t_cumulative = opj_clock();
 
     /*Decoding image one by one*/
@@ -1293,6 +1358,163 @@ int main(int argc, char **argv)
 }
 
 
+/*
+Only part of the file is read for a tile or region decode
+*/
+static bool is_random_access(opj_decompress_parameters* parameters)
+{
+	return parameters->nb_tile_to_decode ||
+			parameters->DA_x1 > parameters->DA_x0 ||
+			parameters->DA_y1 > parameters->DA_y0;
+}
+
+/*
+Read a whole file into memory
+*/
+static bool read_file(const char* filename, std::vector<uint8_t>& data)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (!fp)
+		return false;
+	bool rc = false;
+	if (fseek(fp, 0, SEEK_END) == 0) {
+		long length = ftell(fp);
+		if (length > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+			data.resize((size_t)length);
+			rc = fread(data.data(), 1, data.size(), fp) == data.size();
+		}
+	}
+	fclose(fp);
+	if (!rc)
+		data.clear();
+	return rc;
+}
+
+/* an image of a batch decode, handed from stage to stage */
+struct BatchImage {
+	opj_decompress_parameters parameters;
+	/* compressed file, read by the reader stage; empty if the decode stage opens the file */
+	std::vector<uint8_t> data;
+	uint64_t file_size;
+	opj_plugin_decode_callback_info_t info;
+};
+
+/*
+Decode all images of the input directory, as a pipeline of three stages joined by
+bounded queues, so that the reading, decoding and writing of different images overlap:
+a reader thread reads each compressed file into memory, num_jobs decoders decode
+the images, and num_jobs writers convert and store them. Tile and region decodes, which
+only read part of the file, and -F, are left to the decoders to read.
+Images written strip by strip are decoded straight into the output file, so the
+decoders store them too.
+A summary of throughput and failures is printed at the end.
+*/
+static int decode_batch(DecompressInitParams* initParams, dircnt_t* dirptr, int32_t num_images)
+{
+	uint32_t num_jobs = std::min<uint32_t>(initParams->img_fol.num_jobs, (uint32_t)num_images);
+	/* one image read ahead for each decoder, and one decoded image waiting for each writer */
+	BoundedQueue<std::unique_ptr<BatchImage> > to_decode(num_jobs);
+	BoundedQueue<std::unique_ptr<BatchImage> > to_write(num_jobs);
+	/* guards the summary below */
+	std::mutex mutex;
+	uint32_t num_decoded = 0, num_skipped = 0;
+	uint64_t bytes_decoded = 0;
+	std::vector<std::string> failures;
+
+	auto done = [&](BatchImage* img, bool success) {
+		std::lock_guard<std::mutex> lk(mutex);
+		if (success) {
+			num_decoded++;
+			bytes_decoded += img->file_size;
+		}
+		else {
+			failures.push_back(img->parameters.infile);
+		}
+	};
+
+	auto reader = [&]() {
+		for (int32_t imageno = 0; imageno < num_images; ++imageno) {
+			std::unique_ptr<BatchImage> img(new BatchImage());
+			img->parameters = initParams->parameters;
+			if (get_next_file(imageno, dirptr, &initParams->img_fol, initParams->out_fol.set_imgdir ? &initParams->out_fol : &initParams->img_fol, &img->parameters)) {
+				fprintf(stderr, "skipping file...\n");
+				std::lock_guard<std::mutex> lk(mutex);
+				num_skipped++;
+				continue;
+			}
+			struct stat st;
+			img->file_size = stat(img->parameters.infile, &st) == 0 ? (uint64_t)st.st_size : 0;
+			/* on failure, the decoder opens the file, and reports the error */
+			if (!img->parameters.file_stream && !is_random_access(&img->parameters))
+				read_file(img->parameters.infile, img->data);
+			if (!to_decode.push(std::move(img)))
+				break;
+		}
+		to_decode.close();
+	};
+
+	auto decoder = [&]() {
+		std::unique_ptr<BatchImage> img;
+		while (to_decode.pop(img)) {
+			memset(&img->info, 0, sizeof(opj_plugin_decode_callback_info_t));
+			img->info.decoder_parameters = &img->parameters;
+			if (!img->data.empty())
+				img->info.l_stream = opj_stream_create_buffer_stream(img->data.data(), img->data.size(), true);
+			if (plugin_pre_decode_callback(&img->info)) {
+				done(img.get(), false);
+				continue;
+			}
+			/* left to decode strip by strip, straight to the output file */
+			if (img->info.l_codec) {
+				done(img.get(), !plugin_post_decode_callback(&img->info));
+				continue;
+			}
+			std::vector<uint8_t>().swap(img->data);
+			if (!to_write.push(std::move(img)))
+				break;
+		}
+	};
+
+	auto writer = [&]() {
+		std::unique_ptr<BatchImage> img;
+		while (to_write.pop(img))
+			done(img.get(), !plugin_post_decode_callback(&img->info));
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread reader_thread(reader);
+	std::vector<std::thread> writers;
+	for (uint32_t i = 0; i < num_jobs; ++i)
+		writers.emplace_back(writer);
+	std::vector<std::thread> decoders;
+	for (uint32_t i = 1; i < num_jobs; ++i)
+		decoders.emplace_back(decoder);
+	decoder();
+	for (auto& t : decoders)
+		t.join();
+	reader_thread.join();
+	to_write.close();
+	for (auto& t : writers)
+		t.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stdout, "\n[INFO] batch decode: %u of %d images decoded with %u jobs in %.3f s\n",
+		num_decoded, num_images, num_jobs, seconds);
+	if (seconds > 0) {
+		fprintf(stdout, "[INFO] throughput: %.1f images/s, %.2f MB/s of compressed input\n",
+			num_decoded / seconds, (double)bytes_decoded / (1024.0 * 1024.0) / seconds);
+	}
+	if (num_skipped)
+		fprintf(stdout, "[WARNING] %u files skipped\n", num_skipped);
+	if (!failures.empty()) {
+		fprintf(stderr, "[ERROR] %u images failed to decode:\n", (uint32_t)failures.size());
+		for (auto& f : failures)
+			fprintf(stderr, "    %s\n", f.c_str());
+	}
+	return failures.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
 int plugin_main(int argc, char **argv, DecompressInitParams* initParams)
 {
 	int32_t num_images, imageno = 0;
@@ -1390,6 +1612,95 @@ int plugin_main(int argc, char **argv, DecompressInitParams* initParams)
 }
 
 
+/*
+Decoded strips can be written straight to the output file, so that the whole image is never held
+in memory, if the output format has a strip writer, and the image needs none of the post-processing
+in plugin_post_decode_callback that works on the whole image
+*/
+static bool can_write_strips(opj_decompress_parameters* parameters,
+							opj_header_info_t* header_info,
+							opj_image_t* image)
+{
+	if (!store_file_to_disk || parameters->nb_tile_to_decode)
+		return false;
+	switch (parameters->cod_format) {
+	case PXM_DFMT:
+#ifdef OPJ_HAVE_LIBTIFF
+	case TIF_DFMT:
+#endif
+#ifdef OPJ_HAVE_LIBPNG
+	case PNG_DFMT:
+#endif
+		break;
+	default:
+		return false;
+	}
+	if (parameters->precision || parameters->upsample || parameters->force_rgb)
+		return false;
+
+	/* colour conversions */
+	if (image->numcomps == 3 && image->comps[0].dx == image->comps[0].dy && image->comps[1].dx != 1)
+		return false;
+	if (header_info->enumcs == 18 || header_info->enumcs == 24 ||
+		image->color_space == OPJ_CLRSPC_SYCC || image->color_space == OPJ_CLRSPC_EYCC)
+		return false;
+	if ((header_info->enumcs == 12 || image->color_space == OPJ_CLRSPC_CMYK) && parameters->cod_format != TIF_DFMT)
+		return false;
+	if (header_info->color.icc_profile_buf &&
+		parameters->cod_format != TIF_DFMT && parameters->cod_format != PNG_DFMT)
+		return false;
+	return true;
+}
+
+struct StripOutput {
+	StripOutput(opj_decompress_parameters* parameters, opj_image_t* image) : parameters(parameters),
+																			image(image),
+																			writer(nullptr)
+	{}
+	~StripOutput() {
+		delete writer;
+	}
+	opj_decompress_parameters* parameters;
+	opj_image_t* image;
+	StripWriter* writer;
+};
+
+/*
+Strip callback: the output file is created with the first strip,
+which carries the colour space and ICC profile set by the decoder
+*/
+static bool write_strip(opj_image_t* strip, uint32_t strip_index, void* user_data)
+{
+	auto output = (StripOutput*)user_data;
+	opj_decompress_parameters* parameters = output->parameters;
+	if (!output->writer) {
+		opj_image_t header = *output->image;
+		header.color_space = strip->color_space;
+		header.icc_profile_buf = strip->icc_profile_buf;
+		header.icc_profile_len = strip->icc_profile_len;
+		switch (parameters->cod_format) {
+		case PXM_DFMT:
+			output->writer = pnm_strip_writer_open(&header, parameters->outfile, parameters->split_pnm);
+			break;
+#ifdef OPJ_HAVE_LIBTIFF
+		case TIF_DFMT:
+			output->writer = tif_strip_writer_open(&header, parameters->outfile, parameters->compression, parameters->core.numThreads);
+			break;
+#endif
+#ifdef OPJ_HAVE_LIBPNG
+		case PNG_DFMT:
+			output->writer = png_strip_writer_open(&header, parameters->outfile, parameters->compressionLevel, parameters->core.numThreads);
+			break;
+#endif
+		default:
+			break;
+		}
+		if (!output->writer)
+			return false;
+	}
+	return output->writer->write(strip);
+}
+
 int plugin_pre_decode_callback(opj_plugin_decode_callback_info_t* info) {
 	if (!info)
 		return 1;
@@ -1399,11 +1710,15 @@ int plugin_pre_decode_callback(opj_plugin_decode_callback_info_t* info) {
 
 	/* read the input file and put it in memory */
 	/* ---------------------------------------- */
-	// use file stream 
-	info->l_stream = opj_stream_create_default_file_stream(parameters->infile, true);
+	// memory mapped stream: tile data is decoded in place, straight from the page cache.
+	// Tile and region decodes only touch part of the file, so read-ahead is disabled for them
+	// The stream is already open when the file has been read by the caller, as in a batch decode
+	if (!info->l_stream && !parameters->file_stream)
+		info->l_stream = opj_stream_create_mapped_file_read_stream_ex(parameters->infile, is_random_access(parameters));
 
-	// other option is to use memory mapped stream
-	//info->l_stream = opj_stream_create_mapped_file_read_stream(parameters->infile);
+	// other option is to use file stream, also used when the file cannot be mapped
+	if (!info->l_stream)
+		info->l_stream = opj_stream_create_default_file_stream(parameters->infile, true);
 
 
 	// third option is to read from buffer
@@ -1527,6 +1842,10 @@ int plugin_pre_decode_callback(opj_plugin_decode_callback_info_t* info) {
 	}
 
 	if (!parameters->nb_tile_to_decode) {
+		/* the image is decoded strip by strip, straight to the output file, in plugin_post_decode_callback */
+		if (!info->tile && can_write_strips(parameters, &header_info, image))
+			return 0;
+
 		/* Get the decoded image */
 		if (!(opj_decode_ex(info->l_codec,info->tile, info->l_stream, image) && opj_end_decompress(info->l_codec, info->l_stream))) {
 			fprintf(stderr, "ERROR -> opj_decompress: failed to decode image!\n");
@@ -1570,6 +1889,23 @@ int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info) {
 	opj_image_t* image = info->image;
 
 	
+	/* decoding was left to us by plugin_pre_decode_callback, to write the image strip by strip */
+	if (!info->tile && info->l_codec) {
+		StripOutput output(parameters, image);
+		if (!(opj_decode_strips(info->l_codec, info->l_stream, image, write_strip, &output) &&
+				opj_end_decompress(info->l_codec, info->l_stream))) {
+			fprintf(stderr, "ERROR -> opj_decompress: failed to decode image!\n");
+			failed = 1;
+		}
+		if (!output.writer || !output.writer->close())
+			failed = 1;
+		if (failed)
+			fprintf(stderr, "[ERROR] Outfile %s not generated\n", parameters->outfile);
+		else
+			fprintf(stdout, "[INFO] Generated Outfile %s\n", parameters->outfile);
+		goto cleanup;
+	}
+
 	if (info->tile) {
 		info->tile->decode_flag = OPJ_PLUGIN_DECODE_POST_T1 ;
 		/* Get the decoded image */
@@ -1598,17 +1934,17 @@ int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info) {
 		image->color_space = OPJ_CLRSPC_GRAY;
 
 	if (image->color_space == OPJ_CLRSPC_SYCC) {
-		color_sycc_to_rgb(image);
+		color_sycc_to_rgb(image, info->decoder_parameters->core.numThreads);
 	}
 	else if ((image->color_space == OPJ_CLRSPC_CMYK) && (parameters->cod_format != TIF_DFMT)) {
-		if (color_cmyk_to_rgb(image)) {
+		if (color_cmyk_to_rgb(image, info->decoder_parameters->core.numThreads)) {
 			fprintf(stderr, "ERROR -> opj_decompress: CMYK to RGB colour conversion failed !\n");
 			failed = 1;
 			goto cleanup;
 		}
 	}
 	else if (image->color_space == OPJ_CLRSPC_EYCC) {
-		if (color_esycc_to_rgb(image)) {
+		if (color_esycc_to_rgb(image, info->decoder_parameters->core.numThreads)) {
 			fprintf(stderr, "ERROR -> opj_decompress: eSYCC to RGB colour conversion failed !\n");
 			failed = 1;
 			goto cleanup;
@@ -1621,10 +1957,11 @@ int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info) {
 		(info->decoder_parameters->force_rgb || (info->decoder_parameters->cod_format != TIF_DFMT &&	info->decoder_parameters->cod_format != PNG_DFMT) ) ) {
 #if defined(OPJ_HAVE_LIBLCMS)
 		if (image->icc_profile_len) {
-			color_apply_icc_profile(image, info->decoder_parameters->force_rgb);
+			color_apply_icc_profile(image, info->decoder_parameters->force_rgb,
+				info->decoder_parameters->core.numThreads);
 		}
 		else {
-			color_cielab_to_rgb(image);
+			color_cielab_to_rgb(image, info->decoder_parameters->core.numThreads);
 		}
 		free(image->icc_profile_buf);
 		image->icc_profile_buf = NULL;
@@ -1730,7 +2067,7 @@ int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info) {
 			break;
 #ifdef OPJ_HAVE_LIBTIFF
 		case TIF_DFMT:			/* TIFF */
-			if (imagetotif(image, parameters->outfile, parameters->compression)) {
+			if (imagetotif(image, parameters->outfile, parameters->compression, parameters->core.numThreads)) {
 				fprintf(stderr, "[ERROR] Outfile %s not generated\n", parameters->outfile);
 				failed = 1;
 			}
@@ -1770,7 +2107,7 @@ int plugin_post_decode_callback(opj_plugin_decode_callback_info_t* info) {
 			break;
 #ifdef OPJ_HAVE_LIBPNG
 		case PNG_DFMT:			/* PNG */
-			if (imagetopng(image, parameters->outfile, parameters->compressionLevel)) {
+			if (imagetopng(image, parameters->outfile, parameters->compressionLevel, parameters->core.numThreads)) {
 				fprintf(stderr, "[ERROR] Error generating png file. Outfile %s not generated\n", parameters->outfile);
 				failed = 1;
 			}
@@ -0,0 +1,164 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "Scheduler.h"
+
+static std::mutex instance_mutex;
+static std::atomic<Scheduler*> scheduler_instance(nullptr);
+
+// owning scheduler and deque index of the current thread, if it is a worker
+static thread_local Scheduler* worker_owner = nullptr;
+static thread_local size_t worker_index = 0;
+
+Scheduler* Scheduler::instance() {
+	auto sched = scheduler_instance.load(std::memory_order_acquire);
+	if (sched)
+		return sched;
+	std::lock_guard<std::mutex> lk(instance_mutex);
+	sched = scheduler_instance.load(std::memory_order_relaxed);
+	if (!sched) {
+		size_t numWorkers = std::thread::hardware_concurrency();
+		if (numWorkers == 0)
+			numWorkers = 1;
+		sched = new Scheduler(numWorkers);
+		scheduler_instance.store(sched, std::memory_order_release);
+	}
+	return sched;
+}
+
+void Scheduler::release() {
+	std::lock_guard<std::mutex> lk(instance_mutex);
+	delete scheduler_instance.exchange(nullptr);
+}
+
+Scheduler::Scheduler(size_t numWorkers) : queued(0),
+										next_worker(0),
+										stop(false)
+{
+	for (size_t i = 0; i < numWorkers; ++i)
+		workers.emplace_back(new Worker());
+	for (size_t i = 0; i < numWorkers; ++i)
+		workers[i]->thread = std::thread([this, i]() { work(i); });
+}
+
+Scheduler::~Scheduler() {
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		stop = true;
+	}
+	condition.notify_all();
+	for (auto& w : workers)
+		w->thread.join();
+}
+
+void Scheduler::run(TaskGroup& group, std::function<void()> task) {
+	group.pending++;
+	if (workers.empty()) {
+		task();
+		group.pending--;
+		return;
+	}
+	push(Task{ std::move(task), &group });
+	{
+		// synchronize with threads that are about to sleep
+		std::lock_guard<std::mutex> lk(mutex);
+	}
+	condition.notify_one();
+}
+
+void Scheduler::wait(TaskGroup& group) {
+	while (group.pending.load(std::memory_order_acquire)) {
+		Task task;
+		if (pop(task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lk(mutex);
+		condition.wait(lk, [this, &group] {
+			return !group.pending.load(std::memory_order_acquire) || queued.load() > 0;
+		});
+	}
+}
+
+void Scheduler::push(Task&& task) {
+	// workers push to their own deque, other threads distribute round robin
+	size_t index = (worker_owner == this) ?
+						worker_index :
+						next_worker++ % workers.size();
+	auto w = workers[index].get();
+	std::lock_guard<std::mutex> lk(w->mutex);
+	w->tasks.push_back(std::move(task));
+	queued++;
+}
+
+bool Scheduler::pop(Task& task) {
+	if (!queued.load())
+		return false;
+	if (worker_owner == this) {
+		auto w = workers[worker_index].get();
+		std::lock_guard<std::mutex> lk(w->mutex);
+		if (!w->tasks.empty()) {
+			task = std::move(w->tasks.back());
+			w->tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	return steal(worker_owner == this ? worker_index + 1 : 0, task);
+}
+
+bool Scheduler::steal(size_t first, Task& task) {
+	auto numWorkers = workers.size();
+	for (size_t i = 0; i < numWorkers; ++i) {
+		auto w = workers[(first + i) % numWorkers].get();
+		std::lock_guard<std::mutex> lk(w->mutex);
+		if (!w->tasks.empty()) {
+			task = std::move(w->tasks.front());
+			w->tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Scheduler::execute(Task& task) {
+	task.fn();
+	if (--task.group->pending == 0) {
+		// wake up thread waiting on this group
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+		}
+		condition.notify_all();
+	}
+}
+
+void Scheduler::work(size_t index) {
+	worker_owner = this;
+	worker_index = index;
+	while (true) {
+		Task task;
+		if (pop(task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lk(mutex);
+		condition.wait(lk, [this] { return stop || queued.load() > 0; });
+		if (stop)
+			return;
+	}
+}
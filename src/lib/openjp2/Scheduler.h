@@ -0,0 +1,126 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/**
+Set of tasks that a caller can wait on
+*/
+class TaskGroup
+{
+public:
+	TaskGroup() : pending(0) {}
+private:
+	friend class Scheduler;
+	std::atomic<size_t> pending;
+};
+
+/**
+Process-wide work-stealing task scheduler.
+
+Each worker thread owns a deque of tasks: it pushes and pops its own
+tasks at the back, and steals from the front of other workers' deques
+when its own deque is empty. A thread waiting on a TaskGroup runs pending
+tasks instead of blocking, so tasks may submit and wait on nested groups.
+
+The workers are created once, either by opj_initialize or on first use,
+and are joined by opj_cleanup.
+*/
+class Scheduler
+{
+public:
+	/**
+	Get the process-wide scheduler, creating it if necessary
+	*/
+	static Scheduler* instance();
+
+	/**
+	Join worker threads and destroy the process-wide scheduler.
+	No tasks may be in flight.
+	*/
+	static void release();
+
+	/**
+	Submit a task to the scheduler
+	@param group	group that the task belongs to
+	@param task		task to run
+	*/
+	void run(TaskGroup& group, std::function<void()> task);
+
+	/**
+	Wait until all tasks in a group have completed. The calling thread
+	runs pending tasks while it waits.
+	*/
+	void wait(TaskGroup& group);
+
+	/**
+	Run fn(0) ... fn(count-1) concurrently and wait for all calls to complete.
+	fn(0) is run on the calling thread.
+	*/
+	template<typename F> void parallel_for(size_t count, F fn) {
+		if (count == 0)
+			return;
+		if (count == 1 || workers.empty()) {
+			for (size_t i = 0; i < count; ++i)
+				fn(i);
+			return;
+		}
+		TaskGroup group;
+		for (size_t i = 1; i < count; ++i)
+			run(group, [&fn, i]() { fn(i); });
+		fn(0);
+		wait(group);
+	}
+
+	size_t num_workers() const { return workers.size(); }
+
+private:
+	struct Task {
+		std::function<void()> fn;
+		TaskGroup* group;
+	};
+	struct Worker {
+		std::deque<Task> tasks;
+		std::mutex mutex;
+		std::thread thread;
+	};
+
+	explicit Scheduler(size_t numWorkers);
+	~Scheduler();
+
+	void push(Task&& task);
+	bool pop(Task& task);
+	bool steal(size_t first, Task& task);
+	void execute(Task& task);
+	void work(size_t index);
+
+	std::vector<std::unique_ptr<Worker> > workers;
+	std::atomic<size_t> queued;
+	std::atomic<size_t> next_worker;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stop;
+};
@@ -17,8 +17,8 @@
 
 #include "opj_includes.h"
 #include "T1Decoder.h"
-#include "Barrier.h"
-#include "ThreadPool.h"
+#include "Scheduler.h"
+#include "dequant.h"
 #include "testing.h"
 
 
@@ -31,101 +31,88 @@ T1Decoder::T1Decoder(uint16_t blockw,
 bool T1Decoder::decode(std::vector<decodeBlockInfo*>* blocks, int32_t numThreads) {
 	if (!blocks)
 		return false;
-	decodeQueue.push_no_lock(blocks);
+	decodeBlocks = *blocks;
 	blocks->clear();
+	nextBlock = 0;
 #ifdef DEBUG_LOSSLESS_T1
 	numThreads = 1;
 #endif
 
-
-	Barrier decode_t1_barrier(numThreads);
-	Barrier decode_t1_calling_barrier(numThreads + 1);
-
-	auto pool = new ThreadPool(numThreads);
-	volatile bool success = true;
-	for (auto threadId = 0; threadId < numThreads; threadId++) {
-		pool->enqueue([this,
-						&decode_t1_barrier,
-						&decode_t1_calling_barrier,
-						threadId,
-						&success]()		{
-			auto t1 = opj_t1_create(false, (uint16_t)codeblock_width, (uint16_t)codeblock_height);
-			if (!t1) {
-				success = false;
-				return;
-			}
+	std::atomic_bool success(true);
+	Scheduler::instance()->parallel_for((size_t)numThreads, [this, &success](size_t) {
+			// code blocks that allow it are decoded by the optimized T1 decoder;
+			// both handles are created on demand
+			opj_t1_t* t1 = nullptr;
+			opj_t1_opt_t* t1_opt = nullptr;
 			decodeBlockInfo* block = NULL;
-			while (decodeQueue.tryPop(block)) {
-				if (!opj_t1_decode_cblk(t1,
-										block->cblk,
-										block->bandno,
-										(uint32_t)block->roishift,
-										block->cblksty)) {
-						delete block;
+			while (popBlock(block)) {
+				int32_t* t1_data = nullptr;
+				uint32_t t1_w = 0, t1_h = 0;
+				if (opj_t1_opt_can_decode(block->cblksty)) {
+					if (!t1_opt) {
+						t1_opt = opj_t1_opt_create(false);
+						if (!t1_opt || !opj_t1_opt_allocate_buffers(t1_opt,
+																	codeblock_width,
+																	codeblock_height)) {
+							success = false;
+							break;
+						}
+					}
+					if (!opj_t1_opt_decode_cblk(t1_opt,
+												block->cblk,
+												block->bandno,
+												(uint32_t)block->roishift,
+												block->cblksty)) {
+						success = false;
 						break;
+					}
+					t1_data = (int32_t*)t1_opt->data;
+					t1_w = t1_opt->w;
+					t1_h = t1_opt->h;
 				}
-
-
-				auto t1_data = t1->data;
-
-				// ROI shift
-				if (block->roishift) {
-					int32_t threshold = 1 << block->roishift;
-					for (auto j = 0U; j < t1->h; ++j) {
-						for (auto i = 0U; i < t1->w; ++i) {
-							auto value = *t1_data;
-							auto magnitude = abs(value);
-							if (magnitude >= threshold) {
-								magnitude >>= block->roishift;
-								// ((value > 0) - (value < 0)) == signum(value)
-								*t1_data = ((value > 0) - (value < 0))* magnitude;
-							}
-							t1_data++;
+				else {
+					if (!t1) {
+						t1 = opj_t1_create(false);
+						if (!t1) {
+							success = false;
+							break;
 						}
 					}
-					//reset t1_data to start of buffer
+					if (!opj_t1_decode_cblk(t1,
+											block->cblk,
+											block->bandno,
+											(uint32_t)block->roishift,
+											block->cblksty)) {
+						success = false;
+						break;
+					}
 					t1_data = t1->data;
+					t1_w = t1->w;
+					t1_h = t1->h;
 				}
 
-				//dequantization
+				// ROI shift and dequantization, fused into one pass over the code-block
 				uint32_t tile_width = block->tilec->x1 - block->tilec->x0;
 				if (block->qmfbid == 1) {
-					int32_t* restrict tile_data = block->tiledp;
-					for (auto j = 0U; j < t1->h; ++j) {
-						int32_t* restrict tile_row_data = tile_data;
-						for (auto i = 0U; i < t1->w; ++i) {
-							tile_row_data[i] = *t1_data / 2;
-							t1_data++;
-						}
-						tile_data += tile_width;
-					}
+					opj_dequant_cblk_53(t1_data, t1_w, t1_h, block->tiledp, tile_width, block->roishift);
 				}
-				else {		
-					float* restrict tile_data = (float*)block->tiledp;
-					for (auto j = 0U; j < t1->h; ++j) {
-						float* restrict tile_row_data = tile_data;
-						for (auto i = 0U; i < t1->w; ++i) {
-							tile_row_data[i] = (float)*t1_data * block->stepsize;
-							t1_data++;
-						}
-						tile_data += tile_width;
-					}
+				else {
+					opj_dequant_cblk_97(t1_data, t1_w, t1_h, (float*)block->tiledp, tile_width,
+										block->roishift, block->stepsize);
 				}
-				delete block;
 			}
 			opj_t1_destroy(t1);
-			decode_t1_barrier.arrive_and_wait();
-			decode_t1_calling_barrier.arrive_and_wait();
-		});
-	}
-
-	decode_t1_calling_barrier.arrive_and_wait();
-	// cleanup
-	delete pool;
-	decodeBlockInfo* block = NULL;
-	while (decodeQueue.tryPop(block)) {
-		delete block;
-	}
+			opj_t1_opt_destroy(t1_opt);
+	});
+	decodeBlocks.clear();
 	return success;
 
 }
+
+bool T1Decoder::popBlock(decodeBlockInfo*& block) {
+	auto index = nextBlock++;
+	if (index >= decodeBlocks.size())
+		return false;
+	block = decodeBlocks[index];
+	return true;
+}
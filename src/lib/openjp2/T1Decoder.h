@@ -19,8 +19,7 @@
 
 #include <string>
 #include <vector>
-#include <thread>
-#include "BlockingQueue.h"
+#include <atomic>
 
 
 class T1Decoder
@@ -31,6 +30,9 @@ public:
 
 private:
 
+	bool popBlock(decodeBlockInfo*& block);
+
 	uint16_t codeblock_width, codeblock_height;  //nominal dimensions of block
-	BlockingQueue<decodeBlockInfo*> decodeQueue;
+	std::vector<decodeBlockInfo*> decodeBlocks;
+	std::atomic<size_t> nextBlock;		// index of next block to decode
 };
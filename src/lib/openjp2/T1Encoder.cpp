@@ -17,32 +17,41 @@
 
 #include "opj_includes.h"
 #include "T1Encoder.h"
-#include "Barrier.h"
-#include "ThreadPool.h"
+#include "Scheduler.h"
 #include "testing.h"
+#include <algorithm>
+
+/* when estimating the rate threshold, one code block in OPJ_T1_SLOPE_SAMPLING
+of each band is coded in full */
+#define OPJ_T1_SLOPE_SAMPLING 4
+
+/* passes are skipped only when their slope falls this far below the estimated
+threshold, to absorb the error of the estimate */
+#define OPJ_T1_SLOPE_MARGIN 0.5
 
 
 T1Encoder::T1Encoder() : tile(NULL), 
 						maxCblkW(0),
-						maxCblkH(0)
+						maxCblkH(0),
+						nextBlock(0),
+						minSlope(0)
 {
 
 }
 
 void T1Encoder::encode(void) {
 	auto state = opj_plugin_get_debug_state();
-	auto t1 = opj_t1_create(true, 0,0);
+	auto t1 = opj_t1_create(true);
 	if (!t1) {
 		return_code = false;
 	}
 	encodeBlockInfo* block = NULL;
-	while (return_code && encodeQueue.tryPop(block)) {
+	while (return_code && popBlock(block)) {
 		uint32_t tileIndex = 0, tileLineAdvance;
 		if (!opj_t1_allocate_buffers(
 			t1,
 			block->cblk->x1 - block->cblk->x0,
 			block->cblk->y1 - block->cblk->y0)) {
-			delete block;
 			return_code = false;
 			break;
 		}
@@ -94,8 +103,6 @@ void T1Encoder::encode(void) {
 										block->mct_norms,
 										block->mct_numcomps);
 
-		delete block;
-
 		std::unique_lock<std::mutex> lk(distortion_mutex);
 		tile->distotile += dist;
 	}
@@ -105,7 +112,7 @@ void T1Encoder::encodeOpt(size_t threadId) {
 	auto state = opj_plugin_get_debug_state();
 	auto t1 = t1OptVec[threadId];
 	encodeBlockInfo* block = NULL;
-	while (return_code && encodeQueue.tryPop(block)) {
+	while (return_code && popBlock(block)) {
 
 		auto tilec = tile->comps + block->compno;
 		opj_t1_opt_init_buffers(t1,
@@ -190,11 +197,12 @@ void T1Encoder::encodeOpt(size_t threadId) {
 											tile->numcomps,
 											block->mct_norms,
 											block->mct_numcomps,
-											max);
+											max,
+											minSlope);
 
 
 #ifdef DEBUG_LOSSLESS_T1
-		opj_t1_t* t1Decode = opj_t1_create(false, t1->w, t1->h);
+		opj_t1_t* t1Decode = opj_t1_create(false);
 
 		opj_tcd_cblk_dec_t* cblkDecode = new opj_tcd_cblk_dec_t();
 		cblkDecode->data = nullptr;
@@ -221,7 +229,7 @@ void T1Encoder::encodeOpt(size_t threadId) {
 		auto rate = seg->numpasses  ? block->cblk->passes[seg->numpasses - 1].rate : 0;
 		seg->len = rate;
 		seg->dataindex = 0;
-		opj_min_buf_vec_push_back(&cblkDecode->seg_buffers, block->cblk->data, (uint16_t)rate);
+		opj_min_buf_vec_push_back(&cblkDecode->seg_buffers, block->cblk->data, rate);
 		//decode
 		opj_t1_decode_cblk(t1Decode, cblkDecode, block->bandno, 0, 0);
 
@@ -244,7 +252,6 @@ void T1Encoder::encodeOpt(size_t threadId) {
 		delete[] block->unencodedData;
 		block->unencodedData = nullptr;
 #endif
-		delete block;
 		std::unique_lock<std::mutex> lk(distortion_mutex);
 		tile->distotile += dist;
 	}
@@ -255,7 +262,8 @@ bool T1Encoder::encode(bool do_opt,
 						std::vector<encodeBlockInfo*>* blocks, 
 						uint32_t encodeMaxCblkW,
 						uint32_t encodeMaxCblkH,
-						uint32_t numThreads) {
+						uint32_t numThreads,
+						uint64_t max_bytes) {
 	if (!blocks || blocks->size() == 0)
 		return true;
 	tile = encodeTile;
@@ -285,37 +293,16 @@ bool T1Encoder::encode(bool do_opt,
 			t1OptVec.push_back(t1);
 		}
 	}
-	encodeQueue.push_no_lock(blocks);
+	encodeBlocks = *blocks;
 	return_code = true;
+	minSlope = 0;
 
-	Barrier encode_t1_barrier(numThreads);
-	Barrier encode_t1_calling_barrier(numThreads + 1);
-
-	auto pool = new ThreadPool(numThreads);
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		pool->enqueue([this,
-						do_opt,
-						&encode_t1_barrier,
-						&encode_t1_calling_barrier,
-						threadId] {
-
-			if (do_opt)
-				encodeOpt(threadId);
-			else
-				encode();
-			encode_t1_barrier.arrive_and_wait();
-			encode_t1_calling_barrier.arrive_and_wait();
-		});
-	}
-
-	encode_t1_calling_barrier.arrive_and_wait();
-	delete pool;
-	
-	// clean up remaining blocks
-	encodeBlockInfo* block = NULL;
-	while (encodeQueue.tryPop(block)) {
-		delete block;
-	}
+	// early termination is only supported by the optimized coder, and would
+	// break the comparison with a debug plugin
+	if (do_opt && max_bytes && !(opj_plugin_get_debug_state() & OPJ_PLUGIN_STATE_DEBUG))
+		minSlope = estimateMinSlope(max_bytes, numThreads);
+	run(do_opt, numThreads);
+	encodeBlocks.clear();
 
 	// clean up t1 structs
 	for (auto t : t1OptVec) {
@@ -328,3 +315,94 @@ bool T1Encoder::encode(bool do_opt,
 	return return_code;
 
 }
+
+/*
+Encode a sample of the code blocks in full, and estimate from their feasible
+truncation points the slope threshold at which the tile reaches max_bytes.
+The sampled blocks are removed from the blocks left to encode.
+The estimate is not a bound: when the sample is not representative of its band,
+passes that rate allocation would have kept can be dropped, so early termination
+can change the codestream, at a small cost in PSNR.
+*/
+double T1Encoder::estimateMinSlope(uint64_t max_bytes, uint32_t numThreads) {
+	struct sample_t {
+		opj_tcd_cblk_enc_t* cblk;
+		double weight;	// number of code blocks of the band represented by this block
+	};
+	std::vector<sample_t> samples;
+	std::vector<encodeBlockInfo*> sampled;
+	std::vector<encodeBlockInfo*> remaining;
+
+	// blocks are ordered by component, resolution and band
+	for (size_t begin = 0; begin < encodeBlocks.size();) {
+		auto first = encodeBlocks[begin];
+		size_t end = begin + 1;
+		while (end < encodeBlocks.size() &&
+				encodeBlocks[end]->compno == first->compno &&
+				encodeBlocks[end]->resno == first->resno &&
+				encodeBlocks[end]->bandno == first->bandno)
+			end++;
+		size_t count = end - begin;
+		size_t num_samples = (count + OPJ_T1_SLOPE_SAMPLING - 1) / OPJ_T1_SLOPE_SAMPLING;
+		for (size_t i = begin; i < end; ++i) {
+			if ((i - begin) % OPJ_T1_SLOPE_SAMPLING == 0) {
+				samples.push_back({ encodeBlocks[i]->cblk, (double)count / (double)num_samples });
+				sampled.push_back(encodeBlocks[i]);
+			}
+			else {
+				remaining.push_back(encodeBlocks[i]);
+			}
+		}
+		begin = end;
+	}
+
+	encodeBlocks = sampled;
+	run(true, numThreads);
+	encodeBlocks = remaining;
+	if (!return_code || remaining.empty())
+		return 0;
+
+	std::vector<std::pair<uint16_t, double> > points;
+	for (auto& sample : samples) {
+		auto cblk = sample.cblk;
+		RateControl::convexHull(cblk->passes, cblk->num_passes_encoded);
+		uint32_t prev_rate = 0;
+		for (uint32_t passno = 0; passno < cblk->num_passes_encoded; passno++) {
+			opj_tcd_pass_t *pass = &cblk->passes[passno];
+			if (!pass->slope)
+				continue;
+			points.push_back(std::make_pair(pass->slope, (pass->rate - prev_rate) * sample.weight));
+			prev_rate = pass->rate;
+		}
+	}
+	std::sort(points.begin(), points.end(),
+		[](const std::pair<uint16_t, double>& a, const std::pair<uint16_t, double>& b) {
+			return a.first > b.first;
+	});
+	double bytes = 0;
+	for (auto& point : points) {
+		bytes += point.second;
+		if (bytes > (double)max_bytes)
+			return RateControl::slopeFromLog(point.first) * OPJ_T1_SLOPE_MARGIN;
+	}
+	// everything fits in the budget
+	return 0;
+}
+
+void T1Encoder::run(bool do_opt, uint32_t numThreads) {
+	nextBlock = 0;
+	Scheduler::instance()->parallel_for(numThreads, [this, do_opt](size_t threadId) {
+		if (do_opt)
+			encodeOpt(threadId);
+		else
+			encode();
+	});
+}
+
+bool T1Encoder::popBlock(encodeBlockInfo*& block) {
+	auto index = nextBlock++;
+	if (index >= encodeBlocks.size())
+		return false;
+	block = encodeBlocks[index];
+	return true;
+}
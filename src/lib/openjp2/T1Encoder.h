@@ -17,20 +17,27 @@
 
 #pragma once
 
-#include "BlockingQueue.h"
 #include <atomic>
-#include <thread>
+#include <vector>
+#include <mutex>
 
 
 class T1Encoder
 {
 public:
 	T1Encoder();
+	/**
+	Encode code blocks
+
+	@param max_bytes	if non-zero, byte budget of the final layer: coding passes
+						that will fall below its rate threshold are skipped
+	*/
 	bool encode(bool do_opt, opj_tcd_tile_t *tile,
 				std::vector<encodeBlockInfo*>* blocks,
 				uint32_t maxCblkW, 
 				uint32_t maxCblkH,
-				uint32_t numThreads);
+				uint32_t numThreads,
+				uint64_t max_bytes);
 
 	void encode();
 	void encodeOpt(size_t threadId);
@@ -45,7 +52,15 @@ private:
 	std::vector<opj_t1_opt*> t1OptVec;
 	std::vector<opj_t1*> t1Vec;
 
-	BlockingQueue<encodeBlockInfo*> encodeQueue;
+	bool popBlock(encodeBlockInfo*& block);
+	void run(bool do_opt, uint32_t numThreads);
+	double estimateMinSlope(uint64_t max_bytes, uint32_t numThreads);
+
+	// passes whose slope falls below this value are not coded; 0 codes all passes
+	double minSlope;
+
+	std::vector<encodeBlockInfo*> encodeBlocks;
+	std::atomic<size_t> nextBlock;		// index of next block to encode
 	mutable std::mutex distortion_mutex;
 
 };
@@ -408,6 +408,12 @@ size_t opj_stream_read_data (opj_stream_private_t * p_stream,
 
 
 
+bool opj_stream_supports_zero_copy(const opj_stream_private_t * p_stream)
+{
+    /* data already buffered by a regular read would be skipped */
+    return p_stream->m_zero_copy_read_fn && !p_stream->m_bytes_in_buffer;
+}
+
 size_t opj_stream_read_data_zero_copy(opj_stream_private_t * p_stream, 
 										uint8_t ** p_buffer,
 										size_t p_size,
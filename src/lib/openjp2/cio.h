@@ -296,8 +296,22 @@ void opj_write_float_BE(uint8_t * p_buffer, float p_value);
  */
 size_t opj_stream_read_data (opj_stream_private_t * p_stream, uint8_t * p_buffer, size_t p_size, opj_event_mgr_t * p_event_mgr);
 
+/**
+ * Reads some bytes from the stream without copying them.
+ * @param		p_stream	the stream to read data from.
+ * @param		p_buffer	receives a pointer to the data, which stays valid as long as the stream.
+ * @param		p_size		number of bytes to read.
+ * @param		p_event_mgr	the user event manager to be notified of special events.
+ * @return		the number of bytes read, or -1 if an error occurred or if the stream is at the end.
+ */
 size_t opj_stream_read_data_zero_copy(opj_stream_private_t * p_stream, uint8_t ** p_buffer, size_t p_size, opj_event_mgr_t * p_event_mgr);
 
+/**
+ * Tells whether the stream can be read with opj_stream_read_data_zero_copy
+ * @param		p_stream	the stream to check.
+ */
+bool opj_stream_supports_zero_copy(const opj_stream_private_t * p_stream);
+
 /**
  * Writes some bytes to the stream.
  * @param		p_stream	the stream to write data to.
@@ -0,0 +1,217 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "opj_includes.h"
+#include "dequant.h"
+#ifdef OPJ_HAVE_AVX2
+#include "dequant_avx2.h"
+#endif
+
+/**
+Row kernels, dispatched once according to the instruction sets
+available at build time and at run time
+*/
+struct opj_dequant_kernels_t {
+    void (*row_53)(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift);
+    void (*row_97)(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize);
+    void (*dc_shift_53)(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+    void (*dc_shift_97)(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+};
+
+/**
+Undo the ROI shift of a single sample: magnitudes at or above
+1 << roishift are shifted down, keeping their sign
+*/
+static inline int32_t opj_roi_unshift(int32_t value, uint32_t roishift);
+
+static void opj_dequant_row_53(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift);
+static void opj_dequant_row_97(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize);
+static void opj_dc_shift_53_row(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+static void opj_dc_shift_97_row(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+
+static const opj_dequant_kernels_t* opj_dequant_get_kernels(void);
+
+/* ----------------------------------------------------------------------- */
+
+static inline int32_t opj_roi_unshift(int32_t value, uint32_t roishift)
+{
+    int32_t magnitude = abs(value);
+    if (magnitude >= (1 << roishift)) {
+        magnitude >>= roishift;
+        // ((value > 0) - (value < 0)) == signum(value)
+        return ((value > 0) - (value < 0)) * magnitude;
+    }
+    return value;
+}
+
+static void opj_dequant_row_53(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift)
+{
+    if (roishift) {
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = opj_roi_unshift(src[k], roishift) / 2;
+    } else {
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = src[k] / 2;
+    }
+}
+
+static void opj_dequant_row_97(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize)
+{
+    if (roishift) {
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = (float)opj_roi_unshift(src[k], roishift) * stepsize;
+    } else {
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = (float)src[k] * stepsize;
+    }
+}
+
+static void opj_dc_shift_53_row(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    for (size_t k = 0; k < n; ++k)
+        d[k] = opj_int_clamp(d[k] + shift, min, max);
+}
+
+static void opj_dc_shift_97_row(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    for (size_t k = 0; k < n; ++k) {
+        float value = *((float*)(d + k));
+        d[k] = opj_int_clamp((int32_t)opj_lrintf(value) + shift, min, max);
+    }
+}
+
+#ifdef __SSE4_1__
+static inline __m128i opj_roi_unshift_sse41(__m128i v, __m128i vs, __m128i vthreshold)
+{
+    __m128i magnitude = _mm_abs_epi32(v);
+    __m128i shifted = _mm_sign_epi32(_mm_srl_epi32(magnitude, vs), v);
+    return _mm_blendv_epi8(v, shifted, _mm_cmpgt_epi32(magnitude, vthreshold));
+}
+
+static void opj_dequant_row_53_sse41(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift)
+{
+    const __m128i vs = _mm_cvtsi32_si128((int)roishift);
+    const __m128i vthreshold = _mm_set1_epi32((1 << roishift) - 1);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + k));
+        if (roishift)
+            v = opj_roi_unshift_sse41(v, vs, vthreshold);
+        /* v / 2, rounding towards zero */
+        v = _mm_srai_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 31)), 1);
+        _mm_storeu_si128((__m128i*)(dst + k), v);
+    }
+    opj_dequant_row_53(src + k, dst + k, n - k, roishift);
+}
+
+static void opj_dequant_row_97_sse41(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize)
+{
+    const __m128i vs = _mm_cvtsi32_si128((int)roishift);
+    const __m128i vthreshold = _mm_set1_epi32((1 << roishift) - 1);
+    const __m128 vstep = _mm_set1_ps(stepsize);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + k));
+        if (roishift)
+            v = opj_roi_unshift_sse41(v, vs, vthreshold);
+        _mm_storeu_ps(dst + k, _mm_mul_ps(_mm_cvtepi32_ps(v), vstep));
+    }
+    opj_dequant_row_97(src + k, dst + k, n - k, roishift, stepsize);
+}
+
+static void opj_dc_shift_53_sse41(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    const __m128i vshift = _mm_set1_epi32(shift);
+    const __m128i vmin = _mm_set1_epi32(min);
+    const __m128i vmax = _mm_set1_epi32(max);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(d + k)), vshift);
+        _mm_storeu_si128((__m128i*)(d + k), _mm_min_epi32(_mm_max_epi32(v, vmin), vmax));
+    }
+    opj_dc_shift_53_row(d + k, n - k, shift, min, max);
+}
+
+static void opj_dc_shift_97_sse41(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    const __m128i vshift = _mm_set1_epi32(shift);
+    const __m128i vmin = _mm_set1_epi32(min);
+    const __m128i vmax = _mm_set1_epi32(max);
+    size_t k = 0;
+    /* conversion rounds to nearest even, as lrintf does in the default rounding mode */
+    for (; k + 4 <= n; k += 4) {
+        __m128i v = _mm_add_epi32(_mm_cvtps_epi32(_mm_loadu_ps((const float*)(d + k))), vshift);
+        _mm_storeu_si128((__m128i*)(d + k), _mm_min_epi32(_mm_max_epi32(v, vmin), vmax));
+    }
+    opj_dc_shift_97_row(d + k, n - k, shift, min, max);
+}
+#endif
+
+static const opj_dequant_kernels_t* opj_dequant_get_kernels(void)
+{
+    static const opj_dequant_kernels_t kernels = []() {
+#ifdef OPJ_HAVE_AVX2
+        if (opj_cpu_has_avx2())
+            return opj_dequant_kernels_t{ opj_dequant_row_53_avx2, opj_dequant_row_97_avx2,
+                                          opj_dc_shift_53_avx2, opj_dc_shift_97_avx2 };
+#endif
+#ifdef __SSE4_1__
+        return opj_dequant_kernels_t{ opj_dequant_row_53_sse41, opj_dequant_row_97_sse41,
+                                      opj_dc_shift_53_sse41, opj_dc_shift_97_sse41 };
+#else
+        return opj_dequant_kernels_t{ opj_dequant_row_53, opj_dequant_row_97,
+                                      opj_dc_shift_53_row, opj_dc_shift_97_row };
+#endif
+    }();
+    return &kernels;
+}
+
+void opj_dequant_cblk_53(const int32_t* src, uint32_t w, uint32_t h,
+                         int32_t* dst, size_t dst_stride, uint32_t roishift)
+{
+    auto row = opj_dequant_get_kernels()->row_53;
+    for (uint32_t j = 0; j < h; ++j) {
+        row(src, dst, w, roishift);
+        src += w;
+        dst += dst_stride;
+    }
+}
+
+void opj_dequant_cblk_97(const int32_t* src, uint32_t w, uint32_t h,
+                         float* dst, size_t dst_stride, uint32_t roishift, float stepsize)
+{
+    auto row = opj_dequant_get_kernels()->row_97;
+    for (uint32_t j = 0; j < h; ++j) {
+        row(src, dst, w, roishift, stepsize);
+        src += w;
+        dst += dst_stride;
+    }
+}
+
+void opj_dc_shift_53(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    opj_dequant_get_kernels()->dc_shift_53(d, n, shift, min, max);
+}
+
+void opj_dc_shift_97(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    opj_dequant_get_kernels()->dc_shift_97(d, n, shift, min, max);
+}
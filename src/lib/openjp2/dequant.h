@@ -0,0 +1,69 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+Decoder sample kernels: code-block dequantization into the tile buffer,
+and the final DC level shift and clamp of each tile component.
+
+Each kernel has scalar, SSE4.1 (when the library is built with it) and
+AVX2 (selected at run time) versions, which all give identical results.
+*/
+
+/**
+Copy a decoded w x h code-block into the tile buffer, undoing the ROI shift
+and the reversible quantization: dst = roi(src) / 2
+
+@param src			code-block samples, w samples per row
+@param w			code-block width
+@param h			code-block height
+@param dst			top left corner of the code-block in the tile buffer
+@param dst_stride	tile buffer stride, in samples
+@param roishift		ROI shift of the code-block, or 0
+*/
+void opj_dequant_cblk_53(const int32_t* src, uint32_t w, uint32_t h,
+                         int32_t* dst, size_t dst_stride, uint32_t roishift);
+
+/**
+Copy a decoded w x h code-block into the tile buffer, undoing the ROI shift
+and the irreversible quantization: dst = roi(src) * stepsize
+
+@param src			code-block samples, w samples per row
+@param w			code-block width
+@param h			code-block height
+@param dst			top left corner of the code-block in the tile buffer
+@param dst_stride	tile buffer stride, in samples
+@param roishift		ROI shift of the code-block, or 0
+@param stepsize		quantization step size of the band
+*/
+void opj_dequant_cblk_97(const int32_t* src, uint32_t w, uint32_t h,
+                         float* dst, size_t dst_stride, uint32_t roishift, float stepsize);
+
+/**
+Apply the DC level shift to n reversible samples: d = clamp(d + shift, min, max)
+*/
+void opj_dc_shift_53(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+
+/**
+Round n irreversible samples to integers in place and apply the DC level shift:
+d = clamp(lrintf(f) + shift, min, max), where f is the float stored at d
+*/
+void opj_dc_shift_97(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
@@ -0,0 +1,114 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+/*
+This file is compiled with AVX2 enabled. Keep its includes to the bare
+minimum: any inline function pulled in from a shared header could be
+emitted here with AVX2 instructions and then picked by the linker for
+the rest of the library.
+*/
+
+#include <immintrin.h>
+#include "dequant_avx2.h"
+
+static int32_t opj_roi_unshift(int32_t v, uint32_t roishift)
+{
+    int32_t magnitude = v < 0 ? -v : v;
+    if (magnitude >= (1 << roishift)) {
+        magnitude >>= roishift;
+        return v < 0 ? -magnitude : magnitude;
+    }
+    return v;
+}
+
+static int32_t opj_clamp(int32_t v, int32_t min, int32_t max)
+{
+    return v < min ? min : (v > max ? max : v);
+}
+
+/* magnitudes at or above 1 << roishift are shifted down, keeping their sign */
+static __m256i opj_roi_unshift_avx2(__m256i v, __m128i vs, __m256i vthreshold)
+{
+    __m256i magnitude = _mm256_abs_epi32(v);
+    __m256i shifted = _mm256_sign_epi32(_mm256_srl_epi32(magnitude, vs), v);
+    return _mm256_blendv_epi8(v, shifted, _mm256_cmpgt_epi32(magnitude, vthreshold));
+}
+
+void opj_dequant_row_53_avx2(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift)
+{
+    const __m128i vs = _mm_cvtsi32_si128((int)roishift);
+    const __m256i vthreshold = _mm256_set1_epi32((1 << roishift) - 1);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + k));
+        if (roishift)
+            v = opj_roi_unshift_avx2(v, vs, vthreshold);
+        /* v / 2, rounding towards zero */
+        v = _mm256_srai_epi32(_mm256_add_epi32(v, _mm256_srli_epi32(v, 31)), 1);
+        _mm256_storeu_si256((__m256i*)(dst + k), v);
+    }
+    for (; k < n; ++k)
+        dst[k] = opj_roi_unshift(src[k], roishift) / 2;
+}
+
+void opj_dequant_row_97_avx2(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize)
+{
+    const __m128i vs = _mm_cvtsi32_si128((int)roishift);
+    const __m256i vthreshold = _mm256_set1_epi32((1 << roishift) - 1);
+    const __m256 vstep = _mm256_set1_ps(stepsize);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + k));
+        if (roishift)
+            v = opj_roi_unshift_avx2(v, vs, vthreshold);
+        _mm256_storeu_ps(dst + k, _mm256_mul_ps(_mm256_cvtepi32_ps(v), vstep));
+    }
+    for (; k < n; ++k)
+        dst[k] = (float)opj_roi_unshift(src[k], roishift) * stepsize;
+}
+
+void opj_dc_shift_53_avx2(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    const __m256i vshift = _mm256_set1_epi32(shift);
+    const __m256i vmin = _mm256_set1_epi32(min);
+    const __m256i vmax = _mm256_set1_epi32(max);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(d + k)), vshift);
+        v = _mm256_min_epi32(_mm256_max_epi32(v, vmin), vmax);
+        _mm256_storeu_si256((__m256i*)(d + k), v);
+    }
+    for (; k < n; ++k)
+        d[k] = opj_clamp(d[k] + shift, min, max);
+}
+
+void opj_dc_shift_97_avx2(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max)
+{
+    const __m256i vshift = _mm256_set1_epi32(shift);
+    const __m256i vmin = _mm256_set1_epi32(min);
+    const __m256i vmax = _mm256_set1_epi32(max);
+    float* f = (float*)d;
+    size_t k = 0;
+    /* conversion rounds to nearest even, as lrintf does in the default rounding mode */
+    for (; k + 8 <= n; k += 8) {
+        __m256i v = _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_loadu_ps(f + k)), vshift);
+        v = _mm256_min_epi32(_mm256_max_epi32(v, vmin), vmax);
+        _mm256_storeu_si256((__m256i*)(d + k), v);
+    }
+    for (; k < n; ++k)
+        d[k] = opj_clamp(_mm_cvtss_si32(_mm_set_ss(f[k])) + shift, min, max);
+}
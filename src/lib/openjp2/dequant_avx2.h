@@ -0,0 +1,48 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+AVX2 row kernels behind dequant.h.
+
+They are built in their own translation unit with AVX2 code generation enabled,
+and must only be called after checking that the CPU supports AVX2.
+*/
+
+/**
+dst[k] = roi(src[k]) / 2, for k < n
+*/
+void opj_dequant_row_53_avx2(const int32_t* src, int32_t* dst, size_t n, uint32_t roishift);
+
+/**
+dst[k] = roi(src[k]) * stepsize, for k < n
+*/
+void opj_dequant_row_97_avx2(const int32_t* src, float* dst, size_t n, uint32_t roishift, float stepsize);
+
+/**
+d[k] = clamp(d[k] + shift, min, max), for k < n
+*/
+void opj_dc_shift_53_avx2(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
+
+/**
+d[k] = clamp(lrintf(f[k]) + shift, min, max), for k < n
+*/
+void opj_dc_shift_97_avx2(int32_t* d, size_t n, int32_t shift, int32_t min, int32_t max);
@@ -58,9 +58,15 @@
 #ifdef __SSE__
 #include <xmmintrin.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "opj_includes.h"
-#include "Barrier.h"
+#include "Scheduler.h"
+#ifdef OPJ_HAVE_AVX2
+#include "dwt_avx2.h"
+#endif
 #include "T1Decoder.h"
 #include <atomic>
 #include "testing.h"
@@ -87,11 +93,38 @@ typedef union {
 
 typedef struct v4dwt_local {
     opj_v4_t*	wavelet ;
+    int32_t		nv ;	/* vectors per sample: 1 for a group of four rows, more for a strip of columns */
     int32_t		dn ;
     int32_t		sn ;
     int32_t		cas ;
 } opj_v4dwt_t ;
 
+/* four interleaved integer samples, one from each of four adjacent columns */
+typedef union {
+    int32_t	i[4];
+} opj_v4i_t;
+
+typedef void (*opj_dwt_encode_h_fn)(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas);
+
+/* d[k] += (x[k] + y[k] + r) >> s, or -=, for k < n: the 5-3 lifting steps */
+typedef void (*opj_dwt_lift_fn)(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s);
+
+typedef struct opj_dwt_lift_kernels {
+    opj_dwt_lift_fn add;
+    opj_dwt_lift_fn sub;
+} opj_dwt_lift_kernels_t;
+typedef void (*opj_v4dwt_encode_fn)(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas);
+
+/*
+The vertical passes work on strips of adjacent columns rather than on single
+columns: each row of a strip is read and written as a contiguous run, and
+the strip is sized so that its interleaved copy stays in L2 while the
+lifting steps sweep over it.
+*/
+#define OPJ_DWT_STRIP_BYTES			(256 * 1024)
+#define OPJ_DWT_STRIP_MIN_VECTORS	4	/* 16 columns: one 64 byte cache line per row */
+#define OPJ_DWT_STRIP_MAX_VECTORS	16	/* 64 columns */
+
 static const float opj_dwt_alpha =  1.586134342f; /*  12994 */
 static const float opj_dwt_beta  =  0.052980118f; /*    434 */
 static const float opj_dwt_gamma = -0.882911075f; /*  -7233 */
@@ -110,30 +143,79 @@ Forward lazy transform (horizontal)
 */
 static void opj_dwt_deinterleave_h(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t cas);
 /**
-Forward lazy transform (vertical)
-*/
-static void opj_dwt_deinterleave_v(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t x, int32_t cas);
-/**
 Inverse lazy transform (horizontal)
 */
 static void opj_dwt_interleave_h(opj_dwt_t* h, int32_t *a);
 /**
-Inverse lazy transform (vertical)
+Best 5-3 lifting kernels for the CPU we are running on
 */
-static void opj_dwt_interleave_v(opj_dwt_t* v, int32_t *a, int32_t x);
+static const opj_dwt_lift_kernels_t* opj_dwt_get_lift_kernels(void);
 /**
-Forward 5-3 wavelet transform in 1-D
+One 5-3 lifting step over the n samples of band d, from the m samples of the other band x:
+d[i] +/-= (x[i + o0] + x[i + o1] + r) >> s, with x indices clamped to [0, m)
 */
-static void opj_dwt_encode_line_53(int32_t *a, int32_t dn, int32_t sn, int32_t cas);
+static void opj_dwt_lift_53(int32_t* d, int32_t n, const int32_t* x, int32_t m,
+                            int32_t o0, int32_t o1, int32_t r, int32_t s, bool subtract);
 /**
-Inverse 5-3 wavelet transform in 1-D
+Forward 5-3 wavelet transform in 1-D, on one row
 */
-static void opj_dwt_decode_line_53(opj_dwt_t *v);
+static void opj_dwt_encode_h_53(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas);
+/**
+Inverse 5-3 wavelet transform in 1-D, on one row
+*/
+static void opj_dwt_decode_h_53(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas);
 /**
 Forward 9-7 wavelet transform in 1-D
 */
 static void opj_dwt_encode_line_97(int32_t *a, int32_t dn, int32_t sn, int32_t cas);
 /**
+Forward 9-7 wavelet transform in 1-D, on one row
+*/
+static void opj_dwt_encode_h_97(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas);
+/**
+Number of four-column vectors in a vertical strip of a rw x rh resolution
+*/
+static int32_t opj_dwt_strip_vectors(uint32_t rw, uint32_t rh, uint32_t numThreads);
+/**
+Size in bytes of a per-thread scratch buffer, large enough for a row or a strip
+*/
+static size_t opj_dwt_strip_buffer_size(uint32_t max_res);
+/**
+Forward 5-3 wavelet transform in 1-D, on a strip of 4 * nv columns
+*/
+static void opj_v4dwt_encode_53(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas);
+/**
+Inverse 5-3 wavelet transform in 1-D, on a strip of 4 * nv columns
+*/
+static void opj_v4dwt_decode_53(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas);
+/**
+Forward 9-7 wavelet transform in 1-D, on a strip of 4 * nv columns
+*/
+static void opj_v4dwt_encode_97(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas);
+/**
+Copy nb (<= 4 * nv) adjacent columns of height n into a strip
+*/
+static void opj_dwt_strip_load(opj_v4i_t *b, const int32_t *a, int32_t x, int32_t n, int32_t nb, int32_t nv);
+/**
+Copy a strip back to nb (<= 4 * nv) adjacent columns of height n
+*/
+static void opj_dwt_strip_store(const opj_v4i_t *b, int32_t *a, int32_t x, int32_t n, int32_t nb, int32_t nv);
+/**
+Forward lazy transform (vertical) of a strip
+*/
+static void opj_dwt_strip_deinterleave_v(const opj_v4i_t *b, int32_t *a, int32_t dn, int32_t sn, int32_t x, int32_t cas, int32_t nb, int32_t nv);
+/**
+Inverse lazy transform (vertical) of a strip
+*/
+static void opj_dwt_strip_interleave_v(opj_v4i_t *b, const int32_t *a, int32_t dn, int32_t sn, int32_t x, int32_t cas, int32_t nb, int32_t nv);
+/**
+Forward wavelet transform in 2-D, shared by the 5-3 and 9-7 transforms
+*/
+static bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,
+									opj_dwt_encode_h_fn encode_h,
+									opj_v4dwt_encode_fn encode_v4,
+									uint32_t numThreads);
+/**
 Explicit calculation of the Quantization Stepsizes
 */
 static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsize_t *bandno_stepsize);
@@ -148,14 +230,14 @@ static void opj_v4dwt_interleave_h(opj_v4dwt_t* restrict w, float* restrict a, i
 static void opj_v4dwt_interleave_v(opj_v4dwt_t* restrict v , float* restrict a , int32_t x, int32_t nb_elts_read);
 
 #ifdef __SSE__
-static void opj_v4dwt_decode_step1_sse(opj_v4_t* w, int32_t count, const __m128 c);
+static void opj_v4dwt_decode_step1_sse(opj_v4_t* w, int32_t count, int32_t nv, const __m128 c);
 
-static void opj_v4dwt_decode_step2_sse(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, __m128 c);
+static void opj_v4dwt_decode_step2_sse(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, int32_t nv, __m128 c);
 
 #else
-static void opj_v4dwt_decode_step1(opj_v4_t* w, int32_t count, const float c);
+static void opj_v4dwt_decode_step1(opj_v4_t* w, int32_t count, int32_t nv, const float c);
 
-static void opj_v4dwt_decode_step2(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, float c);
+static void opj_v4dwt_decode_step2(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, int32_t nv, float c);
 
 #endif
 
@@ -220,32 +302,6 @@ static void opj_dwt_deinterleave_h(int32_t *a, int32_t *b, int32_t dn, int32_t s
     }
 }
 
-/* <summary>                             */
-/* Forward lazy transform (vertical).    */
-/* </summary>                            */
-static void opj_dwt_deinterleave_v(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t x, int32_t cas)
-{
-    int32_t i = sn;
-    int32_t * l_dest = b;
-    int32_t * l_src = a+cas;
-
-    while (i--) {
-        *l_dest = *l_src;
-        l_dest += x;
-        l_src += 2;
-    } /* b[i*x]=a[2*i+cas]; */
-
-    l_dest = b + sn * x;
-    l_src = a + 1 - cas;
-
-    i = dn;
-    while (i--) {
-        *l_dest = *l_src;
-        l_dest += x;
-        l_src += 2;
-    } /*b[(sn+i)*x]=a[(2*i+1-cas)];*/
-}
-
 /* <summary>                             */
 /* Inverse lazy transform (horizontal).  */
 /* </summary>                            */
@@ -268,119 +324,438 @@ static void opj_dwt_interleave_h(opj_dwt_t* h, int32_t *a)
 }
 
 /* <summary>                             */
-/* Inverse lazy transform (vertical).    */
+/* Forward 9-7 wavelet transform in 1-D. */
 /* </summary>                            */
-static void opj_dwt_interleave_v(opj_dwt_t* v, int32_t *a, int32_t x)
+static void opj_dwt_encode_line_97(int32_t *a, int32_t dn, int32_t sn, int32_t cas)
 {
-    int32_t *ai = a;
-    int32_t *bi = v->mem + v->cas;
-    int32_t  i = v->sn;
-    while( i-- ) {
-        *bi = *ai;
-        bi += 2;
-        ai += x;
+    int32_t i;
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            for (i = 0; i < dn; i++)
+                OPJ_D(i) -= opj_int_fix_mul(OPJ_S_(i) + OPJ_S_(i + 1), 12993);
+            for (i = 0; i < sn; i++)
+                OPJ_S(i) -= opj_int_fix_mul(OPJ_D_(i - 1) + OPJ_D_(i), 434);
+            for (i = 0; i < dn; i++)
+                OPJ_D(i) += opj_int_fix_mul(OPJ_S_(i) + OPJ_S_(i + 1), 7233);
+            for (i = 0; i < sn; i++)
+                OPJ_S(i) += opj_int_fix_mul(OPJ_D_(i - 1) + OPJ_D_(i), 3633);
+            for (i = 0; i < dn; i++)
+                OPJ_D(i) = opj_int_fix_mul(OPJ_D(i), 5038);	/*5038 */
+            for (i = 0; i < sn; i++)
+                OPJ_S(i) = opj_int_fix_mul(OPJ_S(i), 6659);	/*6660 */
+        }
+    } else {
+        if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            for (i = 0; i < dn; i++)
+                OPJ_S(i) -= opj_int_fix_mul(OPJ_DD_(i) + OPJ_DD_(i - 1), 12993);
+            for (i = 0; i < sn; i++)
+                OPJ_D(i) -= opj_int_fix_mul(OPJ_SS_(i) + OPJ_SS_(i + 1), 434);
+            for (i = 0; i < dn; i++)
+                OPJ_S(i) += opj_int_fix_mul(OPJ_DD_(i) + OPJ_DD_(i - 1), 7233);
+            for (i = 0; i < sn; i++)
+                OPJ_D(i) += opj_int_fix_mul(OPJ_SS_(i) + OPJ_SS_(i + 1), 3633);
+            for (i = 0; i < dn; i++)
+                OPJ_S(i) = opj_int_fix_mul(OPJ_S(i), 5038);	/*5038 */
+            for (i = 0; i < sn; i++)
+                OPJ_D(i) = opj_int_fix_mul(OPJ_D(i), 6659);	/*6660 */
+        }
     }
-    ai = a + (v->sn * x);
-    bi = v->mem + 1 - v->cas;
-    i = v->dn ;
-    while( i-- ) {
-        *bi = *ai;
-        bi += 2;
-        ai += x;
+}
+
+/* <summary>                                                     */
+/* Forward 9-7 wavelet transform in 1-D, on one row.             */
+/* </summary>                                                    */
+static void opj_dwt_encode_h_97(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas)
+{
+    memcpy(tmp, row, (size_t)(dn + sn) * sizeof(int32_t));
+    opj_dwt_encode_line_97(tmp, dn, sn, cas);
+    opj_dwt_deinterleave_h(tmp, row, dn, sn, cas);
+}
+
+/* <summary>                                                     */
+/* 5-3 lifting kernels.                                          */
+/* </summary>                                                    */
+static void opj_dwt_lift_add(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    for (size_t k = 0; k < n; ++k)
+        d[k] += (x[k] + y[k] + r) >> s;
+}
+
+static void opj_dwt_lift_sub(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    for (size_t k = 0; k < n; ++k)
+        d[k] -= (x[k] + y[k] + r) >> s;
+}
+
+#ifdef __SSE2__
+static void opj_dwt_lift_add_sse2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    const __m128i vr = _mm_set1_epi32(r);
+    const __m128i vs = _mm_cvtsi32_si128(s);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i t = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(x + k)), _mm_loadu_si128((const __m128i*)(y + k)));
+        t = _mm_sra_epi32(_mm_add_epi32(t, vr), vs);
+        _mm_storeu_si128((__m128i*)(d + k), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(d + k)), t));
     }
+    opj_dwt_lift_add(d + k, x + k, y + k, n - k, r, s);
 }
 
+static void opj_dwt_lift_sub_sse2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    const __m128i vr = _mm_set1_epi32(r);
+    const __m128i vs = _mm_cvtsi32_si128(s);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m128i t = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(x + k)), _mm_loadu_si128((const __m128i*)(y + k)));
+        t = _mm_sra_epi32(_mm_add_epi32(t, vr), vs);
+        _mm_storeu_si128((__m128i*)(d + k), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(d + k)), t));
+    }
+    opj_dwt_lift_sub(d + k, x + k, y + k, n - k, r, s);
+}
+#endif
 
-/* <summary>                            */
-/* Forward 5-3 wavelet transform in 1-D. */
-/* </summary>                           */
-static void opj_dwt_encode_line_53(int32_t *a, int32_t dn, int32_t sn, int32_t cas)
+static const opj_dwt_lift_kernels_t* opj_dwt_get_lift_kernels(void)
 {
-    int32_t i;
+    static const opj_dwt_lift_kernels_t kernels = []() {
+#ifdef OPJ_HAVE_AVX2
+        if (opj_cpu_has_avx2())
+            return opj_dwt_lift_kernels_t{ opj_dwt_lift_add_avx2, opj_dwt_lift_sub_avx2 };
+#endif
+#ifdef __SSE2__
+        return opj_dwt_lift_kernels_t{ opj_dwt_lift_add_sse2, opj_dwt_lift_sub_sse2 };
+#else
+        return opj_dwt_lift_kernels_t{ opj_dwt_lift_add, opj_dwt_lift_sub };
+#endif
+    }();
+    return &kernels;
+}
 
+/* <summary>                                                     */
+/* One 5-3 lifting step between the two bands of a row.          */
+/* </summary>                                                    */
+static void opj_dwt_lift_53(int32_t* d, int32_t n, const int32_t* x, int32_t m,
+                            int32_t o0, int32_t o1, int32_t r, int32_t s, bool subtract)
+{
+    /* samples whose neighbours need no clamping go through the vector kernel */
+    int32_t lo = opj_min<int32_t>(n, opj_max<int32_t>(0, -opj_min<int32_t>(o0, o1)));
+    int32_t hi = opj_max<int32_t>(lo, opj_min<int32_t>(n, m - opj_max<int32_t>(o0, o1)));
+    if (hi > lo) {
+        auto kernels = opj_dwt_get_lift_kernels();
+        (subtract ? kernels->sub : kernels->add)(d + lo, x + lo + o0, x + lo + o1, (size_t)(hi - lo), r, s);
+    }
+    auto edge = [=](int32_t i) {
+        int32_t j0 = i + o0 < 0 ? 0 : (i + o0 >= m ? m - 1 : i + o0);
+        int32_t j1 = i + o1 < 0 ? 0 : (i + o1 >= m ? m - 1 : i + o1);
+        int32_t t = (x[j0] + x[j1] + r) >> s;
+        d[i] = subtract ? d[i] - t : d[i] + t;
+    };
+    for (int32_t i = 0; i < lo; ++i)
+        edge(i);
+    for (int32_t i = hi; i < n; ++i)
+        edge(i);
+}
+
+/* <summary>                                                     */
+/* Forward 5-3 wavelet transform in 1-D, on one row.             */
+/* </summary>                                                    */
+static void opj_dwt_encode_h_53(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas)
+{
+    /* lift on the separated bands, so that the kernels see contiguous samples */
+    opj_dwt_deinterleave_h(row, tmp, dn, sn, cas);
+    int32_t* l = tmp;
+    int32_t* h = tmp + sn;
     if (!cas) {
-        if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
-            for (i = 0; i < dn; i++) OPJ_D(i) -= (OPJ_S_(i) + OPJ_S_(i + 1)) >> 1;
-            for (i = 0; i < sn; i++) OPJ_S(i) += (OPJ_D_(i - 1) + OPJ_D_(i) + 2) >> 2;
+        if ((dn > 0) || (sn > 1)) {
+            opj_dwt_lift_53(h, dn, l, sn, 0, 1, 0, 1, true);
+            opj_dwt_lift_53(l, sn, h, dn, -1, 0, 2, 2, false);
         }
     } else {
-        if (!sn && dn == 1)		    /* NEW :  CASE ONE ELEMENT */
-            OPJ_S(0) *= 2;
+        if (!sn && dn == 1)
+            h[0] *= 2;
         else {
-            for (i = 0; i < dn; i++) OPJ_S(i) -= (OPJ_DD_(i) + OPJ_DD_(i - 1)) >> 1;
-            for (i = 0; i < sn; i++) OPJ_D(i) += (OPJ_SS_(i) + OPJ_SS_(i + 1) + 2) >> 2;
+            opj_dwt_lift_53(h, dn, l, sn, 0, -1, 0, 1, true);
+            opj_dwt_lift_53(l, sn, h, dn, 0, 1, 2, 2, false);
         }
     }
+    memcpy(row, tmp, (size_t)(dn + sn) * sizeof(int32_t));
 }
 
+/* <summary>                                                     */
+/* Inverse 5-3 wavelet transform in 1-D, on one row.             */
+/* </summary>                                                    */
+static void opj_dwt_decode_h_53(int32_t *row, int32_t *tmp, int32_t dn, int32_t sn, int32_t cas)
+{
+    /* the row holds the separated bands: lift in place, then interleave */
+    int32_t* l = row;
+    int32_t* h = row + sn;
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) {
+            opj_dwt_lift_53(l, sn, h, dn, -1, 0, 2, 2, true);
+            opj_dwt_lift_53(h, dn, l, sn, 0, 1, 0, 1, false);
+        }
+    } else {
+        if (!sn && dn == 1)
+            h[0] /= 2;
+        else {
+            opj_dwt_lift_53(l, sn, h, dn, 0, 1, 2, 2, true);
+            opj_dwt_lift_53(h, dn, l, sn, 0, -1, 0, 1, false);
+        }
+    }
+    opj_dwt_t v;
+    v.mem = tmp;
+    v.dn = dn;
+    v.sn = sn;
+    v.cas = cas;
+    opj_dwt_interleave_h(&v, row);
+    memcpy(row, tmp, (size_t)(dn + sn) * sizeof(int32_t));
+}
 
-/* <summary>                            */
-/* Inverse 5-3 wavelet transform in 1-D. */
-/* </summary>                           */
-static void opj_dwt_decode_line_53(opj_dwt_t *v)
+/* <summary>                                                     */
+/* Number of four-column vectors in a vertical strip.            */
+/* </summary>                                                    */
+static int32_t opj_dwt_strip_vectors(uint32_t rw, uint32_t rh, uint32_t numThreads)
 {
-	int32_t *a = v->mem;
-	int32_t dn = v->dn;
-	int32_t sn = v->sn;
-	int32_t cas = v->cas;
-	int32_t i;
-
-	if (!cas) {
-		if ((dn > 0) || (sn > 1)) { /* NEW :  CASE ONE ELEMENT */
-			for (i = 0; i < sn; i++) OPJ_S(i) -= (OPJ_D_(i - 1) + OPJ_D_(i) + 2) >> 2;
-			for (i = 0; i < dn; i++) OPJ_D(i) += (OPJ_S_(i) + OPJ_S_(i + 1)) >> 1;
-		}
-	}
-	else {
-		if (!sn  && dn == 1)          /* NEW :  CASE ONE ELEMENT */
-			OPJ_S(0) /= 2;
-		else {
-			for (i = 0; i < sn; i++) OPJ_D(i) -= (OPJ_SS_(i) + OPJ_SS_(i + 1) + 2) >> 2;
-			for (i = 0; i < dn; i++) OPJ_S(i) += (OPJ_DD_(i) + OPJ_DD_(i - 1)) >> 1;
-		}
-	}
+    /* keep the interleaved strip within the L2 budget, but read at least
+       a full cache line from every row of a strip */
+    size_t nv = OPJ_DWT_STRIP_BYTES / ((size_t)opj_max<uint32_t>(rh, 1U) * sizeof(opj_v4i_t));
+    nv = opj_min<size_t>(opj_max<size_t>(nv, OPJ_DWT_STRIP_MIN_VECTORS), OPJ_DWT_STRIP_MAX_VECTORS);
+    /* but leave at least one strip for each thread */
+    size_t per_thread = ((size_t)rw + 4 * numThreads - 1) / (4 * numThreads);
+    return (int32_t)opj_max<size_t>(opj_min<size_t>(nv, per_thread), 1);
+}
 
+/* <summary>                                                     */
+/* Size of the per-thread scratch buffer for the 2-D transforms. */
+/* </summary>                                                    */
+static size_t opj_dwt_strip_buffer_size(uint32_t max_res)
+{
+    size_t nb_vectors = opj_max<size_t>((size_t)max_res * OPJ_DWT_STRIP_MIN_VECTORS,
+                                        OPJ_DWT_STRIP_BYTES / sizeof(opj_v4i_t));
+    nb_vectors = opj_min<size_t>(nb_vectors, (size_t)max_res * OPJ_DWT_STRIP_MAX_VECTORS);
+    return nb_vectors * sizeof(opj_v4i_t);
 }
 
-/* <summary>                             */
-/* Forward 9-7 wavelet transform in 1-D. */
-/* </summary>                            */
-static void opj_dwt_encode_line_97(int32_t *a, int32_t dn, int32_t sn, int32_t cas)
+/* <summary>                                                      */
+/* Lifting steps on rows of nv four-sample integer vectors.       */
+/* </summary>                                                     */
+
+/* d += (x + y + r) >> s */
+static inline void opj_v4i_add_shift(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t r, int32_t s)
+{
+    opj_dwt_get_lift_kernels()->add(d->i, x->i, y->i, 4 * (size_t)nv, r, s);
+}
+
+/* d -= (x + y + r) >> s */
+static inline void opj_v4i_sub_shift(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t r, int32_t s)
+{
+    opj_dwt_get_lift_kernels()->sub(d->i, x->i, y->i, 4 * (size_t)nv, r, s);
+}
+
+#ifdef __SSE2__
+/* opj_int_fix_mul on four lanes: SSE2 only has an unsigned 32x32->64 multiply,
+   so the signed product is recovered by subtracting c << 32 for negative a.
+   The low 32 bits of a logical and an arithmetic shift of the product agree. */
+static inline __m128i opj_v4i_fix_mul(__m128i a, __m128i c)
+{
+    const __m128i rnd = _mm_set_epi32(0, 4096, 0, 4096);
+    const __m128i lo = _mm_set_epi32(0, -1, 0, -1);
+    __m128i neg = _mm_and_si128(_mm_srai_epi32(a, 31), c);
+    __m128i even = _mm_mul_epu32(a, c);
+    even = _mm_sub_epi64(even, _mm_slli_epi64(neg, 32));
+    even = _mm_srli_epi64(_mm_add_epi64(even, rnd), 13);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), c);
+    odd = _mm_sub_epi64(odd, _mm_andnot_si128(lo, neg));
+    odd = _mm_srli_epi64(_mm_add_epi64(odd, rnd), 13);
+    return _mm_or_si128(_mm_and_si128(even, lo), _mm_slli_epi64(odd, 32));
+}
+
+/* d += fix_mul(x + y, c) *//* d += fix_mul(x + y, c) */
+static inline void opj_v4i_add_fix_mul(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t c)
+{
+    const __m128i vc = _mm_set1_epi32(c);
+    for (int32_t v = 0; v < nv; ++v) {
+        __m128i t = _mm_add_epi32(_mm_load_si128((const __m128i*)(x + v)), _mm_load_si128((const __m128i*)(y + v)));
+        t = opj_v4i_fix_mul(t, vc);
+        _mm_store_si128((__m128i*)(d + v), _mm_add_epi32(_mm_load_si128((const __m128i*)(d + v)), t));
+    }
+}
+
+/* d -= fix_mul(x + y, c) */
+static inline void opj_v4i_sub_fix_mul(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t c)
+{
+    const __m128i vc = _mm_set1_epi32(c);
+    for (int32_t v = 0; v < nv; ++v) {
+        __m128i t = _mm_add_epi32(_mm_load_si128((const __m128i*)(x + v)), _mm_load_si128((const __m128i*)(y + v)));
+        t = opj_v4i_fix_mul(t, vc);
+        _mm_store_si128((__m128i*)(d + v), _mm_sub_epi32(_mm_load_si128((const __m128i*)(d + v)), t));
+    }
+}
+
+/* d = fix_mul(d, c) */
+static inline void opj_v4i_scale(opj_v4i_t* d, int32_t nv, int32_t c)
+{
+    const __m128i vc = _mm_set1_epi32(c);
+    for (int32_t v = 0; v < nv; ++v)
+        _mm_store_si128((__m128i*)(d + v), opj_v4i_fix_mul(_mm_load_si128((const __m128i*)(d + v)), vc));
+}
+#else
+static inline void opj_v4i_add_fix_mul(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t k)
+{
+    for (int32_t v = 0; v < nv; ++v)
+        for (int32_t c = 0; c < 4; ++c)
+            d[v].i[c] += opj_int_fix_mul(x[v].i[c] + y[v].i[c], k);
+}
+
+static inline void opj_v4i_sub_fix_mul(opj_v4i_t* d, const opj_v4i_t* x, const opj_v4i_t* y, int32_t nv, int32_t k)
+{
+    for (int32_t v = 0; v < nv; ++v)
+        for (int32_t c = 0; c < 4; ++c)
+            d[v].i[c] -= opj_int_fix_mul(x[v].i[c] + y[v].i[c], k);
+}
+
+static inline void opj_v4i_scale(opj_v4i_t* d, int32_t nv, int32_t k)
+{
+    for (int32_t v = 0; v < nv; ++v)
+        for (int32_t c = 0; c < 4; ++c)
+            d[v].i[c] = opj_int_fix_mul(d[v].i[c], k);
+}
+#endif
+
+/* rows of a strip: sample i of the strip is the row of nv vectors at a + i * nv */
+#define OPJ_SV(i) (a + (size_t)(2*(i)) * (size_t)nv)
+#define OPJ_DV(i) (a + (size_t)(1+2*(i)) * (size_t)nv)
+#define OPJ_SV_(i) ((i)<0?OPJ_SV(0):((i)>=sn?OPJ_SV(sn-1):OPJ_SV(i)))
+#define OPJ_DV_(i) ((i)<0?OPJ_DV(0):((i)>=dn?OPJ_DV(dn-1):OPJ_DV(i)))
+#define OPJ_SSV_(i) ((i)<0?OPJ_SV(0):((i)>=dn?OPJ_SV(dn-1):OPJ_SV(i)))
+#define OPJ_DDV_(i) ((i)<0?OPJ_DV(0):((i)>=sn?OPJ_DV(sn-1):OPJ_DV(i)))
+
+/* <summary>                                                */
+/* Forward 5-3 wavelet transform in 1-D, on a strip.         */
+/* </summary>                                               */
+static void opj_v4dwt_encode_53(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas)
+{
+    int32_t i;
+
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            for (i = 0; i < dn; i++) opj_v4i_sub_shift(OPJ_DV(i), OPJ_SV_(i), OPJ_SV_(i + 1), nv, 0, 1);
+            for (i = 0; i < sn; i++) opj_v4i_add_shift(OPJ_SV(i), OPJ_DV_(i - 1), OPJ_DV_(i), nv, 2, 2);
+        }
+    } else {
+        if (!sn && dn == 1) {		    /* NEW :  CASE ONE ELEMENT */
+            for (int32_t v = 0; v < nv; ++v)
+                for (int32_t c = 0; c < 4; ++c)
+                    a[v].i[c] *= 2;
+        } else {
+            for (i = 0; i < dn; i++) opj_v4i_sub_shift(OPJ_SV(i), OPJ_DDV_(i), OPJ_DDV_(i - 1), nv, 0, 1);
+            for (i = 0; i < sn; i++) opj_v4i_add_shift(OPJ_DV(i), OPJ_SSV_(i), OPJ_SSV_(i + 1), nv, 2, 2);
+        }
+    }
+}
+
+/* <summary>                                                */
+/* Inverse 5-3 wavelet transform in 1-D, on a strip.         */
+/* </summary>                                               */
+static void opj_v4dwt_decode_53(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas)
+{
+    int32_t i;
+
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) { /* NEW :  CASE ONE ELEMENT */
+            for (i = 0; i < sn; i++) opj_v4i_sub_shift(OPJ_SV(i), OPJ_DV_(i - 1), OPJ_DV_(i), nv, 2, 2);
+            for (i = 0; i < dn; i++) opj_v4i_add_shift(OPJ_DV(i), OPJ_SV_(i), OPJ_SV_(i + 1), nv, 0, 1);
+        }
+    } else {
+        if (!sn && dn == 1) {          /* NEW :  CASE ONE ELEMENT */
+            for (int32_t v = 0; v < nv; ++v)
+                for (int32_t c = 0; c < 4; ++c)
+                    a[v].i[c] /= 2;
+        } else {
+            for (i = 0; i < sn; i++) opj_v4i_sub_shift(OPJ_DV(i), OPJ_SSV_(i), OPJ_SSV_(i + 1), nv, 2, 2);
+            for (i = 0; i < dn; i++) opj_v4i_add_shift(OPJ_SV(i), OPJ_DDV_(i), OPJ_DDV_(i - 1), nv, 0, 1);
+        }
+    }
+}
+
+/* <summary>                                                */
+/* Forward 9-7 wavelet transform in 1-D, on a strip.         */
+/* </summary>                                               */
+static void opj_v4dwt_encode_97(opj_v4i_t *a, int32_t nv, int32_t dn, int32_t sn, int32_t cas)
 {
     int32_t i;
     if (!cas) {
         if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
             for (i = 0; i < dn; i++)
-                OPJ_D(i) -= opj_int_fix_mul(OPJ_S_(i) + OPJ_S_(i + 1), 12993);
+                opj_v4i_sub_fix_mul(OPJ_DV(i), OPJ_SV_(i), OPJ_SV_(i + 1), nv, 12993);
             for (i = 0; i < sn; i++)
-                OPJ_S(i) -= opj_int_fix_mul(OPJ_D_(i - 1) + OPJ_D_(i), 434);
+                opj_v4i_sub_fix_mul(OPJ_SV(i), OPJ_DV_(i - 1), OPJ_DV_(i), nv, 434);
             for (i = 0; i < dn; i++)
-                OPJ_D(i) += opj_int_fix_mul(OPJ_S_(i) + OPJ_S_(i + 1), 7233);
+                opj_v4i_add_fix_mul(OPJ_DV(i), OPJ_SV_(i), OPJ_SV_(i + 1), nv, 7233);
             for (i = 0; i < sn; i++)
-                OPJ_S(i) += opj_int_fix_mul(OPJ_D_(i - 1) + OPJ_D_(i), 3633);
+                opj_v4i_add_fix_mul(OPJ_SV(i), OPJ_DV_(i - 1), OPJ_DV_(i), nv, 3633);
             for (i = 0; i < dn; i++)
-                OPJ_D(i) = opj_int_fix_mul(OPJ_D(i), 5038);	/*5038 */
+                opj_v4i_scale(OPJ_DV(i), nv, 5038);	/*5038 */
             for (i = 0; i < sn; i++)
-                OPJ_S(i) = opj_int_fix_mul(OPJ_S(i), 6659);	/*6660 */
+                opj_v4i_scale(OPJ_SV(i), nv, 6659);	/*6660 */
         }
     } else {
         if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
             for (i = 0; i < dn; i++)
-                OPJ_S(i) -= opj_int_fix_mul(OPJ_DD_(i) + OPJ_DD_(i - 1), 12993);
+                opj_v4i_sub_fix_mul(OPJ_SV(i), OPJ_DDV_(i), OPJ_DDV_(i - 1), nv, 12993);
             for (i = 0; i < sn; i++)
-                OPJ_D(i) -= opj_int_fix_mul(OPJ_SS_(i) + OPJ_SS_(i + 1), 434);
+                opj_v4i_sub_fix_mul(OPJ_DV(i), OPJ_SSV_(i), OPJ_SSV_(i + 1), nv, 434);
             for (i = 0; i < dn; i++)
-                OPJ_S(i) += opj_int_fix_mul(OPJ_DD_(i) + OPJ_DD_(i - 1), 7233);
+                opj_v4i_add_fix_mul(OPJ_SV(i), OPJ_DDV_(i), OPJ_DDV_(i - 1), nv, 7233);
             for (i = 0; i < sn; i++)
-                OPJ_D(i) += opj_int_fix_mul(OPJ_SS_(i) + OPJ_SS_(i + 1), 3633);
+                opj_v4i_add_fix_mul(OPJ_DV(i), OPJ_SSV_(i), OPJ_SSV_(i + 1), nv, 3633);
             for (i = 0; i < dn; i++)
-                OPJ_S(i) = opj_int_fix_mul(OPJ_S(i), 5038);	/*5038 */
+                opj_v4i_scale(OPJ_SV(i), nv, 5038);	/*5038 */
             for (i = 0; i < sn; i++)
-                OPJ_D(i) = opj_int_fix_mul(OPJ_D(i), 6659);	/*6660 */
+                opj_v4i_scale(OPJ_DV(i), nv, 6659);	/*6660 */
         }
     }
 }
 
+/* <summary>                                                      */
+/* Copy nb adjacent columns of height n into a strip, and back.   */
+/* </summary>                                                     */
+static void opj_dwt_strip_load(opj_v4i_t *b, const int32_t *a, int32_t x, int32_t n, int32_t nb, int32_t nv)
+{
+    for (int32_t k = 0; k < n; ++k) {
+        memcpy(b, a, (size_t)nb * sizeof(int32_t));
+        a += x;
+        b += nv;
+    }
+}
+
+static void opj_dwt_strip_store(const opj_v4i_t *b, int32_t *a, int32_t x, int32_t n, int32_t nb, int32_t nv)
+{
+    for (int32_t k = 0; k < n; ++k) {
+        memcpy(a, b, (size_t)nb * sizeof(int32_t));
+        a += x;
+        b += nv;
+    }
+}
+
+/* <summary>                                   */
+/* Forward lazy transform (vertical) of a strip. */
+/* </summary>                                  */
+static void opj_dwt_strip_deinterleave_v(const opj_v4i_t *b, int32_t *a, int32_t dn, int32_t sn, int32_t x, int32_t cas, int32_t nb, int32_t nv)
+{
+    opj_dwt_strip_store(b + cas * nv, a, x, sn, nb, 2 * nv);
+    opj_dwt_strip_store(b + (1 - cas) * nv, a + (size_t)sn * x, x, dn, nb, 2 * nv);
+}
+
+/* <summary>                                   */
+/* Inverse lazy transform (vertical) of a strip. */
+/* </summary>                                  */
+static void opj_dwt_strip_interleave_v(opj_v4i_t *b, const int32_t *a, int32_t dn, int32_t sn, int32_t x, int32_t cas, int32_t nb, int32_t nv)
+{
+    opj_dwt_strip_load(b + cas * nv, a, x, sn, nb, 2 * nv);
+    opj_dwt_strip_load(b + (1 - cas) * nv, a + (size_t)sn * x, x, dn, nb, 2 * nv);
+}
+
 static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsize_t *bandno_stepsize)
 {
     int32_t p, n;
@@ -397,93 +772,101 @@ static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsi
 */
 
 
-/* Forward 5-3 wavelet transform in 2-D. */
-/* </summary>                           */
-bool opj_dwt_encode_53(opj_tcd_tilecomp_t * tilec)
+/* <summary>                                  */
+/* Forward wavelet transform in 2-D.          */
+/* </summary>                                 */
+static bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,
+									opj_dwt_encode_h_fn encode_h,
+									opj_v4dwt_encode_fn encode_v4,
+									uint32_t numThreads)
 {
-	int32_t k;
-	int32_t *a = nullptr;
-	int32_t *aj = nullptr;
-	int32_t *bj = nullptr;
-	int32_t w;
-
-	int32_t rw;			/* width of the resolution level computed   */
-	int32_t rh;			/* height of the resolution level computed  */
-	size_t l_data_size;
-
-	opj_tcd_resolution_t * l_cur_res = 0;
-	opj_tcd_resolution_t * l_last_res = 0;
+	if (numThreads == 0)
+		numThreads = 1;
 
-	w = tilec->x1 - tilec->x0;
+	int32_t w = tilec->x1 - tilec->x0;
 	int32_t num_decomps = (int32_t)tilec->numresolutions - 1;
-	a = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+	int32_t* a = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+
+	opj_tcd_resolution_t * l_cur_res = tilec->resolutions + num_decomps;
+	opj_tcd_resolution_t * l_last_res = l_cur_res - 1;
+
+	/* one scratch buffer per worker, used both for rows and for strips of columns */
+	std::vector<opj_v4i_t*> mem(numThreads);
+	size_t l_data_size = opj_dwt_strip_buffer_size(opj_dwt_max_resolution(tilec->resolutions, tilec->numresolutions));
+	if (tilec->numresolutions == 1)
+		l_data_size = 0;
+	bool rc = true;
+	/* l_data_size is equal to 0 when numresolutions == 1 but the scratch buffers */
+	/* are not used in that case, so do not error out */
+	if (l_data_size != 0) {
+		for (auto& m : mem) {
+			m = (opj_v4i_t*)opj_aligned_malloc(l_data_size);
+			if (!m) {
+				rc = false;
+				goto cleanup;
+			}
+		}
+	}
 
-	l_cur_res = tilec->resolutions + num_decomps;
-	l_last_res = l_cur_res - 1;
+	while (num_decomps--) {
+		int32_t rw = l_cur_res->x1 - l_cur_res->x0;		/* width of the resolution level computed   */
+		int32_t rh = l_cur_res->y1 - l_cur_res->y0;		/* height of the resolution level computed  */
+		int32_t rw1 = l_last_res->x1 - l_last_res->x0;	/* width of the resolution level once lower than computed one   */
+		int32_t rh1 = l_last_res->y1 - l_last_res->y0;	/* height of the resolution level once lower than computed one  */
+
+		int32_t cas_row = l_cur_res->x0 & 1;	/* 0 = non inversion on horizontal filtering 1 = inversion between low-pass and high-pass filtering */
+		int32_t cas_col = l_cur_res->y0 & 1;	/* 0 = non inversion on vertical filtering 1 = inversion between low-pass and high-pass filtering   */
+
+		/* vertical pass, one strip of columns at a time */
+		int32_t nv = opj_dwt_strip_vectors((uint32_t)rw, (uint32_t)rh, numThreads);
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			int32_t sn = rh1;
+			int32_t dn = rh - rh1;
+			opj_v4i_t* bj = mem[threadId];
+			for (int32_t j = 4 * nv * (int32_t)threadId; j < rw; j += 4 * nv * (int32_t)numThreads) {
+				int32_t nb = opj_min<int32_t>(rw - j, 4 * nv);
+				opj_dwt_strip_load(bj, a + j, w, rh, nb, nv);
+				encode_v4(bj, nv, dn, sn, cas_col);
+				opj_dwt_strip_deinterleave_v(bj, a + j, dn, sn, w, cas_col, nb, nv);
+			}
+		});
 
+		/* horizontal pass */
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			int32_t sn = rw1;
+			int32_t dn = rw - rw1;
+			int32_t* bj = (int32_t*)mem[threadId];
+			for (int32_t j = (int32_t)threadId; j < rh; j += (int32_t)numThreads)
+				encode_h(a + j * w, bj, dn, sn, cas_row);
+		});
 
+		l_cur_res = l_last_res;
+		--l_last_res;
+	}
+cleanup:
+	for (auto m : mem)
+		opj_aligned_free(m);
+	return rc;
+}
 
+/* <summary>                            */
+/* Forward 5-3 wavelet transform in 2-D. */
+/* </summary>                           */
+bool opj_dwt_encode_53(opj_tcd_tilecomp_t * tilec, uint32_t numThreads)
+{
 #ifdef DEBUG_LOSSLESS_DWT
+	int32_t* a = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+	opj_tcd_resolution_t * l_cur_res = tilec->resolutions + tilec->numresolutions - 1;
 	int32_t rw_full = l_cur_res->x1 - l_cur_res->x0;
 	int32_t rh_full = l_cur_res->y1 - l_cur_res->y0;
 	int32_t* before = new int32_t[rw_full * rh_full];
 	memcpy(before, a, rw_full * rh_full * sizeof(int32_t));
 	int32_t* after = new int32_t[rw_full * rh_full];
-
 #endif
 
-	l_data_size = opj_dwt_max_resolution(tilec->resolutions, tilec->numresolutions) * sizeof(int32_t);
-	/* overflow check */
-	if (l_data_size > SIZE_MAX) {
-		/* FIXME event manager error callback */
-		return false;
-	}
-	bj = (int32_t*)opj_malloc(l_data_size);
-	/* l_data_size is equal to 0 when numresolutions == 1 but bj is not used */
-	/* in that case, so do not error out */
-	if (l_data_size != 0 && !bj) {
+	if (!opj_dwt_encode_procedure(tilec, opj_dwt_encode_h_53, opj_v4dwt_encode_53, numThreads))
 		return false;
-	}
 
-	while (num_decomps--) {
-		int32_t rw1;		/* width of the resolution level once lower than computed one                                       */
-		int32_t rh1;		/* height of the resolution level once lower than computed one                                      */
-		int32_t cas_col;	/* 0 = non inversion on horizontal filtering 1 = inversion between low-pass and high-pass filtering */
-		int32_t cas_row;	/* 0 = non inversion on vertical filtering 1 = inversion between low-pass and high-pass filtering   */
-		int32_t dn, sn;
-
-		rw = l_cur_res->x1 - l_cur_res->x0;
-		rh = l_cur_res->y1 - l_cur_res->y0;
-		rw1 = l_last_res->x1 - l_last_res->x0;
-		rh1 = l_last_res->y1 - l_last_res->y0;
-
-		cas_row = l_cur_res->x0 & 1;
-		cas_col = l_cur_res->y0 & 1;
-
-		sn = rh1;
-		dn = rh - rh1;
-
-		for (int32_t j = 0; j < rw; ++j) {
-			aj = a + j;
-			for (k = 0; k < rh; ++k) {
-				bj[k] = aj[k*w];
-			}
-			opj_dwt_encode_line_53(bj, dn, sn, cas_col);
-			opj_dwt_deinterleave_v(bj, aj, dn, sn, w, cas_col);
-		}
-		sn = rw1;
-		dn = rw - rw1;
-
-		for (int32_t j = 0; j < rh; j++) {
-			aj = a + j * w;
-			for (k = 0; k < rw; k++)  bj[k] = aj[k];
-			opj_dwt_encode_line_53(bj, dn, sn, cas_row);
-			opj_dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
-		}
-		l_cur_res = l_last_res;
-		--l_last_res;
-	}
-	opj_free(bj);
 #ifdef DEBUG_LOSSLESS_DWT
 	memcpy(after, a, rw_full * rh_full * sizeof(int32_t));
 	opj_dwt_decode_53(tilec, tilec->numresolutions, 8);
@@ -505,83 +888,10 @@ bool opj_dwt_encode_53(opj_tcd_tilecomp_t * tilec)
 
 /* <summary>                             */
 /* Forward 9-7 wavelet transform in 2-D. */
-/* </summary>                            */
-bool opj_dwt_encode_97(opj_tcd_tilecomp_t * tilec)
+/* </summary>                           */
+bool opj_dwt_encode_97(opj_tcd_tilecomp_t * tilec, uint32_t numThreads)
 {
-	int32_t i, k;
-	int32_t *a = nullptr;
-	int32_t *aj = nullptr;
-	int32_t *bj = nullptr;
-	int32_t w, l;
-
-	int32_t rw;			/* width of the resolution level computed   */
-	int32_t rh;			/* height of the resolution level computed  */
-	size_t l_data_size;
-
-	opj_tcd_resolution_t * l_cur_res = 0;
-	opj_tcd_resolution_t * l_last_res = 0;
-
-	w = tilec->x1 - tilec->x0;
-	l = (int32_t)tilec->numresolutions - 1;
-	a = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-
-	l_cur_res = tilec->resolutions + l;
-	l_last_res = l_cur_res - 1;
-
-	l_data_size = opj_dwt_max_resolution(tilec->resolutions, tilec->numresolutions) * sizeof(int32_t);
-	/* overflow check */
-	if (l_data_size > SIZE_MAX) {
-		/* FIXME event manager error callback */
-		return false;
-	}
-	bj = (int32_t*)opj_malloc(l_data_size);
-	/* l_data_size is equal to 0 when numresolutions == 1 but bj is not used */
-	/* in that case, so do not error out */
-	if (l_data_size != 0 && !bj) {
-		return false;
-	}
-	i = l;
-
-	while (i--) {
-		int32_t rw1;		/* width of the resolution level once lower than computed one                                       */
-		int32_t rh1;		/* height of the resolution level once lower than computed one                                      */
-		int32_t cas_col;	/* 0 = non inversion on horizontal filtering 1 = inversion between low-pass and high-pass filtering */
-		int32_t cas_row;	/* 0 = non inversion on vertical filtering 1 = inversion between low-pass and high-pass filtering   */
-		int32_t dn, sn;
-
-		rw = l_cur_res->x1 - l_cur_res->x0;
-		rh = l_cur_res->y1 - l_cur_res->y0;
-		rw1 = l_last_res->x1 - l_last_res->x0;
-		rh1 = l_last_res->y1 - l_last_res->y0;
-
-		cas_row = l_cur_res->x0 & 1;
-		cas_col = l_cur_res->y0 & 1;
-
-		sn = rh1;
-		dn = rh - rh1;
-		for (int32_t j = 0; j < rw; ++j) {
-			aj = a + j;
-			for (k = 0; k < rh; ++k) {
-				bj[k] = aj[k*w];
-			}
-			opj_dwt_encode_line_97(bj, dn, sn, cas_col);
-			opj_dwt_deinterleave_v(bj, aj, dn, sn, w, cas_col);
-		}
-		sn = rw1;
-		dn = rw - rw1;
-
-		for (int32_t j = 0; j < rh; j++) {
-			aj = a + j * w;
-			for (k = 0; k < rw; k++)  bj[k] = aj[k];
-			opj_dwt_encode_line_97(bj, dn, sn, cas_row);
-			opj_dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
-		}
-		l_cur_res = l_last_res;
-		--l_last_res;
-	}
-
-	opj_free(bj);
-	return true;
+	return opj_dwt_encode_procedure(tilec, opj_dwt_encode_h_97, opj_v4dwt_encode_97, numThreads);
 }
 
 /* <summary>                            */
@@ -597,87 +907,60 @@ bool opj_dwt_decode_53(opj_tcd_tilecomp_t* tilec,
     if (opj_tile_buf_is_decode_region(tilec->buf))
         return opj_dwt_region_decode53(tilec, numres, numThreads);
 
-	std::vector<std::thread> dwtWorkers;
-	int rc = 0;
 	auto tileBuf = (int32_t*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([tilec,
-			numres,
-			&rc,
-			tileBuf,
-			&decode_dwt_barrier,
-			&decode_dwt_calling_barrier,
-			threadId,
-			numThreads]()
-		{
-			auto numResolutions = numres;
-			opj_dwt_t h;
-			opj_dwt_t v;
-
-			opj_tcd_resolution_t* tr = tilec->resolutions;
-
-			uint32_t rw = (tr->x1 - tr->x0);	/* width of the resolution level computed */
-			uint32_t rh = (tr->y1 - tr->y0);	/* height of the resolution level computed */
-
-			uint32_t w = (tilec->x1 - tilec->x0);
-			h.mem = (int32_t*)opj_aligned_malloc(opj_dwt_max_resolution(tr, numResolutions) * sizeof(int32_t));
-			if (!h.mem) {
-				rc++;
-				goto cleanup;
-			}
-
-			v.mem = h.mem;
-
-			while (--numResolutions) {
-				int32_t * restrict tiledp = tileBuf;
-
-				++tr;
-				h.sn = (int32_t)rw;
-				v.sn = (int32_t)rh;
-
-				rw = (tr->x1 - tr->x0);
-				rh = (tr->y1 - tr->y0);
-
-				h.dn = (int32_t)(rw - (uint32_t)h.sn);
-				h.cas = tr->x0 % 2;
-
-				for (uint32_t j = threadId; j < rh; j += numThreads) {
-					opj_dwt_interleave_h(&h, &tiledp[j*w]);
-					opj_dwt_decode_line_53(&h);
-					memcpy(&tiledp[j*w], h.mem, rw * sizeof(int32_t));
-				}
-
-				v.dn = (int32_t)(rh - (uint32_t)v.sn);
-				v.cas = tr->y0 % 2;
-
-				decode_dwt_barrier.arrive_and_wait();
-
-				for (uint32_t j = threadId; j < rw; j += numThreads) {
-					opj_dwt_interleave_v(&v, &tiledp[j], (int32_t)w);
-					opj_dwt_decode_line_53(&v);
-					for (uint32_t k = 0; k < rh; ++k) {
-						tiledp[k * w + j] = v.mem[k];
-					}
-				}
-				decode_dwt_barrier.arrive_and_wait();
-			}
-		cleanup:
-			if (h.mem)
-				opj_aligned_free(h.mem);
-			decode_dwt_calling_barrier.arrive_and_wait();
-
-		}));
+	opj_tcd_resolution_t* tr = tilec->resolutions;
+
+	uint32_t rw = (tr->x1 - tr->x0);	/* width of the resolution level computed */
+	uint32_t rh = (tr->y1 - tr->y0);	/* height of the resolution level computed */
+
+	uint32_t w = (tilec->x1 - tilec->x0);
+
+	/* one scratch buffer per worker, used both for rows and for strips of columns */
+	std::vector<int32_t*> mem(numThreads);
+	auto memSize = opj_dwt_strip_buffer_size(opj_dwt_max_resolution(tr, numres));
+	bool rc = true;
+	for (auto& m : mem) {
+		m = (int32_t*)opj_aligned_malloc(memSize);
+		if (!m) {
+			rc = false;
+			goto cleanup;
+		}
 	}
-	decode_dwt_calling_barrier.arrive_and_wait();
 
-	for (auto& t : dwtWorkers) {
-		t.join();
+	for (auto numResolutions = numres; --numResolutions; ) {
+		int32_t h_sn = (int32_t)rw;
+		int32_t v_sn = (int32_t)rh;
+
+		++tr;
+		rw = (tr->x1 - tr->x0);
+		rh = (tr->y1 - tr->y0);
+		int32_t h_cas = tr->x0 % 2;
+		int32_t v_cas = tr->y0 % 2;
+
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			int32_t dn = (int32_t)(rw - (uint32_t)h_sn);
+			for (uint32_t j = (uint32_t)threadId; j < rh; j += numThreads)
+				opj_dwt_decode_h_53(&tileBuf[j*w], mem[threadId], dn, h_sn, h_cas);
+		});
+
+		/* vertical pass, one strip of columns at a time */
+		int32_t nv = opj_dwt_strip_vectors(rw, rh, numThreads);
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			auto bj = (opj_v4i_t*)mem[threadId];
+			int32_t sn = v_sn;
+			int32_t dn = (int32_t)(rh - (uint32_t)v_sn);
+			for (uint32_t j = 4 * (uint32_t)nv * (uint32_t)threadId; j < rw; j += 4 * (uint32_t)nv * numThreads) {
+				int32_t nb = (int32_t)opj_min<uint32_t>(rw - j, 4 * (uint32_t)nv);
+				opj_dwt_strip_interleave_v(bj, &tileBuf[j], dn, sn, (int32_t)w, v_cas, nb, nv);
+				opj_v4dwt_decode_53(bj, nv, dn, sn, v_cas);
+				opj_dwt_strip_store(bj, &tileBuf[j], (int32_t)w, (int32_t)rh, nb, nv);
+			}
+		});
 	}
-	return rc == 0 ? true : false;
-
+cleanup:
+	for (auto m : mem)
+		opj_aligned_free(m);
+	return rc;
 }
 
 
@@ -803,135 +1086,115 @@ static void opj_v4dwt_interleave_h(opj_v4dwt_t* restrict w, float* restrict a, i
 
 static void opj_v4dwt_interleave_v(opj_v4dwt_t* restrict v , float* restrict a , int32_t x, int32_t nb_elts_read)
 {
-    opj_v4_t* restrict bi = v->wavelet + v->cas;
+    opj_v4_t* restrict bi = v->wavelet + v->cas * v->nv;
+    int32_t nv = v->nv;
     int32_t i;
 
     for(i = 0; i < v->sn; ++i) {
-        memcpy(&bi[i*2], &a[i*x], (size_t)nb_elts_read * sizeof(float));
+        memcpy(&bi[i*2*nv], &a[i*x], (size_t)nb_elts_read * sizeof(float));
     }
 
     a += v->sn * x;
-    bi = v->wavelet + 1 - v->cas;
+    bi = v->wavelet + (1 - v->cas) * nv;
 
     for(i = 0; i < v->dn; ++i) {
-        memcpy(&bi[i*2], &a[i*x], (size_t)nb_elts_read * sizeof(float));
+        memcpy(&bi[i*2*nv], &a[i*x], (size_t)nb_elts_read * sizeof(float));
     }
 }
 
 #ifdef __SSE__
 
-static void opj_v4dwt_decode_step1_sse(opj_v4_t* w, int32_t count, const __m128 c)
+static void opj_v4dwt_decode_step1_sse(opj_v4_t* w, int32_t count, int32_t nv, const __m128 c)
 {
     __m128* restrict vw = (__m128*) w;
-    int32_t i;
-    /* 4x unrolled loop */
-    for(i = 0; i < count >> 2; ++i) {
-        *vw = _mm_mul_ps(*vw, c);
-        vw += 2;
-        *vw = _mm_mul_ps(*vw, c);
-        vw += 2;
-        *vw = _mm_mul_ps(*vw, c);
-        vw += 2;
-        *vw = _mm_mul_ps(*vw, c);
-        vw += 2;
+    int32_t i, v;
+    if (nv == 1) {
+        /* 4x unrolled loop */
+        for(i = 0; i < count >> 2; ++i) {
+            *vw = _mm_mul_ps(*vw, c);
+            vw += 2;
+            *vw = _mm_mul_ps(*vw, c);
+            vw += 2;
+            *vw = _mm_mul_ps(*vw, c);
+            vw += 2;
+            *vw = _mm_mul_ps(*vw, c);
+            vw += 2;
+        }
+        count &= 3;
     }
-    count &= 3;
     for(i = 0; i < count; ++i) {
-        *vw = _mm_mul_ps(*vw, c);
-        vw += 2;
+        for (v = 0; v < nv; ++v)
+            vw[v] = _mm_mul_ps(vw[v], c);
+        vw += 2 * nv;
     }
 }
 
-void opj_v4dwt_decode_step2_sse(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, __m128 c)
+void opj_v4dwt_decode_step2_sse(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, int32_t nv, __m128 c)
 {
     __m128* restrict vl = (__m128*) l;
     __m128* restrict vw = (__m128*) w;
-    int32_t i;
-    __m128 tmp1, tmp2, tmp3;
-    tmp1 = vl[0];
-    for(i = 0; i < m; ++i) {
-        tmp2 = vw[-1];
-        tmp3 = vw[ 0];
-        vw[-1] = _mm_add_ps(tmp2, _mm_mul_ps(_mm_add_ps(tmp1, tmp3), c));
-        tmp1 = tmp3;
-        vw += 2;
+    int32_t i, v;
+    if (nv == 1) {
+        __m128 tmp1, tmp2, tmp3;
+        tmp1 = vl[0];
+        for(i = 0; i < m; ++i) {
+            tmp2 = vw[-1];
+            tmp3 = vw[ 0];
+            vw[-1] = _mm_add_ps(tmp2, _mm_mul_ps(_mm_add_ps(tmp1, tmp3), c));
+            tmp1 = tmp3;
+            vw += 2;
+        }
+        if (m > 0)
+            vl = vw - 2;
+    } else {
+        for(i = 0; i < m; ++i) {
+            for (v = 0; v < nv; ++v)
+                vw[v - nv] = _mm_add_ps(vw[v - nv], _mm_mul_ps(_mm_add_ps(vl[v], vw[v]), c));
+            vl = vw;
+            vw += 2 * nv;
+        }
     }
-    vl = vw - 2;
     if(m >= k) {
         return;
     }
     c = _mm_add_ps(c, c);
-    c = _mm_mul_ps(c, vl[0]);
     for(; m < k; ++m) {
-        __m128 tmp = vw[-1];
-        vw[-1] = _mm_add_ps(tmp, c);
-        vw += 2;
+        for (v = 0; v < nv; ++v)
+            vw[v - nv] = _mm_add_ps(vw[v - nv], _mm_mul_ps(c, vl[v]));
+        vw += 2 * nv;
     }
 }
 
 #else
 
-static void opj_v4dwt_decode_step1(opj_v4_t* w, int32_t count, const float c)
+static void opj_v4dwt_decode_step1(opj_v4_t* w, int32_t count, int32_t nv, const float c)
 {
     float* restrict fw = (float*) w;
-    int32_t i;
+    int32_t i, j;
     for(i = 0; i < count; ++i) {
-        float tmp1 = fw[i*8    ];
-        float tmp2 = fw[i*8 + 1];
-        float tmp3 = fw[i*8 + 2];
-        float tmp4 = fw[i*8 + 3];
-        fw[i*8    ] = tmp1 * c;
-        fw[i*8 + 1] = tmp2 * c;
-        fw[i*8 + 2] = tmp3 * c;
-        fw[i*8 + 3] = tmp4 * c;
+        for (j = 0; j < 4 * nv; ++j)
+            fw[j] *= c;
+        fw += 8 * nv;
     }
 }
 
-static void opj_v4dwt_decode_step2(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, float c)
+static void opj_v4dwt_decode_step2(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t m, int32_t nv, float c)
 {
     float* fl = (float*) l;
     float* fw = (float*) w;
-    int32_t i;
+    int32_t i, j;
     for(i = 0; i < m; ++i) {
-        float tmp1_1 = fl[0];
-        float tmp1_2 = fl[1];
-        float tmp1_3 = fl[2];
-        float tmp1_4 = fl[3];
-        float tmp2_1 = fw[-4];
-        float tmp2_2 = fw[-3];
-        float tmp2_3 = fw[-2];
-        float tmp2_4 = fw[-1];
-        float tmp3_1 = fw[0];
-        float tmp3_2 = fw[1];
-        float tmp3_3 = fw[2];
-        float tmp3_4 = fw[3];
-        fw[-4] = tmp2_1 + ((tmp1_1 + tmp3_1) * c);
-        fw[-3] = tmp2_2 + ((tmp1_2 + tmp3_2) * c);
-        fw[-2] = tmp2_3 + ((tmp1_3 + tmp3_3) * c);
-        fw[-1] = tmp2_4 + ((tmp1_4 + tmp3_4) * c);
+        for (j = 0; j < 4 * nv; ++j)
+            fw[j - 4 * nv] += (fl[j] + fw[j]) * c;
         fl = fw;
-        fw += 8;
+        fw += 8 * nv;
     }
     if(m < k) {
-        float c1;
-        float c2;
-        float c3;
-        float c4;
         c += c;
-        c1 = fl[0] * c;
-        c2 = fl[1] * c;
-        c3 = fl[2] * c;
-        c4 = fl[3] * c;
         for(; m < k; ++m) {
-            float tmp1 = fw[-4];
-            float tmp2 = fw[-3];
-            float tmp3 = fw[-2];
-            float tmp4 = fw[-1];
-            fw[-4] = tmp1 + c1;
-            fw[-3] = tmp2 + c2;
-            fw[-2] = tmp3 + c3;
-            fw[-1] = tmp4 + c4;
-            fw += 8;
+            for (j = 0; j < 4 * nv; ++j)
+                fw[j - 4 * nv] += fl[j] * c;
+            fw += 8 * nv;
         }
     }
 }
@@ -944,6 +1207,7 @@ static void opj_v4dwt_decode_step2(opj_v4_t* l, opj_v4_t* w, int32_t k, int32_t
 static void opj_v4dwt_decode(opj_v4dwt_t* restrict dwt)
 {
     int32_t a, b;
+    int32_t nv = dwt->nv;
     if(dwt->cas == 0) {
         if(!((dwt->dn > 0) || (dwt->sn > 1))) {
             return;
@@ -958,23 +1222,22 @@ static void opj_v4dwt_decode(opj_v4dwt_t* restrict dwt)
         b = 0;
     }
 #ifdef __SSE__
-    opj_v4dwt_decode_step1_sse(dwt->wavelet+a, dwt->sn, _mm_set1_ps(opj_K));
-    opj_v4dwt_decode_step1_sse(dwt->wavelet+b, dwt->dn, _mm_set1_ps(opj_c13318));
-    opj_v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), _mm_set1_ps(opj_dwt_delta));
-    opj_v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), _mm_set1_ps(opj_dwt_gamma));
-    opj_v4dwt_decode_step2_sse(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), _mm_set1_ps(opj_dwt_beta));
-    opj_v4dwt_decode_step2_sse(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), _mm_set1_ps(opj_dwt_alpha));
+    opj_v4dwt_decode_step1_sse(dwt->wavelet+a*nv, dwt->sn, nv, _mm_set1_ps(opj_K));
+    opj_v4dwt_decode_step1_sse(dwt->wavelet+b*nv, dwt->dn, nv, _mm_set1_ps(opj_c13318));
+    opj_v4dwt_decode_step2_sse(dwt->wavelet+b*nv, dwt->wavelet+(a+1)*nv, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), nv, _mm_set1_ps(opj_dwt_delta));
+    opj_v4dwt_decode_step2_sse(dwt->wavelet+a*nv, dwt->wavelet+(b+1)*nv, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), nv, _mm_set1_ps(opj_dwt_gamma));
+    opj_v4dwt_decode_step2_sse(dwt->wavelet+b*nv, dwt->wavelet+(a+1)*nv, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), nv, _mm_set1_ps(opj_dwt_beta));
+    opj_v4dwt_decode_step2_sse(dwt->wavelet+a*nv, dwt->wavelet+(b+1)*nv, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), nv, _mm_set1_ps(opj_dwt_alpha));
 #else
-    opj_v4dwt_decode_step1(dwt->wavelet+a, dwt->sn, opj_K);
-    opj_v4dwt_decode_step1(dwt->wavelet+b, dwt->dn, opj_c13318);
-    opj_v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), opj_dwt_delta);
-    opj_v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), opj_dwt_gamma);
-    opj_v4dwt_decode_step2(dwt->wavelet+b, dwt->wavelet+a+1, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), opj_dwt_beta);
-    opj_v4dwt_decode_step2(dwt->wavelet+a, dwt->wavelet+b+1, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), opj_dwt_alpha);
+    opj_v4dwt_decode_step1(dwt->wavelet+a*nv, dwt->sn, nv, opj_K);
+    opj_v4dwt_decode_step1(dwt->wavelet+b*nv, dwt->dn, nv, opj_c13318);
+    opj_v4dwt_decode_step2(dwt->wavelet+b*nv, dwt->wavelet+(a+1)*nv, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), nv, opj_dwt_delta);
+    opj_v4dwt_decode_step2(dwt->wavelet+a*nv, dwt->wavelet+(b+1)*nv, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), nv, opj_dwt_gamma);
+    opj_v4dwt_decode_step2(dwt->wavelet+b*nv, dwt->wavelet+(a+1)*nv, dwt->sn, opj_min<int32_t>(dwt->sn, dwt->dn-a), nv, opj_dwt_beta);
+    opj_v4dwt_decode_step2(dwt->wavelet+a*nv, dwt->wavelet+(b+1)*nv, dwt->dn, opj_min<int32_t>(dwt->dn, dwt->sn-b), nv, opj_dwt_alpha);
 #endif
 }
 
-
 /* <summary>                             */
 /* Inverse 9-7 wavelet transform in 2-D. */
 /* </summary>                            */
@@ -988,129 +1251,104 @@ bool opj_dwt_decode_97(opj_tcd_tilecomp_t* restrict tilec,
 	if (opj_tile_buf_is_decode_region(tilec->buf))
 		return opj_dwt_region_decode97(tilec, numres, numThreads);
 
-	int rc = 0;
 	auto tileBuf = (float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-	std::vector<std::thread> dwtWorkers;
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([ tilec,
-											numres,
-											&rc,
-											tileBuf,
-											&decode_dwt_barrier,
-											&decode_dwt_calling_barrier,
-											threadId,
-											numThreads]()
-		{
-			auto numResolutions = numres;
-			opj_v4dwt_t h;
-			opj_v4dwt_t v;
+	opj_tcd_resolution_t* res = tilec->resolutions;
+
+	uint32_t rw = (res->x1 - res->x0);	/* width of the resolution level computed */
+	uint32_t rh = (res->y1 - res->y0);	/* height of the resolution level computed */
+
+	uint32_t w = (tilec->x1 - tilec->x0);
+
+	/* one scratch buffer per worker, used both for groups of rows and for strips of columns */
+	std::vector<opj_v4_t*> wavelets(numThreads);
+	auto waveletSize = opj_dwt_strip_buffer_size(opj_dwt_max_resolution(res, numres));
+	bool rc = true;
+	for (auto& wavelet : wavelets) {
+		wavelet = (opj_v4_t*)opj_aligned_malloc(waveletSize);
+		if (!wavelet) {
+			/* FIXME event manager error callback */
+			rc = false;
+			goto cleanup;
+		}
+	}
 
-			opj_tcd_resolution_t* res = tilec->resolutions;
+	for (auto numResolutions = numres; --numResolutions;) {
+		int32_t h_sn = (int32_t)rw;
+		int32_t v_sn = (int32_t)rh;
 
-			uint32_t rw = (res->x1 - res->x0);	/* width of the resolution level computed */
-			uint32_t rh = (res->y1 - res->y0);	/* height of the resolution level computed */
+		++res;
 
-			uint32_t w = (tilec->x1 - tilec->x0);
+		rw = (res->x1 - res->x0);	// width of the resolution level computed 
+		rh = (res->y1 - res->y0);	// height of the resolution level computed 
 
-			h.wavelet = (opj_v4_t*)opj_aligned_malloc((opj_dwt_max_resolution(res, numResolutions)) * sizeof(opj_v4_t));
-			if (!h.wavelet) {
-				/* FIXME event manager error callback */
-				rc++;
-				goto cleanup;
-			}
-			v.wavelet = h.wavelet;
-
-			
-			while (--numResolutions) {
-				float * restrict aj = tileBuf + ((w << 2) * threadId);
-				uint64_t bufsize = (uint64_t)(tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) - (threadId * (w << 2));
-
-				h.sn = (int32_t)rw;
-				v.sn = (int32_t)rh;
-
-				++res;
-
-				rw = (res->x1 - res->x0);	// width of the resolution level computed 
-				rh = (res->y1 - res->y0);	// height of the resolution level computed 
-
-				h.dn = (int32_t)(rw - (uint32_t)h.sn);
-				h.cas = res->x0 & 1;
-				int32_t j;
-				for (j = (int32_t)rh - (threadId<<2); j > 3; j -= (numThreads <<2)) {
-					opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
-					opj_v4dwt_decode(&h);
-					
-					for (int32_t k = (int32_t)rw; k-- > 0;) {
-						aj[(uint32_t)k] = h.wavelet[k].f[0];
-						aj[(uint32_t)k + w] = h.wavelet[k].f[1];
-						aj[(uint32_t)k + (w << 1)] = h.wavelet[k].f[2];
-						aj[(uint32_t)k + w * 3] = h.wavelet[k].f[3];
-					}
-					
-					aj += (w << 2) * numThreads;
-					bufsize -= (w << 2) * numThreads;
-				}
-				decode_dwt_barrier.arrive_and_wait();
-				
-				if (j > 0 ) {
-					opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
-					opj_v4dwt_decode(&h);
-					for (int32_t k = (int32_t)rw; k-- > 0;) {
-						switch (j) {
-						case 3:
-							aj[k + (int32_t)(w << 1)] = h.wavelet[k].f[2];
-						case 2:
-							aj[k + (int32_t)w] = h.wavelet[k].f[1];
-						case 1:
-							aj[k] = h.wavelet[k].f[0];
-						}
-					}
-				}
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				v.dn = (int32_t)(rh - (uint32_t)v.sn);
-				v.cas = res->y0 & 1;
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				aj = tileBuf + (threadId << 2);
-				for (j = (int32_t)rw - (threadId<<2); j > 3; j -= (numThreads <<2)) {
-					opj_v4dwt_interleave_v(&v, aj, (int32_t)w, 4);
-					opj_v4dwt_decode(&v);
-
-					for (uint32_t k = 0; k < rh; ++k) {
-						memcpy(&aj[k*w], &v.wavelet[k], 4 * sizeof(float));
-					}
-					aj += (numThreads <<2);
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_v4dwt_t h;
+			h.wavelet = wavelets[threadId];
+			h.nv = 1;
+			h.sn = h_sn;
+			h.dn = (int32_t)(rw - (uint32_t)h_sn);
+			h.cas = res->x0 & 1;
+
+			float * restrict aj = tileBuf + ((w << 2) * threadId);
+			uint64_t bufsize = (uint64_t)(tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) - (threadId * (w << 2));
+			int32_t j;
+			for (j = (int32_t)rh - (int32_t)(threadId<<2); j > 3; j -= (int32_t)(numThreads <<2)) {
+				opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
+				opj_v4dwt_decode(&h);
+
+				for (int32_t k = (int32_t)rw; k-- > 0;) {
+					aj[(uint32_t)k] = h.wavelet[k].f[0];
+					aj[(uint32_t)k + w] = h.wavelet[k].f[1];
+					aj[(uint32_t)k + (w << 1)] = h.wavelet[k].f[2];
+					aj[(uint32_t)k + w * 3] = h.wavelet[k].f[3];
 				}
-				
-				if (j > 0) {
-					opj_v4dwt_interleave_v(&v, aj, (int32_t)w, j);
-					opj_v4dwt_decode(&v);
 
-					for (uint32_t k = 0; k < rh; ++k) {
-						memcpy(&aj[k*w], &v.wavelet[k], (size_t)j * sizeof(float));
+				aj += (w << 2) * numThreads;
+				bufsize -= (w << 2) * numThreads;
+			}
+
+			if (j > 0 ) {
+				opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
+				opj_v4dwt_decode(&h);
+				for (int32_t k = (int32_t)rw; k-- > 0;) {
+					switch (j) {
+					case 3:
+						aj[k + (int32_t)(w << 1)] = h.wavelet[k].f[2];
+					case 2:
+						aj[k + (int32_t)w] = h.wavelet[k].f[1];
+					case 1:
+						aj[k] = h.wavelet[k].f[0];
 					}
 				}
-				
-				decode_dwt_barrier.arrive_and_wait();
 			}
+		});
 
-		cleanup:
-			if (h.wavelet)
-				opj_aligned_free(h.wavelet);
-			decode_dwt_calling_barrier.arrive_and_wait();
-
-		}));
+		/* vertical pass, one strip of columns at a time */
+		int32_t nv = opj_dwt_strip_vectors(rw, rh, numThreads);
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_v4dwt_t v;
+			v.wavelet = wavelets[threadId];
+			v.nv = nv;
+			v.sn = v_sn;
+			v.dn = (int32_t)(rh - (uint32_t)v_sn);
+			v.cas = res->y0 & 1;
+
+			uint32_t strip = 4 * (uint32_t)nv;
+			for (uint32_t j = strip * (uint32_t)threadId; j < rw; j += strip * numThreads) {
+				float * restrict aj = tileBuf + j;
+				uint32_t nb = opj_min<uint32_t>(rw - j, strip);
+				opj_v4dwt_interleave_v(&v, aj, (int32_t)w, (int32_t)nb);
+				opj_v4dwt_decode(&v);
+
+				for (uint32_t k = 0; k < rh; ++k) {
+					memcpy(&aj[k*w], &v.wavelet[k * (uint32_t)nv], nb * sizeof(float));
+				}
+			}
+		});
 	}
 
-	decode_dwt_calling_barrier.arrive_and_wait();
-
-	for (auto& t : dwtWorkers) {
-		t.join();
-	}
-    return rc == 0 ? true : false;
+cleanup:
+	for (auto wavelet : wavelets)
+		opj_aligned_free(wavelet);
+	return rc;
 }
@@ -76,8 +76,10 @@ DWT.C are used by some function in TCD.C.
 Forward 5-3 wavelet transform in 2-D.
 Apply a reversible DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
+@param numThreads Number of threads used to transform rows and columns
 */
-bool opj_dwt_encode_53(opj_tcd_tilecomp_t * tilec);
+bool opj_dwt_encode_53(opj_tcd_tilecomp_t * tilec,
+						uint32_t numThreads);
 
 /**
 Inverse 5-3 wavelet transform in 2-D.
@@ -106,8 +108,10 @@ double opj_dwt_getnorm(uint32_t level, uint32_t orient);
 Forward 9-7 wavelet transform in 2-D.
 Apply an irreversible DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
+@param numThreads Number of threads used to transform rows and columns
 */
-bool opj_dwt_encode_97(opj_tcd_tilecomp_t * tilec);
+bool opj_dwt_encode_97(opj_tcd_tilecomp_t * tilec,
+						uint32_t numThreads);
 /**
 Inverse 9-7 wavelet transform in 2-D.
 Apply an irreversible inverse DWT transform to a component of an image.
@@ -0,0 +1,56 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+/*
+This file is compiled with AVX2 enabled. Keep its includes to the bare
+minimum: any inline function pulled in from a shared header could be
+emitted here with AVX2 instructions and then picked by the linker for
+the rest of the library.
+*/
+
+#include <immintrin.h>
+#include "dwt_avx2.h"
+
+void opj_dwt_lift_add_avx2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    const __m256i vr = _mm256_set1_epi32(r);
+    const __m128i vs = _mm_cvtsi32_si128(s);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i t = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(x + k)),
+                                     _mm256_loadu_si256((const __m256i*)(y + k)));
+        t = _mm256_sra_epi32(_mm256_add_epi32(t, vr), vs);
+        _mm256_storeu_si256((__m256i*)(d + k), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(d + k)), t));
+    }
+    for (; k < n; ++k)
+        d[k] += (x[k] + y[k] + r) >> s;
+}
+
+void opj_dwt_lift_sub_avx2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s)
+{
+    const __m256i vr = _mm256_set1_epi32(r);
+    const __m128i vs = _mm_cvtsi32_si128(s);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256i t = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(x + k)),
+                                     _mm256_loadu_si256((const __m256i*)(y + k)));
+        t = _mm256_sra_epi32(_mm256_add_epi32(t, vr), vs);
+        _mm256_storeu_si256((__m256i*)(d + k), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(d + k)), t));
+    }
+    for (; k < n; ++k)
+        d[k] -= (x[k] + y[k] + r) >> s;
+}
@@ -0,0 +1,38 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+AVX2 integer lifting kernels for the 5-3 wavelet transform.
+
+They are built in their own translation unit with AVX2 code generation enabled,
+and must only be called after checking that the CPU supports AVX2.
+*/
+
+/**
+d[k] += (x[k] + y[k] + r) >> s, for k < n
+*/
+void opj_dwt_lift_add_avx2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s);
+
+/**
+d[k] -= (x[k] + y[k] + r) >> s, for k < n
+*/
+void opj_dwt_lift_sub_avx2(int32_t* d, const int32_t* x, const int32_t* y, size_t n, int32_t r, int32_t s);
@@ -56,7 +56,7 @@
 
 
 #include "opj_includes.h"
-#include "Barrier.h"
+#include "Scheduler.h"
 #include "T1Decoder.h"
 #include <atomic>
 
@@ -327,117 +327,99 @@ bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec,
 		return true;
 	}
 
-	int rc = 0;
 	auto tileBuf = (int32_t*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-	std::vector<std::thread> dwtWorkers;
-	bool success = true;
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([tilec,
-			numres,
-			&rc,
-			tileBuf,
-			&decode_dwt_barrier,
-			&decode_dwt_calling_barrier,
-			threadId,
-			numThreads,
-			&success]()
-		{
-			auto numResolutions = numres;
-
-			opj_dwt53_t buffer_h;
-			opj_dwt53_t buffer_v;
-
-			opj_tcd_resolution_t* tr = tilec->resolutions;
-
-			uint32_t res_width = (tr->x1 - tr->x0);	/* width of the resolution level computed */
-			uint32_t res_height = (tr->y1 - tr->y0);	/* height of the resolution level computed */
-
-			uint32_t w = (tilec->x1 - tilec->x0);
-
-			int32_t resno = 1;
-
-			// add 2 for boundary, plus one for parity
-			auto bufferDataSize = opj_tile_buf_get_interleaved_upper_bound(tilec->buf)+3;
-			buffer_h.data =	(int32_t*)opj_aligned_malloc(bufferDataSize * sizeof(int32_t));
-			if (!buffer_h.data) {
-				success = false;
-				return;
-			}
-
-			buffer_v.data = buffer_h.data;
+	opj_tcd_resolution_t* tr = tilec->resolutions;
 
-			while (--numResolutions) {
-				/* start with the first resolution, and work upwards*/
-				buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, true);
-				buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, true);
-				buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, false);
-				buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, false);
+	uint32_t res_width = (tr->x1 - tr->x0);	/* width of the resolution level computed */
+	uint32_t res_height = (tr->y1 - tr->y0);	/* height of the resolution level computed */
 
-				opj_pt_t interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, resno, true);
-				opj_pt_t interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, resno, false);
+	uint32_t w = (tilec->x1 - tilec->x0);
 
+	// add 2 for boundary, plus one for parity
+	auto bufferDataSize = opj_tile_buf_get_interleaved_upper_bound(tilec->buf)+3;
 
-				buffer_h.s_n = (int32_t)res_width;
-				buffer_v.s_n = (int32_t)res_height;
-				buffer_v.interleaved_offset = opj_max<int64_t>(0, interleaved_v.x - 2);
-
-				++tr;
-				res_width = (tr->x1 - tr->x0);
-				res_height = (tr->y1 - tr->y0);
+	/* one scratch buffer per worker */
+	std::vector<int32_t*> bufferData(numThreads);
+	bool success = true;
+	for (auto& data : bufferData) {
+		data = (int32_t*)opj_aligned_malloc(bufferDataSize * sizeof(int32_t));
+		if (!data) {
+			success = false;
+			goto cleanup;
+		}
+	}
 
-				buffer_h.d_n = (int32_t)(res_width - buffer_h.s_n);
-				buffer_h.odd_top_left_bit = tr->x0 & 1;
-				buffer_h.interleaved_offset = opj_max<int64_t>(0, interleaved_h.x - 2);
+	for (uint32_t resno = 1; resno < numres; ++resno) {
+		opj_dwt53_t buffer_h;
+		opj_dwt53_t buffer_v;
+
+		/* start with the first resolution, and work upwards*/
+		buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, true);
+		buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, true);
+		buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, false);
+		buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, false);
+
+		opj_pt_t interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, resno, true);
+		opj_pt_t interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, resno, false);
+
+		buffer_h.s_n = (int32_t)res_width;
+		buffer_v.s_n = (int32_t)res_height;
+		buffer_v.interleaved_offset = opj_max<int64_t>(0, interleaved_v.x - 2);
+
+		++tr;
+		res_width = (tr->x1 - tr->x0);
+		res_height = (tr->y1 - tr->y0);
+
+		buffer_h.d_n = (int32_t)(res_width - buffer_h.s_n);
+		buffer_h.odd_top_left_bit = tr->x0 & 1;
+		buffer_h.interleaved_offset = opj_max<int64_t>(0, interleaved_h.x - 2);
+
+		buffer_v.d_n = (int32_t)(res_height - buffer_v.s_n);
+		buffer_v.odd_top_left_bit = tr->y0 & 1;
+
+		/* first do horizontal interleave, for even and then odd rows */
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_dwt53_t h = buffer_h;
+			h.data = bufferData[threadId];
+
+			int32_t * restrict tiledp = tileBuf + (buffer_v.range_even.x + threadId) * w;
+			for (auto j = (int64_t)threadId; j < (buffer_v.range_even.y- buffer_v.range_even.x); j+=numThreads) {
+				opj_dwt_region_interleave53_h(&h, tiledp);
+				opj_dwt_region_decode53_1d(&h);
+				memcpy(tiledp + interleaved_h.x, h.data + interleaved_h.x - h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
+				tiledp += w*numThreads;
+			}
 
-				/* first do horizontal interleave */
-				int32_t * restrict tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0) + (buffer_v.range_even.x + threadId) * w;
-				for (auto j = threadId; j < buffer_v.range_even.y- buffer_v.range_even.x; j+=numThreads) {
-					opj_dwt_region_interleave53_h(&buffer_h, tiledp);
-					opj_dwt_region_decode53_1d(&buffer_h);
-					memcpy(tiledp + interleaved_h.x, buffer_h.data + interleaved_h.x - buffer_h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
-					tiledp += w*numThreads;
-				}
-				decode_dwt_barrier.arrive_and_wait();
-
-				tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0) + (buffer_v.s_n +  buffer_v.range_odd.x + threadId) * w;
-				for (auto j = threadId; j < buffer_v.range_odd.y- buffer_v.range_odd.x; j+=numThreads) {
-					opj_dwt_region_interleave53_h(&buffer_h, tiledp);
-					opj_dwt_region_decode53_1d(&buffer_h);
-					memcpy(tiledp + interleaved_h.x, buffer_h.data + interleaved_h.x - buffer_h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
-					tiledp += (w*numThreads);
-				}
-				decode_dwt_barrier.arrive_and_wait();
-
-				buffer_v.d_n = (int32_t)(res_height - buffer_v.s_n);
-				buffer_v.odd_top_left_bit = tr->y0 & 1;
-
-				// next do vertical interleave 
-				tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0) + interleaved_h.x + threadId;
-				for (auto j = threadId; j < interleaved_h.y- interleaved_h.x; j+=numThreads) {
-					int32_t * restrict tiledp_v = tiledp + (interleaved_v.x)*w;
-					opj_dwt_region_interleave53_v(&buffer_v, tiledp, w);
-					opj_dwt_region_decode53_1d(&buffer_v);
-					for (auto k = interleaved_v.x; k < interleaved_v.y; k++) {
-						*tiledp_v = buffer_v.data[k - buffer_v.interleaved_offset];
-						tiledp_v += w;
-					}
-					tiledp+= numThreads;
+			tiledp = tileBuf + (buffer_v.s_n +  buffer_v.range_odd.x + threadId) * w;
+			for (auto j = (int64_t)threadId; j < (buffer_v.range_odd.y- buffer_v.range_odd.x); j+=numThreads) {
+				opj_dwt_region_interleave53_h(&h, tiledp);
+				opj_dwt_region_decode53_1d(&h);
+				memcpy(tiledp + interleaved_h.x, h.data + interleaved_h.x - h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
+				tiledp += (w*numThreads);
+			}
+		});
+
+		// next do vertical interleave 
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_dwt53_t v = buffer_v;
+			v.data = bufferData[threadId];
+
+			int32_t * restrict tiledp = tileBuf + interleaved_h.x + threadId;
+			for (auto j = (int64_t)threadId; j < (interleaved_h.y- interleaved_h.x); j+=numThreads) {
+				int32_t * restrict tiledp_v = tiledp + (interleaved_v.x)*w;
+				opj_dwt_region_interleave53_v(&v, tiledp, w);
+				opj_dwt_region_decode53_1d(&v);
+				for (auto k = interleaved_v.x; k < interleaved_v.y; k++) {
+					*tiledp_v = v.data[k - v.interleaved_offset];
+					tiledp_v += w;
 				}
-
-				resno++;
-				decode_dwt_barrier.arrive_and_wait();
+				tiledp+= numThreads;
 			}
-			opj_aligned_free(buffer_h.data);
-			decode_dwt_calling_barrier.arrive_and_wait();
-		}));
-	}
-	decode_dwt_calling_barrier.arrive_and_wait();
-
-	for (auto& t : dwtWorkers) {
-		t.join();
+		});
 	}
+cleanup:
+	for (auto data : bufferData)
+		opj_aligned_free(data);
     return success;
 }
 
@@ -669,192 +651,167 @@ bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec,
 	if (numres == 1U) {
 		return true;
 	}
-	int rc = 0;
-	auto tileBuf = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-	std::vector<std::thread> dwtWorkers;
-	bool success = true;
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([tilec,
-			numres,
-			&rc,
-			tileBuf,
-			&decode_dwt_barrier,
-			&decode_dwt_calling_barrier,
-			threadId,
-			numThreads,
-			&success]()
-		{
-
-			auto numResolutions = numres;
-
-			opj_dwt97_t buffer_h;
-			opj_dwt97_t buffer_v;
+	auto tileBuf = (float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+	opj_tcd_resolution_t* res = tilec->resolutions;
 
-			opj_tcd_resolution_t* res = tilec->resolutions;
+	/* start with lowest resolution */
+	uint32_t res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
+	uint32_t res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
 
-			uint32_t resno = 1;
+	uint32_t tile_width = (tilec->x1 - tilec->x0);
 
-			/* start with lowest resolution */
-			uint32_t res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
-			uint32_t res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
+	// add 4 for boundary, plus one for parity
+	auto dataSize = (opj_tile_buf_get_interleaved_upper_bound(tilec->buf) + 5) * 4;
 
-			uint32_t tile_width = (tilec->x1 - tilec->x0);
-
-			// add 4 for boundary, plus one for parity
-			buffer_h.dataSize = (opj_tile_buf_get_interleaved_upper_bound(tilec->buf) + 5) * 4;
-			buffer_h.data = (opj_coeff97_t*)opj_aligned_malloc(buffer_h.dataSize * sizeof(float));
+	/* one scratch buffer per worker */
+	std::vector<opj_coeff97_t*> bufferData(numThreads);
+	bool success = true;
+	for (auto& data : bufferData) {
+		data = (opj_coeff97_t*)opj_aligned_malloc(dataSize * sizeof(float));
+		if (!data) {
+			/* FIXME event manager error callback */
+			success = false;
+			goto cleanup;
+		}
+	}
 
-			if (!buffer_h.data) {
-				/* FIXME event manager error callback */
-				success = false;
-				return;
+	for (uint32_t resno = 1; resno < numres; ++resno) {
+		opj_dwt97_t buffer_h;
+		opj_dwt97_t buffer_v;
+		opj_pt_t interleaved_h, interleaved_v;
+
+		/* start with the first resolution, and work upwards*/
+
+		buffer_h.s_n = res_width;
+		buffer_v.s_n = res_height;
+
+		buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, true);
+		buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, true);
+		buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, false);
+		buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, false);
+
+		interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, resno, true);
+		interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, resno, false);
+
+		++res;
+
+		/* dimensions of next higher resolution */
+		res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
+		res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
+
+		buffer_h.dataSize = dataSize;
+		buffer_h.d_n = (res_width - buffer_h.s_n);
+		buffer_h.odd_top_left_bit = res->x0 & 1;
+		buffer_h.interleaved_offset = opj_max<int64_t>(0, interleaved_h.x - 4);
+
+		buffer_v.dataSize = dataSize;
+		buffer_v.d_n = (res_height - buffer_v.s_n);
+		buffer_v.odd_top_left_bit = res->y0 & 1;
+		buffer_v.interleaved_offset = opj_max<int64_t>(0, interleaved_v.x - 4);
+
+		//  Step 1.  interleave and lift in horizontal direction, for even and then odd rows
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_dwt97_t h = buffer_h;
+			h.data = bufferData[threadId];
+
+			float * restrict tile_data = tileBuf + tile_width * (buffer_v.range_even.x + (threadId<<2));
+			auto bufsize = tile_width * (tilec->y1 - tilec->y0 - buffer_v.range_even.x - (threadId<<2));
+			int64_t j;
+			for (j = buffer_v.range_even.y - buffer_v.range_even.x - (int64_t)(threadId<<2); j > 3; j -= 4*numThreads) {
+				opj_region_interleave97_h(&h, tile_data, tile_width, bufsize);
+				opj_region_decode97(&h);
+
+				for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
+					auto buffer_index				= k - h.interleaved_offset;
+					tile_data[k]					= h.data[buffer_index].f[0];
+					tile_data[k + tile_width]		= h.data[buffer_index].f[1];
+					tile_data[k + (tile_width << 1)] = h.data[buffer_index].f[2];
+					tile_data[k + tile_width * 3]	= h.data[buffer_index].f[3];
+				}
 
+				tile_data += (tile_width << 2) * numThreads;
+				bufsize -= (tile_width << 2)*numThreads;
 			}
-			/* share data buffer between vertical and horizontal lifting steps*/
-			buffer_v.data = buffer_h.data;
-
-			while (--numResolutions) {
-
-				int64_t j = 0;
-				opj_pt_t interleaved_h, interleaved_v;
 
-				/* start with the first resolution, and work upwards*/
-
-				buffer_h.s_n = res_width;
-				buffer_v.s_n = res_height;
-
-				buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, true);
-				buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, true);
-				buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, false);
-				buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, false);
-
-				interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, resno, true);
-				interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, resno, false);
-
-				++res;
-
-				/* dimensions of next higher resolution */
-				res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
-				res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
-
-				buffer_h.d_n = (res_width - buffer_h.s_n);
-				buffer_h.odd_top_left_bit = res->x0 & 1;
-				buffer_h.interleaved_offset = opj_max<int64_t>(0, interleaved_h.x - 4);
-
-				//  Step 1.  interleave and lift in horizontal direction 
-				float * restrict tile_data = (float*)tileBuf + tile_width * (buffer_v.range_even.x + (threadId<<2));
-				auto bufsize = tile_width * (tilec->y1 - tilec->y0 - buffer_v.range_even.x - (threadId<<2));
+			if (j > 0) {
+				opj_region_interleave97_h(&h, tile_data, tile_width, bufsize);
+				opj_region_decode97(&h);
+				for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
+					auto buffer_index = k - h.interleaved_offset;
+					switch (j) {
+					case 3:
+						tile_data[k + (tile_width << 1)] = h.data[buffer_index].f[2];
+					case 2:
+						tile_data[k + tile_width] = h.data[buffer_index].f[1];
+					case 1:
+						tile_data[k] = h.data[buffer_index].f[0];
+					}
+				}
+			}
 
-				for (j = buffer_v.range_even.y - buffer_v.range_even.x - (threadId<<2); j > 3; j -= 4*numThreads) {
-					opj_region_interleave97_h(&buffer_h, tile_data, tile_width, bufsize);
-					opj_region_decode97(&buffer_h);
+			tile_data = tileBuf + tile_width *(buffer_v.s_n + buffer_v.range_odd.x + (threadId<<2));
+			bufsize = tile_width *(tilec->y1 - tilec->y0 -  buffer_v.s_n - buffer_v.range_odd.x - (threadId<<2));
 
-					for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
-						auto buffer_index				= k - buffer_h.interleaved_offset;
-						tile_data[k]					= buffer_h.data[buffer_index].f[0];
-						tile_data[k + tile_width]		= buffer_h.data[buffer_index].f[1];
-						tile_data[k + (tile_width << 1)] = buffer_h.data[buffer_index].f[2];
-						tile_data[k + tile_width * 3]	= buffer_h.data[buffer_index].f[3];
-					}
+			for (j = buffer_v.range_odd.y - buffer_v.range_odd.x - (int64_t)(threadId<<2); j > 3; j -= 4*numThreads) {
+				opj_region_interleave97_h(&h, tile_data, tile_width, bufsize);
+				opj_region_decode97(&h);
 
-					tile_data += (tile_width << 2) * numThreads;
-					bufsize -= (tile_width << 2)*numThreads;
+				for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
+					auto buffer_index					= k - h.interleaved_offset;
+					tile_data[k]						= h.data[buffer_index].f[0];
+					tile_data[k + tile_width]			= h.data[buffer_index].f[1];
+					tile_data[k + (tile_width << 1)]	= h.data[buffer_index].f[2];
+					tile_data[k + tile_width * 3]		= h.data[buffer_index].f[3];
 				}
-				
-				if (j > 0) {
-					opj_region_interleave97_h(&buffer_h, tile_data, tile_width, bufsize);
-					opj_region_decode97(&buffer_h);
-					for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
-						auto buffer_index = k - buffer_h.interleaved_offset;
-						switch (j) {
-						case 3:
-							tile_data[k + (tile_width << 1)] = buffer_h.data[buffer_index].f[2];
-						case 2:
-							tile_data[k + tile_width] = buffer_h.data[buffer_index].f[1];
-						case 1:
-							tile_data[k] = buffer_h.data[buffer_index].f[0];
-						}
-					}
-				}
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				tile_data = (float*)tileBuf + tile_width *(buffer_v.s_n + buffer_v.range_odd.x + (threadId<<2));
-				bufsize = tile_width *(tilec->y1 - tilec->y0 -  buffer_v.s_n - buffer_v.range_odd.x - (threadId<<2));
-
-				for (j = buffer_v.range_odd.y - buffer_v.range_odd.x - (threadId<<2); j > 3; j -= 4*numThreads) {
-					opj_region_interleave97_h(&buffer_h, tile_data, tile_width, bufsize);
-					opj_region_decode97(&buffer_h);
-
-					for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
-						auto buffer_index					= k - buffer_h.interleaved_offset;
-						tile_data[k]						= buffer_h.data[buffer_index].f[0];
-						tile_data[k + tile_width]			= buffer_h.data[buffer_index].f[1];
-						tile_data[k + (tile_width << 1)]	= buffer_h.data[buffer_index].f[2];
-						tile_data[k + tile_width * 3]		= buffer_h.data[buffer_index].f[3];
-					}
 
-					tile_data	+= (tile_width << 2)*numThreads;
-					bufsize		-= (tile_width << 2)*numThreads;
-				}
+				tile_data	+= (tile_width << 2)*numThreads;
+				bufsize		-= (tile_width << 2)*numThreads;
+			}
 
-				
-				if (j > 0) {
-					opj_region_interleave97_h(&buffer_h, tile_data, tile_width, bufsize);
-					opj_region_decode97(&buffer_h);
-					for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
-						auto buffer_index = k - buffer_h.interleaved_offset;
-						switch (j) {
-						case 3:
-							tile_data[k + (tile_width << 1)] = buffer_h.data[buffer_index].f[2];
-						case 2:
-							tile_data[k + tile_width] = buffer_h.data[buffer_index].f[1];
-						case 1:
-							tile_data[k] = buffer_h.data[buffer_index].f[0];
-						}
-					}
-				}
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				// Step 2: interleave and lift in vertical direction 
-				
-				buffer_v.d_n = (res_height - buffer_v.s_n);
-				buffer_v.odd_top_left_bit = res->y0 & 1;
-				buffer_v.interleaved_offset = opj_max<int64_t>(0, interleaved_v.x - 4);
-
-				tile_data = (float*)tileBuf + interleaved_h.x + (threadId<<2);
-				for (j = interleaved_h.y - interleaved_h.x - (threadId<<2); j > 3; j -= 4*numThreads) {
-					opj_region_interleave97_v(&buffer_v, tile_data, tile_width, 4);
-					opj_region_decode97(&buffer_v);
-					for (auto k = interleaved_v.x; k < interleaved_v.y; ++k) {
-						memcpy(tile_data + k*tile_width, buffer_v.data + k - buffer_v.interleaved_offset, 4 * sizeof(float));
+			if (j > 0) {
+				opj_region_interleave97_h(&h, tile_data, tile_width, bufsize);
+				opj_region_decode97(&h);
+				for (auto k = interleaved_h.x; k < interleaved_h.y; ++k) {
+					auto buffer_index = k - h.interleaved_offset;
+					switch (j) {
+					case 3:
+						tile_data[k + (tile_width << 1)] = h.data[buffer_index].f[2];
+					case 2:
+						tile_data[k + tile_width] = h.data[buffer_index].f[1];
+					case 1:
+						tile_data[k] = h.data[buffer_index].f[0];
 					}
-					tile_data += (4*numThreads);
 				}
-				
-				if (j > 0) {
-					opj_region_interleave97_v(&buffer_v, tile_data, tile_width, j);
-					opj_region_decode97(&buffer_v);
-					for (auto k = interleaved_v.x; k < interleaved_v.y; ++k) {
-						memcpy(tile_data + k*tile_width, buffer_v.data + k - buffer_v.interleaved_offset, (size_t)j * sizeof(float));
-					}
+			}
+		});
+
+		// Step 2: interleave and lift in vertical direction 
+		Scheduler::instance()->parallel_for(numThreads, [&](size_t threadId) {
+			opj_dwt97_t v = buffer_v;
+			v.data = bufferData[threadId];
+
+			float * restrict tile_data = tileBuf + interleaved_h.x + (threadId<<2);
+			int64_t j;
+			for (j = interleaved_h.y - interleaved_h.x - (int64_t)(threadId<<2); j > 3; j -= 4*numThreads) {
+				opj_region_interleave97_v(&v, tile_data, tile_width, 4);
+				opj_region_decode97(&v);
+				for (auto k = interleaved_v.x; k < interleaved_v.y; ++k) {
+					memcpy(tile_data + k*tile_width, v.data + k - v.interleaved_offset, 4 * sizeof(float));
 				}
-				
-				resno++;
-				decode_dwt_barrier.arrive_and_wait();
+				tile_data += (4*numThreads);
 			}
-			opj_aligned_free(buffer_h.data);
-			decode_dwt_calling_barrier.arrive_and_wait();
-		}));
-	}
-	decode_dwt_calling_barrier.arrive_and_wait();
 
-	for (auto& t : dwtWorkers) {
-		t.join();
+			if (j > 0) {
+				opj_region_interleave97_v(&v, tile_data, tile_width, j);
+				opj_region_decode97(&v);
+				for (auto k = interleaved_v.x; k < interleaved_v.y; ++k) {
+					memcpy(tile_data + k*tile_width, v.data + k - v.interleaved_offset, (size_t)j * sizeof(float));
+				}
+			}
+		});
 	}
-	 return success;
+cleanup:
+	for (auto data : bufferData)
+		opj_aligned_free(data);
+	return success;
 }
@@ -65,6 +65,7 @@
 
 #include <fcntl.h>
 #include "opj_includes.h"
+#include "Scheduler.h"
 
 static bool is_initialized = false;
 bool OPJ_CALLCONV opj_initialize(const char* plugin_path)
@@ -74,11 +75,15 @@ bool OPJ_CALLCONV opj_initialize(const char* plugin_path)
 		info.plugin_path = plugin_path;
         is_initialized = opj_plugin_load(info);
     }
+	// start worker threads up front, rather than on first decode/encode
+	Scheduler::instance();
     return is_initialized;
 }
 
 OPJ_API void OPJ_CALLCONV opj_cleanup() {
 	opj_plugin_cleanup();
+	Scheduler::release();
+	opj_arena_pool_cleanup();
 }
 
 /* ---------------------------------------------------------------------- */
@@ -291,6 +296,11 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
                         uint32_t res_factor,
                         opj_event_mgr_t * p_manager)) opj_j2k_set_decoded_resolution_factor;
 
+        l_codec->m_codec_data.m_decompression.opj_set_strip_callback =
+            (void (*) ( void * p_codec,
+                        opj_strip_callback_fn callback,
+                        void * user_data)) opj_j2k_set_strip_callback;
+
         l_codec->m_codec = opj_j2k_create_decompress();
 
         if (! l_codec->m_codec) {
@@ -371,6 +381,11 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
                         uint32_t res_factor,
                         opj_event_mgr_t * p_manager)) opj_jp2_set_decoded_resolution_factor;
 
+        l_codec->m_codec_data.m_decompression.opj_set_strip_callback =
+            (void (*) ( void * p_codec,
+                        opj_strip_callback_fn callback,
+                        void * user_data)) opj_jp2_set_strip_callback;
+
         l_codec->m_codec = opj_jp2_create(true);
 
         if (! l_codec->m_codec) {
@@ -486,6 +501,28 @@ bool OPJ_CALLCONV opj_decode_ex(   opj_codec_t *p_codec,
     return false;
 }
 
+bool OPJ_CALLCONV opj_decode_strips(opj_codec_t *p_codec,
+									opj_stream_t *p_stream,
+									opj_image_t* p_image,
+									opj_strip_callback_fn callback,
+									void* user_data)
+{
+    if (p_codec && p_stream && callback) {
+        opj_codec_private_t * l_codec = (opj_codec_private_t *) p_codec;
+
+        if (! l_codec->is_decompressor) {
+            return false;
+        }
+
+        l_codec->m_codec_data.m_decompression.opj_set_strip_callback(l_codec->m_codec, callback, user_data);
+        bool rc = opj_decode_ex(p_codec, NULL, p_stream, p_image);
+        l_codec->m_codec_data.m_decompression.opj_set_strip_callback(l_codec->m_codec, NULL, NULL);
+        return rc;
+    }
+
+    return false;
+}
+
 bool OPJ_CALLCONV opj_set_decode_area(	opj_codec_t *p_codec,
                                         opj_image_t* p_image,
                                         uint32_t p_start_x, uint32_t p_start_y,
@@ -646,6 +683,11 @@ opj_codec_t* OPJ_CALLCONV opj_create_compress(OPJ_CODEC_FORMAT p_format)
                 opj_image_t *,
                 opj_event_mgr_t * )) opj_j2k_setup_encoder;
 
+        l_codec->m_codec_data.m_compression.opj_set_strip_callback =
+            (void (*) ( void * p_codec,
+                        opj_strip_callback_fn callback,
+                        void * user_data)) opj_j2k_set_strip_callback;
+
         l_codec->m_codec = opj_j2k_create_compress();
         if (! l_codec->m_codec) {
             opj_free(l_codec);
@@ -684,6 +726,11 @@ opj_codec_t* OPJ_CALLCONV opj_create_compress(OPJ_CODEC_FORMAT p_format)
                 opj_image_t *,
                 opj_event_mgr_t * )) opj_jp2_setup_encoder;
 
+        l_codec->m_codec_data.m_compression.opj_set_strip_callback =
+            (void (*) ( void * p_codec,
+                        opj_strip_callback_fn callback,
+                        void * user_data)) opj_jp2_set_strip_callback;
+
         l_codec->m_codec = opj_jp2_create(false);
         if (! l_codec->m_codec) {
             opj_free(l_codec);
@@ -791,6 +838,27 @@ bool OPJ_CALLCONV opj_encode_with_plugin(opj_codec_t *p_info, opj_plugin_tile_t*
 
 }
 
+bool OPJ_CALLCONV opj_encode_strips(opj_codec_t *p_codec,
+									opj_stream_t *p_stream,
+									opj_strip_callback_fn callback,
+									void* user_data)
+{
+    if (p_codec && p_stream && callback) {
+        opj_codec_private_t * l_codec = (opj_codec_private_t *) p_codec;
+
+        if (l_codec->is_decompressor) {
+            return false;
+        }
+
+        l_codec->m_codec_data.m_compression.opj_set_strip_callback(l_codec->m_codec, callback, user_data);
+        bool rc = opj_encode(p_codec, p_stream);
+        l_codec->m_codec_data.m_compression.opj_set_strip_callback(l_codec->m_codec, NULL, NULL);
+        return rc;
+    }
+
+    return false;
+}
+
 bool OPJ_CALLCONV opj_end_compress (opj_codec_t *p_codec,
                                     opj_stream_t *p_stream)
 {
@@ -1029,7 +1097,12 @@ opj_stream_t* OPJ_CALLCONV opj_stream_create_buffer_stream(uint8_t *buf,
 
 opj_stream_t* OPJ_CALLCONV opj_stream_create_mapped_file_read_stream(const char *fname)
 {
-    return opj_create_mapped_file_read_stream(fname);
+    return opj_create_mapped_file_read_stream(fname, false);
+}
+
+opj_stream_t* OPJ_CALLCONV opj_stream_create_mapped_file_read_stream_ex(const char *fname, bool p_random_access)
+{
+    return opj_create_mapped_file_read_stream(fname, p_random_access);
 }
 
 
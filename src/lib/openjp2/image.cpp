@@ -191,6 +191,10 @@ void opj_copy_image_header(const opj_image_t* p_image_src, opj_image_t* p_image_
     }
 
     p_image_dest->color_space = p_image_src->color_space;
+    for (uint32_t i = 0; i < 2; ++i) {
+        p_image_dest->capture_resolution[i] = p_image_src->capture_resolution[i];
+        p_image_dest->display_resolution[i] = p_image_src->display_resolution[i];
+    }
     p_image_dest->icc_profile_len = p_image_src->icc_profile_len;
 
     if (p_image_dest->icc_profile_len) {
@@ -59,6 +59,10 @@
  */
 
 #include "opj_includes.h"
+#include "Scheduler.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 /** @defgroup J2K J2K - JPEG-2000 codestream reader/writer */
 /*@{*/
@@ -78,6 +82,7 @@ opj_tcp_t::opj_tcp_t() : csty(0),
 						tccps(NULL),
 						m_nb_tile_parts(0),
 						m_data(NULL),
+						m_packet_lengths(),
 						mct_norms(NULL),
 						m_mct_decoding_matrix(NULL),
 						m_mct_coding_matrix(NULL),
@@ -436,17 +441,143 @@ static bool opj_j2k_decode_tiles (  opj_j2k_t *p_j2k,
                                     opj_stream_private_t *p_stream,
                                     opj_event_mgr_t * p_manager);
 
+/**
+ * Reads the tiles, decoding several tiles at once: tile headers are read on the calling
+ * thread, while each tile is decoded and copied to the output image by a task on the
+ * shared scheduler.
+ */
+static bool opj_j2k_decode_tiles_concurrent(opj_j2k_t *p_j2k,
+											opj_stream_private_t *p_stream,
+											opj_event_mgr_t * p_manager);
+
+/**
+ * Checks whether the tiles can be decoded concurrently.
+ */
+static bool opj_j2k_can_decode_tiles_concurrently(opj_j2k_t *p_j2k, uint32_t num_tiles);
+
+/**
+ * Marks the data of the current tile as consumed, and reads the marker following the tile,
+ * which should be either SOT or EOC.
+ *
+ * Throws DecodeUnknownMarkerAtEndOfTileException if any other marker is found.
+ */
+static bool opj_j2k_end_tile_data(opj_j2k_t * p_j2k,
+									opj_stream_private_t *p_stream,
+									opj_event_mgr_t * p_manager);
+
 static bool opj_j2k_pre_write_tile ( opj_j2k_t * p_j2k,
                                      uint32_t p_tile_index,
                                      opj_stream_private_t *p_stream,
                                      opj_event_mgr_t * p_manager );
 
+/**
+ * Sets up the tile part state for writing a tile whose tile coder has already been initialized.
+ */
+static bool opj_j2k_begin_write_tile(opj_j2k_t * p_j2k,
+									uint32_t p_tile_index,
+									opj_event_mgr_t * p_manager);
+
+struct opj_j2k_source_strips_t;
+
+/**
+ * Checks whether the tiles can be encoded concurrently.
+ */
+static bool opj_j2k_can_encode_tiles_concurrently(opj_j2k_t *p_j2k, uint32_t num_tiles);
+
+/**
+ * Encodes all tiles, transforming, T1 coding and rate allocating several tiles at once
+ * on the shared scheduler. Tier 2 and codestream writing, including TLM updates,
+ * run on the calling thread in tile order.
+ */
+static bool opj_j2k_encode_tiles_concurrent(opj_j2k_t * p_j2k,
+											opj_j2k_source_strips_t* p_strips,
+											opj_stream_private_t *p_stream,
+											opj_event_mgr_t * p_manager);
+
+/**
+Creates the strip that the strip callback fills with the source rows of one row of tiles.
+Each component of the strip holds the rows of the image component covered by the tile row.
+
+@param	p_j2k		the jpeg2000 codec.
+@param	p_tile_row	row of tiles, counted from the top of the tile grid
+@return the strip image, or NULL if it could not be allocated
+*/
+static opj_image_t* opj_j2k_create_source_strip(opj_j2k_t *p_j2k, uint32_t p_tile_row);
+
+/**
+Gets the source strip of a tile, reading it with the strip callback for the first tile of its row.
+Rows are read top to bottom, so tiles must be requested in codestream order.
+*/
+static opj_image_t* opj_j2k_get_source_strip(opj_j2k_source_strips_t* p_strips,
+											uint32_t p_tile_no,
+											opj_event_mgr_t * p_manager);
+
+/**
+Releases the source strip of a tile once the last tile of its row has been written.
+*/
+static void opj_j2k_release_source_strip(opj_j2k_source_strips_t* p_strips, uint32_t p_tile_no);
+
+/**
+Copies the samples of a tile from its source strip into the tile coder's component buffers.
+*/
+static void opj_j2k_copy_strip_to_tile(opj_tcd_t* p_tcd, opj_image_t* p_strip);
+
 static bool opj_j2k_copy_decoded_tile_to_output_image (opj_tcd_t * p_tcd,
 										uint8_t * p_data,
 										opj_image_t* p_output_image,
 										bool clearOutputOnInit,
 										opj_event_mgr_t * p_manager);
 
+/**
+Copies the number of decoded resolutions of each tile component into the output image.
+Tiles decoded concurrently do not call this: their output image takes the number of
+resolutions of the coding parameters instead, before any tile is scheduled.
+*/
+static void opj_j2k_copy_resno_decoded(opj_tcd_t * p_tcd, opj_image_t* p_output_image);
+
+struct opj_j2k_strips_t;
+
+/**
+Creates the empty strip that the tiles of one row of tiles are copied into.
+Each component of the strip holds the rows of the output component covered by the tile row.
+
+@param	p_j2k		the jpeg2000 codec.
+@param	p_tile_row	row of tiles, counted from the top of the tile grid
+@return the strip image, or NULL if it could not be allocated
+*/
+static opj_image_t* opj_j2k_create_strip_image(opj_j2k_t *p_j2k, uint32_t p_tile_row);
+
+/**
+Gets the strip that a tile is copied into, creating it for the first tile of its row.
+*/
+static opj_image_t* opj_j2k_get_strip(opj_j2k_strips_t* p_strips,
+									uint32_t p_tile_no,
+									opj_event_mgr_t * p_manager);
+
+/**
+Records that a tile has been copied into its strip. The strip takes its number of
+decoded resolutions from the last tile of its row, in tile order.
+
+@param	p_strips	the strips of the decoded area.
+@param	p_tile_no	the tile that has been copied.
+@param	p_tile_image	image header of the tile coder that decoded the tile.
+*/
+static void opj_j2k_strip_tile_done(opj_j2k_strips_t* p_strips,
+									uint32_t p_tile_no,
+									opj_image_t* p_tile_image);
+
+/**
+Hands complete strips to the strip callback, top to bottom.
+
+@param	p_strips	the strips of the decoded area.
+@param	p_flush_all	hand over all remaining strips, whether or not all of their tiles were decoded
+@param	p_manager	the user event manager.
+@return false if a strip could not be allocated, or if the callback asked to stop
+*/
+static bool opj_j2k_write_strips(opj_j2k_strips_t* p_strips,
+								bool p_flush_all,
+								opj_event_mgr_t * p_manager);
+
 static void opj_get_tile_dimensions(opj_image_t * l_image,
                                     opj_tcd_tilecomp_t * l_tilec,
                                     opj_image_comp_t * l_img_comp,
@@ -806,6 +937,69 @@ static bool opj_j2k_read_tlm (  opj_j2k_t *p_j2k,
                                 uint32_t p_header_size,
                                 opj_event_mgr_t * p_manager);
 
+/**
+ * Computes the positions of the tile-parts listed in the TLM markers
+ * read in the main header. Must be called once the main header has been read.
+ *
+ * @param       p_j2k                   J2K codec.
+ * @param       p_manager               the user event manager.
+*/
+static void opj_j2k_index_tlm(opj_j2k_t *p_j2k,
+                              opj_event_mgr_t * p_manager);
+
+/**
+ * Finds the TLM tile-part entry for a SOT marker position.
+ *
+ * @param       p_j2k                   J2K codec.
+ * @param       p_sot_pos               position of the SOT marker.
+ * @return      index of the entry, or the number of entries if there is none.
+*/
+static uint32_t opj_j2k_find_tlm_entry(opj_j2k_t *p_j2k,
+                                       int64_t p_sot_pos);
+
+/**
+ * Uses the TLM markers to seek to the first tile-part of a tile.
+ * On success, the stream is positioned just after the SOT marker ID.
+ *
+ * @param       p_j2k                   J2K codec.
+ * @param       p_tile_no               index of tile to seek to
+ * @param       p_found                 set to true if the tile-part was found
+ * @param       p_stream                the stream to read data from.
+ * @param       p_manager               the user event manager.
+*/
+static bool opj_j2k_seek_tile_tlm(opj_j2k_t *p_j2k,
+                                  uint32_t p_tile_no,
+                                  bool * p_found,
+                                  opj_stream_private_t *p_stream,
+                                  opj_event_mgr_t * p_manager);
+
+/**
+ * Scans SOT markers, skipping over tile-part data, to locate the first
+ * tile-part of a tile, and records the tile-parts found in the codestream index.
+ * Scanning starts at the last SOT marker read.
+ *
+ * @param       p_j2k                   J2K codec.
+ * @param       p_tile_no               index of tile to locate
+ * @param       p_stream                the stream to read data from.
+ * @param       p_manager               the user event manager.
+*/
+static bool opj_j2k_scan_sot(opj_j2k_t *p_j2k,
+                             uint32_t p_tile_no,
+                             opj_stream_private_t *p_stream,
+                             opj_event_mgr_t * p_manager);
+
+/**
+ * When decoding a region, uses the TLM tile-part index to seek past tile-parts
+ * of tiles outside of the region. Stream must be positioned just after a SOT marker ID.
+ *
+ * @param       p_j2k                   J2K codec.
+ * @param       p_stream                the stream to read data from.
+ * @param       p_manager               the user event manager.
+*/
+static bool opj_j2k_seek_next_tile_part(opj_j2k_t *p_j2k,
+                                        opj_stream_private_t *p_stream,
+                                        opj_event_mgr_t * p_manager);
+
 /**
  * Writes the updated tlm.
  *
@@ -817,6 +1011,47 @@ static bool opj_j2k_write_updated_tlm(      opj_j2k_t *p_j2k,
         opj_stream_private_t *p_stream,
         opj_event_mgr_t * p_manager );
 
+/**
+ * Appends a packet length to a list of packet lengths.
+ *
+ * @param       p_lengths       the list of packet lengths.
+ * @param       p_length        the packet length.
+ * @return      false if memory could not be allocated.
+*/
+static bool opj_j2k_add_packet_length(opj_packet_lengths_t* p_lengths,
+                                      uint32_t p_length);
+
+/**
+ * Frees the packet lengths of a list, and empties the list.
+*/
+static void opj_j2k_packet_lengths_destroy(opj_packet_lengths_t* p_lengths);
+
+/**
+ * Decodes a run of variable length packet lengths (Iplt or Iplm), appending them to a list.
+ *
+ * @param       p_data          the packet length data.
+ * @param       p_size          the size of the packet length data.
+ * @param       p_lengths       the list of packet lengths.
+ * @param       p_manager       the user event manager.
+ * @return      false if the data is corrupt or memory could not be allocated.
+*/
+static bool opj_j2k_read_packet_lengths(uint8_t * p_data,
+                                        uint32_t p_size,
+                                        opj_packet_lengths_t* p_lengths,
+                                        opj_event_mgr_t * p_manager);
+
+/**
+ * Appends the packet lengths signalled by PLM markers for the tile-part
+ * just read to the packet lengths of its tile.
+ *
+ * @param       p_j2k           the jpeg2000 codec.
+ * @param       p_sot_pos       position of the SOT marker of the tile-part.
+ * @param       p_manager       the user event manager.
+*/
+static bool opj_j2k_add_plm_lengths(opj_j2k_t *p_j2k,
+                                    int64_t p_sot_pos,
+                                    opj_event_mgr_t * p_manager);
+
 /**
  * Reads a PLM marker (Packet length, main header marker)
  *
@@ -3215,6 +3450,8 @@ static bool opj_j2k_read_tlm (  opj_j2k_t *p_j2k,
                              )
 {
     uint32_t l_Ztlm, l_Stlm, l_ST, l_SP, l_tot_num_tp_remaining, l_quotient, l_Ptlm_size;
+    uint32_t l_tot_num_tp, l_Ttlm_i, l_Ptlm_i, i;
+    opj_j2k_dec_t* l_dec = nullptr;
     /* preconditions */
     assert(p_header_data != nullptr);
     assert(p_j2k != nullptr);
@@ -3243,16 +3480,320 @@ static bool opj_j2k_read_tlm (  opj_j2k_t *p_j2k,
         opj_event_msg(p_manager, EVT_ERROR, "Error reading TLM marker\n");
         return false;
     }
-    /* FIXME Do not care of this at the moment since only local variables are set here */
-    /*
-    for
-            (i = 0; i < l_tot_num_tp; ++i)
-    {
-            opj_read_bytes(p_header_data,&l_Ttlm_i,l_ST);                           // Ttlm_i
+
+    /* Keep the tile-part lengths, so that tiles can be located without
+       walking through every SOT marker. TLM markers must be in sequence. */
+    l_dec = &p_j2k->m_specific_param.m_decoder;
+    if (l_dec->m_tlm_invalid)
+        return true;
+    if ((int32_t)l_Ztlm != l_dec->m_last_tlm_index + 1 || l_ST == 3) {
+        opj_event_msg(p_manager, EVT_WARNING, "TLM marker out of sequence or invalid: ignoring TLM markers\n");
+        l_dec->m_tlm_invalid = 1;
+        return true;
+    }
+    l_dec->m_last_tlm_index = (int32_t)l_Ztlm;
+
+    l_tot_num_tp = p_header_size / l_quotient;
+    if (l_dec->m_nb_tlm_entries + l_tot_num_tp > l_dec->m_max_tlm_entries) {
+        uint32_t l_max = l_dec->m_nb_tlm_entries + l_tot_num_tp;
+        opj_tlm_entry_t* l_new_entries = (opj_tlm_entry_t*)opj_realloc(l_dec->m_tlm_entries, l_max * sizeof(opj_tlm_entry_t));
+        if (!l_new_entries) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read TLM marker\n");
+            return false;
+        }
+        l_dec->m_tlm_entries = l_new_entries;
+        l_dec->m_max_tlm_entries = l_max;
+    }
+    for (i = 0; i < l_tot_num_tp; ++i) {
+        opj_tlm_entry_t* l_entry = l_dec->m_tlm_entries + l_dec->m_nb_tlm_entries;
+        if (l_ST) {
+            opj_read_bytes(p_header_data,&l_Ttlm_i,l_ST);                       /* Ttlm_i */
             p_header_data += l_ST;
-            opj_read_bytes(p_header_data,&l_Ptlm_i,l_Ptlm_size);            // Ptlm_i
-            p_header_data += l_Ptlm_size;
-    }*/
+        } else {
+            /* one tile-part per tile, in tile order */
+            l_Ttlm_i = l_dec->m_nb_tlm_entries;
+        }
+        opj_read_bytes(p_header_data,&l_Ptlm_i,l_Ptlm_size);                    /* Ptlm_i */
+        p_header_data += l_Ptlm_size;
+        l_entry->tileno = l_Ttlm_i;
+        l_entry->length = l_Ptlm_i;
+        l_entry->start_pos = 0;
+        l_dec->m_nb_tlm_entries++;
+    }
+    return true;
+}
+
+static void opj_j2k_index_tlm(opj_j2k_t *p_j2k,
+                              opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    uint32_t l_nb_tiles = p_j2k->m_cp.tw * p_j2k->m_cp.th;
+    int64_t l_pos = (int64_t)p_j2k->cstr_index->main_head_end;
+    uint32_t i;
+
+    if (l_dec->m_tlm_invalid || !l_dec->m_nb_tlm_entries)
+        return;
+
+    /* validate, and compute positions of SOT markers */
+    for (i = 0; i < l_dec->m_nb_tlm_entries; ++i) {
+        opj_tlm_entry_t* l_entry = l_dec->m_tlm_entries + i;
+        /* SOT marker segment followed by SOD marker */
+        if (l_entry->tileno >= l_nb_tiles || l_entry->length < 14) {
+            opj_event_msg(p_manager, EVT_WARNING, "Invalid TLM marker: ignoring TLM markers\n");
+            l_dec->m_tlm_invalid = 1;
+            return;
+        }
+        l_entry->start_pos = l_pos;
+        l_pos += l_entry->length;
+    }
+}
+
+static uint32_t opj_j2k_find_tlm_entry(opj_j2k_t *p_j2k,
+                                       int64_t p_sot_pos)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    uint32_t l_first = 0, l_last = l_dec->m_nb_tlm_entries;
+
+    while (l_first < l_last) {
+        uint32_t l_mid = (l_first + l_last) >> 1;
+        if (l_dec->m_tlm_entries[l_mid].start_pos < p_sot_pos)
+            l_first = l_mid + 1;
+        else
+            l_last = l_mid;
+    }
+    if (l_first == l_dec->m_nb_tlm_entries || l_dec->m_tlm_entries[l_first].start_pos != p_sot_pos)
+        return l_dec->m_nb_tlm_entries;
+    return l_first;
+}
+
+static bool opj_j2k_seek_tile_tlm(opj_j2k_t *p_j2k,
+                                  uint32_t p_tile_no,
+                                  bool * p_found,
+                                  opj_stream_private_t *p_stream,
+                                  opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    uint8_t l_data[2];
+    uint32_t l_marker = 0, i;
+
+    *p_found = false;
+    if (l_dec->m_tlm_invalid || !l_dec->m_nb_tlm_entries || !l_dec->m_tlm_entries[0].start_pos)
+        return true;
+    for (i = 0; i < l_dec->m_nb_tlm_entries; ++i) {
+        if (l_dec->m_tlm_entries[i].tileno == p_tile_no)
+            break;
+    }
+    if (i == l_dec->m_nb_tlm_entries)
+        return true;
+
+    if (!opj_stream_read_seek(p_stream, l_dec->m_tlm_entries[i].start_pos, p_manager)) {
+        opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
+        return false;
+    }
+    if (opj_stream_read_data(p_stream, l_data, 2, p_manager) == 2)
+        opj_read_bytes(l_data, &l_marker, 2);
+    if (l_marker != J2K_MS_SOT) {
+        opj_event_msg(p_manager, EVT_WARNING, "TLM marker inconsistent with codestream: ignoring TLM markers\n");
+        l_dec->m_tlm_invalid = 1;
+        return true;
+    }
+    l_dec->m_tile_parts_skipped = 1;
+    *p_found = true;
+    return true;
+}
+
+static bool opj_j2k_scan_sot(opj_j2k_t *p_j2k,
+                             uint32_t p_tile_no,
+                             opj_stream_private_t *p_stream,
+                             opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    opj_codestream_index_t* l_cstr_index = p_j2k->cstr_index;
+    uint32_t l_nb_tiles = p_j2k->m_cp.tw * p_j2k->m_cp.th;
+    int64_t l_pos = l_dec->m_last_sot_read_pos ? l_dec->m_last_sot_read_pos : (int64_t)l_cstr_index->main_head_end;
+    uint8_t l_data[12];
+    uint32_t l_marker, l_tile_no, l_tot_len, l_current_part, l_num_parts;
+
+    if (!l_cstr_index->tile_index)
+        return true;
+
+    for (;;) {
+        opj_tile_index_t* l_tile_index = nullptr;
+
+        if (!opj_stream_read_seek(p_stream, l_pos, p_manager))
+            break;
+        /* SOT marker ID, Lsot, Isot, Psot, TPsot, TNsot */
+        if (opj_stream_read_data(p_stream, l_data, 12, p_manager) != 12)
+            break;
+        opj_read_bytes(l_data, &l_marker, 2);
+        if (l_marker != J2K_MS_SOT)
+            break;
+        opj_read_bytes(l_data + 4, &l_tile_no, 2);
+        opj_read_bytes(l_data + 6, &l_tot_len, 4);
+        opj_read_bytes(l_data + 10, &l_current_part, 1);
+        opj_read_bytes(l_data + 11, &l_num_parts, 1);
+        if (l_tile_no >= l_nb_tiles || (l_tot_len && l_tot_len < 14))
+            break;
+
+        l_tile_index = l_cstr_index->tile_index + l_tile_no;
+        if (l_current_part >= l_tile_index->current_nb_tps) {
+            uint32_t l_max = opj_max<uint32_t>(l_current_part + 1, l_num_parts);
+            opj_tp_index_t* l_new_tp_index = (opj_tp_index_t*)opj_realloc(l_tile_index->tp_index, l_max * sizeof(opj_tp_index_t));
+            if (!l_new_tp_index) {
+                opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to build tile-part index\n");
+                return false;
+            }
+            memset(l_new_tp_index + l_tile_index->current_nb_tps, 0,
+                   (l_max - l_tile_index->current_nb_tps) * sizeof(opj_tp_index_t));
+            l_tile_index->tp_index = l_new_tp_index;
+            l_tile_index->current_nb_tps = l_max;
+        }
+        l_tile_index->tp_index[l_current_part].start_pos = l_pos;
+        l_tile_index->tp_index[l_current_part].end_pos = l_tot_len ? l_pos + l_tot_len : 0;
+        if (l_tile_index->nb_tps < l_current_part + 1)
+            l_tile_index->nb_tps = l_current_part + 1;
+        if (l_pos > l_dec->m_last_sot_read_pos) {
+            l_dec->m_last_sot_read_pos = l_pos;
+            l_dec->m_nb_tile_parts_read++;
+        }
+
+        /* Psot equal to zero: last tile-part of the codestream */
+        if ((l_tile_no == p_tile_no && l_current_part == 0) || !l_tot_len)
+            break;
+        l_pos += l_tot_len;
+    }
+    return true;
+}
+
+static bool opj_j2k_seek_next_tile_part(opj_j2k_t *p_j2k,
+                                        opj_stream_private_t *p_stream,
+                                        opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    int64_t l_sot_pos = opj_stream_tell(p_stream) - 2;
+    uint32_t l_first = opj_j2k_find_tlm_entry(p_j2k, l_sot_pos), i;
+    uint8_t l_data[2];
+    uint32_t l_marker;
+
+    /* locate current tile-part */
+    if (l_first == l_dec->m_nb_tlm_entries)
+        return true;
+
+    /* next tile-part inside the decode area; if there is none, the last tile-part,
+       which is followed by EOC */
+    for (i = l_first; i < l_dec->m_nb_tlm_entries - 1; ++i) {
+        uint32_t l_tile_x = l_dec->m_tlm_entries[i].tileno % p_j2k->m_cp.tw;
+        uint32_t l_tile_y = l_dec->m_tlm_entries[i].tileno / p_j2k->m_cp.tw;
+        if (l_tile_x >= l_dec->m_start_tile_x && l_tile_x < l_dec->m_end_tile_x &&
+                l_tile_y >= l_dec->m_start_tile_y && l_tile_y < l_dec->m_end_tile_y)
+            break;
+    }
+    if (i == l_first)
+        return true;
+
+    if (!opj_stream_read_seek(p_stream, l_dec->m_tlm_entries[i].start_pos, p_manager) ||
+            opj_stream_read_data(p_stream, l_data, 2, p_manager) != 2) {
+        l_marker = 0;
+    } else {
+        opj_read_bytes(l_data, &l_marker, 2);
+    }
+    if (l_marker != J2K_MS_SOT) {
+        opj_event_msg(p_manager, EVT_WARNING, "TLM marker inconsistent with codestream: ignoring TLM markers\n");
+        l_dec->m_tlm_invalid = 1;
+        if (!opj_stream_read_seek(p_stream, l_sot_pos + 2, p_manager)) {
+            opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
+            return false;
+        }
+    } else {
+        l_dec->m_tile_parts_skipped = 1;
+    }
+    return true;
+}
+
+static bool opj_j2k_add_packet_length(opj_packet_lengths_t* p_lengths,
+                                      uint32_t p_length)
+{
+    if (p_lengths->m_nb_lengths == p_lengths->m_max_lengths) {
+        uint32_t l_max = p_lengths->m_max_lengths ? p_lengths->m_max_lengths * 2 : 256;
+        uint32_t* l_new_lengths = (uint32_t*)opj_realloc(p_lengths->m_lengths, l_max * sizeof(uint32_t));
+        if (!l_new_lengths)
+            return false;
+        p_lengths->m_lengths = l_new_lengths;
+        p_lengths->m_max_lengths = l_max;
+    }
+    p_lengths->m_lengths[p_lengths->m_nb_lengths++] = p_length;
+    return true;
+}
+
+static void opj_j2k_packet_lengths_destroy(opj_packet_lengths_t* p_lengths)
+{
+    if (p_lengths->m_lengths) {
+        opj_free(p_lengths->m_lengths);
+        p_lengths->m_lengths = nullptr;
+    }
+    p_lengths->m_nb_lengths = 0;
+    p_lengths->m_max_lengths = 0;
+}
+
+static bool opj_j2k_read_packet_lengths(uint8_t * p_data,
+                                        uint32_t p_size,
+                                        opj_packet_lengths_t* p_lengths,
+                                        opj_event_mgr_t * p_manager)
+{
+    uint32_t l_tmp, l_packet_len = 0, i;
+
+    for (i = 0; i < p_size; ++i) {
+        opj_read_bytes(p_data,&l_tmp,1);
+        ++p_data;
+        /* take only the last seven bytes */
+        l_packet_len |= (l_tmp & 0x7f);
+        if (l_tmp & 0x80) {
+            l_packet_len <<= 7;
+        } else {
+            /* store packet length and proceed to next packet */
+            if (!opj_j2k_add_packet_length(p_lengths, l_packet_len)) {
+                opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to store packet lengths\n");
+                return false;
+            }
+            l_packet_len = 0;
+        }
+    }
+    return l_packet_len == 0;
+}
+
+static bool opj_j2k_add_plm_lengths(opj_j2k_t *p_j2k,
+                                    int64_t p_sot_pos,
+                                    opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+    opj_packet_lengths_t* l_tile_lengths = &p_j2k->m_cp.tcps[p_j2k->m_current_tile_number].m_packet_lengths;
+    opj_packet_lengths_t* l_tile_part_lengths = nullptr;
+    uint32_t l_index, i;
+
+    if (!l_dec->m_nb_plm_tile_parts)
+        return true;
+
+    /* PLM markers list tile-parts in codestream order: find the index of this tile-part,
+       either from the TLM markers, or by counting SOT markers if none were skipped */
+    if (!l_dec->m_tlm_invalid && l_dec->m_nb_tlm_entries && l_dec->m_tlm_entries[0].start_pos) {
+        l_index = opj_j2k_find_tlm_entry(p_j2k, p_sot_pos);
+        if (l_index == l_dec->m_nb_tlm_entries)
+            return true;
+    } else if (!l_dec->m_tile_parts_skipped && p_sot_pos == l_dec->m_last_sot_read_pos) {
+        l_index = l_dec->m_nb_tile_parts_read - 1;
+    } else {
+        return true;
+    }
+    if (l_index >= l_dec->m_nb_plm_tile_parts)
+        return true;
+
+    l_tile_part_lengths = l_dec->m_plm_tile_parts + l_index;
+    for (i = 0; i < l_tile_part_lengths->m_nb_lengths; ++i) {
+        if (!opj_j2k_add_packet_length(l_tile_lengths, l_tile_part_lengths->m_lengths[i])) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to store packet lengths\n");
+            return false;
+        }
+    }
     return true;
 }
 
@@ -3274,7 +3815,8 @@ static bool opj_j2k_read_plm (  opj_j2k_t *p_j2k,
     assert(p_header_data != nullptr);
     assert(p_j2k != nullptr);
     assert(p_manager != nullptr);
-	uint32_t l_Zplm, l_Nplm, l_tmp, l_packet_len = 0, i;
+    opj_j2k_dec_t* l_dec = &p_j2k->m_specific_param.m_decoder;
+	uint32_t l_Zplm, l_Nplm;
 	int64_t header_size = p_header_size;
     if (header_size < 1) {
         opj_event_msg(p_manager, EVT_ERROR, "Error reading PLM marker\n");
@@ -3286,6 +3828,7 @@ static bool opj_j2k_read_plm (  opj_j2k_t *p_j2k,
     --header_size;
 
     while  (header_size > 0)   {
+        opj_packet_lengths_t* l_tile_part_lengths = nullptr;
         opj_read_bytes(p_header_data,&l_Nplm,1);                                // Nplm
         ++p_header_data;
 		header_size -= (1+l_Nplm);
@@ -3293,22 +3836,25 @@ static bool opj_j2k_read_plm (  opj_j2k_t *p_j2k,
              opj_event_msg(p_manager, EVT_ERROR, "Error reading PLM marker\n");
              return false;
         }
-        for (i = 0; i < l_Nplm; ++i)       {
-            opj_read_bytes(p_header_data,&l_tmp,1);                         // Iplm_ij
-            ++p_header_data;
-            // take only the last seven bytes
-            l_packet_len |= (l_tmp & 0x7f);
-            if  (l_tmp & 0x80)        {
-                l_packet_len <<= 7;
-            }  else   {
-				// store packet length and proceed to next packet
-                l_packet_len = 0;
+        // each run of Iplm_ij holds the packet lengths of the next tile-part
+        if (l_dec->m_nb_plm_tile_parts == l_dec->m_max_plm_tile_parts) {
+            uint32_t l_max = l_dec->m_max_plm_tile_parts ? l_dec->m_max_plm_tile_parts * 2 : 16;
+            opj_packet_lengths_t* l_new_tile_parts = (opj_packet_lengths_t*)opj_realloc(l_dec->m_plm_tile_parts,
+                    l_max * sizeof(opj_packet_lengths_t));
+            if (!l_new_tile_parts) {
+                opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read PLM marker\n");
+                return false;
             }
+            l_dec->m_plm_tile_parts = l_new_tile_parts;
+            l_dec->m_max_plm_tile_parts = l_max;
         }
-        if (l_packet_len != 0)      {
+        l_tile_part_lengths = l_dec->m_plm_tile_parts + l_dec->m_nb_plm_tile_parts++;
+        memset(l_tile_part_lengths, 0, sizeof(opj_packet_lengths_t));
+        if (!opj_j2k_read_packet_lengths(p_header_data, l_Nplm, l_tile_part_lengths, p_manager)) {
             opj_event_msg(p_manager, EVT_ERROR, "Error reading PLM marker\n");
             return false;
         }
+        p_header_data += l_Nplm;
     }
      return true;
 }
@@ -3327,7 +3873,7 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
                                 opj_event_mgr_t * p_manager
                              )
 {
-    uint32_t l_Zplt, l_tmp, l_packet_len = 0, i;
+    uint32_t l_Zplt;
 
     /* preconditions */
     assert(p_header_data != nullptr);
@@ -3343,20 +3889,10 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
     ++p_header_data;
     --p_header_size;
 
-    for (i = 0; i < p_header_size; ++i) {
-        opj_read_bytes(p_header_data,&l_tmp,1);         /* Iplt_ij */
-        ++p_header_data;
-        /* take only the last seven bytes */
-        l_packet_len |= (l_tmp & 0x7f);
-        if (l_tmp & 0x80) {
-            l_packet_len <<= 7;
-        } else {
-            /* store packet length and proceed to next packet */
-            l_packet_len = 0;
-        }
-    }
-
-    if (l_packet_len != 0) {
+    /* Iplt_ij : keep the lengths, so that T2 can locate packets without reading their headers */
+    if (!opj_j2k_read_packet_lengths(p_header_data, p_header_size,
+                                     &p_j2k->m_cp.tcps[p_j2k->m_current_tile_number].m_packet_lengths,
+                                     p_manager)) {
         opj_event_msg(p_manager, EVT_ERROR, "Error reading PLT marker\n");
         return false;
     }
@@ -3851,6 +4387,10 @@ static bool opj_j2k_read_sot ( opj_j2k_t *p_j2k,
     l_tile_x = p_j2k->m_current_tile_number % l_cp->tw;
     l_tile_y = p_j2k->m_current_tile_number / l_cp->tw;
 
+    /* packet lengths are collected again whenever the tile is read from its first tile-part */
+    if (l_current_part == 0)
+        l_tcp->m_packet_lengths.m_nb_lengths = 0;
+
     /* look for the tile in the list of already processed tile (in parts). */
     /* Optimization possible here with a more complex data structure and with the removing of tiles */
     /* since the time taken by this function can only grow at the time */
@@ -4114,13 +4654,54 @@ static bool opj_j2k_read_sod (opj_j2k_t *p_j2k,
 		if (!l_tcp->m_data)
 			l_tcp->m_data = new opj_seg_buf_t();
 
-        opj_seg_buf_alloc_and_push_back(l_tcp->m_data, p_j2k->m_specific_param.m_decoder.m_sot_length);
-        l_current_read_size = opj_stream_read_data(
-                                    p_stream,
-                                    opj_seg_buf_get_global_ptr(l_tcp->m_data),
-                                    p_j2k->m_specific_param.m_decoder.m_sot_length,
-                                    p_manager);
-
+		if (opj_stream_supports_zero_copy(p_stream)) {
+			/* memory mapped or buffer stream: the tile part is decoded in place */
+			uint8_t* l_tile_part_data = nullptr;
+			l_current_read_size = opj_stream_read_data_zero_copy(
+										p_stream,
+										&l_tile_part_data,
+										p_j2k->m_specific_param.m_decoder.m_sot_length,
+										p_manager);
+			if (l_current_read_size == (size_t)-1)
+				l_current_read_size = 0;
+			if (l_current_read_size == p_j2k->m_specific_param.m_decoder.m_sot_length) {
+				if (!opj_seg_buf_push_back(l_tcp->m_data, l_tile_part_data, l_current_read_size)) {
+					opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read tile part\n");
+					return false;
+				}
+			}
+			else {
+				/* truncated tile part: pad it to its signalled length, as when it is
+				read into an allocated buffer, so that it decodes as far as possible */
+				if (!opj_seg_buf_alloc_and_push_back(l_tcp->m_data, p_j2k->m_specific_param.m_decoder.m_sot_length)) {
+					opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read tile part\n");
+					return false;
+				}
+				uint8_t* l_dest = opj_seg_buf_get_global_ptr(l_tcp->m_data);
+				if (l_current_read_size)
+					memcpy(l_dest, l_tile_part_data, l_current_read_size);
+				memset(l_dest + l_current_read_size, 0,
+						p_j2k->m_specific_param.m_decoder.m_sot_length - l_current_read_size);
+			}
+		}
+		else {
+			if (!opj_seg_buf_alloc_and_push_back(l_tcp->m_data, p_j2k->m_specific_param.m_decoder.m_sot_length)) {
+				opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read tile part\n");
+				return false;
+			}
+			uint8_t* l_dest = opj_seg_buf_get_global_ptr(l_tcp->m_data);
+			l_current_read_size = opj_stream_read_data(
+										p_stream,
+										l_dest,
+										p_j2k->m_specific_param.m_decoder.m_sot_length,
+										p_manager);
+			if (l_current_read_size == (size_t)-1)
+				l_current_read_size = 0;
+			/* truncated tile part: zero the padding, as on the zero-copy path */
+			if (l_current_read_size < p_j2k->m_specific_param.m_decoder.m_sot_length)
+				memset(l_dest + l_current_read_size, 0,
+						p_j2k->m_specific_param.m_decoder.m_sot_length - l_current_read_size);
+		}
      } else {
         l_current_read_size = 0;
     }
@@ -5828,6 +6409,7 @@ bool opj_j2k_setup_encoder(     opj_j2k_t *p_j2k,
     cp->m_specific_param.m_enc.m_disto_alloc = parameters->cp_disto_alloc & 1u;
     cp->m_specific_param.m_enc.m_fixed_quality = parameters->cp_fixed_quality & 1u;
 	cp->m_specific_param.m_enc.rateControlAlgorithm = parameters->rateControlAlgorithm;
+	cp->m_specific_param.m_enc.m_early_termination = parameters->earlyTermination;
 
     /* tiles */
     cp->tdx = parameters->cp_tdx;
@@ -6274,6 +6856,9 @@ bool opj_j2k_read_header(   opj_stream_private_t *p_stream,
         return false;
     }
 
+    /* Locate tile-parts from TLM markers, if present */
+    opj_j2k_index_tlm(p_j2k, p_manager);
+
     return true;
 }
 
@@ -6975,6 +7560,23 @@ void opj_j2k_destroy (opj_j2k_t *p_j2k)
             p_j2k->m_specific_param.m_decoder.m_header_data = nullptr;
             p_j2k->m_specific_param.m_decoder.m_header_data_size = 0;
         }
+
+        if (p_j2k->m_specific_param.m_decoder.m_tlm_entries != nullptr) {
+            opj_free(p_j2k->m_specific_param.m_decoder.m_tlm_entries);
+            p_j2k->m_specific_param.m_decoder.m_tlm_entries = nullptr;
+            p_j2k->m_specific_param.m_decoder.m_nb_tlm_entries = 0;
+            p_j2k->m_specific_param.m_decoder.m_max_tlm_entries = 0;
+        }
+
+        if (p_j2k->m_specific_param.m_decoder.m_plm_tile_parts != nullptr) {
+            uint32_t i;
+            for (i = 0; i < p_j2k->m_specific_param.m_decoder.m_nb_plm_tile_parts; ++i)
+                opj_j2k_packet_lengths_destroy(p_j2k->m_specific_param.m_decoder.m_plm_tile_parts + i);
+            opj_free(p_j2k->m_specific_param.m_decoder.m_plm_tile_parts);
+            p_j2k->m_specific_param.m_decoder.m_plm_tile_parts = nullptr;
+            p_j2k->m_specific_param.m_decoder.m_nb_plm_tile_parts = 0;
+            p_j2k->m_specific_param.m_decoder.m_max_plm_tile_parts = 0;
+        }
     } else {
 
 		if (p_j2k->m_specific_param.m_encoder.tile)
@@ -7121,6 +7723,8 @@ static void opj_j2k_tcp_destroy (opj_tcp_t *p_tcp)
         p_tcp->mct_norms = nullptr;
     }
 
+    opj_j2k_packet_lengths_destroy(&p_tcp->m_packet_lengths);
+
     opj_j2k_tcp_data_destroy(p_tcp);
 
 }
@@ -7308,6 +7912,18 @@ bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
     /* Read into the codestream until reach the EOC or ! can_decode ??? FIXME */
     while ( (!p_j2k->m_specific_param.m_decoder.m_can_decode) && (l_current_marker != J2K_MS_EOC) ) {
 
+        /* When decoding a region, jump over tile-parts outside of the region */
+        if (l_current_marker == J2K_MS_SOT &&
+                p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_TPHSOT &&
+                p_j2k->m_specific_param.m_decoder.m_discard_tiles &&
+                p_j2k->m_specific_param.m_decoder.m_tile_ind_to_dec == -1 &&
+                !p_j2k->m_specific_param.m_decoder.m_tlm_invalid &&
+                p_j2k->m_specific_param.m_decoder.m_nb_tlm_entries &&
+                p_j2k->m_specific_param.m_decoder.m_tlm_entries[0].start_pos) {
+            if (!opj_j2k_seek_next_tile_part(p_j2k, p_stream, p_manager))
+                return false;
+        }
+
         /* Try to read until the Start Of Data is detected */
         while (l_current_marker != J2K_MS_SOD) {
 
@@ -7400,6 +8016,11 @@ bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
                 uint32_t sot_pos = (uint32_t) opj_stream_tell(p_stream) - l_marker_size - 4 ;
                 if (sot_pos > p_j2k->m_specific_param.m_decoder.m_last_sot_read_pos) {
                     p_j2k->m_specific_param.m_decoder.m_last_sot_read_pos = sot_pos;
+                    p_j2k->m_specific_param.m_decoder.m_nb_tile_parts_read++;
+                }
+                if (!p_j2k->m_specific_param.m_decoder.m_skip_data &&
+                        !opj_j2k_add_plm_lengths(p_j2k, sot_pos, p_manager)) {
+                    return false;
                 }
             }
 
@@ -7538,6 +8159,57 @@ bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
     return true;
 }
 
+static bool opj_j2k_end_tile_data(opj_j2k_t * p_j2k,
+									opj_stream_private_t *p_stream,
+									opj_event_mgr_t * p_manager)
+{
+	uint32_t l_current_marker;
+	uint8_t l_data[2];
+
+	p_j2k->m_specific_param.m_decoder.m_can_decode = 0;
+	p_j2k->m_specific_param.m_decoder.m_state &= (~(J2K_DEC_STATE_DATA));
+
+	// if there is no EOC marker and there is also no data left, then simply return true
+	if (opj_stream_get_number_byte_left(p_stream) == 0
+		&& p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_NEOC) {
+		return true;
+	}
+
+	// if EOC marker has not been read yet, then try to read the next marker (should be EOC or SOT)
+	if (p_j2k->m_specific_param.m_decoder.m_state != J2K_DEC_STATE_EOC) {
+
+		// not enough data for another marker : fail decode
+		if (opj_stream_read_data(p_stream, l_data, 2, p_manager) != 2) {
+			opj_event_msg(p_manager, EVT_ERROR, "Stream too short\n");
+			return false;
+		}
+
+		// read marker
+		opj_read_bytes(l_data, &l_current_marker, 2);
+
+		// we found the EOC marker - set state accordingly and return true - can ignore all data after EOC
+		if (l_current_marker == J2K_MS_EOC) {
+			p_j2k->m_current_tile_number = 0;
+			p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_EOC;
+			return true;
+		}
+
+		// if we get here, we expect an SOT marker......
+		if (l_current_marker != J2K_MS_SOT) {
+			auto bytesLeft = opj_stream_get_number_byte_left(p_stream);
+			// no bytes left - file ends without EOC marker
+			if (bytesLeft == 0) {
+				p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_NEOC;
+				opj_event_msg(p_manager, EVT_WARNING, "Stream does not end with EOC\n");
+				return true;
+			}
+			opj_event_msg(p_manager, EVT_WARNING, "Decode tile: expected EOC or SOT but found unknown \"marker\" %x. \n", l_current_marker);
+			throw DecodeUnknownMarkerAtEndOfTileException();
+		}
+	}
+	return true;
+}
+
 bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
                             uint32_t p_tile_index,
                             uint8_t * p_data,
@@ -7545,8 +8217,6 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
                             opj_stream_private_t *p_stream,
                             opj_event_mgr_t * p_manager )
 {
-    uint32_t l_current_marker;
-    uint8_t l_data [2];
     opj_tcp_t * l_tcp;
 
     /* preconditions */
@@ -7622,51 +8292,18 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
 		/* we only destroy the data, which will be re-read in read_tile_header*/
 		opj_j2k_tcp_data_destroy(l_tcp);
 
-		p_j2k->m_specific_param.m_decoder.m_can_decode = 0;
-		p_j2k->m_specific_param.m_decoder.m_state &= (~(J2K_DEC_STATE_DATA));
-
-		// if there is no EOC marker and there is also no data left, then simply return true
-		if (opj_stream_get_number_byte_left(p_stream) == 0
-			&& p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_NEOC) {
-			return true;
-		}
-
-		// if EOC marker has not been read yet, then try to read the next marker (should be EOC or SOT)
-		if (p_j2k->m_specific_param.m_decoder.m_state != J2K_DEC_STATE_EOC) {
-
-			// not enough data for another marker : fail decode
-			if (opj_stream_read_data(p_stream, l_data, 2, p_manager) != 2) {
-				opj_event_msg(p_manager, EVT_ERROR, "Stream too short\n");
-				return false;
-			}
-
-			// read marker
-			opj_read_bytes(l_data, &l_current_marker, 2);
-
-			// we found the EOC marker - set state accordingly and return true - can ignore all data after EOC
-			if (l_current_marker == J2K_MS_EOC) {
-				p_j2k->m_current_tile_number = 0;
-				p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_EOC;
-				return true;
-			}
-
-			// if we get here, we expect an SOT marker......
-			if (l_current_marker != J2K_MS_SOT) {
-				auto bytesLeft = opj_stream_get_number_byte_left(p_stream);
-				// no bytes left - file ends without EOC marker
-				if (bytesLeft == 0) {
-					p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_NEOC;
-					opj_event_msg(p_manager, EVT_WARNING, "Stream does not end with EOC\n");
-					return true;
-				}
-				opj_event_msg(p_manager, EVT_WARNING, "Decode tile: expected EOC or SOT but found unknown \"marker\" %x. \n", l_current_marker);
-				throw DecodeUnknownMarkerAtEndOfTileException();
-			}
-		}
+		if (!opj_j2k_end_tile_data(p_j2k, p_stream, p_manager))
+			return false;
 	}
     return true;
 }
 
+static void opj_j2k_copy_resno_decoded(opj_tcd_t * p_tcd, opj_image_t* p_output_image)
+{
+	for (uint32_t compno = 0; compno < p_tcd->image->numcomps; ++compno)
+		p_output_image->comps[compno].resno_decoded = p_tcd->image->comps[compno].resno_decoded;
+}
+
 /*
 p_data stores the number of resolutions decoded, in the actual precision of the decoded image.
 
@@ -7688,6 +8325,10 @@ static bool opj_j2k_copy_decoded_tile_to_output_image (opj_tcd_t * p_tcd,
 		opj_image_comp_t* img_comp_src = image_src->comps+i;
 		opj_image_comp_t* img_comp_dest = p_output_image->comps+i;
 
+		/* a strip can hold no rows of a sub-sampled or reduced component */
+		if (img_comp_dest->w && !img_comp_dest->h)
+			continue;
+
 		if (img_comp_dest->w * img_comp_dest->h == 0) {
 			opj_event_msg(p_manager, EVT_ERROR, "Output image has invalid dimensions %d x %d\n", img_comp_dest->w, img_comp_dest->h);
 			return false;
@@ -7703,9 +8344,6 @@ static bool opj_j2k_copy_decoded_tile_to_output_image (opj_tcd_t * p_tcd,
 			}
         }
 
-        /* Copy info from decoded comp image to output image */
-        img_comp_dest->resno_decoded = img_comp_src->resno_decoded;
-
         /*-----*/
         /* Compute the precision of the output buffer */
 		uint32_t size_comp = (img_comp_src->prec + 7) >> 3;
@@ -8109,6 +8747,8 @@ opj_j2k_t* opj_j2k_create_decompress(void)
 
     l_j2k->m_specific_param.m_decoder.m_last_sot_read_pos = 0 ;
 
+    l_j2k->m_specific_param.m_decoder.m_last_tlm_index = -1 ;
+
     /* codestream index creation */
     l_j2k->cstr_index = opj_j2k_create_cstr_index();
     if (!l_j2k->cstr_index) {
@@ -9189,6 +9829,413 @@ static bool opj_j2k_needs_copy_tile_data(opj_j2k_t *p_j2k, uint32_t num_tiles)
     return copy_tile_data;
 }
 
+static bool opj_j2k_can_decode_tiles_concurrently(opj_j2k_t *p_j2k, uint32_t num_tiles)
+{
+	/* plugin decode and PPM headers both depend on tiles being decoded in codestream order */
+	return p_j2k->numThreads > 1 &&
+			num_tiles > 1 &&
+			!p_j2k->m_tcd->current_plugin_tile &&
+			!p_j2k->m_cp.ppm;
+}
+
+/**
+Strips of the decoded area, one per row of tiles, for decoding with a strip callback.
+
+The strip of a tile row is created when the first tile of the row is decoded, and is handed
+to the callback once all tiles of the row have been copied into it. Strips are handed over
+top to bottom, so that a row which completes early waits for the rows above it.
+*/
+struct opj_j2k_strips_t {
+	opj_j2k_strips_t(opj_j2k_t* j2k) : j2k(j2k), next(0) {
+		auto l_decoder = &j2k->m_specific_param.m_decoder;
+		uint32_t l_num_rows = l_decoder->m_end_tile_y - l_decoder->m_start_tile_y;
+		images.resize(l_num_rows, nullptr);
+		tiles_left.resize(l_num_rows, l_decoder->m_end_tile_x - l_decoder->m_start_tile_x);
+		last_tile.resize(l_num_rows, 0);
+	}
+	~opj_j2k_strips_t() {
+		for (auto image : images)
+			opj_image_destroy(image);
+	}
+	opj_j2k_t* j2k;
+	std::mutex mutex;
+	/* strip image, and number of tiles still to be copied into it, for each tile row */
+	std::vector<opj_image_t*> images;
+	std::vector<uint32_t> tiles_left;
+	/* one more than the last tile copied into each strip, which sets its number of decoded resolutions */
+	std::vector<uint32_t> last_tile;
+	/* next strip to hand over */
+	uint32_t next;
+};
+
+static opj_image_t* opj_j2k_create_strip_image(opj_j2k_t *p_j2k, uint32_t p_tile_row)
+{
+	opj_cp_t* l_cp = &p_j2k->m_cp;
+	opj_image_t* l_image = p_j2k->m_private_image;
+
+	/* tile row borders, computed as in opj_tcd_init_tile */
+	uint32_t l_ty0 = l_cp->ty0 + p_tile_row * l_cp->tdy;
+	uint32_t l_y0 = opj_max<uint32_t>(l_ty0, l_image->y0);
+	uint32_t l_y1 = opj_min<uint32_t>(opj_uint_adds(l_ty0, l_cp->tdy), l_image->y1);
+
+	opj_image_t* l_strip = opj_image_create0();
+	if (!l_strip)
+		return nullptr;
+	opj_copy_image_header(p_j2k->m_output_image, l_strip);
+	if (!l_strip->comps) {
+		opj_image_destroy(l_strip);
+		return nullptr;
+	}
+	for (uint32_t compno = 0; compno < l_strip->numcomps; ++compno) {
+		opj_image_comp_t* l_comp = l_strip->comps + compno;
+		uint32_t l_factor = l_comp->decodeScaleFactor;
+		uint32_t l_comp_y0 = opj_uint_ceildivpow2(l_comp->y0, l_factor);
+		uint32_t l_row0 = opj_max<uint32_t>(opj_uint_ceildivpow2(opj_uint_ceildiv(l_y0, l_comp->dy), l_factor), l_comp_y0);
+		uint32_t l_row1 = opj_min<uint32_t>(opj_uint_ceildivpow2(opj_uint_ceildiv(l_y1, l_comp->dy), l_factor), l_comp_y0 + l_comp->h);
+		/* the strip origin is l_row0 once divided by the scale factor, in opj_j2k_copy_decoded_tile_to_output_image */
+		l_comp->y0 = l_row0 << l_factor;
+		l_comp->h = l_row1 > l_row0 ? l_row1 - l_row0 : 0;
+		if (l_comp->w * l_comp->h) {
+			if (!opj_image_single_component_data_alloc(l_comp)) {
+				opj_image_destroy(l_strip);
+				return nullptr;
+			}
+			memset(l_comp->data, 0, (size_t)l_comp->w * l_comp->h * sizeof(int32_t));
+		}
+	}
+	return l_strip;
+}
+
+static opj_image_t* opj_j2k_get_strip(opj_j2k_strips_t* p_strips,
+									uint32_t p_tile_no,
+									opj_event_mgr_t * p_manager)
+{
+	auto l_j2k = p_strips->j2k;
+	uint32_t l_tile_row = p_tile_no / l_j2k->m_cp.tw;
+	uint32_t l_row = l_tile_row - l_j2k->m_specific_param.m_decoder.m_start_tile_y;
+	if (l_tile_row < l_j2k->m_specific_param.m_decoder.m_start_tile_y || l_row >= p_strips->images.size()) {
+		opj_event_msg(p_manager, EVT_ERROR, "Tile %d is outside of the decoded area\n", p_tile_no);
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> lock(p_strips->mutex);
+	if (l_row < p_strips->next) {
+		opj_event_msg(p_manager, EVT_ERROR, "Strip of tile %d has already been written\n", p_tile_no);
+		return nullptr;
+	}
+	if (!p_strips->images[l_row]) {
+		p_strips->images[l_row] = opj_j2k_create_strip_image(l_j2k, l_tile_row);
+		if (!p_strips->images[l_row])
+			opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to create strip for tile %d\n", p_tile_no);
+	}
+	return p_strips->images[l_row];
+}
+
+static void opj_j2k_strip_tile_done(opj_j2k_strips_t* p_strips,
+									uint32_t p_tile_no,
+									opj_image_t* p_tile_image)
+{
+	auto l_j2k = p_strips->j2k;
+	uint32_t l_row = p_tile_no / l_j2k->m_cp.tw - l_j2k->m_specific_param.m_decoder.m_start_tile_y;
+	std::lock_guard<std::mutex> lock(p_strips->mutex);
+	if (p_strips->tiles_left[l_row])
+		p_strips->tiles_left[l_row]--;
+	auto l_strip = p_strips->images[l_row];
+	if (l_strip && p_tile_no + 1 >= p_strips->last_tile[l_row]) {
+		p_strips->last_tile[l_row] = p_tile_no + 1;
+		for (uint32_t compno = 0; compno < l_strip->numcomps; ++compno)
+			l_strip->comps[compno].resno_decoded = p_tile_image->comps[compno].resno_decoded;
+	}
+}
+
+static bool opj_j2k_write_strips(opj_j2k_strips_t* p_strips,
+								bool p_flush_all,
+								opj_event_mgr_t * p_manager)
+{
+	auto l_decoder = &p_strips->j2k->m_specific_param.m_decoder;
+	uint32_t l_num_rows = (uint32_t)p_strips->images.size();
+	while (true) {
+		opj_image_t* l_strip = nullptr;
+		uint32_t l_row = 0;
+		{
+			std::lock_guard<std::mutex> lock(p_strips->mutex);
+			l_row = p_strips->next;
+			if (l_row == l_num_rows)
+				return true;
+			if (!p_flush_all && (!p_strips->images[l_row] || p_strips->tiles_left[l_row]))
+				return true;
+			l_strip = p_strips->images[l_row];
+			p_strips->images[l_row] = nullptr;
+			p_strips->next++;
+		}
+		/* tiles missing from a truncated codestream leave their strip blank */
+		if (!l_strip) {
+			l_strip = opj_j2k_create_strip_image(p_strips->j2k, l_decoder->m_start_tile_y + l_row);
+			if (!l_strip) {
+				opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to create strip %d\n", l_row);
+				return false;
+			}
+		}
+		bool l_rc = l_decoder->m_strip_callback(l_strip, l_row, l_decoder->m_strip_user_data);
+		opj_image_destroy(l_strip);
+		if (!l_rc) {
+			opj_event_msg(p_manager, EVT_ERROR, "Strip %d was rejected by the strip callback\n", l_row);
+			return false;
+		}
+	}
+}
+
+/**
+Tile decoder used by the concurrent decode pipeline. Each slot decodes one tile at a time,
+into its own tile coder, image header and tile data buffer.
+*/
+struct opj_j2k_tile_slot_t {
+	opj_j2k_tile_slot_t() : tcd(nullptr),
+							image(nullptr),
+							data(nullptr),
+							data_size(0)
+	{}
+	opj_tcd_t* tcd;
+	/* private copy of the image header, since tile decode updates resno_decoded */
+	opj_image_t* image;
+	uint8_t* data;
+	uint64_t data_size;
+	TaskGroup group;
+};
+
+static bool opj_j2k_decode_tiles_concurrent(opj_j2k_t *p_j2k,
+											opj_stream_private_t *p_stream,
+											opj_event_mgr_t * p_manager)
+{
+	bool l_go_on = true;
+	bool l_rc = true;
+	uint32_t l_current_tile_no = 0;
+	uint64_t l_data_size = 0;
+	uint32_t l_nb_comps = 0;
+	uint32_t nr_tiles = 0;
+	uint32_t num_tiles_to_decode = p_j2k->m_cp.th * p_j2k->m_cp.tw;
+	uint32_t num_tiles_decoded = 0;
+	uint32_t num_slots = opj_min<uint32_t>(p_j2k->numThreads, num_tiles_to_decode);
+	std::atomic<bool> l_decode_success(true);
+	auto l_scheduler = Scheduler::instance();
+	opj_tcd_t* l_original_tcd = p_j2k->m_tcd;
+	opj_image_t* l_output_image = p_j2k->m_output_image;
+	std::unique_ptr<opj_j2k_strips_t> l_strips;
+
+	/* number of decoded resolutions of each component of each tile, in stream order: the tile
+	tasks share the output image, so it is set from the last decoded tile once they are done,
+	as the sequential decode does */
+	uint32_t l_numcomps = l_output_image->numcomps;
+	std::vector<uint32_t> l_resno_decoded((size_t)num_tiles_to_decode * l_numcomps);
+	std::vector<uint8_t> l_tile_decoded(num_tiles_to_decode, 0);
+	uint32_t* l_resno_decoded_ptr = l_resno_decoded.data();
+	uint8_t* l_tile_decoded_ptr = l_tile_decoded.data();
+
+	if (p_j2k->m_specific_param.m_decoder.m_strip_callback)
+		l_strips.reset(new opj_j2k_strips_t(p_j2k));
+
+	/* allocate output components up front, since tiles are copied concurrently */
+	for (uint32_t compno = 0; !l_strips && compno < l_output_image->numcomps; ++compno) {
+		opj_image_comp_t* comp = l_output_image->comps + compno;
+		if (comp->w * comp->h == 0) {
+			opj_event_msg(p_manager, EVT_ERROR, "Output image has invalid dimensions %d x %d\n", comp->w, comp->h);
+			return false;
+		}
+		if (!comp->data) {
+			if (!opj_image_single_component_data_alloc(comp)) {
+				opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tiles\n");
+				return false;
+			}
+			memset(comp->data, 0, (size_t)comp->w * comp->h * sizeof(int32_t));
+		}
+	}
+
+	std::unique_ptr<opj_j2k_tile_slot_t[]> l_slots(new opj_j2k_tile_slot_t[num_slots]);
+	for (uint32_t i = 0; i < num_slots; ++i) {
+		auto slot = l_slots.get() + i;
+		slot->image = opj_image_create0();
+		if (!slot->image) {
+			l_rc = false;
+			break;
+		}
+		opj_copy_image_header(p_j2k->m_private_image, slot->image);
+		slot->tcd = opj_tcd_create(true);
+		if (!slot->tcd ||
+			!opj_tcd_init(slot->tcd, slot->image, &p_j2k->m_cp, p_j2k->numThreads)) {
+			l_rc = false;
+			break;
+		}
+		slot->tcd->current_plugin_tile = l_original_tcd->current_plugin_tile;
+	}
+	if (!l_rc)
+		opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tiles\n");
+
+	for (nr_tiles = 0; l_rc && nr_tiles < num_tiles_to_decode; nr_tiles++) {
+		uint32_t l_tile_x0, l_tile_y0, l_tile_x1, l_tile_y1;
+		l_tile_x0 = l_tile_y0 = l_tile_x1 = l_tile_y1 = 0;
+
+		/* wait for the slot's previous tile to finish before re-using its tile coder */
+		auto slot = l_slots.get() + (nr_tiles % num_slots);
+		l_scheduler->wait(slot->group);
+		if (!l_decode_success) {
+			l_rc = false;
+			break;
+		}
+
+		p_j2k->m_tcd = slot->tcd;
+		if (!opj_j2k_read_tile_header(p_j2k,
+									&l_current_tile_no,
+									&l_data_size,
+									&l_tile_x0,
+									&l_tile_y0,
+									&l_tile_x1,
+									&l_tile_y1,
+									&l_nb_comps,
+									&l_go_on,
+									p_stream,
+									p_manager)) {
+			l_rc = false;
+			break;
+		}
+		if (!l_go_on)
+			break;
+
+		if (l_data_size > slot->data_size) {
+			uint8_t *l_new_data = (uint8_t *)opj_realloc(slot->data, l_data_size);
+			if (!l_new_data) {
+				opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+				l_rc = false;
+				break;
+			}
+			slot->data = l_new_data;
+			slot->data_size = l_data_size;
+		}
+
+		if (!(p_j2k->m_specific_param.m_decoder.m_state & J2K_DEC_STATE_DATA) ||
+			(l_current_tile_no != p_j2k->m_current_tile_number)) {
+			opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+			l_rc = false;
+			break;
+		}
+		auto l_tcp = p_j2k->m_cp.tcps + l_current_tile_no;
+		if (!l_tcp->m_data) {
+			opj_j2k_tcp_destroy(l_tcp);
+			opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+			l_rc = false;
+			break;
+		}
+
+		auto l_dest_image = l_output_image;
+		if (l_strips) {
+			l_dest_image = opj_j2k_get_strip(l_strips.get(), l_current_tile_no, p_manager);
+			if (!l_dest_image) {
+				l_rc = false;
+				break;
+			}
+		}
+
+		/* the task takes ownership of the tile data, so that the header reader
+		no longer sees this tile as pending */
+		auto l_tile_data = l_tcp->m_data;
+		l_tcp->m_data = nullptr;
+		auto l_strips_ptr = l_strips.get();
+		uint32_t l_order = nr_tiles;
+		l_scheduler->run(slot->group, [=, &l_decode_success]() {
+			bool l_success = opj_tcd_decode_tile(slot->tcd, l_tile_data, l_current_tile_no, p_manager);
+			delete l_tile_data;
+			if (!l_success) {
+				opj_event_msg(p_manager, EVT_ERROR, "Failed to decode.\n");
+			}
+			else if (opj_tcd_update_tile_data(slot->tcd, slot->data, l_data_size)) {
+				opj_event_msg(p_manager, EVT_INFO, "Tile %d/%d has been decoded.\n", l_current_tile_no + 1, num_tiles_to_decode);
+				l_success = opj_j2k_copy_decoded_tile_to_output_image(slot->tcd,
+																	slot->data,
+																	l_dest_image,
+																	true,
+																	p_manager);
+				if (l_success) {
+					for (uint32_t compno = 0; compno < l_numcomps; ++compno)
+						l_resno_decoded_ptr[(size_t)l_order * l_numcomps + compno] = slot->tcd->image->comps[compno].resno_decoded;
+					l_tile_decoded_ptr[l_order] = 1;
+					if (l_strips_ptr)
+						opj_j2k_strip_tile_done(l_strips_ptr, l_current_tile_no, slot->tcd->image);
+					opj_event_msg(p_manager, EVT_INFO, "Image data has been updated with tile %d.\n\n", l_current_tile_no + 1);
+				}
+			}
+			else {
+				l_success = false;
+			}
+			if (!l_success) {
+				opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+				l_decode_success = false;
+			}
+		});
+
+		try {
+			if (!opj_j2k_end_tile_data(p_j2k, p_stream, p_manager)) {
+				opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+				l_rc = false;
+				break;
+			}
+		}
+		catch (DecodeUnknownMarkerAtEndOfTileException e) {
+			// only worry about exception if we have more tiles to decode
+			if (nr_tiles < num_tiles_to_decode - 1) {
+				opj_event_msg(p_manager, EVT_ERROR, "Stream too short, expected SOT\n");
+				opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_current_tile_no + 1, num_tiles_to_decode);
+				l_rc = false;
+				break;
+			}
+		}
+
+		num_tiles_decoded++;
+
+		/* hand over the strips completed by the tiles decoded so far */
+		if (l_strips && !opj_j2k_write_strips(l_strips.get(), false, p_manager)) {
+			l_rc = false;
+			break;
+		}
+
+		if (opj_stream_get_number_byte_left(p_stream) == 0
+			&& p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_NEOC)
+			break;
+	}
+
+	for (uint32_t i = 0; i < num_slots; ++i) {
+		auto slot = l_slots.get() + i;
+		l_scheduler->wait(slot->group);
+		opj_tcd_destroy(slot->tcd);
+		opj_image_destroy(slot->image);
+		opj_free(slot->data);
+	}
+	p_j2k->m_tcd = l_original_tcd;
+
+	for (uint32_t i = num_tiles_to_decode; i > 0; --i) {
+		if (l_tile_decoded[i - 1]) {
+			for (uint32_t compno = 0; compno < l_numcomps; ++compno)
+				l_output_image->comps[compno].resno_decoded = l_resno_decoded[(size_t)(i - 1) * l_numcomps + compno];
+			break;
+		}
+	}
+
+	if (!l_decode_success) {
+		p_j2k->m_specific_param.m_decoder.m_state |= J2K_DEC_STATE_ERR;
+		l_rc = false;
+	}
+	if (!l_rc)
+		return false;
+
+	if (num_tiles_decoded == 0) {
+		opj_event_msg(p_manager, EVT_ERROR, "No tiles were decoded. Exiting\n");
+		return false;
+	}
+	else if (num_tiles_decoded < num_tiles_to_decode) {
+		opj_event_msg(p_manager, EVT_WARNING, "Only %d out of %d tiles were decoded\n", num_tiles_decoded, num_tiles_to_decode);
+	}
+	if (l_strips)
+		return opj_j2k_write_strips(l_strips.get(), true, p_manager);
+	return true;
+}
+
 static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
                                    opj_stream_private_t *p_stream,
                                    opj_event_mgr_t * p_manager)
@@ -9201,7 +10248,13 @@ static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
     uint32_t nr_tiles = 0;
 	uint32_t num_tiles_to_decode = p_j2k->m_cp.th * p_j2k->m_cp.tw;
 	bool clearOutputOnInit = false;
-    if (opj_j2k_needs_copy_tile_data(p_j2k, num_tiles_to_decode)) {
+	if (opj_j2k_can_decode_tiles_concurrently(p_j2k, num_tiles_to_decode))
+		return opj_j2k_decode_tiles_concurrent(p_j2k, p_stream, p_manager);
+	/* with a strip callback, tiles are always copied into their strip */
+	std::unique_ptr<opj_j2k_strips_t> l_strips;
+	if (p_j2k->m_specific_param.m_decoder.m_strip_callback)
+		l_strips.reset(new opj_j2k_strips_t(p_j2k));
+    if (l_strips || opj_j2k_needs_copy_tile_data(p_j2k, num_tiles_to_decode)) {
         l_current_data = (uint8_t*)opj_malloc(1);
         if (!l_current_data) {
             opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tiles\n");
@@ -9266,17 +10319,29 @@ static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
 		}
         opj_event_msg(p_manager, EVT_INFO, "Tile %d/%d has been decoded.\n", l_current_tile_no +1, num_tiles_to_decode);
 
-        /* copy from current data to output image, if necessary */
+        /* copy from current data to output image, or to the tile's strip, if necessary */
         if (l_current_data) {
-            if (!opj_j2k_copy_decoded_tile_to_output_image(p_j2k->m_tcd, 
+            opj_image_t* l_dest_image = p_j2k->m_output_image;
+            if (l_strips)
+                l_dest_image = opj_j2k_get_strip(l_strips.get(), l_current_tile_no, p_manager);
+            if (!l_dest_image ||
+                    !opj_j2k_copy_decoded_tile_to_output_image(p_j2k->m_tcd,
 															l_current_data,
-															p_j2k->m_output_image,
+															l_dest_image,
 															clearOutputOnInit,
 															p_manager)) {
                 opj_free(l_current_data);
                 return false;
             }
+            opj_j2k_copy_resno_decoded(p_j2k->m_tcd, l_dest_image);
             opj_event_msg(p_manager, EVT_INFO, "Image data has been updated with tile %d.\n\n", l_current_tile_no + 1);
+            if (l_strips) {
+                opj_j2k_strip_tile_done(l_strips.get(), l_current_tile_no, p_j2k->m_tcd->image);
+                if (!opj_j2k_write_strips(l_strips.get(), false, p_manager)) {
+                    opj_free(l_current_data);
+                    return false;
+                }
+            }
         }
 
 		num_tiles_decoded++;
@@ -9295,8 +10360,9 @@ static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
 	}
 	else if (num_tiles_decoded < num_tiles_to_decode) {
 		opj_event_msg(p_manager, EVT_WARNING, "Only %d out of %d tiles were decoded\n", num_tiles_decoded, num_tiles_to_decode);
-		return true;
 	}
+	if (l_strips)
+		return opj_j2k_write_strips(l_strips.get(), true, p_manager);
 	return true;
 }
 
@@ -9351,29 +10417,45 @@ static bool opj_j2k_decode_one_tile ( opj_j2k_t *p_j2k,
     }
     /* Move into the codestream to the first SOT used to decode the desired tile */
     l_tile_no_to_dec = p_j2k->m_specific_param.m_decoder.m_tile_ind_to_dec;
-    if (p_j2k->cstr_index->tile_index)
-        if(p_j2k->cstr_index->tile_index->tp_index) {
-            if ( ! p_j2k->cstr_index->tile_index[l_tile_no_to_dec].nb_tps) {
-                /* the index for this tile has not been built,
-                 *  so move to the last SOT read */
-                if ( !(opj_stream_read_seek(p_stream, p_j2k->m_specific_param.m_decoder.m_last_sot_read_pos+2, p_manager)) ) {
-                    opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
+    if (p_j2k->cstr_index->tile_index) {
+        bool l_found = false;
+        int64_t l_sot_pos = 0;
+        opj_tile_index_t* l_tile_index = p_j2k->cstr_index->tile_index + l_tile_no_to_dec;
+
+        /* Use the TLM markers if present, otherwise scan SOT markers from the last
+         * SOT read until the tile is found, unless the tile has already been indexed */
+        if (!opj_j2k_seek_tile_tlm(p_j2k, l_tile_no_to_dec, &l_found, p_stream, p_manager)) {
+            if (l_current_data)
+                opj_free(l_current_data);
+            return false;
+        }
+        if (!l_found) {
+            if (!l_tile_index->nb_tps) {
+                if (!opj_j2k_scan_sot(p_j2k, l_tile_no_to_dec, p_stream, p_manager)) {
                     if (l_current_data)
                         opj_free(l_current_data);
                     return false;
                 }
+            }
+            if (l_tile_index->nb_tps) {
+                l_sot_pos = l_tile_index->tp_index[0].start_pos;
             } else {
-                if ( !(opj_stream_read_seek(p_stream, p_j2k->cstr_index->tile_index[l_tile_no_to_dec].tp_index[0].start_pos+2, p_manager)) ) {
-                    opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
-                    if (l_current_data)
-                        opj_free(l_current_data);
-                    return false;
-                }
+                /* tile not found, so move to the last SOT read */
+                l_sot_pos = p_j2k->m_specific_param.m_decoder.m_last_sot_read_pos ?
+                            p_j2k->m_specific_param.m_decoder.m_last_sot_read_pos :
+                            (int64_t)p_j2k->cstr_index->main_head_end;
+            }
+            if ( !(opj_stream_read_seek(p_stream, l_sot_pos+2, p_manager)) ) {
+                opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
+                if (l_current_data)
+                    opj_free(l_current_data);
+                return false;
             }
-            /* Special case if we have previously read the EOC marker (if the previous tile decoded is the last ) */
-            if(p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_EOC)
-                p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_TPHSOT;
         }
+        /* Special case if we have previously read the EOC marker (if the previous tile decoded is the last ) */
+        if(p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_EOC)
+            p_j2k->m_specific_param.m_decoder.m_state = J2K_DEC_STATE_TPHSOT;
+    }
 
     for (;;) {
         if (! opj_j2k_read_tile_header( p_j2k,
@@ -9429,6 +10511,7 @@ static bool opj_j2k_decode_one_tile ( opj_j2k_t *p_j2k,
                 opj_free(l_current_data);
                 return false;
             }
+            opj_j2k_copy_resno_decoded(p_j2k->m_tcd, p_j2k->m_output_image);
         }
         opj_event_msg(p_manager, EVT_INFO, "Image data has been updated with tile %d.\n\n", l_current_tile_no+1);
 
@@ -9502,6 +10585,19 @@ bool opj_j2k_decode(opj_j2k_t * p_j2k,
     return true;
 }
 
+void opj_j2k_set_strip_callback(opj_j2k_t *p_j2k,
+								opj_strip_callback_fn callback,
+								void* user_data)
+{
+	if (p_j2k->m_is_decoder) {
+		p_j2k->m_specific_param.m_decoder.m_strip_callback = callback;
+		p_j2k->m_specific_param.m_decoder.m_strip_user_data = user_data;
+	} else {
+		p_j2k->m_specific_param.m_encoder.m_strip_callback = callback;
+		p_j2k->m_specific_param.m_encoder.m_strip_user_data = user_data;
+	}
+}
+
 bool opj_j2k_get_tile(  opj_j2k_t *p_j2k,
                         opj_stream_private_t *p_stream,
                         opj_image_t* p_image,
@@ -9644,6 +10740,283 @@ bool opj_j2k_set_decoded_resolution_factor(opj_j2k_t *p_j2k,
     return false;
 }
 
+static bool opj_j2k_can_encode_tiles_concurrently(opj_j2k_t *p_j2k, uint32_t num_tiles)
+{
+	if (p_j2k->numThreads <= 1 || num_tiles <= 1)
+		return false;
+
+	/* plugin encode and plugin debugging expect tiles in codestream order */
+	if (p_j2k->m_tcd->current_plugin_tile ||
+		(opj_plugin_get_debug_state() & OPJ_PLUGIN_STATE_DEBUG))
+		return false;
+
+	/* writing a POC marker clamps the progression bounds, which rate allocation depends on */
+	for (uint32_t i = 0; i < num_tiles; ++i) {
+		if (p_j2k->m_cp.tcps[i].numpocs)
+			return false;
+	}
+	return true;
+}
+
+/**
+Tile encoder used by the concurrent encode pipeline. Each slot prepares one tile at a time,
+with its own tile coder and raw tile data buffer.
+*/
+struct opj_j2k_encode_slot_t {
+	opj_j2k_encode_slot_t() : tcd(nullptr),
+							data(nullptr),
+							data_size(0),
+							tile_no(0),
+							strip(nullptr)
+	{}
+	opj_tcd_t* tcd;
+	uint8_t* data;
+	uint64_t data_size;
+	uint32_t tile_no;
+	/* source strip of the tile, when encoding with a strip callback */
+	opj_image_t* strip;
+	TaskGroup group;
+};
+
+/**
+Source strips, one per row of tiles, for encoding with a strip callback.
+
+The strip of a tile row is read when the first tile of the row is encoded, and is released
+once the last tile of the row has been written, so that only the rows of tiles in flight
+are held in memory.
+*/
+struct opj_j2k_source_strips_t {
+	opj_j2k_source_strips_t(opj_j2k_t* j2k) : j2k(j2k),
+											images(j2k->m_cp.th, nullptr),
+											next(0)
+	{}
+	~opj_j2k_source_strips_t() {
+		for (auto image : images)
+			opj_image_destroy(image);
+	}
+	opj_j2k_t* j2k;
+	std::vector<opj_image_t*> images;
+	/* next tile row to read */
+	uint32_t next;
+};
+
+static opj_image_t* opj_j2k_create_source_strip(opj_j2k_t *p_j2k, uint32_t p_tile_row)
+{
+	opj_cp_t* l_cp = &p_j2k->m_cp;
+	opj_image_t* l_image = p_j2k->m_private_image;
+
+	/* tile row borders, computed as in opj_tcd_init_tile */
+	uint32_t l_ty0 = l_cp->ty0 + p_tile_row * l_cp->tdy;
+	uint32_t l_y0 = opj_max<uint32_t>(l_ty0, l_image->y0);
+	uint32_t l_y1 = opj_min<uint32_t>(opj_uint_adds(l_ty0, l_cp->tdy), l_image->y1);
+
+	opj_image_t* l_strip = opj_image_create0();
+	if (!l_strip)
+		return nullptr;
+	opj_copy_image_header(l_image, l_strip);
+	if (!l_strip->comps) {
+		opj_image_destroy(l_strip);
+		return nullptr;
+	}
+	for (uint32_t compno = 0; compno < l_strip->numcomps; ++compno) {
+		opj_image_comp_t* l_comp = l_strip->comps + compno;
+		uint32_t l_row0 = opj_uint_ceildiv(l_y0, l_comp->dy);
+		uint32_t l_row1 = opj_uint_ceildiv(l_y1, l_comp->dy);
+		l_comp->x0 = opj_uint_ceildiv(l_image->x0, l_comp->dx);
+		l_comp->w = opj_uint_ceildiv(l_image->x1, l_comp->dx) - l_comp->x0;
+		l_comp->y0 = l_row0;
+		l_comp->h = l_row1 - l_row0;
+		if (l_comp->w * l_comp->h && !opj_image_single_component_data_alloc(l_comp)) {
+			opj_image_destroy(l_strip);
+			return nullptr;
+		}
+	}
+	return l_strip;
+}
+
+static opj_image_t* opj_j2k_get_source_strip(opj_j2k_source_strips_t* p_strips,
+											uint32_t p_tile_no,
+											opj_event_mgr_t * p_manager)
+{
+	auto l_encoder = &p_strips->j2k->m_specific_param.m_encoder;
+	uint32_t l_row = p_tile_no / p_strips->j2k->m_cp.tw;
+	if (p_strips->images[l_row])
+		return p_strips->images[l_row];
+	if (l_row != p_strips->next) {
+		opj_event_msg(p_manager, EVT_ERROR, "Strip %d requested out of order\n", l_row);
+		return nullptr;
+	}
+	auto l_strip = opj_j2k_create_source_strip(p_strips->j2k, l_row);
+	if (!l_strip) {
+		opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to create strip %d\n", l_row);
+		return nullptr;
+	}
+	if (!l_encoder->m_strip_callback(l_strip, l_row, l_encoder->m_strip_user_data)) {
+		opj_event_msg(p_manager, EVT_ERROR, "Strip %d could not be read by the strip callback\n", l_row);
+		opj_image_destroy(l_strip);
+		return nullptr;
+	}
+	p_strips->images[l_row] = l_strip;
+	p_strips->next++;
+	return l_strip;
+}
+
+static void opj_j2k_release_source_strip(opj_j2k_source_strips_t* p_strips, uint32_t p_tile_no)
+{
+	uint32_t l_tw = p_strips->j2k->m_cp.tw;
+	if (p_tile_no % l_tw != l_tw - 1)
+		return;
+	uint32_t l_row = p_tile_no / l_tw;
+	opj_image_destroy(p_strips->images[l_row]);
+	p_strips->images[l_row] = nullptr;
+}
+
+static void opj_j2k_copy_strip_to_tile(opj_tcd_t* p_tcd, opj_image_t* p_strip)
+{
+	for (uint32_t compno = 0; compno < p_strip->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* l_tilec = p_tcd->tile->comps + compno;
+		opj_image_comp_t* l_comp = p_strip->comps + compno;
+		uint32_t l_width = l_tilec->x1 - l_tilec->x0;
+		uint32_t l_height = l_tilec->y1 - l_tilec->y0;
+		const int32_t* l_src = l_comp->data + (uint64_t)(l_tilec->y0 - l_comp->y0) * l_comp->w +
+													(l_tilec->x0 - l_comp->x0);
+		int32_t* l_dest = l_tilec->buf->data;
+		for (uint32_t j = 0; j < l_height; ++j) {
+			memcpy(l_dest, l_src, (size_t)l_width * sizeof(int32_t));
+			l_dest += l_width;
+			l_src += l_comp->w;
+		}
+	}
+}
+
+/**
+Copies a tile from the image into the slot's tile coder, and runs everything up to tier 2 on it
+*/
+static bool opj_j2k_pre_t2_encode_tile(opj_j2k_encode_slot_t* p_slot,
+										uint64_t p_max_length,
+										opj_event_mgr_t * p_manager)
+{
+	auto l_tcd = p_slot->tcd;
+	if (!opj_tcd_init_encode_tile(l_tcd, p_slot->tile_no, p_manager))
+		return false;
+
+	for (uint32_t j = 0; j < l_tcd->image->numcomps; ++j) {
+		if (!opj_tile_buf_alloc_component_data_encode(l_tcd->tile->comps[j].buf)) {
+			opj_event_msg(p_manager, EVT_ERROR, "Error allocating tile component data.");
+			return false;
+		}
+	}
+
+	if (p_slot->strip) {
+		opj_j2k_copy_strip_to_tile(l_tcd, p_slot->strip);
+	} else {
+		uint64_t l_tile_size = opj_tcd_get_encoded_tile_size(l_tcd);
+		if (l_tile_size > p_slot->data_size) {
+			uint8_t *l_new_data = (uint8_t *)opj_realloc(p_slot->data, l_tile_size);
+			if (!l_new_data) {
+				opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to encode all tiles\n");
+				return false;
+			}
+			p_slot->data = l_new_data;
+			p_slot->data_size = l_tile_size;
+		}
+		opj_j2k_get_tile_data(l_tcd, p_slot->data);
+		if (!opj_tcd_copy_tile_data(l_tcd, p_slot->data, l_tile_size)) {
+			opj_event_msg(p_manager, EVT_ERROR, "Size mismatch between tile data and sent data.");
+			return false;
+		}
+	}
+
+	if (!opj_tcd_pre_t2_encode_tile(l_tcd, p_slot->tile_no, p_max_length, nullptr)) {
+		opj_event_msg(p_manager, EVT_ERROR, "Cannot encode tile\n");
+		return false;
+	}
+	return true;
+}
+
+static bool opj_j2k_encode_tiles_concurrent(opj_j2k_t * p_j2k,
+											opj_j2k_source_strips_t* p_strips,
+											opj_stream_private_t *p_stream,
+											opj_event_mgr_t * p_manager)
+{
+	bool l_rc = true;
+	uint32_t l_nb_tiles = p_j2k->m_cp.th * p_j2k->m_cp.tw;
+	uint32_t num_slots = opj_min<uint32_t>(p_j2k->numThreads, l_nb_tiles);
+	std::atomic<bool> l_success(true);
+	auto l_scheduler = Scheduler::instance();
+	opj_tcd_t* l_original_tcd = p_j2k->m_tcd;
+
+	/* rate allocation of the first tile part is bounded by the tile buffer, less the
+	SOT marker and the reserve that opj_j2k_write_sod keeps for EOC */
+	uint64_t l_max_length = p_j2k->m_specific_param.m_encoder.tile->getSize() - 12 - 4;
+
+	std::unique_ptr<opj_j2k_encode_slot_t[]> l_slots(new opj_j2k_encode_slot_t[num_slots]);
+	l_slots[0].tcd = l_original_tcd;
+	for (uint32_t i = 1; i < num_slots; ++i) {
+		auto l_tcd = opj_tcd_create(false);
+		if (!l_tcd) {
+			l_rc = false;
+			break;
+		}
+		l_slots[i].tcd = l_tcd;
+		if (!opj_tcd_init(l_tcd, p_j2k->m_private_image, &p_j2k->m_cp, p_j2k->numThreads)) {
+			l_rc = false;
+			break;
+		}
+	}
+	if (!l_rc)
+		opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to create Tile Coder\n");
+
+	/* wait for a slot's tile, then run tier 2 and write its tile parts */
+	auto l_write_tile = [&](opj_j2k_encode_slot_t* slot) {
+		l_scheduler->wait(slot->group);
+		if (!l_success)
+			return false;
+		p_j2k->m_tcd = slot->tcd;
+		if (!opj_j2k_begin_write_tile(p_j2k, slot->tile_no, p_manager) ||
+			!opj_j2k_post_write_tile(p_j2k, p_stream, p_manager))
+			return false;
+		if (p_strips)
+			opj_j2k_release_source_strip(p_strips, slot->tile_no);
+		return true;
+	};
+
+	for (uint32_t i = 0; l_rc && i < l_nb_tiles; ++i) {
+		auto slot = l_slots.get() + (i % num_slots);
+
+		/* the slot holds the oldest tile in flight, which is next in codestream order */
+		if (i >= num_slots && !l_write_tile(slot)) {
+			l_rc = false;
+			break;
+		}
+		slot->tile_no = i;
+		if (p_strips) {
+			slot->strip = opj_j2k_get_source_strip(p_strips, i, p_manager);
+			if (!slot->strip) {
+				l_rc = false;
+				break;
+			}
+		}
+		l_scheduler->run(slot->group, [slot, l_max_length, p_manager, &l_success]() {
+			if (!opj_j2k_pre_t2_encode_tile(slot, l_max_length, p_manager))
+				l_success = false;
+		});
+	}
+	for (uint32_t i = l_nb_tiles - num_slots; l_rc && i < l_nb_tiles; ++i)
+		l_rc = l_write_tile(l_slots.get() + (i % num_slots));
+
+	for (uint32_t i = 0; i < num_slots; ++i) {
+		auto slot = l_slots.get() + i;
+		l_scheduler->wait(slot->group);
+		if (slot->tcd != l_original_tcd)
+			opj_tcd_destroy(slot->tcd);
+		opj_free(slot->data);
+	}
+	p_j2k->m_tcd = l_original_tcd;
+
+	return l_rc;
+}
+
 bool opj_j2k_encode(opj_j2k_t * p_j2k,
 					opj_plugin_tile_t* tile,
                     opj_stream_private_t *p_stream,
@@ -9665,8 +11038,16 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
     p_tcd = p_j2k->m_tcd;
 	p_tcd->current_plugin_tile = tile;
 
+    /* with a strip callback, the source rows are read one row of tiles at a time */
+    std::unique_ptr<opj_j2k_source_strips_t> l_strips;
+    if (p_j2k->m_specific_param.m_encoder.m_strip_callback)
+        l_strips.reset(new opj_j2k_source_strips_t(p_j2k));
+
     l_nb_tiles = p_j2k->m_cp.th * p_j2k->m_cp.tw;
-    if (l_nb_tiles == 1) {
+    if (opj_j2k_can_encode_tiles_concurrently(p_j2k, l_nb_tiles)) {
+        return opj_j2k_encode_tiles_concurrent(p_j2k, l_strips.get(), p_stream, p_manager);
+    }
+    if (l_nb_tiles == 1 && !l_strips) {
         l_reuse_data = true;
 #ifdef __SSE__
         for (j=0; j<p_j2k->m_tcd->image->numcomps; ++j) {
@@ -9701,8 +11082,17 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
                 }
             }
         }
+        if (l_strips) {
+            auto l_strip = opj_j2k_get_source_strip(l_strips.get(), i, p_manager);
+            if (!l_strip) {
+                if (l_current_data)
+                    opj_free(l_current_data);
+                return false;
+            }
+            opj_j2k_copy_strip_to_tile(p_j2k->m_tcd, l_strip);
+        }
         l_current_tile_size = opj_tcd_get_encoded_tile_size(p_j2k->m_tcd);
-        if (!l_reuse_data) {
+        if (!l_reuse_data && !l_strips) {
             if (l_current_tile_size > l_max_tile_size) {
                 uint8_t *l_new_current_data = (uint8_t *) opj_realloc(l_current_data, l_current_tile_size);
                 if (! l_new_current_data) {
@@ -9736,7 +11126,8 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
 			}
 			return false;
 		}
-		
+		if (l_strips)
+			opj_j2k_release_source_strip(l_strips.get(), i);
     }
 
     if (l_current_data) {
@@ -9813,12 +11204,10 @@ bool opj_j2k_start_compress(opj_j2k_t *p_j2k,
     return true;
 }
 
-static bool opj_j2k_pre_write_tile (       opj_j2k_t * p_j2k,
-        uint32_t p_tile_index,
-        opj_stream_private_t *p_stream,
-        opj_event_mgr_t * p_manager )
+static bool opj_j2k_begin_write_tile(opj_j2k_t * p_j2k,
+									uint32_t p_tile_index,
+									opj_event_mgr_t * p_manager)
 {
-    (void)p_stream;
     if (p_tile_index != p_j2k->m_current_tile_number) {
         opj_event_msg(p_manager, EVT_ERROR, "The given tile index does not match." );
         return false;
@@ -9830,6 +11219,19 @@ static bool opj_j2k_pre_write_tile (       opj_j2k_t * p_j2k,
     p_j2k->m_tcd->cur_totnum_tp = p_j2k->m_cp.tcps[p_tile_index].m_nb_tile_parts;
     p_j2k->m_specific_param.m_encoder.m_current_poc_tile_part_number = 0;
 
+    return true;
+}
+
+static bool opj_j2k_pre_write_tile (       opj_j2k_t * p_j2k,
+        uint32_t p_tile_index,
+        opj_stream_private_t *p_stream,
+        opj_event_mgr_t * p_manager )
+{
+    (void)p_stream;
+    if (!opj_j2k_begin_write_tile(p_j2k, p_tile_index, p_manager)) {
+        return false;
+    }
+
     /* initialisation before tile encoding  */
     if (! opj_tcd_init_encode_tile(p_j2k->m_tcd, p_j2k->m_current_tile_number, p_manager)) {
         return false;
@@ -237,6 +237,15 @@ typedef struct opj_simple_mcc_decorrelation_data {
 }
 opj_simple_mcc_decorrelation_data_t;
 
+/**
+Packet lengths signalled by PLT or PLM markers, in codestream order
+*/
+typedef struct opj_packet_lengths {
+    uint32_t* m_lengths;
+    uint32_t m_nb_lengths;
+    uint32_t m_max_lengths;
+} opj_packet_lengths_t;
+
 typedef struct opj_ppx_struct {
     uint8_t*   m_data; /* m_data == NULL => Zppx not read yet */
     uint32_t	m_data_size;
@@ -291,6 +300,8 @@ struct opj_tcp_t {
     uint32_t m_nb_tile_parts;
 
     opj_seg_buf_t* m_data;
+    /** lengths of all packets of the tile read so far (from PLT or PLM markers) */
+    opj_packet_lengths_t m_packet_lengths;
 
     /** encoding norms */
     double *	mct_norms;
@@ -339,6 +350,8 @@ typedef struct opj_encoding_param {
     uint32_t m_tp_on : 1;
 	/* rate control algorithm */
 	uint32_t rateControlAlgorithm;
+	/* skip T1 coding passes below the estimated rate threshold */
+	bool m_early_termination;
 }
 opj_encoding_param_t;
 
@@ -417,6 +430,18 @@ typedef struct opj_cp {
 } opj_cp_t;
 
 
+/**
+Tile-part entry read from a TLM marker
+*/
+typedef struct opj_tlm_entry {
+    /** tile index (Ttlm) */
+    uint32_t tileno;
+    /** length of tile-part, from start of SOT marker to end of tile-part data (Ptlm) */
+    uint32_t length;
+    /** position of SOT marker in codestream, computed once main header has been read */
+    int64_t start_pos;
+} opj_tlm_entry_t;
+
 typedef struct opj_j2k_dec {
     /** Decoder state: used to indicate in which part of the codestream the decoder is (main header, tile header, end) */
     uint32_t m_state;
@@ -457,6 +482,28 @@ typedef struct opj_j2k_dec {
     /** TNsot correction : see issue 254 **/
     uint32_t m_nb_tile_parts_correction_checked : 1;
     uint32_t m_nb_tile_parts_correction : 1;
+    /** TLM markers are missing, out of sequence or inconsistent with the codestream */
+    uint32_t m_tlm_invalid : 1;
+
+    /** Tile-part entries from all TLM markers, in codestream order */
+    opj_tlm_entry_t* m_tlm_entries;
+    uint32_t m_nb_tlm_entries;
+    uint32_t m_max_tlm_entries;
+    /** Ztlm of last TLM marker read; -1 if none */
+    int32_t m_last_tlm_index;
+
+    /** Packet lengths from all PLM markers, one entry per tile-part in codestream order */
+    opj_packet_lengths_t* m_plm_tile_parts;
+    uint32_t m_nb_plm_tile_parts;
+    uint32_t m_max_plm_tile_parts;
+    /** Number of distinct tile-parts whose SOT marker has been read, in codestream order */
+    uint32_t m_nb_tile_parts_read;
+    /** tile-parts were skipped by seeking, so m_nb_tile_parts_read is not a tile-part index */
+    uint32_t m_tile_parts_skipped : 1;
+
+    /** when set, decoded tile rows are handed to this callback instead of filling the output image */
+    opj_strip_callback_fn m_strip_callback;
+    void* m_strip_user_data;
 
 } opj_j2k_dec_t;
 
@@ -487,6 +534,10 @@ struct opj_j2k_enc_t {
 
 	EncodedTileData* tile;
 	EncodedTileData* tileHeader;
+
+    /** Callback that fills the source strips, when encoding with opj_encode_strips */
+    opj_strip_callback_fn m_strip_callback;
+    void* m_strip_user_data;
 } ;
 
 
@@ -744,6 +795,18 @@ bool opj_j2k_decode(opj_j2k_t *j2k,
                     opj_image_t *p_image,
                     opj_event_mgr_t *p_manager);
 
+/**
+ * Sets the callback that the next decode hands decoded strips to,
+ * or that the next encode reads the source strips from.
+ * @param p_j2k			J2K codec handle
+ * @param callback		strip callback, or NULL to decode into the output image,
+ *						or encode from the image passed to opj_j2k_start_compress
+ * @param user_data		user data passed to the callback
+*/
+void opj_j2k_set_strip_callback(opj_j2k_t *p_j2k,
+								opj_strip_callback_fn callback,
+								void* user_data);
+
 
 bool opj_j2k_get_tile(	opj_j2k_t *p_j2k,
                         opj_stream_private_t *p_stream,
@@ -1843,6 +1843,70 @@ static bool opj_jp2_read_colr( opj_jp2_t *jp2,
     return true;
 }
 
+/**
+Sets the colour space of the decoded image from the colour specification box
+*/
+static void opj_jp2_set_color_space(opj_jp2_t *jp2, opj_image_t* p_image)
+{
+    if (jp2->enumcs == 16)
+        p_image->color_space = OPJ_CLRSPC_SRGB;
+    else if (jp2->enumcs == 17)
+        p_image->color_space = OPJ_CLRSPC_GRAY;
+    else if (jp2->enumcs == 18)
+        p_image->color_space = OPJ_CLRSPC_SYCC;
+    else if (jp2->enumcs == 24)
+        p_image->color_space = OPJ_CLRSPC_EYCC;
+    else if (jp2->enumcs == 12)
+        p_image->color_space = OPJ_CLRSPC_CMYK;
+    else
+        p_image->color_space = OPJ_CLRSPC_UNKNOWN;
+}
+
+/**
+Decodes to strips. The colour space and ICC profile are set before decoding, so that every strip carries them.
+A palette or channel definitions can only be applied to the whole image, so in that case
+the image is decoded in full and handed to the callback as a single strip.
+*/
+static bool opj_jp2_decode_strips(opj_jp2_t *jp2,
+                                  opj_stream_private_t *p_stream,
+                                  opj_image_t* p_image,
+                                  opj_event_mgr_t * p_manager)
+{
+    auto l_decoder = &jp2->j2k->m_specific_param.m_decoder;
+    bool l_whole_image = (jp2->color.jp2_pclr && jp2->color.jp2_pclr->cmap) || jp2->color.jp2_cdef;
+    if (!l_whole_image) {
+        if (!opj_jp2_check_color(p_image, &(jp2->color), p_manager)) {
+            return false;
+        }
+        opj_jp2_set_color_space(jp2, p_image);
+        if (jp2->color.jp2_pclr)
+            opj_jp2_free_pclr(&(jp2->color));
+        if(jp2->color.icc_profile_buf) {
+            p_image->icc_profile_buf = jp2->color.icc_profile_buf;
+            p_image->icc_profile_len = jp2->color.icc_profile_len;
+            jp2->color.icc_profile_buf = NULL;
+        }
+        if (!opj_j2k_decode(jp2->j2k, NULL, p_stream, p_image, p_manager)) {
+            opj_event_msg(p_manager, EVT_ERROR, "Failed to decode the codestream in the JP2 file\n");
+            return false;
+        }
+        return true;
+    }
+
+    auto l_callback = l_decoder->m_strip_callback;
+    auto l_user_data = l_decoder->m_strip_user_data;
+    opj_j2k_set_strip_callback(jp2->j2k, NULL, NULL);
+    bool l_rc = opj_jp2_decode(jp2, NULL, p_stream, p_image, p_manager);
+    opj_j2k_set_strip_callback(jp2->j2k, l_callback, l_user_data);
+    if (!l_rc)
+        return false;
+    l_rc = l_callback(p_image, 0, l_user_data);
+    opj_image_all_components_data_free(p_image);
+    if (!l_rc)
+        opj_event_msg(p_manager, EVT_ERROR, "Strip 0 was rejected by the strip callback\n");
+    return l_rc;
+}
+
 bool opj_jp2_decode(opj_jp2_t *jp2,
 					opj_plugin_tile_t* tile,
                     opj_stream_private_t *p_stream,
@@ -1852,6 +1916,9 @@ bool opj_jp2_decode(opj_jp2_t *jp2,
     if (!p_image)
         return false;
 
+    if (jp2->j2k->m_specific_param.m_decoder.m_strip_callback && !jp2->ignore_pclr_cmap_cdef)
+        return opj_jp2_decode_strips(jp2, p_stream, p_image, p_manager);
+
     /* J2K decoding */
     if( ! opj_j2k_decode(jp2->j2k, tile, p_stream, p_image, p_manager) ) {
         opj_event_msg(p_manager, EVT_ERROR, "Failed to decode the codestream in the JP2 file\n");
@@ -1864,18 +1931,7 @@ bool opj_jp2_decode(opj_jp2_t *jp2,
         }
 
         /* Set Image Color Space */
-        if (jp2->enumcs == 16)
-            p_image->color_space = OPJ_CLRSPC_SRGB;
-        else if (jp2->enumcs == 17)
-            p_image->color_space = OPJ_CLRSPC_GRAY;
-        else if (jp2->enumcs == 18)
-            p_image->color_space = OPJ_CLRSPC_SYCC;
-        else if (jp2->enumcs == 24)
-            p_image->color_space = OPJ_CLRSPC_EYCC;
-        else if (jp2->enumcs == 12)
-            p_image->color_space = OPJ_CLRSPC_CMYK;
-        else
-            p_image->color_space = OPJ_CLRSPC_UNKNOWN;
+        opj_jp2_set_color_space(jp2, p_image);
 
         if(jp2->color.jp2_pclr) {
             /* Part 1, I.5.3.4: Either both or none : */
@@ -1900,6 +1956,13 @@ bool opj_jp2_decode(opj_jp2_t *jp2,
     return true;
 }
 
+void opj_jp2_set_strip_callback(opj_jp2_t *jp2,
+								opj_strip_callback_fn callback,
+								void* user_data)
+{
+    opj_j2k_set_strip_callback(jp2->j2k, callback, user_data);
+}
+
 static bool opj_jp2_write_jp2h(opj_jp2_t *jp2,
                                opj_stream_private_t *stream,
                                opj_event_mgr_t * p_manager
@@ -229,6 +229,18 @@ bool opj_jp2_decode(opj_jp2_t *jp2,
                     opj_image_t* p_image,
                     opj_event_mgr_t * p_manager);
 
+/**
+ * Sets the callback that the next decode hands decoded strips to,
+ * or that the next encode reads the source strips from.
+ * @param jp2			JP2 codec handle
+ * @param callback		strip callback, or NULL to decode into the output image,
+ *						or encode from the image passed to opj_jp2_start_compress
+ * @param user_data		user data passed to the callback
+*/
+void opj_jp2_set_strip_callback(opj_jp2_t *jp2,
+								opj_strip_callback_fn callback,
+								void* user_data);
+
 /**
  * Setup the encoder parameters using the current image and using user parameters.
  * Coding parameters are returned in jp2->j2k->cp.
@@ -470,6 +470,124 @@ void opj_mct_decode_real(
 #endif
 }
 
+#ifdef __SSE2__
+static inline __m128i opj_mct_clamp_epi32(__m128i v, __m128i vmin, __m128i vmax)
+{
+#ifdef __SSE4_1__
+    return _mm_min_epi32(_mm_max_epi32(v, vmin), vmax);
+#else
+    __m128i mask = _mm_cmplt_epi32(v, vmin);
+    v = _mm_or_si128(_mm_and_si128(mask, vmin), _mm_andnot_si128(mask, v));
+    mask = _mm_cmpgt_epi32(v, vmax);
+    return _mm_or_si128(_mm_and_si128(mask, vmax), _mm_andnot_si128(mask, v));
+#endif
+}
+#endif
+
+/* <summary> */
+/* Inverse reversible MCT, followed by DC level shift. */
+/* </summary> */
+void opj_mct_decode_dc_shift(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint64_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    const __m128i vshift0 = _mm_set1_epi32(shift[0]);
+    const __m128i vshift1 = _mm_set1_epi32(shift[1]);
+    const __m128i vshift2 = _mm_set1_epi32(shift[2]);
+    const __m128i vmin0 = _mm_set1_epi32(min[0]);
+    const __m128i vmin1 = _mm_set1_epi32(min[1]);
+    const __m128i vmin2 = _mm_set1_epi32(min[2]);
+    const __m128i vmax0 = _mm_set1_epi32(max[0]);
+    const __m128i vmax1 = _mm_set1_epi32(max[1]);
+    const __m128i vmax2 = _mm_set1_epi32(max[2]);
+    for (; i < (n & ~(uint64_t)3); i += 4) {
+        __m128i y = _mm_loadu_si128((const __m128i *)&(c0[i]));
+        __m128i u = _mm_loadu_si128((const __m128i *)&(c1[i]));
+        __m128i v = _mm_loadu_si128((const __m128i *)&(c2[i]));
+        __m128i g = _mm_sub_epi32(y, _mm_srai_epi32(_mm_add_epi32(u, v), 2));
+        __m128i r = _mm_add_epi32(v, g);
+        __m128i b = _mm_add_epi32(u, g);
+        _mm_storeu_si128((__m128i *)&(c0[i]), opj_mct_clamp_epi32(_mm_add_epi32(r, vshift0), vmin0, vmax0));
+        _mm_storeu_si128((__m128i *)&(c1[i]), opj_mct_clamp_epi32(_mm_add_epi32(g, vshift1), vmin1, vmax1));
+        _mm_storeu_si128((__m128i *)&(c2[i]), opj_mct_clamp_epi32(_mm_add_epi32(b, vshift2), vmin2, vmax2));
+    }
+#endif
+    for (; i < n; ++i) {
+        int32_t y = c0[i];
+        int32_t u = c1[i];
+        int32_t v = c2[i];
+        int32_t g = y - ((u + v) >> 2);
+        int32_t r = v + g;
+        int32_t b = u + g;
+        c0[i] = opj_int_clamp(r + shift[0], min[0], max[0]);
+        c1[i] = opj_int_clamp(g + shift[1], min[1], max[1]);
+        c2[i] = opj_int_clamp(b + shift[2], min[2], max[2]);
+    }
+}
+
+/* <summary> */
+/* Inverse irreversible MCT, followed by rounding and DC level shift. */
+/* </summary> */
+void opj_mct_decode_real_dc_shift(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint64_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    const __m128 vrv = _mm_set1_ps(1.402f);
+    const __m128 vgu = _mm_set1_ps(0.34413f);
+    const __m128 vgv = _mm_set1_ps(0.71414f);
+    const __m128 vbu = _mm_set1_ps(1.772f);
+    const __m128i vshift0 = _mm_set1_epi32(shift[0]);
+    const __m128i vshift1 = _mm_set1_epi32(shift[1]);
+    const __m128i vshift2 = _mm_set1_epi32(shift[2]);
+    const __m128i vmin0 = _mm_set1_epi32(min[0]);
+    const __m128i vmin1 = _mm_set1_epi32(min[1]);
+    const __m128i vmin2 = _mm_set1_epi32(min[2]);
+    const __m128i vmax0 = _mm_set1_epi32(max[0]);
+    const __m128i vmax1 = _mm_set1_epi32(max[1]);
+    const __m128i vmax2 = _mm_set1_epi32(max[2]);
+    /* float to integer conversion rounds to nearest even, as lrintf does */
+    for (; i < (n & ~(uint64_t)3); i += 4) {
+        __m128 vy = _mm_loadu_ps((const float*)&(c0[i]));
+        __m128 vu = _mm_loadu_ps((const float*)&(c1[i]));
+        __m128 vv = _mm_loadu_ps((const float*)&(c2[i]));
+        __m128 vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
+        __m128 vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
+        __m128 vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
+        _mm_storeu_si128((__m128i *)&(c0[i]),
+                         opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vr), vshift0), vmin0, vmax0));
+        _mm_storeu_si128((__m128i *)&(c1[i]),
+                         opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vg), vshift1), vmin1, vmax1));
+        _mm_storeu_si128((__m128i *)&(c2[i]),
+                         opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vb), vshift2), vmin2, vmax2));
+    }
+#endif
+    for (; i < n; ++i) {
+        float y = *((float*)&c0[i]);
+        float u = *((float*)&c1[i]);
+        float v = *((float*)&c2[i]);
+        float r = y + (v * 1.402f);
+        float g = y - (u * 0.34413f) - (v * (0.71414f));
+        float b = y + (u * 1.772f);
+        c0[i] = opj_int_clamp((int32_t)opj_lrintf(r) + shift[0], min[0], max[0]);
+        c1[i] = opj_int_clamp((int32_t)opj_lrintf(g) + shift[1], min[1], max[1]);
+        c2[i] = opj_int_clamp((int32_t)opj_lrintf(b) + shift[2], min[2], max[2]);
+    }
+}
+
 /* <summary> */
 /* Get norm of basis function of irreversible MCT. */
 /* </summary> */
@@ -112,6 +112,33 @@ Apply an irreversible multi-component inverse transform to an image
 */
 void opj_mct_decode_real(float* c0, float* c1, float* c2, uint64_t n);
 /**
+Apply a reversible multi-component inverse transform to an image, followed by the
+DC level shift of each component: c = clamp(c + shift, min, max)
+@param c0 Samples for luminance component
+@param c1 Samples for red chrominance component
+@param c2 Samples for blue chrominance component
+@param n Number of samples for each component
+@param shift DC level shift of each of the three components
+@param min Minimum sample value of each of the three components
+@param max Maximum sample value of each of the three components
+*/
+void opj_mct_decode_dc_shift(int32_t *c0, int32_t *c1, int32_t *c2, uint64_t n,
+                             const int32_t *shift, const int32_t *min, const int32_t *max);
+/**
+Apply an irreversible multi-component inverse transform to an image, followed by the
+DC level shift of each component: c = clamp(lrintf(c) + shift, min, max).
+The samples are floats on input, and are replaced by integers.
+@param c0 Samples for luminance component
+@param c1 Samples for red chrominance component
+@param c2 Samples for blue chrominance component
+@param n Number of samples for each component
+@param shift DC level shift of each of the three components
+@param min Minimum sample value of each of the three components
+@param max Maximum sample value of each of the three components
+*/
+void opj_mct_decode_real_dc_shift(int32_t *c0, int32_t *c1, int32_t *c2, uint64_t n,
+                                  const int32_t *shift, const int32_t *min, const int32_t *max);
+/**
 Get norm of the basis function used for the irreversible multi-component transform
 @param compno Number of the component (0->Y, 1->U, 2->V)
 @return
@@ -59,9 +59,9 @@ static size_t opj_zero_copy_read_from_buffer(void ** p_buffer,
         size_t p_nb_bytes,
         opj_buf_info_t* p_source_buffer)
 {
-    size_t l_nb_read = 0;
+    size_t l_nb_read = p_source_buffer->len - (size_t)p_source_buffer->off;
 
-    if (((size_t)p_source_buffer->off + p_nb_bytes) < p_source_buffer->len) {
+    if (p_nb_bytes < l_nb_read) {
         l_nb_read = p_nb_bytes;
     }
 
@@ -210,9 +210,10 @@ static uint64_t  opj_size_proc(opj_handle_t fd)
 }
 
 
-static void* opj_map(opj_handle_t fd, size_t len)
+static void* opj_map(opj_handle_t fd, size_t len, bool random_access)
 {
 	(void)len;
+	(void)random_access;
     void* ptr = NULL;
     HANDLE hMapFile = NULL;
 
@@ -295,7 +296,7 @@ static int32_t opj_close_fd(opj_handle_t fd)
 static uint64_t opj_size_proc(opj_handle_t fd)
 {
     struct stat sb;
-    if (!fd)
+    if (fd < 0)
         return 0;
 
     if (fstat(fd, &sb)<0)
@@ -304,18 +305,20 @@ static uint64_t opj_size_proc(opj_handle_t fd)
         return((uint64_t)sb.st_size);
 }
 
-static void* opj_map(opj_handle_t fd, size_t len)
+static void* opj_map(opj_handle_t fd, size_t len, bool random_access)
 {
-	(void)len;
     void* ptr = NULL;
-    uint64_t		size64 = 0;
 
-    if (!fd)
+    if (fd < 0 || !len)
         return NULL;
 
-    size64 = opj_size_proc(fd);
-    ptr = (void*)mmap(0, (size_t)size64, PROT_READ, MAP_SHARED, fd, 0);
-    return ptr == (void*)-1 ? NULL : ptr;
+    ptr = (void*)mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == (void*)-1)
+        return NULL;
+    /* a full decode walks the tile parts in order, and read-ahead pays off;
+    a tile or region decode skips most of them, so only fault in what is read */
+    madvise(ptr, len, random_access ? MADV_RANDOM : MADV_SEQUENTIAL);
+    return ptr;
 }
 
 static int32_t opj_unmap(void* ptr, size_t len)
@@ -349,7 +352,7 @@ static opj_handle_t opj_open_fd(const char* fname, const char* mode)
 
 static int32_t opj_close_fd(opj_handle_t fd)
 {
-    if (!fd)
+    if (fd < 0)
         return 0;
     return  (close(fd));
 }
@@ -371,7 +374,7 @@ static void opj_mem_map_free(void* user_data)
 /*
 Currently, only read streams are supported for memory mapped files.
 */
-opj_stream_t* opj_create_mapped_file_read_stream(const char *fname)
+opj_stream_t* opj_create_mapped_file_read_stream(const char *fname, bool random_access)
 {
     opj_stream_t*	l_stream = NULL;
     opj_buf_info_t* buffer_info = NULL;
@@ -383,6 +386,10 @@ opj_stream_t* opj_create_mapped_file_read_stream(const char *fname)
         return NULL;
 
     buffer_info = (opj_buf_info_t*)opj_malloc(sizeof(opj_buf_info_t));
+    if (!buffer_info) {
+        opj_close_fd(fd);
+        return NULL;
+    }
     memset(buffer_info, 0, sizeof(opj_buf_info_t));
     buffer_info->fd = fd;
     buffer_info->len = (size_t)opj_size_proc(fd);
@@ -393,7 +400,7 @@ opj_stream_t* opj_create_mapped_file_read_stream(const char *fname)
         return NULL;
     }
 
-    mapped_view = opj_map(fd, buffer_info->len);
+    mapped_view = opj_map(fd, buffer_info->len, random_access);
     if (!mapped_view) {
         opj_stream_destroy(l_stream);
         opj_mem_map_free(buffer_info);
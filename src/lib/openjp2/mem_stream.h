@@ -40,5 +40,5 @@ opj_stream_t*  opj_create_buffer_stream(uint8_t *buf,
                                         bool p_is_read_stream);
 size_t opj_get_buffer_stream_offset(opj_stream_t* stream);
 
-opj_stream_t* opj_create_mapped_file_read_stream(const char *fname);
+opj_stream_t* opj_create_mapped_file_read_stream(const char *fname, bool random_access);
 
@@ -97,28 +97,6 @@ Set the state of a particular context
 */
 static void opj_mqc_setstate(opj_mqc_t *mqc, uint32_t ctxno, uint32_t msb, int32_t prob);
 
-/**
-FIXME DOC
-@param mqc MQC handle
-@return
-*/
-static inline uint8_t opj_mqc_mpsexchange(opj_mqc_t *const mqc);
-/**
-FIXME DOC
-@param mqc MQC handle
-@return
-*/
-static inline uint8_t opj_mqc_lpsexchange(opj_mqc_t *const mqc);
-/**
-Input a byte
-@param mqc MQC handle
-*/
-static inline void opj_mqc_bytein(opj_mqc_t *const mqc);
-/**
-Renormalize mqc->A and mqc->C while decoding
-@param mqc MQC handle
-*/
-static inline void opj_mqc_renormd(opj_mqc_t *const mqc);
 /*@}*/
 
 /*@}*/
@@ -127,100 +105,100 @@ static inline void opj_mqc_renormd(opj_mqc_t *const mqc);
 /* This array defines all the possible states for a context. */
 /* </summary> */
 static opj_mqc_state_t mqc_states[47 * 2] = {
-    {0x5601, 0, &mqc_states[2], &mqc_states[3]},
-    {0x5601, 1, &mqc_states[3], &mqc_states[2]},
-    {0x3401, 0, &mqc_states[4], &mqc_states[12]},
-    {0x3401, 1, &mqc_states[5], &mqc_states[13]},
-    {0x1801, 0, &mqc_states[6], &mqc_states[18]},
-    {0x1801, 1, &mqc_states[7], &mqc_states[19]},
-    {0x0ac1, 0, &mqc_states[8], &mqc_states[24]},
-    {0x0ac1, 1, &mqc_states[9], &mqc_states[25]},
-    {0x0521, 0, &mqc_states[10], &mqc_states[58]},
-    {0x0521, 1, &mqc_states[11], &mqc_states[59]},
-    {0x0221, 0, &mqc_states[76], &mqc_states[66]},
-    {0x0221, 1, &mqc_states[77], &mqc_states[67]},
-    {0x5601, 0, &mqc_states[14], &mqc_states[13]},
-    {0x5601, 1, &mqc_states[15], &mqc_states[12]},
-    {0x5401, 0, &mqc_states[16], &mqc_states[28]},
-    {0x5401, 1, &mqc_states[17], &mqc_states[29]},
-    {0x4801, 0, &mqc_states[18], &mqc_states[28]},
-    {0x4801, 1, &mqc_states[19], &mqc_states[29]},
-    {0x3801, 0, &mqc_states[20], &mqc_states[28]},
-    {0x3801, 1, &mqc_states[21], &mqc_states[29]},
-    {0x3001, 0, &mqc_states[22], &mqc_states[34]},
-    {0x3001, 1, &mqc_states[23], &mqc_states[35]},
-    {0x2401, 0, &mqc_states[24], &mqc_states[36]},
-    {0x2401, 1, &mqc_states[25], &mqc_states[37]},
-    {0x1c01, 0, &mqc_states[26], &mqc_states[40]},
-    {0x1c01, 1, &mqc_states[27], &mqc_states[41]},
-    {0x1601, 0, &mqc_states[58], &mqc_states[42]},
-    {0x1601, 1, &mqc_states[59], &mqc_states[43]},
-    {0x5601, 0, &mqc_states[30], &mqc_states[29]},
-    {0x5601, 1, &mqc_states[31], &mqc_states[28]},
-    {0x5401, 0, &mqc_states[32], &mqc_states[28]},
-    {0x5401, 1, &mqc_states[33], &mqc_states[29]},
-    {0x5101, 0, &mqc_states[34], &mqc_states[30]},
-    {0x5101, 1, &mqc_states[35], &mqc_states[31]},
-    {0x4801, 0, &mqc_states[36], &mqc_states[32]},
-    {0x4801, 1, &mqc_states[37], &mqc_states[33]},
-    {0x3801, 0, &mqc_states[38], &mqc_states[34]},
-    {0x3801, 1, &mqc_states[39], &mqc_states[35]},
-    {0x3401, 0, &mqc_states[40], &mqc_states[36]},
-    {0x3401, 1, &mqc_states[41], &mqc_states[37]},
-    {0x3001, 0, &mqc_states[42], &mqc_states[38]},
-    {0x3001, 1, &mqc_states[43], &mqc_states[39]},
-    {0x2801, 0, &mqc_states[44], &mqc_states[38]},
-    {0x2801, 1, &mqc_states[45], &mqc_states[39]},
-    {0x2401, 0, &mqc_states[46], &mqc_states[40]},
-    {0x2401, 1, &mqc_states[47], &mqc_states[41]},
-    {0x2201, 0, &mqc_states[48], &mqc_states[42]},
-    {0x2201, 1, &mqc_states[49], &mqc_states[43]},
-    {0x1c01, 0, &mqc_states[50], &mqc_states[44]},
-    {0x1c01, 1, &mqc_states[51], &mqc_states[45]},
-    {0x1801, 0, &mqc_states[52], &mqc_states[46]},
-    {0x1801, 1, &mqc_states[53], &mqc_states[47]},
-    {0x1601, 0, &mqc_states[54], &mqc_states[48]},
-    {0x1601, 1, &mqc_states[55], &mqc_states[49]},
-    {0x1401, 0, &mqc_states[56], &mqc_states[50]},
-    {0x1401, 1, &mqc_states[57], &mqc_states[51]},
-    {0x1201, 0, &mqc_states[58], &mqc_states[52]},
-    {0x1201, 1, &mqc_states[59], &mqc_states[53]},
-    {0x1101, 0, &mqc_states[60], &mqc_states[54]},
-    {0x1101, 1, &mqc_states[61], &mqc_states[55]},
-    {0x0ac1, 0, &mqc_states[62], &mqc_states[56]},
-    {0x0ac1, 1, &mqc_states[63], &mqc_states[57]},
-    {0x09c1, 0, &mqc_states[64], &mqc_states[58]},
-    {0x09c1, 1, &mqc_states[65], &mqc_states[59]},
-    {0x08a1, 0, &mqc_states[66], &mqc_states[60]},
-    {0x08a1, 1, &mqc_states[67], &mqc_states[61]},
-    {0x0521, 0, &mqc_states[68], &mqc_states[62]},
-    {0x0521, 1, &mqc_states[69], &mqc_states[63]},
-    {0x0441, 0, &mqc_states[70], &mqc_states[64]},
-    {0x0441, 1, &mqc_states[71], &mqc_states[65]},
-    {0x02a1, 0, &mqc_states[72], &mqc_states[66]},
-    {0x02a1, 1, &mqc_states[73], &mqc_states[67]},
-    {0x0221, 0, &mqc_states[74], &mqc_states[68]},
-    {0x0221, 1, &mqc_states[75], &mqc_states[69]},
-    {0x0141, 0, &mqc_states[76], &mqc_states[70]},
-    {0x0141, 1, &mqc_states[77], &mqc_states[71]},
-    {0x0111, 0, &mqc_states[78], &mqc_states[72]},
-    {0x0111, 1, &mqc_states[79], &mqc_states[73]},
-    {0x0085, 0, &mqc_states[80], &mqc_states[74]},
-    {0x0085, 1, &mqc_states[81], &mqc_states[75]},
-    {0x0049, 0, &mqc_states[82], &mqc_states[76]},
-    {0x0049, 1, &mqc_states[83], &mqc_states[77]},
-    {0x0025, 0, &mqc_states[84], &mqc_states[78]},
-    {0x0025, 1, &mqc_states[85], &mqc_states[79]},
-    {0x0015, 0, &mqc_states[86], &mqc_states[80]},
-    {0x0015, 1, &mqc_states[87], &mqc_states[81]},
-    {0x0009, 0, &mqc_states[88], &mqc_states[82]},
-    {0x0009, 1, &mqc_states[89], &mqc_states[83]},
-    {0x0005, 0, &mqc_states[90], &mqc_states[84]},
-    {0x0005, 1, &mqc_states[91], &mqc_states[85]},
-    {0x0001, 0, &mqc_states[90], &mqc_states[86]},
-    {0x0001, 1, &mqc_states[91], &mqc_states[87]},
-    {0x5601, 0, &mqc_states[92], &mqc_states[92]},
-    {0x5601, 1, &mqc_states[93], &mqc_states[93]},
+    {0x5601, 0, {&mqc_states[2], &mqc_states[3]}},
+    {0x5601, 1, {&mqc_states[3], &mqc_states[2]}},
+    {0x3401, 0, {&mqc_states[4], &mqc_states[12]}},
+    {0x3401, 1, {&mqc_states[5], &mqc_states[13]}},
+    {0x1801, 0, {&mqc_states[6], &mqc_states[18]}},
+    {0x1801, 1, {&mqc_states[7], &mqc_states[19]}},
+    {0x0ac1, 0, {&mqc_states[8], &mqc_states[24]}},
+    {0x0ac1, 1, {&mqc_states[9], &mqc_states[25]}},
+    {0x0521, 0, {&mqc_states[10], &mqc_states[58]}},
+    {0x0521, 1, {&mqc_states[11], &mqc_states[59]}},
+    {0x0221, 0, {&mqc_states[76], &mqc_states[66]}},
+    {0x0221, 1, {&mqc_states[77], &mqc_states[67]}},
+    {0x5601, 0, {&mqc_states[14], &mqc_states[13]}},
+    {0x5601, 1, {&mqc_states[15], &mqc_states[12]}},
+    {0x5401, 0, {&mqc_states[16], &mqc_states[28]}},
+    {0x5401, 1, {&mqc_states[17], &mqc_states[29]}},
+    {0x4801, 0, {&mqc_states[18], &mqc_states[28]}},
+    {0x4801, 1, {&mqc_states[19], &mqc_states[29]}},
+    {0x3801, 0, {&mqc_states[20], &mqc_states[28]}},
+    {0x3801, 1, {&mqc_states[21], &mqc_states[29]}},
+    {0x3001, 0, {&mqc_states[22], &mqc_states[34]}},
+    {0x3001, 1, {&mqc_states[23], &mqc_states[35]}},
+    {0x2401, 0, {&mqc_states[24], &mqc_states[36]}},
+    {0x2401, 1, {&mqc_states[25], &mqc_states[37]}},
+    {0x1c01, 0, {&mqc_states[26], &mqc_states[40]}},
+    {0x1c01, 1, {&mqc_states[27], &mqc_states[41]}},
+    {0x1601, 0, {&mqc_states[58], &mqc_states[42]}},
+    {0x1601, 1, {&mqc_states[59], &mqc_states[43]}},
+    {0x5601, 0, {&mqc_states[30], &mqc_states[29]}},
+    {0x5601, 1, {&mqc_states[31], &mqc_states[28]}},
+    {0x5401, 0, {&mqc_states[32], &mqc_states[28]}},
+    {0x5401, 1, {&mqc_states[33], &mqc_states[29]}},
+    {0x5101, 0, {&mqc_states[34], &mqc_states[30]}},
+    {0x5101, 1, {&mqc_states[35], &mqc_states[31]}},
+    {0x4801, 0, {&mqc_states[36], &mqc_states[32]}},
+    {0x4801, 1, {&mqc_states[37], &mqc_states[33]}},
+    {0x3801, 0, {&mqc_states[38], &mqc_states[34]}},
+    {0x3801, 1, {&mqc_states[39], &mqc_states[35]}},
+    {0x3401, 0, {&mqc_states[40], &mqc_states[36]}},
+    {0x3401, 1, {&mqc_states[41], &mqc_states[37]}},
+    {0x3001, 0, {&mqc_states[42], &mqc_states[38]}},
+    {0x3001, 1, {&mqc_states[43], &mqc_states[39]}},
+    {0x2801, 0, {&mqc_states[44], &mqc_states[38]}},
+    {0x2801, 1, {&mqc_states[45], &mqc_states[39]}},
+    {0x2401, 0, {&mqc_states[46], &mqc_states[40]}},
+    {0x2401, 1, {&mqc_states[47], &mqc_states[41]}},
+    {0x2201, 0, {&mqc_states[48], &mqc_states[42]}},
+    {0x2201, 1, {&mqc_states[49], &mqc_states[43]}},
+    {0x1c01, 0, {&mqc_states[50], &mqc_states[44]}},
+    {0x1c01, 1, {&mqc_states[51], &mqc_states[45]}},
+    {0x1801, 0, {&mqc_states[52], &mqc_states[46]}},
+    {0x1801, 1, {&mqc_states[53], &mqc_states[47]}},
+    {0x1601, 0, {&mqc_states[54], &mqc_states[48]}},
+    {0x1601, 1, {&mqc_states[55], &mqc_states[49]}},
+    {0x1401, 0, {&mqc_states[56], &mqc_states[50]}},
+    {0x1401, 1, {&mqc_states[57], &mqc_states[51]}},
+    {0x1201, 0, {&mqc_states[58], &mqc_states[52]}},
+    {0x1201, 1, {&mqc_states[59], &mqc_states[53]}},
+    {0x1101, 0, {&mqc_states[60], &mqc_states[54]}},
+    {0x1101, 1, {&mqc_states[61], &mqc_states[55]}},
+    {0x0ac1, 0, {&mqc_states[62], &mqc_states[56]}},
+    {0x0ac1, 1, {&mqc_states[63], &mqc_states[57]}},
+    {0x09c1, 0, {&mqc_states[64], &mqc_states[58]}},
+    {0x09c1, 1, {&mqc_states[65], &mqc_states[59]}},
+    {0x08a1, 0, {&mqc_states[66], &mqc_states[60]}},
+    {0x08a1, 1, {&mqc_states[67], &mqc_states[61]}},
+    {0x0521, 0, {&mqc_states[68], &mqc_states[62]}},
+    {0x0521, 1, {&mqc_states[69], &mqc_states[63]}},
+    {0x0441, 0, {&mqc_states[70], &mqc_states[64]}},
+    {0x0441, 1, {&mqc_states[71], &mqc_states[65]}},
+    {0x02a1, 0, {&mqc_states[72], &mqc_states[66]}},
+    {0x02a1, 1, {&mqc_states[73], &mqc_states[67]}},
+    {0x0221, 0, {&mqc_states[74], &mqc_states[68]}},
+    {0x0221, 1, {&mqc_states[75], &mqc_states[69]}},
+    {0x0141, 0, {&mqc_states[76], &mqc_states[70]}},
+    {0x0141, 1, {&mqc_states[77], &mqc_states[71]}},
+    {0x0111, 0, {&mqc_states[78], &mqc_states[72]}},
+    {0x0111, 1, {&mqc_states[79], &mqc_states[73]}},
+    {0x0085, 0, {&mqc_states[80], &mqc_states[74]}},
+    {0x0085, 1, {&mqc_states[81], &mqc_states[75]}},
+    {0x0049, 0, {&mqc_states[82], &mqc_states[76]}},
+    {0x0049, 1, {&mqc_states[83], &mqc_states[77]}},
+    {0x0025, 0, {&mqc_states[84], &mqc_states[78]}},
+    {0x0025, 1, {&mqc_states[85], &mqc_states[79]}},
+    {0x0015, 0, {&mqc_states[86], &mqc_states[80]}},
+    {0x0015, 1, {&mqc_states[87], &mqc_states[81]}},
+    {0x0009, 0, {&mqc_states[88], &mqc_states[82]}},
+    {0x0009, 1, {&mqc_states[89], &mqc_states[83]}},
+    {0x0005, 0, {&mqc_states[90], &mqc_states[84]}},
+    {0x0005, 1, {&mqc_states[91], &mqc_states[85]}},
+    {0x0001, 0, {&mqc_states[90], &mqc_states[86]}},
+    {0x0001, 1, {&mqc_states[91], &mqc_states[87]}},
+    {0x5601, 0, {&mqc_states[92], &mqc_states[92]}},
+    {0x5601, 1, {&mqc_states[93], &mqc_states[93]}},
 };
 
 /*
@@ -286,7 +264,7 @@ static void opj_mqc_codemps(opj_mqc_t *mqc)
         } else {
             mqc->C += (*mqc->curctx)->qeval;
         }
-        *mqc->curctx = (*mqc->curctx)->nmps;
+        *mqc->curctx = (*mqc->curctx)->next[0];
         opj_mqc_renorme(mqc);
     } else {
         mqc->C += (*mqc->curctx)->qeval;
@@ -301,7 +279,7 @@ static void opj_mqc_codelps(opj_mqc_t *mqc)
     } else {
         mqc->A = (*mqc->curctx)->qeval;
     }
-    *mqc->curctx = (*mqc->curctx)->nlps;
+    *mqc->curctx = (*mqc->curctx)->next[1];
     opj_mqc_renorme(mqc);
 }
 
@@ -314,77 +292,6 @@ static void opj_mqc_setbits(opj_mqc_t *mqc)
     }
 }
 
-static inline uint8_t opj_mqc_mpsexchange(opj_mqc_t *const mqc)
-{
-	uint8_t d;
-    if (mqc->A < (*mqc->curctx)->qeval) {
-        d = (uint8_t)(1 - (*mqc->curctx)->mps);
-        *mqc->curctx = (*mqc->curctx)->nlps;
-    } else {
-        d = (*mqc->curctx)->mps;
-        *mqc->curctx = (*mqc->curctx)->nmps;
-    }
-    return d;
-}
-
-static inline uint8_t opj_mqc_lpsexchange(opj_mqc_t *const mqc)
-{
-	uint8_t d;
-    if (mqc->A < (*mqc->curctx)->qeval) {
-        mqc->A = (*mqc->curctx)->qeval;
-        d = (*mqc->curctx)->mps;
-        *mqc->curctx = (*mqc->curctx)->nmps;
-    } else {
-        mqc->A = (*mqc->curctx)->qeval;
-        d = (uint8_t)(1 - (*mqc->curctx)->mps);
-        *mqc->curctx = (*mqc->curctx)->nlps;
-    }
-    return d;
-}
-
-static void opj_mqc_bytein(opj_mqc_t *const mqc)
-{
-    if (mqc->bp < mqc->end) {
-        uint8_t nextByte = (mqc->bp + 1 < mqc->end) ? *(mqc->bp + 1) : 0xFF;
-        if (mqc->currentByteIs0xFF) {
-            if (nextByte > 0x8F) {
-				// found termination marker - synthesize 1's in C register and do not increment bp
-                mqc->C += 0xFF00;
-                mqc->COUNT = 8;
-            } 
-			else {
-				// bit stuff next byte and add to C register
-                mqc->bp++;
-                mqc->C += nextByte << 9;
-                mqc->COUNT = 7;
-            }
-        } else {
-			// add next byte to C register
-            mqc->bp++;
-            mqc->C += nextByte << 8;
-            mqc->COUNT = 8;
-        }
-		mqc->currentByteIs0xFF = nextByte == 0xFF;
-    } else {
-		// end of code stream has been reached - synthesize 1's in C register and do not increment bp
-        mqc->C += 0xFF00;
-        mqc->COUNT = 8;
-    }
-}
-
-
-static inline void opj_mqc_renormd(opj_mqc_t *const mqc)
-{
-    do {
-        if (mqc->COUNT == 0) {
-            opj_mqc_bytein(mqc);
-        }
-        mqc->A <<= 1;
-        mqc->C <<= 1;
-        mqc->COUNT--;
-    } while (mqc->A < 0x8000);
-}
-
 /*
 ==========================================================
    MQ-Coder interface
@@ -566,16 +473,79 @@ void opj_mqc_segmark_enc(opj_mqc_t *mqc)
     }
 }
 
-void opj_mqc_init_dec(opj_mqc_t *mqc, uint8_t *bp, uint32_t len)
+/**
+Point the decoder at offset in its segment: in place when the piece holding offset
+has more than MQC_GUARD_BYTES bytes left, otherwise at a copy, in the window, of the
+next 2 * MQC_GUARD_BYTES bytes of the segment, which may straddle several pieces
+*/
+static void opj_mqc_dec_set_position(opj_mqc_t *mqc, uint32_t offset)
+{
+    uint32_t in_piece;
+    while (mqc->piece_index < mqc->num_pieces &&
+            mqc->piece_offset + mqc->pieces[mqc->piece_index].len <= offset) {
+        mqc->piece_offset += mqc->pieces[mqc->piece_index].len;
+        mqc->piece_index++;
+    }
+    if (mqc->piece_index < mqc->num_pieces) {
+        const opj_min_buf_t *piece = mqc->pieces + mqc->piece_index;
+        in_piece = offset - mqc->piece_offset;
+        if (piece->len - in_piece > MQC_GUARD_BYTES) {
+            mqc->region = piece->buf;
+            mqc->region_offset = mqc->piece_offset;
+            mqc->guard = piece->buf + piece->len - MQC_GUARD_BYTES;
+            mqc->bp = (uint8_t*)piece->buf + in_piece;
+            return;
+        }
+    }
+
+    uint32_t len = opj_min<uint32_t>(mqc->seg_len - offset, 2 * MQC_GUARD_BYTES);
+    uint32_t copied = 0;
+    uint32_t index = mqc->piece_index;
+    in_piece = offset - mqc->piece_offset;
+    while (copied < len) {
+        const opj_min_buf_t *piece = mqc->pieces + index++;
+        uint32_t n = opj_min<uint32_t>(piece->len - in_piece, len - copied);
+        memcpy(mqc->window + copied, piece->buf + in_piece, n);
+        copied += n;
+        in_piece = 0;
+    }
+    if (offset + len == mqc->seg_len) {
+        /* termination marker: bp never moves past its first byte */
+        memset(mqc->window + len, 0xFF, MQC_NUM_SENTINEL_BYTES);
+        mqc->guard = mqc->window + len + MQC_NUM_SENTINEL_BYTES;
+    } else {
+        mqc->guard = mqc->window + len - MQC_GUARD_BYTES;
+    }
+    mqc->region = mqc->window;
+    mqc->region_offset = offset;
+    mqc->bp = mqc->window;
+}
+
+void opj_mqc_dec_next_window(opj_mqc_dec_t *dec)
+{
+    opj_mqc_t *mqc = dec->mqc;
+    opj_mqc_dec_set_position(mqc, mqc->region_offset + (uint32_t)(dec->bp - mqc->region));
+    dec->bp = mqc->bp;
+    dec->guard = mqc->guard;
+}
+
+void opj_mqc_init_dec(opj_mqc_t *mqc, const opj_min_buf_t *pieces, uint32_t num_pieces)
 {
     opj_mqc_setcurctx(mqc, 0);
-    mqc->start = bp;
-    mqc->end = bp + len;
-    mqc->bp = bp;
-	uint8_t currentByte = (len > 0) ? *mqc->bp : 0xFF;
-	mqc->currentByteIs0xFF = currentByte == 0xFF;
-	mqc->C = (uint32_t)(currentByte << 16);
-    opj_mqc_bytein(mqc);
+    mqc->pieces = pieces;
+    mqc->num_pieces = num_pieces;
+    mqc->seg_len = 0;
+    for (uint32_t i = 0; i < num_pieces; ++i)
+        mqc->seg_len += pieces[i].len;
+    mqc->piece_index = 0;
+    mqc->piece_offset = 0;
+    opj_mqc_dec_set_position(mqc, 0);
+    mqc->C = (uint32_t)(*mqc->bp << 16);
+
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_load(&dec, mqc);
+    opj_mqc_dec_bytein(&dec);
+    opj_mqc_dec_store(&dec, mqc);
     mqc->C <<= 7;
     mqc->COUNT -= 7;
     mqc->A = 0x8000;
@@ -583,21 +553,11 @@ void opj_mqc_init_dec(opj_mqc_t *mqc, uint8_t *bp, uint32_t len)
 
 uint8_t opj_mqc_decode(opj_mqc_t *const mqc)
 {
-	uint8_t d;
-    mqc->A -= (*mqc->curctx)->qeval;
-    if ((mqc->C >> 16) < (*mqc->curctx)->qeval) {
-        d = opj_mqc_lpsexchange(mqc);
-        opj_mqc_renormd(mqc);
-    } else {
-        mqc->C -= (*mqc->curctx)->qeval << 16;
-        if ((mqc->A & 0x8000) == 0) {
-            d = opj_mqc_mpsexchange(mqc);
-            opj_mqc_renormd(mqc);
-        } else {
-            d = (*mqc->curctx)->mps;
-        }
-    }
-
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_load(&dec, mqc);
+    opj_mqc_dec_check_window(&dec);
+    uint8_t d = (uint8_t)opj_mqc_dec_decode(&dec);
+    opj_mqc_dec_store(&dec, mqc);
     return d;
 }
 
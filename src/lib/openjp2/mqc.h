@@ -76,14 +76,23 @@ typedef struct opj_mqc_state {
     uint32_t qeval;
     /** the Most Probable Symbol (0 or 1) */
     uint32_t mps;
-    /** next state if the next encoded symbol is the MPS */
-    struct opj_mqc_state *nmps;
-    /** next state if the next encoded symbol is the LPS */
-    struct opj_mqc_state *nlps;
+    /** next state if the next symbol is the MPS (index 0) or the LPS (index 1),
+        so that the decoder can select it without branching */
+    struct opj_mqc_state *next[2];
 } opj_mqc_state_t;
 
 #define MQC_NUMCTXS 19
 
+/** Number of 0xFF bytes that follow the end of a segment in the decoder window */
+#define MQC_NUM_SENTINEL_BYTES 2
+
+/**
+Bytes the decoder may read past its position between two calls to opj_mqc_dec_check_window.
+A stripe column decodes at most 10 symbols, followed by the 4 segmentation symbols at the end
+of a cleanup pass; each symbol inputs at most 3 bytes, and one more byte is looked ahead.
+*/
+#define MQC_GUARD_BYTES 64
+
 /**
 MQ coder
 */
@@ -93,12 +102,27 @@ typedef struct opj_mqc {
     uint32_t A;
     uint32_t COUNT;
     uint8_t *bp;
-	bool currentByteIs0xFF;
     uint8_t *start;
     uint8_t *end;
     opj_mqc_state_t *ctxs[MQC_NUMCTXS];
     opj_mqc_state_t **curctx;
 
+    /** pieces of the segment being decoded */
+    const opj_min_buf_t *pieces;
+    uint32_t num_pieces;
+    /** length of the segment being decoded */
+    uint32_t seg_len;
+    /** first piece that does not end before the current position, and its offset in the segment */
+    uint32_t piece_index;
+    uint32_t piece_offset;
+    /** bytes bp points into: a piece, or the window; and their offset in the segment */
+    const uint8_t *region;
+    uint32_t region_offset;
+    /** the decoder must be moved to a new region once bp reaches guard */
+    const uint8_t *guard;
+    /** copy of the bytes around a piece boundary, or of the end of the segment followed by 0xFF 0xFF */
+    uint8_t window[2 * MQC_GUARD_BYTES + MQC_NUM_SENTINEL_BYTES];
+
 	plugin_debug_mqc_t debug_mqc;
 
 } opj_mqc_t;
@@ -195,12 +219,16 @@ SEGMARK mode switch (SEGSYM)
 */
 void opj_mqc_segmark_enc(opj_mqc_t *mqc);
 /**
-Initialize the decoder
+Initialize the decoder.
+The segment is read in place, as a sequence of pieces that need not be
+contiguous in memory: the bytes are never modified. Only the bytes within
+MQC_GUARD_BYTES of a piece boundary or of the end of the segment are copied,
+into the decoder window.
 @param mqc MQC handle
-@param bp Pointer to the start of the buffer from which the bytes will be read
-@param len Length of the input buffer
+@param pieces Pieces of the segment, in stream order
+@param num_pieces Number of pieces
 */
-void opj_mqc_init_dec(opj_mqc_t *mqc, uint8_t *bp, uint32_t len);
+void opj_mqc_init_dec(opj_mqc_t *mqc, const opj_min_buf_t *pieces, uint32_t num_pieces);
 /**
 Decode a symbol
 @param mqc MQC handle
@@ -210,6 +238,132 @@ uint8_t opj_mqc_decode(opj_mqc_t * const mqc);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
+/** @name Decoder registers */
+/*@{*/
+/**
+Working registers of the MQ decoder.
+A T1 decoding pass loads them into a local variable, decodes all of its
+symbols through that local and stores them back at the end of the pass,
+so that the compiler can keep A, C, COUNT and the byte pointer in
+registers for the whole pass.
+*/
+typedef struct opj_mqc_dec {
+    uint32_t C;
+    uint32_t A;
+    uint32_t COUNT;
+    const uint8_t *bp;
+    const uint8_t *guard;
+    opj_mqc_state_t **ctxs;
+    opj_mqc_state_t **curctx;
+    opj_mqc_t *mqc;
+} opj_mqc_dec_t;
+
+static inline void opj_mqc_dec_load(opj_mqc_dec_t *dec, opj_mqc_t *mqc)
+{
+    dec->C = mqc->C;
+    dec->A = mqc->A;
+    dec->COUNT = mqc->COUNT;
+    dec->bp = mqc->bp;
+    dec->guard = mqc->guard;
+    dec->ctxs = mqc->ctxs;
+    dec->curctx = mqc->curctx;
+    dec->mqc = mqc;
+}
+
+static inline void opj_mqc_dec_store(const opj_mqc_dec_t *dec, opj_mqc_t *mqc)
+{
+    mqc->C = dec->C;
+    mqc->A = dec->A;
+    mqc->COUNT = dec->COUNT;
+    mqc->bp = (uint8_t*)dec->bp;
+    mqc->guard = dec->guard;
+    mqc->curctx = dec->curctx;
+}
+
+static inline void opj_mqc_dec_setcurctx(opj_mqc_dec_t *dec, uint8_t ctxno)
+{
+    dec->curctx = dec->ctxs + ctxno;
+}
+
+/**
+Move the decoder to the region holding its current position: in place in a piece,
+or in the window when the position is within MQC_GUARD_BYTES of the end of its piece
+*/
+void opj_mqc_dec_next_window(opj_mqc_dec_t *dec);
+
+/**
+Called once per stripe column by the decoding passes, so that byte input
+never needs to check for the end of a piece
+*/
+static inline void opj_mqc_dec_check_window(opj_mqc_dec_t *dec)
+{
+    if (dec->bp >= dec->guard)
+        opj_mqc_dec_next_window(dec);
+}
+
+/**
+Input a byte. The region bp points into holds at least MQC_GUARD_BYTES more bytes
+since the last call to opj_mqc_dec_check_window, and the end of the segment is
+followed by a 0xFF 0xFF termination marker, so no bounds check is needed.
+*/
+static inline void opj_mqc_dec_bytein(opj_mqc_dec_t *dec)
+{
+    if (dec->bp[0] == 0xFF) {
+        if (dec->bp[1] > 0x8F) {
+            /* termination marker: synthesize 1's in C and do not advance */
+            dec->C += 0xFF00;
+            dec->COUNT = 8;
+        } else {
+            /* bit stuffing */
+            dec->bp++;
+            dec->C += (uint32_t)dec->bp[0] << 9;
+            dec->COUNT = 7;
+        }
+    } else {
+        dec->bp++;
+        dec->C += (uint32_t)dec->bp[0] << 8;
+        dec->COUNT = 8;
+    }
+}
+
+static inline void opj_mqc_dec_renorm(opj_mqc_dec_t *dec)
+{
+    do {
+        if (dec->COUNT == 0)
+            opj_mqc_dec_bytein(dec);
+        dec->A <<= 1;
+        dec->C <<= 1;
+        dec->COUNT--;
+    } while (dec->A < 0x8000);
+}
+
+/**
+Decode a symbol with the current context
+@return Returns the decoded symbol (0 or 1)
+*/
+static inline uint32_t opj_mqc_dec_decode(opj_mqc_dec_t *dec)
+{
+    opj_mqc_state_t *state = *dec->curctx;
+    uint32_t qeval = state->qeval;
+    uint32_t lps;
+    dec->A -= qeval;
+    if ((dec->C >> 16) < qeval) {
+        /* LPS sub-interval, with conditional exchange */
+        lps = dec->A >= qeval;
+        dec->A = qeval;
+    } else {
+        dec->C -= qeval << 16;
+        if (dec->A & 0x8000)
+            return state->mps;
+        /* MPS sub-interval, with conditional exchange */
+        lps = dec->A < qeval;
+    }
+    *dec->curctx = state->next[lps];
+    opj_mqc_dec_renorm(dec);
+    return state->mps ^ lps;
+}
+/*@}*/
+
 /*@}*/
 
 
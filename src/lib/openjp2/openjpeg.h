@@ -499,7 +499,8 @@ typedef struct opj_cparameters {
 	bool  write_display_resolution;
 	double display_resolution[2];
 
-	uint32_t rateControlAlgorithm; // 0: bisect with all truncation points,  1: bisect with only feasible truncation points
+	uint32_t rateControlAlgorithm; // 0: bisect with all truncation points,  1: bisect with only feasible truncation points, 2: slope table of feasible truncation points
+	bool earlyTermination;	// skip T1 coding passes that fall below the estimated rate threshold of the final layer (compression ratios only)
 
 	uint32_t numThreads;
 	int32_t deviceId;
@@ -729,6 +730,8 @@ typedef struct opj_decompress_params {
 	uint32_t duration; //seconds
 	uint32_t kernelBuildOptions;
 	uint32_t repeats;
+	/* read the input through buffered file I/O instead of memory mapping it */
+	bool file_stream;
 
 } opj_decompress_parameters;
 
@@ -1194,9 +1197,10 @@ typedef struct opj_codestream_index {
 /* Get the version of the Grok library*/
 OPJ_API const char * OPJ_CALLCONV opj_version(void);
 
-/* Initialize Grok library */
+/* Initialize Grok library: load plugin and start the worker threads shared by all codecs */
 OPJ_API bool OPJ_CALLCONV opj_initialize(const char* plugin_path);
 
+/* Release Grok library resources. No codec may be encoding or decoding when this is called */
 OPJ_API void OPJ_CALLCONV opj_cleanup();
 
 /*
@@ -1340,8 +1344,23 @@ OPJ_API opj_stream_t* OPJ_CALLCONV opj_stream_create_buffer_stream(uint8_t *buf,
 
 OPJ_API size_t OPJ_CALLCONV opj_stream_get_write_buffer_stream_length(opj_stream_t*);
 
+/**
+ * Create a read stream from a memory mapped file. Tile data is decoded in place,
+ * straight from the mapping, without being copied.
+ * The file is expected to be read from start to end.
+ * The stream must not be destroyed before decoding has finished.
+ * @param fname             the filename of the file to map
+*/
 OPJ_API opj_stream_t* OPJ_CALLCONV opj_stream_create_mapped_file_read_stream(const char *fname);
 
+/**
+ * Same as opj_stream_create_mapped_file_read_stream, with a hint on how the file will be accessed.
+ * @param fname             the filename of the file to map
+ * @param p_random_access   true if only part of the file will be read, as for a tile
+ *                          or region decode, false if it will be read from start to end
+*/
+OPJ_API opj_stream_t* OPJ_CALLCONV opj_stream_create_mapped_file_read_stream_ex(const char *fname, bool p_random_access);
+
 /*
 ==========================================================
    event manager functions definitions
@@ -1560,6 +1579,46 @@ OPJ_API bool OPJ_CALLCONV opj_decode_ex(   opj_codec_t *p_decompressor,
                                         opj_stream_t *p_stream,
                                         opj_image_t *p_image);
 
+/**
+ * Strip callback, called by opj_decode_strips with each strip of decoded rows,
+ * and by opj_encode_strips with each strip of source rows to fill.
+ *
+ * The strip image has the header of the image, but each of its components
+ * only holds the strip's rows: comps[i].h rows of comps[i].w samples, in the
+ * same layout as the data of a whole image: one int32_t per sample, across the
+ * full width of the image, whatever the component's precision (comps[i].prec)
+ * is. Packing samples to 8 or 16 bits is left to the writer. Strips are handed
+ * over top to bottom, and the strip image, which the callback may modify, is
+ * destroyed once the library is done with it.
+ *
+ * @param strip			the strip image
+ * @param strip_index	index of the strip, counted from the top of the image
+ * @param user_data		user data passed to opj_decode_strips or opj_encode_strips
+ * @return				false to stop decoding or encoding
+ */
+typedef bool(*opj_strip_callback_fn)(opj_image_t* strip, uint32_t strip_index, void* user_data);
+
+/**
+ * Decode an image from a JPEG-2000 codestream one strip at a time.
+ *
+ * Each row of tiles of the decoded area is handed to the callback as soon as all
+ * of its tiles are decoded, so that only the strips in flight are held in memory:
+ * the component data of p_image is not allocated. Each strip takes four bytes
+ * per sample of the tile row, see opj_strip_callback_fn.
+ *
+ * @param p_decompressor 	decompressor handle
+ * @param p_stream			Input buffer stream
+ * @param p_image 			the decoded image header
+ * @param callback			strip callback
+ * @param user_data			user data passed to the callback
+ * @return 					true if success, otherwise false
+ * */
+OPJ_API bool OPJ_CALLCONV opj_decode_strips(opj_codec_t *p_decompressor,
+											opj_stream_t *p_stream,
+											opj_image_t *p_image,
+											opj_strip_callback_fn callback,
+											void* user_data);
+
 /**
  * Get the decoded tile from the codec
  *
@@ -1735,6 +1794,25 @@ OPJ_API bool OPJ_CALLCONV opj_encode_with_plugin(opj_codec_t *p_codec,
 	opj_plugin_tile_t* tile,
 	opj_stream_t *p_stream);
 
+/**
+ * Encode an image into a JPEG-2000 codestream, reading the source one strip at a time.
+ *
+ * Each row of tiles is read with the callback, which fills the strip's component data,
+ * just before its first tile is encoded, and is freed once its tiles are written, so that
+ * only the rows of tiles in flight are held in memory. The image passed to opj_setup_encoder
+ * and opj_start_compress then only needs its header: its component data is not used.
+ *
+ * @param p_codec 		compressor handle
+ * @param p_stream 		Output buffer stream
+ * @param callback		strip callback, which fills each strip with the source rows
+ * @param user_data		user data passed to the callback
+ * @return 				Returns true if successful, returns false otherwise
+ */
+OPJ_API bool OPJ_CALLCONV opj_encode_strips(opj_codec_t *p_codec,
+											opj_stream_t *p_stream,
+											opj_strip_callback_fn callback,
+											void* user_data);
+
 
 /*
 ==========================================================
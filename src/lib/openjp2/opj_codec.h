@@ -131,6 +131,11 @@ typedef struct opj_codec_private {
             bool (*opj_set_decoded_resolution_factor) ( void * p_codec,
                     uint32_t res_factor,
                     opj_event_mgr_t * p_manager);
+
+            /** Set the strip callback used by the next decode */
+            void (*opj_set_strip_callback) ( void * p_codec,
+                                             opj_strip_callback_fn callback,
+                                             void * user_data);
         } m_decompression;
 
         /**
@@ -164,6 +169,11 @@ typedef struct opj_codec_private {
                                          opj_cparameters_t * p_param,
                                          struct opj_image * p_image,
                                          opj_event_mgr_t * p_manager);
+
+            /** Set the strip callback used by the next encode */
+            void (*opj_set_strip_callback) ( void * p_codec,
+                                             opj_strip_callback_fn callback,
+                                             void * user_data);
         } m_compression;
     } m_codec_data;
     /** FIXME DOC*/
@@ -49,6 +49,7 @@
  */
 #define OPJ_SKIP_POISON
 #include "opj_includes.h"
+#include <mutex>
 
 #if defined(OPJ_HAVE_MALLOC_H) && defined(OPJ_HAVE_MEMALIGN)
 # include <malloc.h>
@@ -254,3 +255,130 @@ void opj_free(void *ptr)
 	if (ptr)
 		free(ptr);
 }
+
+/* ----------------------------------------------------------------------- */
+
+/* size of the chunks carved by arena allocations; larger requests get a chunk of their own */
+#define OPJ_ARENA_CHUNK_SIZE (64U * 1024U)
+/* maximum number of destroyed arenas kept for reuse */
+#define OPJ_ARENA_POOL_SIZE 16U
+/* chunk headers are padded so that allocations stay 16 byte aligned */
+#define OPJ_ARENA_ALIGN 16U
+#define OPJ_ARENA_HEADER_SIZE ((sizeof(opj_arena_chunk_t) + OPJ_ARENA_ALIGN - 1) & ~(size_t)(OPJ_ARENA_ALIGN - 1))
+
+struct opj_arena_chunk_t {
+    opj_arena_chunk_t* next;
+    size_t size;	/* usable bytes, following the header */
+};
+
+struct opj_arena_t {
+    opj_arena_chunk_t* chunks;		/* chunks in use, current one first */
+    opj_arena_chunk_t* free_chunks;	/* chunks released by the last reset */
+    uint8_t* ptr;					/* next free byte of the current chunk */
+    uint8_t* end;					/* end of the current chunk */
+};
+
+static void opj_arena_free_chunks(opj_arena_chunk_t* chunk)
+{
+    while (chunk) {
+        opj_arena_chunk_t* next = chunk->next;
+        opj_aligned_free(chunk);
+        chunk = next;
+    }
+}
+
+/* arenas kept for reuse; they are also released at exit, for applications that never call opj_cleanup */
+struct opj_arena_pool_t {
+    ~opj_arena_pool_t() {
+        clear();
+    }
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto arena : arenas) {
+            opj_arena_free_chunks(arena->free_chunks);
+            opj_free(arena);
+        }
+        arenas.clear();
+    }
+    std::mutex mutex;
+    std::vector<opj_arena_t*> arenas;
+};
+static opj_arena_pool_t opj_arena_pool;
+
+opj_arena_t* opj_arena_create(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(opj_arena_pool.mutex);
+        if (!opj_arena_pool.arenas.empty()) {
+            opj_arena_t* arena = opj_arena_pool.arenas.back();
+            opj_arena_pool.arenas.pop_back();
+            return arena;
+        }
+    }
+    return (opj_arena_t*)opj_calloc(1, sizeof(opj_arena_t));
+}
+
+void * opj_arena_alloc(opj_arena_t* arena, size_t size)
+{
+    if (!arena || size == 0U || size > SIZE_MAX - OPJ_ARENA_CHUNK_SIZE)
+        return NULL;
+    size = (size + OPJ_ARENA_ALIGN - 1) & ~(size_t)(OPJ_ARENA_ALIGN - 1);
+    if ((size_t)(arena->end - arena->ptr) < size) {
+        /* take the first released chunk that is large enough, or allocate a new one */
+        opj_arena_chunk_t** link = &arena->free_chunks;
+        while (*link && (*link)->size < size)
+            link = &(*link)->next;
+        opj_arena_chunk_t* chunk = *link;
+        if (chunk) {
+            *link = chunk->next;
+        } else {
+            size_t chunk_size = opj_max<size_t>(size, OPJ_ARENA_CHUNK_SIZE);
+            chunk = (opj_arena_chunk_t*)opj_aligned_malloc(OPJ_ARENA_HEADER_SIZE + chunk_size);
+            if (!chunk)
+                return NULL;
+            chunk->size = chunk_size;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->ptr = (uint8_t*)chunk + OPJ_ARENA_HEADER_SIZE;
+        arena->end = arena->ptr + chunk->size;
+    }
+    void* rc = arena->ptr;
+    arena->ptr += size;
+    return rc;
+}
+
+void opj_arena_reset(opj_arena_t* arena)
+{
+    if (!arena)
+        return;
+    while (arena->chunks) {
+        opj_arena_chunk_t* chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        chunk->next = arena->free_chunks;
+        arena->free_chunks = chunk;
+    }
+    arena->ptr = NULL;
+    arena->end = NULL;
+}
+
+void opj_arena_destroy(opj_arena_t* arena)
+{
+    if (!arena)
+        return;
+    opj_arena_reset(arena);
+    {
+        std::lock_guard<std::mutex> lock(opj_arena_pool.mutex);
+        if (opj_arena_pool.arenas.size() < OPJ_ARENA_POOL_SIZE) {
+            opj_arena_pool.arenas.push_back(arena);
+            return;
+        }
+    }
+    opj_arena_free_chunks(arena->free_chunks);
+    opj_free(arena);
+}
+
+void opj_arena_pool_cleanup(void)
+{
+    opj_arena_pool.clear();
+}
@@ -103,6 +103,49 @@ Deallocates or frees a memory block.
 */
 void opj_free(void * m);
 
+/**
+Bump allocator for the many small, short-lived allocations made while
+coding a tile. Allocations are carved from large chunks and are never
+freed one by one: the whole arena is reset once the tile is done, keeping
+its chunks for the next tile.
+
+Destroyed arenas are kept in a session pool, so that the next codec can
+reuse their chunks, until opj_arena_pool_cleanup is called.
+Arenas are not thread safe.
+*/
+struct opj_arena_t;
+
+/**
+Create an arena, reusing a pooled one if available
+@return Returns the arena, or NULL if there is insufficient memory available
+*/
+opj_arena_t* opj_arena_create(void);
+
+/**
+Allocate an uninitialized memory block from an arena, aligned to a 16 byte boundary
+@param arena Arena
+@param size Bytes to allocate
+@return Returns a pointer to the allocated space, or NULL if there is insufficient memory available
+*/
+void * opj_arena_alloc(opj_arena_t* arena, size_t size);
+
+/**
+Release all allocations of an arena at once, keeping its memory for reuse
+@param arena Arena
+*/
+void opj_arena_reset(opj_arena_t* arena);
+
+/**
+Release all allocations of an arena, and hand the arena back to the session pool
+@param arena Arena
+*/
+void opj_arena_destroy(opj_arena_t* arena);
+
+/**
+Free the memory of all pooled arenas
+*/
+void opj_arena_pool_cleanup(void);
+
 #if defined(__GNUC__) && !defined(OPJ_SKIP_POISON)
 #pragma GCC poison malloc calloc realloc free
 #endif
@@ -55,6 +55,10 @@
  */
 
 #include "opj_includes.h"
+#include <algorithm>
+#include <list>
+#include <new>
+#include <vector>
 
 /** @defgroup PI PI - Implementation of a packet iterator */
 /*@{*/
@@ -75,23 +79,13 @@ Get next packet in resolution-layer-component-precinct order.
 */
 static bool opj_pi_next_rlcp(opj_pi_iterator_t * pi);
 /**
-Get next packet in resolution-precinct-component-layer order.
+Get next packet in resolution-precinct-component-layer, precinct-component-resolution-layer
+or component-precinct-resolution-layer order, from the precomputed packet sequence.
 @param pi packet iterator to modify
-@return returns false if pi pointed to the last packet or else returns true
-*/
-static bool opj_pi_next_rpcl(opj_pi_iterator_t * pi);
-/**
-Get next packet in precinct-component-resolution-layer order.
-@param pi packet iterator to modify
-@return returns false if pi pointed to the last packet or else returns true
+@return returns false if pi pointed to the last packet, or if the packet sequence could not
+be allocated, or else returns true
 */
-static bool opj_pi_next_pcrl(opj_pi_iterator_t * pi);
-/**
-Get next packet in component-precinct-resolution-layer order.
-@param pi packet iterator to modify
-@return returns false if pi pointed to the last packet or else returns true
-*/
-static bool opj_pi_next_cprl(opj_pi_iterator_t * pi);
+static bool opj_pi_next_position(opj_pi_iterator_t * pi);
 
 /**
  * Updates the coding parameters if the encoding is used with Progression order changes and final (or cinema parameters are used).
@@ -210,10 +204,12 @@ static void opj_get_all_encoding_parameters(const opj_image_t *p_image,
  * @param	p_image		the image used to initialize the packet iterator (in fact only the number of components is relevant.
  * @param	p_cp		the coding parameters.
  * @param	tileno	the index of the tile from which creating the packet iterator.
+ * @param	cache	the packet sequence cache of the iterators, or NULL.
  */
 static opj_pi_iterator_t * opj_pi_create(	const opj_image_t *p_image,
         const opj_cp_t *p_cp,
-        uint32_t tileno );
+        uint32_t tileno,
+        opj_pi_cache_t *cache );
 /**
  * FIXME DOC
  */
@@ -238,8 +234,102 @@ static bool opj_pi_check_next_level(	int32_t pos,
                                         uint32_t pino,
                                         const char *prog);
 
-static void update_pi_dxy(opj_pi_iterator_t * pi);
-static void update_pi_dxy_for_comp(opj_pi_iterator_t * pi, opj_pi_comp_t *comp);
+/**
+Accumulate, in dx and dy, the smallest size on the canvas of the precincts of the resolutions of a component.
+@param comp	component
+@param dx	horizontal step of the scan of the tile, or 0 if not set yet
+@param dy	vertical step of the scan of the tile, or 0 if not set yet
+*/
+static void update_pi_dxy_for_comp(const opj_pi_comp_t *comp, uint32_t *dx, uint32_t *dy);
+/**
+Get the step of the scan of the tile over all components.
+*/
+static void update_pi_dxy(const opj_pi_iterator_t * pi, uint32_t *dx, uint32_t *dy);
+
+/**
+Mark the current packet of the iterator as used.
+@param pi packet iterator
+@return returns false if the packet was already used
+*/
+static bool opj_pi_include_packet(opj_pi_iterator_t * pi);
+
+/**
+Allocate the bit set of used packets.
+@param numlayers	number of layers
+@param step_l		number of packets per layer
+@return returns the bit set, or NULL if it could not be allocated
+*/
+static uint32_t* opj_pi_create_include(uint64_t numlayers, uint32_t step_l);
+
+/**
+Get the canvas positions, along one axis, at which the scan of a position driven progression
+meets the start of a precinct of a resolution.
+
+The scan visits p0 and then every multiple of step before p1; a position starts a precinct
+if it is a multiple of the precinct size, or if it is the tile origin and the tile origin cuts
+the first precinct.
+
+@param p0			first scanned position
+@param p1			end of the scanned range
+@param t0			tile origin
+@param step			scan step
+@param prc_size		precinct size on the canvas
+@param cut			true if the tile origin cuts the first precinct
+@param positions	receives the positions, in increasing order
+*/
+static void opj_pi_precinct_starts(uint32_t p0,
+                                   uint32_t p1,
+                                   uint32_t t0,
+                                   uint32_t step,
+                                   uint64_t prc_size,
+                                   bool cut,
+                                   std::vector<uint32_t>* positions);
+
+/**
+Packet position met by the scan of a position driven progression
+*/
+struct opj_pi_scan_position {
+    uint32_t y, x;
+    uint32_t compno, resno;
+    uint32_t precno;
+};
+
+/**
+Get the packet positions of the resolutions of a component met by the scan of the tile.
+@param pi			packet iterator
+@param compno		component
+@param dx			horizontal step of the scan
+@param dy			vertical step of the scan
+@param positions	receives the positions, appended in no particular order
+*/
+static void opj_pi_scan_component(const opj_pi_iterator_t * pi,
+                                  uint32_t compno,
+                                  uint32_t dx,
+                                  uint32_t dy,
+                                  std::vector<opj_pi_scan_position>* positions);
+
+/**
+Compute the packet sequence of a position driven progression.
+@param pi		packet iterator
+@param packets	receives the packet positions, in progression order
+*/
+static void opj_pi_build_sequence(const opj_pi_iterator_t * pi, std::vector<opj_pi_packet_t>* packets);
+
+/**
+Get the key of the packet sequence of a position driven progression: everything the sequence
+depends on, with the tile origin taken modulo the period of the precinct grids, so that tiles
+with the same geometry share their key.
+@param pi	packet iterator
+@param key	receives the key
+*/
+static void opj_pi_sequence_key(const opj_pi_iterator_t * pi, std::vector<uint32_t>* key);
+
+/**
+Set up the packet sequence of a position driven progression, from the cache if possible.
+@param pi packet iterator
+@return returns false if the sequence could not be allocated
+*/
+static bool opj_pi_load_sequence(opj_pi_iterator_t * pi);
 
 
 /*@}*/
@@ -251,33 +341,70 @@ static void update_pi_dxy_for_comp(opj_pi_iterator_t * pi, opj_pi_comp_t *comp);
    local functions
 ==========================================================
 */
-static void update_pi_dxy_for_comp(opj_pi_iterator_t * pi, opj_pi_comp_t *comp) {
+
+/** maximum number of packet sequences kept in a cache */
+const size_t opj_pi_cache_max_sequences = 16;
+
+/**
+Packet sequence of a position driven progression, and the key it was computed for
+*/
+struct opj_pi_sequence {
+    std::vector<uint32_t> key;
+    std::vector<opj_pi_packet_t> packets;
+};
+
+struct opj_pi_cache {
+    /** most recently used first: a sequence stays valid until it is evicted by a cache miss */
+    std::list<opj_pi_sequence> sequences;
+};
+
+static void update_pi_dxy_for_comp(const opj_pi_comp_t *comp, uint32_t *dx, uint32_t *dy) {
 	for (uint32_t resno = 0; resno < comp->numresolutions; resno++) {
 		opj_pi_resolution_t* res = &comp->resolutions[resno];
-		uint64_t dx = comp->dx * ((uint64_t)1u << (res->pdx + comp->numresolutions - 1 - resno));
-		uint64_t dy = comp->dy * ((uint64_t)1u << (res->pdy + comp->numresolutions - 1 - resno));
-		if (dx < UINT_MAX) {
-			pi->dx = !pi->dx ? (uint32_t)dx : opj_min<uint32_t>(pi->dx, (uint32_t)dx);
+		uint64_t dx_res = comp->dx * ((uint64_t)1u << (res->pdx + comp->numresolutions - 1 - resno));
+		uint64_t dy_res = comp->dy * ((uint64_t)1u << (res->pdy + comp->numresolutions - 1 - resno));
+		if (dx_res < UINT_MAX) {
+			*dx = !*dx ? (uint32_t)dx_res : opj_min<uint32_t>(*dx, (uint32_t)dx_res);
 		}
-		if (dy < UINT_MAX) {
-			pi->dy = !pi->dy ? (uint32_t)dy : opj_min<uint32_t>(pi->dy, (uint32_t)dy);
+		if (dy_res < UINT_MAX) {
+			*dy = !*dy ? (uint32_t)dy_res : opj_min<uint32_t>(*dy, (uint32_t)dy_res);
 		}
 	}
 }
-static void update_pi_dxy(opj_pi_iterator_t * pi) {
-	pi->first = 0;
-	pi->dx = 0;
-	pi->dy = 0;
+static void update_pi_dxy(const opj_pi_iterator_t * pi, uint32_t *dx, uint32_t *dy) {
+	*dx = 0;
+	*dy = 0;
 	for (uint32_t compno = 0; compno < pi->numcomps; compno++) {
-		update_pi_dxy_for_comp(pi, pi->comps+compno);
+		update_pi_dxy_for_comp(pi->comps+compno, dx, dy);
 	}
 }
 
+static bool opj_pi_include_packet(opj_pi_iterator_t * pi)
+{
+    uint64_t index = (uint64_t)pi->layno * pi->step_l + (uint64_t)pi->resno * pi->step_r +
+                     (uint64_t)pi->compno * pi->step_c + (uint64_t)pi->precno * pi->step_p;
+    uint32_t *word = pi->include + (index >> 5);
+    uint32_t mask = 1U << (index & 31);
+    if (*word & mask) {
+        return false;
+    }
+    *word |= mask;
+    return true;
+}
+
+static uint32_t* opj_pi_create_include(uint64_t numlayers, uint32_t step_l)
+{
+    if (!step_l || numlayers > (SIZE_MAX - 31) / step_l) {
+        return nullptr;
+    }
+    size_t numpackets = (size_t)numlayers * step_l;
+    return (uint32_t*)opj_calloc((numpackets + 31) >> 5, sizeof(uint32_t));
+}
+
 static bool opj_pi_next_lrcp(opj_pi_iterator_t * pi)
 {
     opj_pi_comp_t *comp = NULL;
     opj_pi_resolution_t *res = NULL;
-    uint32_t index = 0;
 
     if (!pi->first) {
         comp = &pi->comps[pi->compno];
@@ -299,9 +426,7 @@ static bool opj_pi_next_lrcp(opj_pi_iterator_t * pi)
                     pi->poc.precno1 = res->pw * res->ph;
                 }
                 for (pi->precno = pi->poc.precno0; pi->precno < pi->poc.precno1; pi->precno++) {
-                    index = pi->layno * pi->step_l + pi->resno * pi->step_r + pi->compno * pi->step_c + pi->precno * pi->step_p;
-                    if (!pi->include[index]) {
-                        pi->include[index] = 1;
+                    if (opj_pi_include_packet(pi)) {
                         return true;
                     }
 LABEL_SKIP:
@@ -318,7 +443,6 @@ static bool opj_pi_next_rlcp(opj_pi_iterator_t * pi)
 {
     opj_pi_comp_t *comp = NULL;
     opj_pi_resolution_t *res = NULL;
-    uint32_t index = 0;
 
     if (!pi->first) {
         comp = &pi->comps[pi->compno];
@@ -339,9 +463,7 @@ static bool opj_pi_next_rlcp(opj_pi_iterator_t * pi)
                     pi->poc.precno1 = res->pw * res->ph;
                 }
                 for (pi->precno = pi->poc.precno0; pi->precno < pi->poc.precno1; pi->precno++) {
-                    index = pi->layno * pi->step_l + pi->resno * pi->step_r + pi->compno * pi->step_c + pi->precno * pi->step_p;
-                    if (!pi->include[index]) {
-                        pi->include[index] = 1;
+                    if (opj_pi_include_packet(pi)) {
                         return true;
                     }
 LABEL_SKIP:
@@ -353,220 +475,286 @@ LABEL_SKIP:
     return false;
 }
 
-
-static bool opj_pi_next_rpcl(opj_pi_iterator_t * pi)
+static void opj_pi_precinct_starts(uint32_t p0,
+                                   uint32_t p1,
+                                   uint32_t t0,
+                                   uint32_t step,
+                                   uint64_t prc_size,
+                                   bool cut,
+                                   std::vector<uint32_t>* positions)
 {
-    opj_pi_comp_t *comp = NULL;
-    opj_pi_resolution_t *res = NULL;
-    uint32_t index = 0;
-
-    if (!pi->first) {
-        goto LABEL_SKIP;
-    } else {
-		update_pi_dxy(pi);
+    positions->clear();
+    if (p0 >= p1) {
+        return;
     }
-    if (!pi->tp_on) {
-        pi->poc.ty0 = pi->ty0;
-        pi->poc.tx0 = pi->tx0;
-        pi->poc.ty1 = pi->ty1;
-        pi->poc.tx1 = pi->tx1;
+    if ((p0 % prc_size == 0) || ((p0 == t0) && cut)) {
+        positions->push_back(p0);
     }
-    for (pi->resno = pi->poc.resno0; pi->resno < pi->poc.resno1; pi->resno++) {
-        for (pi->y = pi->poc.ty0; pi->y < pi->poc.ty1; pi->y += pi->dy - (pi->y % pi->dy)) {
-            for (pi->x = pi->poc.tx0; pi->x < pi->poc.tx1; pi->x += pi->dx - (pi->x % pi->dx)) {
-                for (pi->compno = pi->poc.compno0; pi->compno < pi->poc.compno1; pi->compno++) {
-                    uint32_t levelno;
-                    uint32_t trx0, try0;
-                    uint32_t  trx1, try1;
-                    uint32_t  rpx, rpy;
-                    uint32_t  prci, prcj;
-                    comp = &pi->comps[pi->compno];
-                    if (pi->resno >= comp->numresolutions) {
-                        continue;
-                    }
-                    res = &comp->resolutions[pi->resno];
-                    levelno = comp->numresolutions - 1 - pi->resno;
-					if (levelno >= OPJ_J2K_MAXRLVLS)
-						continue;
-                    trx0 = opj_uint64_ceildiv((uint64_t)pi->tx0, ((uint64_t)comp->dx << levelno));
-                    try0 = opj_uint64_ceildiv((uint64_t)pi->ty0, ((uint64_t)comp->dy << levelno));
-                    trx1 = opj_uint64_ceildiv((uint64_t)pi->tx1, ((uint64_t)comp->dx << levelno));
-                    try1 = opj_uint64_ceildiv((uint64_t)pi->ty1, ((uint64_t)comp->dy << levelno));
-                    rpx = res->pdx + levelno;
-                    rpy = res->pdy + levelno;
-                    if (!(((uint64_t)pi->y % ((uint64_t)comp->dy << rpy) == 0) || ((pi->y == pi->ty0) && (((uint64_t)try0 << levelno) % ((uint64_t)1 << rpy))  ))) {
-                        continue;
-                    }
-                    if (!(((uint64_t)pi->x % ((uint64_t)comp->dx << rpx) == 0) || ((pi->x == pi->tx0) && (((uint64_t)trx0 << levelno) % ((uint64_t)1 << rpx))))) {
-                        continue;
-                    }
-
-                    if ((res->pw==0)||(res->ph==0)) continue;
-
-                    if ((trx0==trx1)||(try0==try1)) continue;
+    if (!step) {
+        return;
+    }
+    /* the other scanned positions are multiples of the step: those that start a precinct
+       are the multiples of the least common multiple of the step and the precinct size */
+    uint64_t a = step, b = prc_size;
+    while (b) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    uint64_t q = prc_size / a;
+    if (q <= UINT_MAX) {
+        uint64_t lcm = q * step;
+        for (uint64_t pos = ((uint64_t)p0 / lcm + 1) * lcm; pos < p1; pos += lcm) {
+            positions->push_back((uint32_t)pos);
+        }
+    }
+    if (cut && (t0 > p0) && (t0 < p1) && (t0 % step == 0) && (t0 % prc_size != 0)) {
+        positions->insert(std::upper_bound(positions->begin(), positions->end(), t0), t0);
+    }
+}
 
-                    prci = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->x, ((uint64_t)comp->dx << levelno)), res->pdx)
-                           - opj_uint_floordivpow2(trx0, res->pdx);
-                    prcj = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->y, ((uint64_t)comp->dy << levelno)), res->pdy)
-                           - opj_uint_floordivpow2(try0, res->pdy);
-                    pi->precno = (prci + prcj * res->pw);
-                    for (pi->layno = pi->poc.layno0; pi->layno < pi->poc.layno1; pi->layno++) {
-                        index = pi->layno * pi->step_l + pi->resno * pi->step_r + pi->compno * pi->step_c + pi->precno * pi->step_p;
-                        if (!pi->include[index]) {
-                            pi->include[index] = 1;
-                            return true;
-                        }
-LABEL_SKIP:
-                        ;
-                    }
-                }
+static void opj_pi_scan_component(const opj_pi_iterator_t * pi,
+                                  uint32_t compno,
+                                  uint32_t dx,
+                                  uint32_t dy,
+                                  std::vector<opj_pi_scan_position>* positions)
+{
+    const opj_pi_comp_t *comp = &pi->comps[compno];
+    std::vector<uint32_t> xs, ys;
+
+    for (uint32_t resno = pi->poc.resno0; resno < opj_min<uint32_t>(pi->poc.resno1, comp->numresolutions); resno++) {
+        const opj_pi_resolution_t *res = &comp->resolutions[resno];
+        uint32_t levelno = comp->numresolutions - 1 - resno;
+        if (levelno >= OPJ_J2K_MAXRLVLS)
+            continue;
+        uint32_t trx0 = opj_uint64_ceildiv((uint64_t)pi->tx0, ((uint64_t)comp->dx << levelno));
+        uint32_t try0 = opj_uint64_ceildiv((uint64_t)pi->ty0, ((uint64_t)comp->dy << levelno));
+        uint32_t trx1 = opj_uint64_ceildiv((uint64_t)pi->tx1, ((uint64_t)comp->dx << levelno));
+        uint32_t try1 = opj_uint64_ceildiv((uint64_t)pi->ty1, ((uint64_t)comp->dy << levelno));
+        uint32_t rpx = res->pdx + levelno;
+        uint32_t rpy = res->pdy + levelno;
+
+        if ((res->pw==0)||(res->ph==0)) continue;
+
+        if ((trx0==trx1)||(try0==try1)) continue;
+
+        opj_pi_precinct_starts(pi->poc.tx0, pi->poc.tx1, pi->tx0, dx, (uint64_t)comp->dx << rpx,
+                               (((uint64_t)trx0 << levelno) % ((uint64_t)1 << rpx)) != 0, &xs);
+        opj_pi_precinct_starts(pi->poc.ty0, pi->poc.ty1, pi->ty0, dy, (uint64_t)comp->dy << rpy,
+                               (((uint64_t)try0 << levelno) % ((uint64_t)1 << rpy)) != 0, &ys);
+        for (auto y : ys) {
+            uint32_t prcj = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)y, ((uint64_t)comp->dy << levelno)), res->pdy)
+                            - opj_uint_floordivpow2(try0, res->pdy);
+            if (prcj >= res->ph)
+                continue;
+            for (auto x : xs) {
+                uint32_t prci = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)x, ((uint64_t)comp->dx << levelno)), res->pdx)
+                                - opj_uint_floordivpow2(trx0, res->pdx);
+                if (prci >= res->pw)
+                    continue;
+                opj_pi_scan_position position = { y, x, compno, resno, prci + prcj * res->pw };
+                positions->push_back(position);
             }
         }
     }
-
-    return false;
 }
 
-static bool opj_pi_next_pcrl(opj_pi_iterator_t * pi)
+static void opj_pi_build_sequence(const opj_pi_iterator_t * pi, std::vector<opj_pi_packet_t>* packets)
 {
-    opj_pi_comp_t *comp = NULL;
-    opj_pi_resolution_t *res = NULL;
-    uint32_t index = 0;
+    std::vector<opj_pi_scan_position> positions;
+    uint32_t compno1 = opj_min<uint32_t>(pi->poc.compno1, pi->numcomps);
+    uint32_t dx = 0, dy = 0;
 
-    if (!pi->first) {
-        comp = &pi->comps[pi->compno];
-        goto LABEL_SKIP;
-    } 
-
-	update_pi_dxy(pi);
-    if (!pi->tp_on) {
-        pi->poc.ty0 = pi->ty0;
-        pi->poc.tx0 = pi->tx0;
-        pi->poc.ty1 = pi->ty1;
-        pi->poc.tx1 = pi->tx1;
+    switch (pi->poc.prg) {
+    case OPJ_RPCL:
+        update_pi_dxy(pi, &dx, &dy);
+        for (uint32_t compno = pi->poc.compno0; compno < compno1; compno++) {
+            opj_pi_scan_component(pi, compno, dx, dy, &positions);
+        }
+        std::sort(positions.begin(), positions.end(), [](const opj_pi_scan_position& a, const opj_pi_scan_position& b) {
+            if (a.resno != b.resno) return a.resno < b.resno;
+            if (a.y != b.y) return a.y < b.y;
+            if (a.x != b.x) return a.x < b.x;
+            return a.compno < b.compno;
+        });
+        break;
+    case OPJ_PCRL:
+        update_pi_dxy(pi, &dx, &dy);
+        for (uint32_t compno = pi->poc.compno0; compno < compno1; compno++) {
+            opj_pi_scan_component(pi, compno, dx, dy, &positions);
+        }
+        std::sort(positions.begin(), positions.end(), [](const opj_pi_scan_position& a, const opj_pi_scan_position& b) {
+            if (a.y != b.y) return a.y < b.y;
+            if (a.x != b.x) return a.x < b.x;
+            if (a.compno != b.compno) return a.compno < b.compno;
+            return a.resno < b.resno;
+        });
+        break;
+    case OPJ_CPRL:
+        /* each component is scanned with its own step */
+        for (uint32_t compno = pi->poc.compno0; compno < compno1; compno++) {
+            dx = 0;
+            dy = 0;
+            update_pi_dxy_for_comp(pi->comps + compno, &dx, &dy);
+            opj_pi_scan_component(pi, compno, dx, dy, &positions);
+        }
+        std::sort(positions.begin(), positions.end(), [](const opj_pi_scan_position& a, const opj_pi_scan_position& b) {
+            if (a.compno != b.compno) return a.compno < b.compno;
+            if (a.y != b.y) return a.y < b.y;
+            if (a.x != b.x) return a.x < b.x;
+            return a.resno < b.resno;
+        });
+        break;
+    default:
+        break;
     }
-    for (pi->y = pi->poc.ty0; pi->y < pi->poc.ty1; pi->y += pi->dy - (pi->y % pi->dy)) {
-        for (pi->x = pi->poc.tx0; pi->x < pi->poc.tx1; pi->x += pi->dx - (pi->x % pi->dx)) {
-            for (pi->compno = pi->poc.compno0; pi->compno < pi->poc.compno1; pi->compno++) {
-                comp = &pi->comps[pi->compno];
-                for (pi->resno = pi->poc.resno0; pi->resno < opj_min<uint32_t>(pi->poc.resno1, comp->numresolutions); pi->resno++) {
-                    uint32_t levelno;
-                    uint32_t trx0, try0;
-                    uint32_t trx1, try1;
-                    uint32_t rpx, rpy;
-                    uint32_t prci, prcj;
-                    res = &comp->resolutions[pi->resno];
-                    levelno = comp->numresolutions - 1 - pi->resno;
-					if (levelno >= OPJ_J2K_MAXRLVLS)
-						continue;
-                    trx0 = opj_uint64_ceildiv((uint64_t)pi->tx0, ((uint64_t)comp->dx << levelno));
-                    try0 = opj_uint64_ceildiv((uint64_t)pi->ty0, ((uint64_t)comp->dy << levelno));
-                    trx1 = opj_uint64_ceildiv((uint64_t)pi->tx1, ((uint64_t)comp->dx << levelno));
-                    try1 = opj_uint64_ceildiv((uint64_t)pi->ty1, ((uint64_t)comp->dy << levelno));
-                    rpx = res->pdx + levelno;
-                    rpy = res->pdy + levelno;
-                    if (!(((uint64_t)pi->y % ((uint64_t)comp->dy << rpy) == 0) || ((pi->y == pi->ty0) && (((uint64_t)try0 << levelno) % ((uint64_t)1 << rpy))))) {
-                        continue;
-                    }
-                    if (!(((uint64_t)pi->x % ((uint64_t)comp->dx << rpx) == 0) || ((pi->x == pi->tx0) && (((uint64_t)trx0 << levelno) % ((uint64_t)1 << rpx))))) {
-                        continue;
-                    }
-
-                    if ((res->pw==0)||(res->ph==0)) continue;
 
-                    if ((trx0==trx1)||(try0==try1)) continue;
+    packets->resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        (*packets)[i].compno = (uint16_t)positions[i].compno;
+        (*packets)[i].resno = (uint16_t)positions[i].resno;
+        (*packets)[i].precno = positions[i].precno;
+    }
+}
 
-                    prci = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->x, ((uint64_t)comp->dx << levelno)),res->pdx)
-                           - opj_uint_floordivpow2(trx0, res->pdx);
-                    prcj = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->y, ((uint64_t)comp->dy << levelno)), res->pdy)
-                           - opj_uint_floordivpow2(try0, res->pdy);
-                    pi->precno = (prci + prcj * res->pw);
-                    for (pi->layno = pi->poc.layno0; pi->layno < pi->poc.layno1; pi->layno++) {
-                        index = pi->layno * pi->step_l + pi->resno * pi->step_r + pi->compno * pi->step_c + pi->precno * pi->step_p;
-                        if (!pi->include[index]) {
-                            pi->include[index] = 1;
-                            return true;
-                        }
-LABEL_SKIP:
-                        ;
-                    }
+static void opj_pi_sequence_key(const opj_pi_iterator_t * pi, std::vector<uint32_t>* key)
+{
+    /* the sequence is unchanged by a shift of the tile by a common multiple of the precinct sizes,
+       as all precinct sizes, and the scan steps, divide it */
+    uint64_t period_x = 1, period_y = 1;
+    for (uint32_t compno = 0; compno < pi->numcomps; compno++) {
+        const opj_pi_comp_t *comp = pi->comps + compno;
+        for (uint32_t resno = 0; resno < comp->numresolutions; resno++) {
+            const opj_pi_resolution_t *res = comp->resolutions + resno;
+            uint32_t levelno = comp->numresolutions - 1 - resno;
+            uint64_t* periods[2] = { &period_x, &period_y };
+            uint64_t sizes[2] = { (uint64_t)comp->dx << (res->pdx + levelno), (uint64_t)comp->dy << (res->pdy + levelno) };
+            for (uint32_t i = 0; i < 2; ++i) {
+                uint64_t a = *periods[i], b = sizes[i];
+                if (!a || !b) {
+                    /* no usable period: fall back to the absolute position */
+                    *periods[i] = 0;
+                    continue;
+                }
+                while (b) {
+                    uint64_t r = a % b;
+                    a = b;
+                    b = r;
                 }
+                uint64_t q = sizes[i] / a;
+                *periods[i] = (q <= UINT_MAX / *periods[i]) ? q * *periods[i] : 0;
             }
         }
     }
 
-    return false;
+    key->clear();
+    key->push_back(pi->poc.prg);
+    key->push_back(pi->poc.resno0);
+    key->push_back(pi->poc.resno1);
+    key->push_back(pi->poc.compno0);
+    key->push_back(pi->poc.compno1);
+    key->push_back(period_x ? (uint32_t)(pi->tx0 % period_x) : pi->tx0);
+    key->push_back(period_y ? (uint32_t)(pi->ty0 % period_y) : pi->ty0);
+    int64_t extents[6] = { (int64_t)pi->tx1 - pi->tx0, (int64_t)pi->ty1 - pi->ty0,
+                           (int64_t)pi->poc.tx0 - pi->tx0, (int64_t)pi->poc.tx1 - pi->tx0,
+                           (int64_t)pi->poc.ty0 - pi->ty0, (int64_t)pi->poc.ty1 - pi->ty0
+                         };
+    for (auto extent : extents) {
+        key->push_back((uint32_t)((uint64_t)extent >> 32));
+        key->push_back((uint32_t)extent);
+    }
+    key->push_back(pi->numcomps);
+    for (uint32_t compno = 0; compno < pi->numcomps; compno++) {
+        const opj_pi_comp_t *comp = pi->comps + compno;
+        key->push_back(comp->dx);
+        key->push_back(comp->dy);
+        key->push_back(comp->numresolutions);
+        for (uint32_t resno = 0; resno < comp->numresolutions; resno++) {
+            const opj_pi_resolution_t *res = comp->resolutions + resno;
+            key->push_back(res->pdx);
+            key->push_back(res->pdy);
+            key->push_back(res->pw);
+            key->push_back(res->ph);
+        }
+    }
 }
 
-static bool opj_pi_next_cprl(opj_pi_iterator_t * pi)
+static bool opj_pi_load_sequence(opj_pi_iterator_t * pi)
 {
-    opj_pi_comp_t *comp = NULL;
-    opj_pi_resolution_t *res = NULL;
-    uint32_t index = 0;
+    pi->packets = nullptr;
+    pi->numpackets = 0;
+    try {
+        if (!pi->cache) {
+            std::vector<opj_pi_packet_t> packets;
+            opj_pi_build_sequence(pi, &packets);
+            opj_free(pi->own_packets);
+            pi->own_packets = nullptr;
+            if (!packets.empty()) {
+                pi->own_packets = (opj_pi_packet_t*)opj_malloc(packets.size() * sizeof(opj_pi_packet_t));
+                if (!pi->own_packets)
+                    return false;
+                memcpy(pi->own_packets, packets.data(), packets.size() * sizeof(opj_pi_packet_t));
+            }
+            pi->packets = pi->own_packets;
+            pi->numpackets = (uint32_t)packets.size();
+            return true;
+        }
 
-    if (!pi->first) {
-        comp = &pi->comps[pi->compno];
-        goto LABEL_SKIP;
-    } 
+        std::vector<uint32_t> key;
+        opj_pi_sequence_key(pi, &key);
+        auto& sequences = pi->cache->sequences;
+        auto it = sequences.begin();
+        while (it != sequences.end() && it->key != key)
+            ++it;
+        if (it != sequences.end()) {
+            sequences.splice(sequences.begin(), sequences, it);
+        } else {
+            if (sequences.size() >= opj_pi_cache_max_sequences)
+                sequences.pop_back();
+            sequences.emplace_front();
+            sequences.front().key.swap(key);
+            opj_pi_build_sequence(pi, &sequences.front().packets);
+        }
+        pi->packets = sequences.front().packets.data();
+        pi->numpackets = (uint32_t)sequences.front().packets.size();
+    } catch (std::bad_alloc&) {
+        if (pi->cache && !pi->cache->sequences.empty() && pi->cache->sequences.front().packets.empty())
+            pi->cache->sequences.pop_front();
+        return false;
+    }
+    return true;
+}
 
-	pi->first = 0;
-    for (pi->compno = pi->poc.compno0; pi->compno < pi->poc.compno1; pi->compno++) {
-        comp = &pi->comps[pi->compno];
-        pi->dx = 0;
-        pi->dy = 0;
-		update_pi_dxy_for_comp(pi, comp);
+static bool opj_pi_next_position(opj_pi_iterator_t * pi)
+{
+    if (pi->first) {
+        pi->first = 0;
         if (!pi->tp_on) {
             pi->poc.ty0 = pi->ty0;
             pi->poc.tx0 = pi->tx0;
             pi->poc.ty1 = pi->ty1;
             pi->poc.tx1 = pi->tx1;
         }
-        for (pi->y = pi->poc.ty0; pi->y < pi->poc.ty1; pi->y += pi->dy - (pi->y % pi->dy)) {
-            for (pi->x = pi->poc.tx0; pi->x < pi->poc.tx1; pi->x += pi->dx - (pi->x % pi->dx)) {
-                for (pi->resno = pi->poc.resno0; pi->resno < opj_min<uint32_t>(pi->poc.resno1, comp->numresolutions); pi->resno++) {
-                    uint32_t levelno;
-                    uint32_t trx0, try0;
-                    uint32_t trx1, try1;
-                    uint32_t rpx, rpy;
-                    int32_t prci, prcj;
-                    res = &comp->resolutions[pi->resno];
-                    levelno = comp->numresolutions - 1 - pi->resno;
-					if (levelno >= OPJ_J2K_MAXRLVLS)
-						continue;
-                    trx0 = opj_uint64_ceildiv((uint64_t)pi->tx0, ((uint64_t)comp->dx << levelno));
-                    try0 = opj_uint64_ceildiv((uint64_t)pi->ty0, ((uint64_t)comp->dy << levelno));
-                    trx1 = opj_uint64_ceildiv((uint64_t)pi->tx1, ((uint64_t)comp->dx << levelno));
-                    try1 = opj_uint64_ceildiv((uint64_t)pi->ty1, ((uint64_t)comp->dy << levelno));
-                    rpx = res->pdx + levelno;
-                    rpy = res->pdy + levelno;
-                    if (!(((uint64_t)pi->y % ((uint64_t)comp->dy << rpy) == 0) || ((pi->y == pi->ty0) && (((uint64_t)try0 << levelno) % ((uint64_t)1 << rpy))))) {
-                        continue;
-                    }
-                    if (!(((uint64_t)pi->x % ((uint64_t)comp->dx << rpx) == 0) || ((pi->x == pi->tx0) && (((uint64_t)trx0 << levelno) % ((uint64_t)1 << rpx))))) {
-                        continue;
-                    }
-
-                    if ((res->pw==0)||(res->ph==0)) continue;
-
-                    if ((trx0==trx1)||(try0==try1)) continue;
+        if (!opj_pi_load_sequence(pi)) {
+            return false;
+        }
+        pi->packetno = 0;
+        pi->layno = pi->poc.layno0;
+    } else {
+        pi->layno++;
+    }
 
-                    prci = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->x, ((uint64_t)comp->dx << levelno)), res->pdx)
-                           - opj_uint_floordivpow2(trx0, res->pdx);
-                    prcj = opj_uint_floordivpow2(opj_uint64_ceildiv((uint64_t)pi->y, ((uint64_t)comp->dy << levelno)), res->pdy)
-                           - opj_uint_floordivpow2(try0, res->pdy);
-                    pi->precno = prci + prcj * res->pw;
-                    for (pi->layno = pi->poc.layno0; pi->layno < pi->poc.layno1; pi->layno++) {
-                        index = pi->layno * pi->step_l + pi->resno * pi->step_r + pi->compno * pi->step_c + pi->precno * pi->step_p;
-                        if (!pi->include[index]) {
-                            pi->include[index] = 1;
-                            return true;
-                        }
-LABEL_SKIP:
-                        ;
-                    }
-                }
+    for (; pi->packetno < pi->numpackets; pi->packetno++) {
+        const opj_pi_packet_t *packet = pi->packets + pi->packetno;
+        pi->compno = packet->compno;
+        pi->resno = packet->resno;
+        pi->precno = packet->precno;
+        for (; pi->layno < pi->poc.layno1; pi->layno++) {
+            if (opj_pi_include_packet(pi)) {
+                return true;
             }
         }
+        pi->layno = pi->poc.layno0;
     }
 
     return false;
@@ -813,7 +1001,8 @@ static void opj_get_all_encoding_parameters(   const opj_image_t *p_image,
 
 static opj_pi_iterator_t * opj_pi_create(	const opj_image_t *image,
         const opj_cp_t *cp,
-        uint32_t tileno )
+        uint32_t tileno,
+        opj_pi_cache_t *cache )
 {
     /* loop*/
     uint32_t pino, compno;
@@ -853,6 +1042,7 @@ static opj_pi_iterator_t * opj_pi_create(	const opj_image_t *image,
         }
 
         l_current_pi->numcomps = image->numcomps;
+        l_current_pi->cache = cache;
 
         for (compno = 0; compno < image->numcomps; ++compno) {
             opj_pi_comp_t *comp = &l_current_pi->comps[compno];
@@ -1175,7 +1365,8 @@ static bool opj_pi_check_next_level(	int32_t pos,
 */
 opj_pi_iterator_t *opj_pi_create_decode(opj_image_t *p_image,
                                         opj_cp_t *p_cp,
-                                        uint32_t p_tile_no)
+                                        uint32_t p_tile_no,
+                                        opj_pi_cache_t *p_cache)
 {
     /* loop */
     uint32_t pino;
@@ -1224,7 +1415,7 @@ opj_pi_iterator_t *opj_pi_create_decode(opj_image_t *p_image,
     }
 
     /* memory allocation for pi */
-    l_pi = opj_pi_create(p_image, p_cp, p_tile_no);
+    l_pi = opj_pi_create(p_image, p_cp, p_tile_no, p_cache);
     if (!l_pi) {
         opj_free(l_tmp_data);
         opj_free(l_tmp_ptr);
@@ -1251,10 +1442,7 @@ opj_pi_iterator_t *opj_pi_create_decode(opj_image_t *p_image,
     l_current_pi = l_pi;
 
     /* memory allocation for include */
-	l_current_pi->include = nullptr;
-	if (l_step_l && (l_tcp->numlayers < (SIZE_MAX / l_step_l) - 1))		 {
-		l_current_pi->include = (int16_t*)opj_calloc(((size_t)l_tcp->numlayers + 1) * l_step_l, sizeof(int16_t));
-	}
+	l_current_pi->include = opj_pi_create_include((uint64_t)l_tcp->numlayers + 1, l_step_l);
 
     if (!l_current_pi->include) {
         opj_free(l_tmp_data);
@@ -1363,7 +1551,8 @@ opj_pi_iterator_t *opj_pi_create_decode(opj_image_t *p_image,
 opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *p_image,
         opj_cp_t *p_cp,
         uint32_t p_tile_no,
-        J2K_T2_MODE p_t2_mode )
+        J2K_T2_MODE p_t2_mode,
+        opj_pi_cache_t *p_cache )
 {
     /* loop*/
     uint32_t pino;
@@ -1415,7 +1604,7 @@ opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *p_image,
     }
 
     /* memory allocation for pi*/
-    l_pi = opj_pi_create(p_image,p_cp,p_tile_no);
+    l_pi = opj_pi_create(p_image,p_cp,p_tile_no,p_cache);
     if (!l_pi) {
         opj_free(l_tmp_data);
         opj_free(l_tmp_ptr);
@@ -1443,7 +1632,7 @@ opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *p_image,
     l_current_pi = l_pi;
 
     /* memory allocation for include*/
-    l_current_pi->include = (int16_t*) opj_calloc((size_t)l_tcp->numlayers * l_step_l, sizeof(int16_t));
+    l_current_pi->include = opj_pi_create_include(l_tcp->numlayers, l_step_l);
     if (!l_current_pi->include) {
         opj_free(l_tmp_data);
         opj_free(l_tmp_ptr);
@@ -1459,8 +1648,6 @@ opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *p_image,
     l_current_pi->ty0 = l_ty0;
     l_current_pi->tx1 = l_tx1;
     l_current_pi->ty1 = l_ty1;
-    l_current_pi->dx = l_dx_min;
-    l_current_pi->dy = l_dy_min;
     l_current_pi->step_p = l_step_p;
     l_current_pi->step_c = l_step_c;
     l_current_pi->step_r = l_step_r;
@@ -1498,8 +1685,6 @@ opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *p_image,
         l_current_pi->ty0 = l_ty0;
         l_current_pi->tx1 = l_tx1;
         l_current_pi->ty1 = l_ty1;
-        l_current_pi->dx = l_dx_min;
-        l_current_pi->dy = l_dy_min;
         l_current_pi->step_p = l_step_p;
         l_current_pi->step_c = l_step_c;
         l_current_pi->step_r = l_step_r;
@@ -1816,6 +2001,8 @@ void opj_pi_destroy(opj_pi_iterator_t *p_pi,
             p_pi->include = nullptr;
         }
         for (pino = 0; pino < p_nb_elements; ++pino) {
+            opj_free(l_current_pi->own_packets);
+            l_current_pi->own_packets = nullptr;
             if(l_current_pi->comps) {
                 opj_pi_comp_t *l_current_component = l_current_pi->comps;
                 for (compno = 0; compno < l_current_pi->numcomps; compno++) {
@@ -1875,14 +2062,22 @@ bool opj_pi_next(opj_pi_iterator_t * pi)
     case OPJ_RLCP:
         return opj_pi_next_rlcp(pi);
     case OPJ_RPCL:
-        return opj_pi_next_rpcl(pi);
     case OPJ_PCRL:
-        return opj_pi_next_pcrl(pi);
     case OPJ_CPRL:
-        return opj_pi_next_cprl(pi);
+        return opj_pi_next_position(pi);
     case OPJ_PROG_UNKNOWN:
         return false;
     }
 
     return false;
 }
+
+opj_pi_cache_t *opj_pi_cache_create(void)
+{
+    return new (std::nothrow) opj_pi_cache_t();
+}
+
+void opj_pi_cache_destroy(opj_pi_cache_t *cache)
+{
+    delete cache;
+}
@@ -86,14 +86,32 @@ typedef struct opj_pi_comp {
     opj_pi_resolution_t *resolutions;
 } opj_pi_comp_t;
 
+/**
+Packet position (component, resolution and precinct) in the packet sequence
+of a position driven progression (RPCL, PCRL or CPRL): the packets of all layers
+of a position follow one another
+*/
+typedef struct opj_pi_packet {
+    uint16_t compno;
+    uint16_t resno;
+    uint32_t precno;
+} opj_pi_packet_t;
+
+/**
+Cache of the packet sequences of position driven progressions, shared by the packet
+iterators of successive tiles, so that the sequence of tiles with the same geometry,
+or of a tile iterated several times, is only computed once
+*/
+typedef struct opj_pi_cache opj_pi_cache_t;
+
 /**
 Packet iterator
 */
 typedef struct opj_pi_iterator {
     /** Enabling Tile part generation*/
     uint8_t tp_on;
-    /** precise if the packet has been already used (useful for progression order change) */
-    int16_t *include;
+    /** bit set of the packets already used (useful for progression order change) */
+    uint32_t *include;
     /** layer step used to localize the packet in the include vector */
     uint32_t step_l;
     /** resolution step used to localize the packet in the include vector */
@@ -120,10 +138,16 @@ typedef struct opj_pi_iterator {
     opj_pi_comp_t *comps;
     /** FIXME DOC*/
     uint32_t tx0, ty0, tx1, ty1;
-    /** FIXME DOC*/
-    uint32_t x, y;
-    /** FIXME DOC*/
-    uint32_t dx, dy;
+    /** position driven progressions: packet positions, in progression order */
+    const opj_pi_packet_t *packets;
+    /** number of packet positions */
+    uint32_t numpackets;
+    /** current packet position */
+    uint32_t packetno;
+    /** cache the packet positions are taken from (not owned), or NULL */
+    opj_pi_cache_t *cache;
+    /** packet positions owned by the iterator, when there is no cache */
+    opj_pi_packet_t *own_packets;
 } opj_pi_iterator_t;
 
 /** @name Exported functions */
@@ -136,13 +160,15 @@ typedef struct opj_pi_iterator {
  * @param	cp		the coding parameters.
  * @param	tileno	index of the tile being encoded.
  * @param	t2_mode	the type of pass for generating the packet iterator
+ * @param	cache	packet sequence cache, or NULL
  *
  * @return	a list of packet iterator that points to the first packet of the tile (not true).
 */
 opj_pi_iterator_t *opj_pi_initialise_encode(const opj_image_t *image,
         opj_cp_t *cp,
         uint32_t tileno,
-        J2K_T2_MODE t2_mode);
+        J2K_T2_MODE t2_mode,
+        opj_pi_cache_t *cache);
 
 /**
  * Updates the encoding parameters of the codec.
@@ -178,12 +204,14 @@ Create a packet iterator for Decoder
 @param image Raw image for which the packets will be listed
 @param cp Coding parameters
 @param tileno Number that identifies the tile for which to list the packets
+@param cache Packet sequence cache, or NULL
 @return Returns a packet iterator that points to the first packet of the tile
 @see opj_pi_destroy
 */
 opj_pi_iterator_t *opj_pi_create_decode(opj_image_t * image,
                                         opj_cp_t * cp,
-                                        uint32_t tileno);
+                                        uint32_t tileno,
+                                        opj_pi_cache_t *cache);
 /**
  * Destroys a packet iterator array.
  *
@@ -196,9 +224,22 @@ void opj_pi_destroy(opj_pi_iterator_t *p_pi,
 /**
 Modify the packet iterator to point to the next packet
 @param pi Packet iterator to modify
-@return Returns false if pi pointed to the last packet or else returns true
+@return Returns false if pi pointed to the last packet (or if the packet sequence
+of a position driven progression could not be allocated) or else returns true
 */
 bool opj_pi_next(opj_pi_iterator_t * pi);
+
+/**
+Create a packet sequence cache
+@return Returns the cache, or NULL if it could not be allocated
+*/
+opj_pi_cache_t *opj_pi_cache_create(void);
+
+/**
+Destroy a packet sequence cache; no packet iterator may still use it
+@param cache Cache to destroy
+*/
+void opj_pi_cache_destroy(opj_pi_cache_t *cache);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
@@ -79,11 +79,12 @@ void opj_raw_destroy(opj_raw_t *raw)
     }
 }
 
-void opj_raw_init_dec(opj_raw_t *raw, uint8_t *bp, uint32_t len)
+void opj_raw_init_dec(opj_raw_t *raw, const opj_min_buf_t *pieces, uint32_t num_pieces)
 {
-    raw->start = bp;
-    raw->lenmax = len;
-    raw->len = 0;
+    raw->bp = NULL;
+    raw->end = NULL;
+    raw->next_piece = pieces;
+    raw->last_piece = pieces + num_pieces;
     raw->C = 0;
     raw->COUNT = 0;
 }
@@ -93,14 +94,18 @@ uint32_t opj_raw_decode(opj_raw_t *raw)
     uint32_t d;
     if (raw->COUNT == 0) {
         raw->COUNT = 8;
-        if (raw->len == raw->lenmax) {
+        while (raw->bp == raw->end && raw->next_piece != raw->last_piece) {
+            raw->bp = raw->next_piece->buf;
+            raw->end = raw->bp + raw->next_piece->len;
+            raw->next_piece++;
+        }
+        if (raw->bp == raw->end) {
             raw->C = 0xff;
         } else {
             if (raw->C == 0xff) {
                 raw->COUNT = 7;
             }
-            raw->C = *(raw->start + raw->len);
-            raw->len++;
+            raw->C = *raw->bp++;
         }
     }
     raw->COUNT--;
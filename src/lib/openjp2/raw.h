@@ -63,16 +63,14 @@ typedef struct opj_raw {
     uint8_t C;
     /** number of bits already read or free to write */
     uint32_t COUNT;
-    /** maximum length to decode */
-    uint32_t lenmax;
-    /** length decoded */
-    uint32_t len;
-    /** pointer to the current position in the buffer */
-    uint8_t *bp;
-    /** pointer to the start of the buffer */
-    uint8_t *start;
-    /** pointer to the end of the buffer */
-    uint8_t *end;
+    /** pointer to the current position in the current piece */
+    const uint8_t *bp;
+    /** pointer to the end of the current piece */
+    const uint8_t *end;
+    /** next piece of the segment */
+    const opj_min_buf_t *next_piece;
+    /** end of the pieces of the segment */
+    const opj_min_buf_t *last_piece;
 } opj_raw_t;
 
 
@@ -88,12 +86,12 @@ Destroy a previously created RAW handle
 */
 void opj_raw_destroy(opj_raw_t *raw);
 /**
-Initialize the decoder
+Initialize the decoder. The segment is read in place, as a sequence of pieces
 @param raw RAW handle
-@param bp Pointer to the start of the buffer from which the bytes will be read
-@param len Length of the input buffer
+@param pieces Pieces of the segment, in stream order
+@param num_pieces Number of pieces
 */
-void opj_raw_init_dec(opj_raw_t *raw, uint8_t *bp, uint32_t len);
+void opj_raw_init_dec(opj_raw_t *raw, const opj_min_buf_t *pieces, uint32_t num_pieces);
 /**
 Decode a symbol using raw-decoder. Cfr p.506 TAUBMAN
 @param raw RAW handle
@@ -38,9 +38,8 @@ bool opj_min_buf_vec_copy_to_contiguous_buffer(opj_vec_t* min_buf_vec, uint8_t*
 
 }
 
-bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint16_t len)
+bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint32_t len)
 {
-    opj_min_buf_t* seg = NULL;
     if (!buf_vec || !buf || !len)
         return false;
 
@@ -48,24 +47,16 @@ bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint16_t len)
         buf_vec->init();
     }
 
-    seg = (opj_min_buf_t*)opj_malloc(sizeof(opj_buf_t));
-    if (!seg)
-        return false;
-
-    seg->buf = buf;
-    seg->len = len;
-    if (!buf_vec->push_back(seg)) {
-        opj_free(seg);
-        return false;
-    }
-
-    return true;
+    opj_min_buf_t seg;
+    seg.buf = buf;
+    seg.len = len;
+    return buf_vec->push_back(seg);
 }
 
-uint16_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec)
+size_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec)
 {
-    size_t i = 0;
-    uint16_t len = 0;
+    int32_t i = 0;
+    size_t len = 0;
     if (!min_buf_vec || !min_buf_vec->data)
         return 0;
     for (i = 0; i < min_buf_vec->size(); ++i) {
@@ -77,6 +68,27 @@ uint16_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec)
 
 }
 
+bool opj_min_buf_vec_get_segment(opj_vec_t* min_buf_vec,
+								uint32_t seg_len,
+								uint32_t* index,
+								const opj_min_buf_t** pieces,
+								uint32_t* num_pieces)
+{
+    uint32_t first = *index;
+    uint32_t last = first;
+    uint64_t len = 0;
+    uint32_t count = (min_buf_vec && min_buf_vec->data) ? (uint32_t)min_buf_vec->size() : 0;
+
+    while (len < seg_len && last < count)
+        len += ((opj_min_buf_t*)min_buf_vec->get(last++))->len;
+    if (len != seg_len)
+        return false;
+    *pieces = (last > first) ? (const opj_min_buf_t*)min_buf_vec->get(first) : NULL;
+    *num_pieces = last - first;
+    *index = last;
+    return true;
+}
+
 
 
 /*--------------------------------------------------------------------------*/
@@ -258,6 +270,16 @@ bool opj_seg_buf_push_back(opj_seg_buf_t* seg_buf, uint8_t* buf, size_t len)
     return true;
 }
 
+bool opj_seg_buf_wrap(opj_seg_buf_t* seg_buf, uint8_t* buf, size_t len)
+{
+    if (!seg_buf)
+        return false;
+    opj_seg_buf_cleanup(seg_buf);
+    seg_buf->data_len = 0;
+    seg_buf->cur_seg_id = 0;
+    return opj_seg_buf_push_back(seg_buf, buf, len);
+}
+
 bool opj_seg_buf_alloc_and_push_back(opj_seg_buf_t* seg_buf, size_t len)
 {
     opj_buf_t* seg = NULL;
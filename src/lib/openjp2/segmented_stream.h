@@ -37,15 +37,6 @@
 
 #include <vector>
 
-/*
-Smart wrapper to low level C array
-*/
-
-struct opj_min_buf_t {
-    uint8_t *buf;		/* internal array*/
-    uint16_t len;		/* length of array */
-};
-
 /*
 Copy all segments, in sequence, into contiguous array
 */
@@ -54,13 +45,27 @@ bool opj_min_buf_vec_copy_to_contiguous_buffer(opj_vec_t* min_buf_vec, uint8_t*
 /*
 Push buffer to back of min buf vector
 */
-bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint16_t len);
+bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint32_t len);
 
 /*
 Sum lengths of all buffers
 */
 
-uint16_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec);
+size_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec);
+
+/*
+Get the buffers holding the next code block segment, of length seg_len.
+Tier 2 pushes one buffer per segment contribution, so a segment is a run of
+whole buffers, which can be decoded in place.
+index is the first buffer of the segment on input, and the first buffer of
+the following segment on output.
+Returns false if the buffers do not add up to seg_len.
+*/
+bool opj_min_buf_vec_get_segment(opj_vec_t* min_buf_vec,
+								uint32_t seg_len,
+								uint32_t* index,
+								const opj_min_buf_t** pieces,
+								uint32_t* num_pieces);
 
 
 /*
@@ -93,6 +98,11 @@ Wrap existing array and add to the back of the segmented buffer.
 */
 bool opj_seg_buf_push_back(opj_seg_buf_t* seg_buf, uint8_t* buf, size_t len);
 
+/*
+Replace all segments with a single segment wrapping an existing array
+*/
+bool opj_seg_buf_wrap(opj_seg_buf_t* seg_buf, uint8_t* buf, size_t len);
+
 /*
 Allocate array and add to the back of the segmented buffer
 */
@@ -97,12 +97,14 @@ static inline void opj_t1_dec_sigpass_step_raw(
     int32_t vsc);
 static inline void opj_t1_dec_sigpass_step_mqc(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t orient,
     int32_t oneplushalf);
 static inline void opj_t1_dec_sigpass_step_mqc_vsc(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t orient,
@@ -188,12 +190,14 @@ static inline void  opj_t1_dec_refpass_step_raw(
     int32_t vsc);
 static inline void opj_t1_dec_refpass_step_mqc(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t poshalf,
     int32_t neghalf);
 static inline void opj_t1_dec_refpass_step_mqc_vsc(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t poshalf,
@@ -218,20 +222,23 @@ static void opj_t1_enc_clnpass_step(
 /**
 Decode clean-up pass
 */
-static void opj_t1_dec_clnpass_step_partial(
+static inline void opj_t1_dec_clnpass_step_partial(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t orient,
     int32_t oneplushalf);
-static void opj_t1_dec_clnpass_step(
+static inline void opj_t1_dec_clnpass_step(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t orient,
     int32_t oneplushalf);
-static void opj_t1_dec_clnpass_step_vsc(
+static inline void opj_t1_dec_clnpass_step_vsc(
     opj_t1_t *t1,
+    opj_mqc_dec_t *mqc,
     opj_flag_t *flagsp,
     int32_t *datap,
     int32_t orient,
@@ -384,6 +391,7 @@ static inline void opj_t1_dec_sigpass_step_raw( opj_t1_t *t1,
 }
 
 static inline void opj_t1_dec_sigpass_step_mqc( opj_t1_t *t1,
+												opj_mqc_dec_t *mqc,
 												opj_flag_t *flagsp,
 												int32_t *datap,
 												int32_t orient,
@@ -392,14 +400,12 @@ static inline void opj_t1_dec_sigpass_step_mqc( opj_t1_t *t1,
     int32_t flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;       
-
     flag = *flagsp;
     if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
-        if (opj_mqc_decode(mqc)) {
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
-            v = opj_mqc_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
+        if (opj_mqc_dec_decode(mqc)) {
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
+            v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
             *datap = v ? -oneplushalf : oneplushalf;
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
@@ -408,6 +414,7 @@ static inline void opj_t1_dec_sigpass_step_mqc( opj_t1_t *t1,
 }      
 
 static inline void opj_t1_dec_sigpass_step_mqc_vsc( opj_t1_t *t1,
+													opj_mqc_dec_t *mqc,
 													opj_flag_t *flagsp,
 													int32_t *datap,
 													int32_t orient,
@@ -417,14 +424,12 @@ static inline void opj_t1_dec_sigpass_step_mqc_vsc( opj_t1_t *t1,
     int32_t flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;     
-
     flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
     if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
-        if (opj_mqc_decode(mqc)) {
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
-            v = opj_mqc_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
+        if (opj_mqc_dec_decode(mqc)) {
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
+            v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
             *datap = v ? -oneplushalf : oneplushalf;
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
@@ -496,6 +501,9 @@ static void opj_t1_dec_sigpass_mqc(  opj_t1_t *t1,
 									int32_t bpno,
 									int32_t orient)
 {
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+    opj_mqc_dec_load(mqc, t1->mqc);
     int32_t one, half, oneplushalf;
     uint32_t i, j, k;
     int32_t *data1 = t1->data;
@@ -505,39 +513,45 @@ static void opj_t1_dec_sigpass_mqc(  opj_t1_t *t1,
     oneplushalf = one | half;
     for (k = 0; k < (t1->h & ~3u); k += 4) {
         for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
             int32_t *data2 = data1 + i;
             opj_flag_t *flags2 = flags1 + i;
             flags2 += t1->flags_stride;
-            opj_t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+            opj_t1_dec_sigpass_step_mqc(t1, mqc, flags2, data2, orient, oneplushalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+            opj_t1_dec_sigpass_step_mqc(t1, mqc, flags2, data2, orient, oneplushalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+            opj_t1_dec_sigpass_step_mqc(t1, mqc, flags2, data2, orient, oneplushalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+            opj_t1_dec_sigpass_step_mqc(t1, mqc, flags2, data2, orient, oneplushalf);
             data2 += t1->w;
         }
         data1 += (size_t)t1->w << 2;
         flags1 += (size_t)t1->flags_stride << 2;
     }
     for (i = 0; i < t1->w; ++i) {
+        opj_mqc_dec_check_window(mqc);
         int32_t *data2 = data1 + i;
         opj_flag_t *flags2 = flags1 + i;
         for (j = k; j < t1->h; ++j) {
             flags2 += t1->flags_stride;
-            opj_t1_dec_sigpass_step_mqc(t1, flags2, data2, orient, oneplushalf);
+            opj_t1_dec_sigpass_step_mqc(t1, mqc, flags2, data2, orient, oneplushalf);
             data2 += t1->w;
         }
     }
+    opj_mqc_dec_store(mqc, t1->mqc);
 }                              
 
 static void opj_t1_dec_sigpass_mqc_vsc( opj_t1_t *t1,
 										int32_t bpno,
 										int32_t orient)
 {
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+    opj_mqc_dec_load(mqc, t1->mqc);
     int32_t one, half, oneplushalf, vsc;
     uint32_t i, j, k;
     one = 1 << bpno;
@@ -545,10 +559,11 @@ static void opj_t1_dec_sigpass_mqc_vsc( opj_t1_t *t1,
     oneplushalf = one | half;
     for (k = 0; k < t1->h; k += 4) {
         for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
             for (j = k; j < k + 4 && j < t1->h; ++j) {
                 vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
                 opj_t1_dec_sigpass_step_mqc_vsc(
-                    t1,
+                    t1, mqc,
                     &t1->flags[((j+1) * t1->flags_stride) + i + 1],
                     &t1->data[(j * t1->w) + i],
                     orient,
@@ -557,6 +572,7 @@ static void opj_t1_dec_sigpass_mqc_vsc( opj_t1_t *t1,
             }
         }
     }
+    opj_mqc_dec_store(mqc, t1->mqc);
 }                          
 
 
@@ -610,6 +626,7 @@ static inline void opj_t1_dec_refpass_step_raw( opj_t1_t *t1,
 }                               
 
 static inline void opj_t1_dec_refpass_step_mqc( opj_t1_t *t1,
+												opj_mqc_dec_t *mqc,
 												opj_flag_t *flagsp,
 												int32_t *datap,
 												int32_t poshalf,
@@ -618,12 +635,10 @@ static inline void opj_t1_dec_refpass_step_mqc( opj_t1_t *t1,
     int32_t t, flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;       
-
     flag = *flagsp;
     if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_mag((uint32_t)flag));      
-        v = opj_mqc_decode(mqc);
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_mag((uint32_t)flag));      
+        v = opj_mqc_dec_decode(mqc);
         t = v ? poshalf : neghalf;
         *datap += *datap < 0 ? -t : t;
         *flagsp |= T1_REFINE;
@@ -631,6 +646,7 @@ static inline void opj_t1_dec_refpass_step_mqc( opj_t1_t *t1,
 }                               
 
 static inline void opj_t1_dec_refpass_step_mqc_vsc( opj_t1_t *t1,
+													opj_mqc_dec_t *mqc,
 													opj_flag_t *flagsp,
 													int32_t *datap,
 													int32_t poshalf,
@@ -640,12 +656,10 @@ static inline void opj_t1_dec_refpass_step_mqc_vsc( opj_t1_t *t1,
     int32_t t, flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;       
-
     flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
     if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_mag((uint32_t)flag));      
-        v = opj_mqc_decode(mqc);
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_mag((uint32_t)flag));      
+        v = opj_mqc_dec_decode(mqc);
         t = v ? poshalf : neghalf;
         *datap += *datap < 0 ? -t : t;
         *flagsp |= T1_REFINE;
@@ -710,6 +724,9 @@ static void opj_t1_dec_refpass_raw( opj_t1_t *t1,
 
 static void opj_t1_dec_refpass_mqc( opj_t1_t *t1,
 									int32_t bpno){
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+    opj_mqc_dec_load(mqc, t1->mqc);
     int32_t one, poshalf, neghalf;
     uint32_t i, j, k;
     int32_t *data1 = t1->data;
@@ -719,37 +736,43 @@ static void opj_t1_dec_refpass_mqc( opj_t1_t *t1,
     neghalf = bpno > 0 ? -poshalf : -1;
     for (k = 0; k < (t1->h & ~3u); k += 4) {
         for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
             int32_t *data2 = data1 + i;
             opj_flag_t *flags2 = flags1 + i;
             flags2 += t1->flags_stride;
-            opj_t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+            opj_t1_dec_refpass_step_mqc(t1, mqc, flags2, data2, poshalf, neghalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+            opj_t1_dec_refpass_step_mqc(t1, mqc, flags2, data2, poshalf, neghalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+            opj_t1_dec_refpass_step_mqc(t1, mqc, flags2, data2, poshalf, neghalf);
             data2 += t1->w;
             flags2 += t1->flags_stride;
-            opj_t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+            opj_t1_dec_refpass_step_mqc(t1, mqc, flags2, data2, poshalf, neghalf);
             data2 += t1->w;
         }
         data1 += (size_t)t1->w << 2;
         flags1 += (size_t)t1->flags_stride << 2;
     }
     for (i = 0; i < t1->w; ++i) {
+        opj_mqc_dec_check_window(mqc);
         int32_t *data2 = data1 + i;
         opj_flag_t *flags2 = flags1 + i;
         for (j = k; j < t1->h; ++j) {
             flags2 += t1->flags_stride;
-            opj_t1_dec_refpass_step_mqc(t1, flags2, data2, poshalf, neghalf);
+            opj_t1_dec_refpass_step_mqc(t1, mqc, flags2, data2, poshalf, neghalf);
             data2 += t1->w;
         }
     }
+    opj_mqc_dec_store(mqc, t1->mqc);
 }                               
 
 static void opj_t1_dec_refpass_mqc_vsc(opj_t1_t *t1,
 										int32_t bpno){
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+    opj_mqc_dec_load(mqc, t1->mqc);
     int32_t one, poshalf, neghalf;
     uint32_t i, j, k;
     int32_t vsc;
@@ -758,10 +781,11 @@ static void opj_t1_dec_refpass_mqc_vsc(opj_t1_t *t1,
     neghalf = bpno > 0 ? -poshalf : -1;
     for (k = 0; k < t1->h; k += 4) {
         for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
             for (j = k; j < k + 4 && j < t1->h; ++j) {
                 vsc = ((j == k + 3 || j == t1->h - 1)) ? 1 : 0;
                 opj_t1_dec_refpass_step_mqc_vsc(
-                    t1,
+                    t1, mqc,
                     &t1->flags[((j+1) * t1->flags_stride) + i + 1],
                     &t1->data[(j * t1->w) + i],
                     poshalf,
@@ -770,6 +794,7 @@ static void opj_t1_dec_refpass_mqc_vsc(opj_t1_t *t1,
             }
         }
     }
+    opj_mqc_dec_store(mqc, t1->mqc);
 }                               
 
 
@@ -807,26 +832,27 @@ LABEL_PARTIAL:
     *flagsp &= ~T1_VISIT;
 }
 
-static void opj_t1_dec_clnpass_step_partial( opj_t1_t *t1,
+static inline void opj_t1_dec_clnpass_step_partial( opj_t1_t *t1,
+											opj_mqc_dec_t *mqc,
 											opj_flag_t *flagsp,
 											int32_t *datap,
 											int32_t orient,
 											int32_t oneplushalf){
     int32_t flag;
 	uint8_t v;
-    opj_mqc_t *mqc = t1->mqc;	
 
     OPJ_ARG_NOT_USED(orient);
 
     flag = *flagsp;
-    opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
-    v = opj_mqc_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
+    opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
+    v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
     *datap = v ? -oneplushalf : oneplushalf;
     opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
     *flagsp &= ~T1_VISIT;
 }				
 
-static void opj_t1_dec_clnpass_step(opj_t1_t *t1,
+static inline void opj_t1_dec_clnpass_step(opj_t1_t *t1,
+									opj_mqc_dec_t *mqc,
 									opj_flag_t *flagsp,
 									int32_t *datap,
 									int32_t orient,
@@ -834,14 +860,12 @@ static void opj_t1_dec_clnpass_step(opj_t1_t *t1,
     int32_t flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;	
-
     flag = *flagsp;
     if (!(flag & (T1_SIG | T1_VISIT))) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
-        if (opj_mqc_decode(mqc)) {
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
-            v = opj_mqc_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
+        if (opj_mqc_dec_decode(mqc)) {
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
+            v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
             *datap = v ? -oneplushalf : oneplushalf;
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
@@ -849,7 +873,8 @@ static void opj_t1_dec_clnpass_step(opj_t1_t *t1,
     *flagsp &= ~T1_VISIT;
 }				
 
-static void opj_t1_dec_clnpass_step_vsc( opj_t1_t *t1,
+static inline void opj_t1_dec_clnpass_step_vsc( opj_t1_t *t1,
+										opj_mqc_dec_t *mqc,
 										opj_flag_t *flagsp,
 										int32_t *datap,
 										int32_t orient,
@@ -859,18 +884,16 @@ static void opj_t1_dec_clnpass_step_vsc( opj_t1_t *t1,
     int32_t flag;
 	uint8_t v;
 
-    opj_mqc_t *mqc = t1->mqc;	
-
     flag = vsc ? ((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (*flagsp);
     if (partial) {
         goto LABEL_PARTIAL;
     }
     if (!(flag & (T1_SIG | T1_VISIT))) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
-        if (opj_mqc_decode(mqc)) {
+        opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc((uint32_t)flag, (uint32_t)orient));
+        if (opj_mqc_dec_decode(mqc)) {
 LABEL_PARTIAL:
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
-            v = opj_mqc_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc((uint32_t)flag));
+            v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb((uint32_t)flag);
             *datap = v ? -oneplushalf : oneplushalf;
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
@@ -951,7 +974,9 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
     uint32_t i, j, k;
     int32_t segsym = cblksty & J2K_CCP_CBLKSTY_SEGSYM;
 
-    opj_mqc_t *mqc = t1->mqc;	
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+    opj_mqc_dec_load(mqc, t1->mqc);
 
     one = 1 << bpno;
     half = one >> 1;
@@ -959,6 +984,7 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
     if (cblksty & J2K_CCP_CBLKSTY_VSC) {
         for (k = 0; k < t1->h; k += 4) {
             for (i = 0; i < t1->w; ++i) {
+                opj_mqc_dec_check_window(mqc);
                 if (k + 3 < t1->h) {
                     agg = !(MACRO_t1_flags(1 + k,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
                             || MACRO_t1_flags(1 + k + 1,1 + i) & (T1_SIG | T1_VISIT | T1_SIG_OTH)
@@ -969,20 +995,20 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
                     agg = 0;
                 }
                 if (agg) {
-                    opj_mqc_setcurctx(mqc, T1_CTXNO_AGG);
-                    if (!opj_mqc_decode(mqc)) {
+                    opj_mqc_dec_setcurctx(mqc, T1_CTXNO_AGG);
+                    if (!opj_mqc_dec_decode(mqc)) {
                         continue;
                     }
-                    opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
-                    runlen = opj_mqc_decode(mqc);
-                    runlen = (runlen << 1) | opj_mqc_decode(mqc);
+                    opj_mqc_dec_setcurctx(mqc, T1_CTXNO_UNI);
+                    runlen = opj_mqc_dec_decode(mqc);
+                    runlen = (runlen << 1) | opj_mqc_dec_decode(mqc);
                 } else {
                     runlen = 0;
                 }
                 for (j = k + (uint32_t)runlen; j < k + 4 && j < t1->h; ++j) {
                     vsc = (j == k + 3 || j == t1->h - 1) ? 1 : 0;
                     opj_t1_dec_clnpass_step_vsc(
-                        t1,
+                        t1, mqc,
                         &t1->flags[((j+1) * t1->flags_stride) + i + 1],
                         &t1->data[(j * t1->w) + i],
                         orient,
@@ -997,6 +1023,7 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
         opj_flag_t *flags1 = &t1->flags[1];
         for (k = 0; k < (t1->h & ~3u); k += 4) {
             for (i = 0; i < t1->w; ++i) {
+                opj_mqc_dec_check_window(mqc);
                 int32_t *data2 = data1 + i;
                 opj_flag_t *flags2 = flags1 + i;
                 agg = !((MACRO_t1_flags(1 + k, 1 + i) |
@@ -1004,36 +1031,36 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
                          MACRO_t1_flags(1 + k + 2, 1 + i) |
                          MACRO_t1_flags(1 + k + 3, 1 + i)) & (T1_SIG | T1_VISIT | T1_SIG_OTH));
                 if (agg) {
-                    opj_mqc_setcurctx(mqc, T1_CTXNO_AGG);
-                    if (!opj_mqc_decode(mqc)) {
+                    opj_mqc_dec_setcurctx(mqc, T1_CTXNO_AGG);
+                    if (!opj_mqc_dec_decode(mqc)) {
                         continue;
                     }
-                    opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
-                    runlen = opj_mqc_decode(mqc);
-                    runlen = (runlen << 1) | opj_mqc_decode(mqc);
+                    opj_mqc_dec_setcurctx(mqc, T1_CTXNO_UNI);
+                    runlen = opj_mqc_dec_decode(mqc);
+                    runlen = (runlen << 1) | opj_mqc_dec_decode(mqc);
                     flags2 += (uint32_t)runlen * t1->flags_stride;
                     data2 += (uint32_t)runlen * t1->w;
                     for (j = (uint32_t)runlen; j < 4 && j < t1->h; ++j) {
                         flags2 += t1->flags_stride;
                         if (agg && (j == (uint32_t)runlen)) {
-                            opj_t1_dec_clnpass_step_partial(t1, flags2, data2, orient, oneplushalf);
+                            opj_t1_dec_clnpass_step_partial(t1, mqc, flags2, data2, orient, oneplushalf);
                         } else {
-                            opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                            opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                         }
                         data2 += t1->w;
                     }
                 } else {
                     flags2 += t1->flags_stride;
-                    opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                    opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                     data2 += t1->w;
                     flags2 += t1->flags_stride;
-                    opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                    opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                     data2 += t1->w;
                     flags2 += t1->flags_stride;
-                    opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                    opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                     data2 += t1->w;
                     flags2 += t1->flags_stride;
-                    opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                    opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                     data2 += t1->w;
                 }
             }
@@ -1041,11 +1068,12 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
             flags1 += (size_t)t1->flags_stride << 2;
         }
         for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
             int32_t *data2 = data1 + i;
             opj_flag_t *flags2 = flags1 + i;
             for (j = k; j < t1->h; ++j) {
                 flags2 += t1->flags_stride;
-                opj_t1_dec_clnpass_step(t1, flags2, data2, orient, oneplushalf);
+                opj_t1_dec_clnpass_step(t1, mqc, flags2, data2, orient, oneplushalf);
                 data2 += t1->w;
             }
         }
@@ -1053,17 +1081,19 @@ static void opj_t1_dec_clnpass( opj_t1_t *t1,
 
     if (segsym) {
         uint8_t v = 0;
-        opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
-        v = opj_mqc_decode(mqc);
-        v = (v << 1) | opj_mqc_decode(mqc);
-        v = (v << 1) | opj_mqc_decode(mqc);
-        v = (v << 1) | opj_mqc_decode(mqc);
+        opj_mqc_dec_setcurctx(mqc, T1_CTXNO_UNI);
+        opj_mqc_dec_check_window(mqc);
+        v = opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
         /*
         if (v!=0xa) {
         	opj_event_msg(t1->cinfo, EVT_WARNING, "Bad segmentation symbol %x\n", v);
         }
         */
     }
+    opj_mqc_dec_store(mqc, t1->mqc);
 }				
 
 double opj_t1_getwmsedec(  int32_t nmsedec,
@@ -1142,7 +1172,7 @@ bool opj_t1_allocate_buffers(opj_t1_t *t1,
  * and initializes the look-up tables of the Tier-1 coder/decoder
  * @return a new T1 handle if successful, returns NULL otherwise
 */
-opj_t1_t* opj_t1_create(bool isEncoder, uint16_t code_block_width, uint16_t code_block_height){
+opj_t1_t* opj_t1_create(bool isEncoder){
     opj_t1_t *l_t1 = nullptr;
 
     l_t1 = (opj_t1_t*) opj_calloc(1,sizeof(opj_t1_t));
@@ -1163,15 +1193,6 @@ opj_t1_t* opj_t1_create(bool isEncoder, uint16_t code_block_width, uint16_t code
         return nullptr;
     }
 
-    if (!isEncoder && code_block_width > 0 && code_block_height > 0) {
-        l_t1->compressed_block = (uint8_t*)opj_malloc((size_t)code_block_width * (size_t)code_block_height);
-        if (!l_t1->compressed_block) {
-            opj_t1_destroy(l_t1);
-            return nullptr;
-        }
-        l_t1->compressed_block_size = (size_t)(code_block_width * code_block_height);
-
-    }
     l_t1->encoder = isEncoder;
 
     return l_t1;
@@ -1204,14 +1225,13 @@ void opj_t1_destroy(opj_t1_t *p_t1){
         opj_aligned_free(p_t1->flags);
         p_t1->flags = nullptr;
     }
-    if (p_t1->compressed_block)
-        opj_free(p_t1->compressed_block);
     opj_free(p_t1);
 }
 
 bool opj_t1_prepare_decode_cblks(  opj_tcd_tilecomp_t* tilec,
                            opj_tccp_t* tccp,
 						   std::vector<decodeBlockInfo*>* blocks,
+						   opj_arena_t* arena,
                            opj_event_mgr_t * p_manager)
 {
     uint32_t resno, bandno, precno;
@@ -1227,25 +1247,19 @@ bool opj_t1_prepare_decode_cblks(  opj_tcd_tilecomp_t* tilec,
         for (bandno = 0; bandno < res->numbands; ++bandno) {
             opj_tcd_band_t* restrict band = &res->bands[bandno];
 
-            for (precno = 0; precno < res->pw * res->ph; ++precno) {
+            /* only visit the precincts and code blocks that overlap the decode region */
+            for (uint32_t py = band->win_py0; py < band->win_py1; ++py) {
+              for (uint32_t px = band->win_px0; px < band->win_px1; ++px) {
+                precno = px + py * res->pw;
                 opj_tcd_precinct_t* precinct = &band->precincts[precno];
-                int32_t cblkno;
-                    for (cblkno = 0; cblkno < (int32_t)(precinct->cw * precinct->ch); ++cblkno) {
-                        rect_t cblk_rect;
-                        opj_tcd_cblk_dec_t* cblk = &precinct->cblks.dec[cblkno];
+                for (uint32_t cy = precinct->win_cy0; cy < precinct->win_cy1; ++cy) {
+                    for (uint32_t cx = precinct->win_cx0; cx < precinct->win_cx1; ++cx) {
+                        opj_tcd_cblk_dec_t* cblk = &precinct->cblks.dec[cx + cy * precinct->cw];
                         int32_t x, y;		/* relative code block offset */
                         /* get code block offset relative to band*/
                         x = cblk->x0;
                         y = cblk->y0;
 
-                        /* check if block overlaps with decode region */
-						cblk_rect= rect_t(x, y, x + (1<< tccp->cblkw), y + (1<<tccp->cblkh));
-
-
-                        if (!opj_tile_buf_hit_test(tilec->buf, &cblk_rect))
-                            continue;
-
-
                         x -= band->x0;
                         y -= band->y0;
 
@@ -1259,7 +1273,12 @@ bool opj_t1_prepare_decode_cblks(  opj_tcd_tilecomp_t* tilec,
                             y += pres->y1 - pres->y0;
                         }
 
-						auto block = new decodeBlockInfo();
+						void* mem = opj_arena_alloc(arena, sizeof(decodeBlockInfo));
+						if (!mem) {
+							opj_event_msg(p_manager, EVT_ERROR, "Not enough memory for code blocks\n");
+							return false;
+						}
+						auto block = new (mem) decodeBlockInfo();
 						block->bandno = band->bandno;
 						block->cblk = cblk;
 						block->cblksty = tccp->cblksty;
@@ -1273,8 +1292,10 @@ bool opj_t1_prepare_decode_cblks(  opj_tcd_tilecomp_t* tilec,
 						block->tiledp = opj_tile_buf_get_ptr(tilec->buf, resno, bandno, (uint32_t)x, (uint32_t)y);
 						blocks->push_back(block);
 
-                    } /* cblkno */
-            } /* precno */
+                    } /* cx */
+                } /* cy */
+              } /* px */
+            } /* py */
         } /* bandno */
     } /* resno */
     return rc;
@@ -1294,8 +1315,7 @@ bool opj_t1_decode_cblk(opj_t1_t *t1,
     uint32_t passtype;
     uint32_t segno, passno;
     uint8_t type = T1_TYPE_MQ; /* BYPASS mode */
-    uint8_t* block_buffer = NULL;
-    size_t total_seg_len;
+    uint32_t piece_index = 0;
 
     if(!opj_t1_allocate_buffers(
                 t1,
@@ -1304,30 +1324,8 @@ bool opj_t1_decode_cblk(opj_t1_t *t1,
         return false;
     }
 
-    total_seg_len = opj_min_buf_vec_get_len(&cblk->seg_buffers);
-    if (cblk->numSegments && total_seg_len) {
-        /* if there is only one segment, then it is already contiguous, so no need to make a copy*/
-        if (total_seg_len == 1 && cblk->seg_buffers.get(0)) {
-            block_buffer = ((opj_buf_t*)(cblk->seg_buffers.get(0)))->buf;
-        } else {
-            /* block should have been allocated on creation of t1*/
-            if (!t1->compressed_block)
-                return false;
-            if (t1->compressed_block_size < total_seg_len) {
-                uint8_t* new_block = (uint8_t*)opj_realloc(t1->compressed_block, total_seg_len);
-                if (!new_block)
-                    return false;
-                t1->compressed_block = new_block;
-                t1->compressed_block_size = total_seg_len;
-            }
-            opj_min_buf_vec_copy_to_contiguous_buffer(&cblk->seg_buffers, t1->compressed_block);
-            block_buffer = t1->compressed_block;
-        }
-    } else {
+    if (!cblk->numSegments || !opj_min_buf_vec_get_len(&cblk->seg_buffers))
         return true;
-    }
-
-
 
     bpno_plus_one = (int32_t)(roishift + cblk->numbps);
     passtype = 2;
@@ -1335,14 +1333,20 @@ bool opj_t1_decode_cblk(opj_t1_t *t1,
     opj_mqc_resetstates(mqc);
     for (segno = 0; segno < cblk->numSegments; ++segno) {
         opj_tcd_seg_t *seg = &cblk->segs[segno];
+        const opj_min_buf_t* pieces = NULL;
+        uint32_t num_pieces = 0;
+
+        /* the segment is decoded in place, from the buffers filled in by tier 2 */
+        if (!opj_min_buf_vec_get_segment(&cblk->seg_buffers, seg->len, &piece_index, &pieces, &num_pieces))
+            break;
 
         /* BYPASS mode */
         type = ((bpno_plus_one <= ((int32_t) (cblk->numbps)) - 4) && (passtype < 2) && (cblksty & J2K_CCP_CBLKSTY_LAZY)) ? T1_TYPE_RAW : T1_TYPE_MQ;
         if (type == T1_TYPE_RAW) {
-            opj_raw_init_dec(raw, block_buffer + seg->dataindex, seg->len);
+            opj_raw_init_dec(raw, pieces, num_pieces);
 		}
 		else {
-			opj_mqc_init_dec(mqc, block_buffer + seg->dataindex, seg->len);
+			opj_mqc_init_dec(mqc, pieces, num_pieces);
 		}
 
         for (passno = 0; (passno < seg->numpasses) && (bpno_plus_one >= 1); ++passno) {
@@ -1393,7 +1397,9 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
                             opj_tcp_t *tcp,
                             const double * mct_norms,
                             uint32_t mct_numcomps,
-							uint32_t numThreads )
+							uint32_t numThreads,
+							uint64_t max_bytes,
+							opj_arena_t* arena)
 {
     bool do_opt = true;
     uint32_t compno, resno, bandno, precno;
@@ -1443,7 +1449,10 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
 
 						maxCblkW = opj_max<int32_t>(maxCblkW, 1 << tccp->cblkw);
 						maxCblkH = opj_max<int32_t>(maxCblkH, 1 << tccp->cblkh);
-						auto block = new encodeBlockInfo();
+						void* mem = opj_arena_alloc(arena, sizeof(encodeBlockInfo));
+						if (!mem)
+							return false;
+						auto block = new (mem) encodeBlockInfo();
 						block->compno = compno;
 						block->bandno = band->bandno;
 						block->cblk = cblk;
@@ -1471,7 +1480,8 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
 							&blocks,
 							maxCblkW,
 							maxCblkH,
-							numThreads);
+							numThreads,
+							max_bytes);
 	
 }
 
@@ -1510,8 +1520,11 @@ double opj_t1_encode_cblk(opj_t1_t *t1,
 
 	auto logMax = opj_int_floorlog2((int32_t)max) + 1;
 	cblk->numbps = (max && (logMax > T1_NMSEDEC_FRACBITS)) ? (uint32_t)(logMax - T1_NMSEDEC_FRACBITS) : 0;
-	if (!cblk->numbps)
+	if (!cblk->numbps) {
+		/* code blocks are re-used across tiles, so clear passes from a previous tile */
+		cblk->num_passes_encoded = 0;
 		return 0;
+	}
 
     bpno = (int32_t)(cblk->numbps - 1);
     passtype = 2;
@@ -193,8 +193,6 @@ in T1.C are used by some function in TCD.C.
 typedef uint16_t opj_flag_t;
 
 typedef struct opj_t1 {
-	uint8_t* compressed_block;
-	size_t compressed_block_size;
 	/** MQC component */
 	opj_mqc_t *mqc;
 	/** RAW component */
@@ -223,12 +221,18 @@ Encode the code-blocks of a tile
 @param tcp Tile coding parameters
 @param mct_norms  FIXME DOC
 @param mct_numcomps Number of components used for MCT
+@param numThreads Number of encoding threads
+@param max_bytes If non-zero, byte budget of the final layer, used to skip coding passes
+that would be discarded by rate control
+@param arena Tile-scoped arena holding the code block descriptions
 */
 bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
                             opj_tcp_t *tcp,
                             const double * mct_norms,
                             uint32_t mct_numcomps,
-							uint32_t numThreads);
+							uint32_t numThreads,
+							uint64_t max_bytes,
+							opj_arena_t* arena);
 
 
 double opj_t1_encode_cblk(opj_t1_t *t1,
@@ -249,10 +253,13 @@ double opj_t1_encode_cblk(opj_t1_t *t1,
 Decode the code-blocks of a tile
 @param tilec The tile to decode
 @param tccp Tile coding parameters
+@param blocks Receives the code blocks to decode
+@param arena Tile-scoped arena holding the code block descriptions
 */
 bool opj_t1_prepare_decode_cblks(   opj_tcd_tilecomp_t* tilec,
                             opj_tccp_t* tccp,
 							std::vector<decodeBlockInfo*>* blocks,
+							opj_arena_t* arena,
                             opj_event_mgr_t * p_manager);
 
 
@@ -294,7 +301,7 @@ int16_t opj_t1_getnmsedec_ref(uint32_t x, uint32_t bitpos);
 * and initializes the look-up tables of the Tier-1 coder/decoder
 * @return a new T1 handle if successful, returns NULL otherwise
 */
-opj_t1_t* opj_t1_create(bool isEncoder, uint16_t code_block_width, uint16_t code_block_height);
+opj_t1_t* opj_t1_create(bool isEncoder);
 
 /**
 * Destroys a previously created T1 handle
@@ -135,6 +135,60 @@ static void opj_t1_enc_clnpass(
     uint32_t orient,
     int32_t *nmsedec);
 
+/**
+Decode significant pass
+*/
+static inline void opj_t1_dec_sigpass_step(opj_t1_opt_t *t1,
+											opj_mqc_dec_t *mqc,
+											opj_flag_opt_t *flagsp,
+											int32_t *datap,
+											uint32_t orient,
+											int32_t oneplushalf);
+
+/**
+Decode significant pass
+*/
+static void opj_t1_dec_sigpass(opj_t1_opt_t *t1,
+								int32_t bpno,
+								uint32_t orient);
+
+/**
+Decode refinement pass
+*/
+static inline void opj_t1_dec_refpass_step(opj_t1_opt_t *t1,
+											opj_mqc_dec_t *mqc,
+											opj_flag_opt_t *flagsp,
+											int32_t *datap,
+											int32_t poshalf,
+											int32_t neghalf);
+
+/**
+Decode refinement pass
+*/
+static void opj_t1_dec_refpass(opj_t1_opt_t *t1,
+								int32_t bpno);
+
+/**
+Decode clean-up pass
+*/
+static inline void opj_t1_dec_clnpass_step(opj_t1_opt_t *t1,
+									opj_mqc_dec_t *mqc,
+									opj_flag_opt_t *flagsp,
+									int32_t *datap,
+									uint32_t orient,
+									int32_t oneplushalf,
+									uint32_t agg,
+									uint32_t runlen,
+									uint32_t y);
+
+/**
+Decode clean-up pass
+*/
+static void opj_t1_dec_clnpass(opj_t1_opt_t *t1,
+								int32_t bpno,
+								uint32_t orient,
+								uint32_t cblksty);
+
 /**
 * Creates a new Tier 1 handle
 * and initializes the look-up tables of the Tier-1 coder/decoder
@@ -185,7 +239,6 @@ void opj_t1_opt_destroy(opj_t1_opt_t *p_t1){
         opj_aligned_free(p_t1->flags);
         p_t1->flags = nullptr;
     }
-
     opj_free(p_t1);
 }
 
@@ -553,6 +606,239 @@ static void opj_t1_enc_clnpass( opj_t1_opt_t *t1,
 }
 
 
+static inline void opj_t1_dec_sigpass_step(opj_t1_opt_t *t1,
+											opj_mqc_dec_t *mqc,
+											opj_flag_opt_t *flagsp,
+											int32_t *datap,
+											uint32_t orient,
+											int32_t oneplushalf)
+{
+    uint32_t ci;
+    uint8_t v;
+
+    if (*flagsp == 0U) {
+        return;  /* Nothing to do for any of the 4 data points */
+    }
+    for (ci = 0U; ci < 4U; ++ci) {
+        uint32_t const shift_flags = *flagsp >> (ci * 3U);
+        /* if location is not significant, has not been coded in significance pass, and is in preferred neighbourhood,
+        then decode in this pass: */
+        if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == 0U && (shift_flags & T1_SIGMA_NEIGHBOURS) != 0U) {
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc_opt(shift_flags, orient));
+            if (opj_mqc_dec_decode(mqc)) {
+                opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci);
+                *datap = v ? -oneplushalf : oneplushalf;
+                opj_t1_updateflags_opt(flagsp, ci, v, t1->flags_stride);
+            }
+            /* set propagation pass bit for this location */
+            *flagsp |= T1_PI_THIS << (ci * 3U);
+        }
+        datap += t1->w;
+    }
+}
+
+static void opj_t1_dec_sigpass(opj_t1_opt_t *t1,
+								int32_t bpno,
+								uint32_t orient)
+{
+    uint32_t i, k;
+    int32_t const one = 1 << bpno;
+    int32_t const half = one >> 1;
+    int32_t const oneplushalf = one | half;
+    uint32_t const flag_row_extra = t1->flags_stride - t1->w;
+    uint32_t const data_row_extra = (t1->w << 2) - t1->w;
+
+    opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
+    int32_t* d = (int32_t*)t1->data;
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+
+    opj_mqc_dec_load(mqc, t1->mqc);
+    for (k = 0; k < t1->h; k += 4) {
+        for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
+            opj_t1_dec_sigpass_step(t1, mqc, f, d, orient, oneplushalf);
+            ++f;
+            ++d;
+        }
+        d += data_row_extra;
+        f += flag_row_extra;
+    }
+    opj_mqc_dec_store(mqc, t1->mqc);
+}
+
+static inline void opj_t1_dec_refpass_step(opj_t1_opt_t *t1,
+											opj_mqc_dec_t *mqc,
+											opj_flag_opt_t *flagsp,
+											int32_t *datap,
+											int32_t poshalf,
+											int32_t neghalf)
+{
+    uint32_t ci;
+    int32_t t;
+    uint8_t v;
+
+    if ((*flagsp & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13)) == 0) {
+        /* none significant */
+        return;
+    }
+    if ((*flagsp & (T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3)) == (T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3)) {
+        /* all processed by sigpass */
+        return;
+    }
+
+    for (ci = 0U; ci < 4U; ++ci) {
+        uint32_t shift_flags = *flagsp >> (ci * 3U);
+        /* if location is significant, but has not been coded in significance propagation pass, then decode in this pass: */
+        if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
+            opj_mqc_dec_setcurctx(mqc, (uint8_t)opj_t1_getctxno_mag_opt(shift_flags));
+            v = opj_mqc_dec_decode(mqc);
+            t = v ? poshalf : neghalf;
+            *datap += *datap < 0 ? -t : t;
+            /* flip magnitude refinement bit*/
+            *flagsp |= T1_MU_THIS << (ci * 3U);
+        }
+        datap += t1->w;
+    }
+}
+
+static void opj_t1_dec_refpass(opj_t1_opt_t *t1,
+								int32_t bpno)
+{
+    uint32_t i, k;
+    int32_t const one = 1 << bpno;
+    int32_t const poshalf = one >> 1;
+    int32_t const neghalf = bpno > 0 ? -poshalf : -1;
+    opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
+    uint32_t const flag_row_extra = t1->flags_stride - t1->w;
+    uint32_t const data_row_extra = (t1->w << 2) - t1->w;
+    int32_t* d = (int32_t*)t1->data;
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+
+    opj_mqc_dec_load(mqc, t1->mqc);
+    for (k = 0U; k < t1->h; k += 4U) {
+        for (i = 0U; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
+            opj_t1_dec_refpass_step(t1, mqc, f, d, poshalf, neghalf);
+            ++f;
+            ++d;
+        }
+        f += flag_row_extra;
+        d += data_row_extra;
+    }
+    opj_mqc_dec_store(mqc, t1->mqc);
+}
+
+static inline void opj_t1_dec_clnpass_step(opj_t1_opt_t *t1,
+									opj_mqc_dec_t *mqc,
+									opj_flag_opt_t *flagsp,
+									int32_t *datap,
+									uint32_t orient,
+									int32_t oneplushalf,
+									uint32_t agg,
+									uint32_t runlen,
+									uint32_t y)
+{
+    uint32_t ci;
+    uint8_t v;
+
+    uint32_t lim;
+    const uint32_t check = (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13 | T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
+
+    if ((*flagsp & check) == check) {
+        if (runlen == 0) {
+            *flagsp &= ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
+        } else if (runlen == 1) {
+            *flagsp &= ~(T1_PI_1 | T1_PI_2 | T1_PI_3);
+        } else if (runlen == 2) {
+            *flagsp &= ~(T1_PI_2 | T1_PI_3);
+        } else if (runlen == 3) {
+            *flagsp &= ~(T1_PI_3);
+        }
+        return;
+    }
+
+    lim = 4U < (t1->h - y) ? 4U : (t1->h - y);
+    for (ci = runlen; ci < lim; ++ci) {
+        opj_flag_opt_t shift_flags;
+        if ((agg != 0) && (ci == runlen)) {
+            goto LABEL_PARTIAL;
+        }
+
+        shift_flags = *flagsp >> (ci * 3U);
+
+        if (!(shift_flags & (T1_SIGMA_THIS | T1_PI_THIS))) {
+            opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_zc_opt(shift_flags, orient));
+            if (opj_mqc_dec_decode(mqc)) {
+LABEL_PARTIAL:
+                opj_mqc_dec_setcurctx(mqc, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                v = opj_mqc_dec_decode(mqc) ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci);
+                *datap = v ? -oneplushalf : oneplushalf;
+                opj_t1_updateflags_opt(flagsp, ci, v, t1->flags_stride);
+            }
+        }
+        *flagsp &= ~(T1_PI_0 << (3U * ci));
+        datap += t1->w;
+    }
+}
+
+static void opj_t1_dec_clnpass(opj_t1_opt_t *t1,
+								int32_t bpno,
+								uint32_t orient,
+								uint32_t cblksty)
+{
+    uint32_t i, k;
+    int32_t const one = 1 << bpno;
+    int32_t const half = one >> 1;
+    int32_t const oneplushalf = one | half;
+    uint32_t agg, runlen;
+    int32_t* data = (int32_t*)t1->data;
+    opj_mqc_dec_t dec;
+    opj_mqc_dec_t *mqc = &dec;
+
+    opj_mqc_dec_load(mqc, t1->mqc);
+    for (k = 0; k < t1->h; k += 4) {
+        for (i = 0; i < t1->w; ++i) {
+            opj_mqc_dec_check_window(mqc);
+            agg = !ENC_FLAGS(i, k);
+            if (agg) {
+                opj_mqc_dec_setcurctx(mqc, T1_CTXNO_AGG);
+                if (!opj_mqc_dec_decode(mqc)) {
+                    continue;
+                }
+                opj_mqc_dec_setcurctx(mqc, T1_CTXNO_UNI);
+                runlen = opj_mqc_dec_decode(mqc);
+                runlen = (runlen << 1) | opj_mqc_dec_decode(mqc);
+            } else {
+                runlen = 0;
+            }
+            opj_t1_dec_clnpass_step(
+                t1,
+                mqc,
+                ENC_FLAGS_ADDRESS(i, k),
+                data + ((k + runlen) * t1->w) + i,
+                orient,
+                oneplushalf,
+                agg,
+                runlen,
+                k);
+        }
+    }
+
+    if (cblksty & J2K_CCP_CBLKSTY_SEGSYM) {
+        uint8_t v = 0;
+        opj_mqc_dec_setcurctx(mqc, T1_CTXNO_UNI);
+        opj_mqc_dec_check_window(mqc);
+        v = opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
+        v = (v << 1) | opj_mqc_dec_decode(mqc);
+    }
+    opj_mqc_dec_store(mqc, t1->mqc);
+}
+
 bool opj_t1_opt_allocate_buffers(   opj_t1_opt_t *t1,
 									uint32_t cblkw,
 									uint32_t cblkh)
@@ -635,7 +921,8 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
                                uint32_t numcomps,
                                const double * mct_norms,
                                uint32_t mct_numcomps,
-                               uint32_t max){
+                               uint32_t max,
+                               double min_slope){
     double cumwmsedec = 0.0;
 
     opj_mqc_t *mqc = t1->mqc;
@@ -648,8 +935,11 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
 
 	auto logMax = opj_int_floorlog2((int32_t)max) + 1;
     cblk->numbps = (max && (logMax > T1_NMSEDEC_FRACBITS)) ? (uint32_t)(logMax - T1_NMSEDEC_FRACBITS) : 0;
-	if (!cblk->numbps)
+	if (!cblk->numbps) {
+		/* code blocks are re-used across tiles, so clear passes from a previous tile */
+		cblk->num_passes_encoded = 0;
 		return 0;
+	}
 
 	bool TERMALL = (cblksty & J2K_CCP_CBLKSTY_TERMALL) ? true : false;
 
@@ -693,12 +983,22 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
 				correction++;
 			pass->term = 0;
 		}
+		pass->distortiondec = cumwmsedec;
+		pass->rate = opj_mqc_numbytes(mqc) + correction;
+
         if (++passtype == 3) {
             passtype = 0;
             bpno--;
+			// passes of the next bit-plane are not worth coding if this
+			// bit-plane already falls below the expected rate threshold
+			if (min_slope > 0 && passno >= 2) {
+				opj_tcd_pass_t *first = &cblk->passes[passno - 2];
+				double dd = cumwmsedec - (passno > 2 ? (first - 1)->distortiondec : 0);
+				double dr = (double)pass->rate - (passno > 2 ? (first - 1)->rate : 0);
+				if (dr > 0 && dd < min_slope * dr)
+					bpno = -1;
+			}
         }
-		pass->distortiondec = cumwmsedec;
-		pass->rate = opj_mqc_numbytes(mqc) + correction;
 
 		if (bpno >= 0) {
 			if (pass->term) {
@@ -727,4 +1027,70 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
         pass->len = pass->rate - (passno == 0 ? 0 : cblk->passes[passno - 1].rate);
     }
 	return cumwmsedec;
-}
\ No newline at end of file
+}
+
+bool opj_t1_opt_can_decode(uint32_t cblksty)
+{
+	/* BYPASS needs raw decoding, and VSC masks the southern neighbours,
+	   neither of which is supported by the column flags decoder */
+	return !(cblksty & (J2K_CCP_CBLKSTY_LAZY | J2K_CCP_CBLKSTY_VSC));
+}
+
+bool opj_t1_opt_decode_cblk(opj_t1_opt_t *t1,
+							opj_tcd_cblk_dec_t* cblk,
+							uint32_t orient,
+							uint32_t roishift,
+							uint32_t cblksty)
+{
+	opj_mqc_t *mqc = t1->mqc;
+
+	int32_t bpno_plus_one;
+	uint32_t passtype;
+	uint32_t segno, passno;
+	uint32_t piece_index = 0;
+
+	opj_t1_opt_init_buffers(t1,
+		cblk->x1 - cblk->x0,
+		cblk->y1 - cblk->y0);
+
+	if (!cblk->numSegments || !opj_min_buf_vec_get_len(&cblk->seg_buffers))
+		return true;
+
+	bpno_plus_one = (int32_t)(roishift + cblk->numbps);
+	passtype = 2;
+
+	opj_mqc_resetstates(mqc);
+	for (segno = 0; segno < cblk->numSegments; ++segno) {
+		opj_tcd_seg_t *seg = &cblk->segs[segno];
+		const opj_min_buf_t* pieces = NULL;
+		uint32_t num_pieces = 0;
+
+		/* the segment is decoded in place, from the buffers filled in by tier 2 */
+		if (!opj_min_buf_vec_get_segment(&cblk->seg_buffers, seg->len, &piece_index, &pieces, &num_pieces))
+			break;
+		opj_mqc_init_dec(mqc, pieces, num_pieces);
+
+		for (passno = 0; (passno < seg->numpasses) && (bpno_plus_one >= 1); ++passno) {
+			switch (passtype) {
+			case 0:
+				opj_t1_dec_sigpass(t1, bpno_plus_one, orient);
+				break;
+			case 1:
+				opj_t1_dec_refpass(t1, bpno_plus_one);
+				break;
+			case 2:
+				opj_t1_dec_clnpass(t1, bpno_plus_one, orient, cblksty);
+				break;
+			}
+
+			if (cblksty & J2K_CCP_CBLKSTY_RESET) {
+				opj_mqc_resetstates(mqc);
+			}
+			if (++passtype == 3) {
+				passtype = 0;
+				bpno_plus_one--;
+			}
+		}
+	}
+	return true;
+}
@@ -59,13 +59,14 @@
 /*********************/
 
 
-/** We hold the state of individual data points for the T1 encoder using
+/** We hold the state of individual data points for the T1 coder using
 *  a single 32-bit flags word to hold the state of 4 data points.  This corresponds
 *  to the 4-point-high columns that the data is processed in.
 *
 *  These #defines declare the layout of a 32-bit flags word.
 *
-*  This is currently done for encoding only.
+*  This is used for encoding, and for decoding code blocks that do not use
+*  the BYPASS (LAZY) or VSC code block styles.
 */
 
 /* T1_SIGMA_XXX is significance flag for stripe column and neighbouring locations: 18 locations in total */
@@ -175,6 +176,7 @@ Tier-1 coding (coding of code-block coefficients)
 */
 typedef struct opj_t1_opt {
 	opj_mqc_t *mqc;
+	/* encoder stores sign-magnitude coefficients, decoder stores signed coefficients */
 	uint32_t  *data;
 	opj_flag_opt_t *flags;
 	uint32_t w;
@@ -210,7 +212,14 @@ void opj_t1_opt_init_buffers(opj_t1_opt_t *t1,
 	uint32_t w,
 	uint32_t h);
 
+/**
+Encode 1 code-block
 
+@param max			largest sample magnitude in the code-block
+@param min_slope	if non-zero, stop coding after the first bit-plane
+					whose distortion-rate slope falls below min_slope
+@return weighted MSE decrease of the coded passes
+*/
 double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
 	opj_tcd_cblk_enc_t* cblk,
 	uint32_t orient,
@@ -222,7 +231,30 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
 	uint32_t numcomps,
 	const double * mct_norms,
 	uint32_t mct_numcomps,
-	uint32_t max);
+	uint32_t max,
+	double min_slope);
+
+/**
+* Returns true if code blocks with this code block style
+* can be decoded by the optimized T1 decoder
+*
+* @param cblksty Code-block style
+*/
+bool opj_t1_opt_can_decode(uint32_t cblksty);
+
+/**
+Decode 1 code-block
+@param t1 T1 handle
+@param cblk Code-block coding parameters
+@param orient
+@param roishift Region of interest shifting value
+@param cblksty Code-block style
+*/
+bool opj_t1_opt_decode_cblk(opj_t1_opt_t *t1,
+	opj_tcd_cblk_dec_t* cblk,
+	uint32_t orient,
+	uint32_t roishift,
+	uint32_t cblksty);
 
 
 
@@ -57,7 +57,11 @@
 
 #include "opj_includes.h"
 #include "testing.h"
+#include "Scheduler.h"
 #include <memory>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 
 /** @defgroup T2 T2 - Implementation of a tier-2 coding */
 /*@{*/
@@ -140,6 +144,41 @@ static bool opj_t2_decode_packet(   opj_t2_t* t2,
                                     uint64_t * data_read,
                                     opj_event_mgr_t *p_manager);
 
+/**
+Check whether a packet is needed to decode a tile. Packets of layers or resolutions that
+are not decoded, and packets of precincts outside of the decoded region, are not needed.
+@param p_tile Tile to decode
+@param p_tcp Tile coding parameters
+@param p_pi Packet identity
+@param p_skip_layer_or_res set to true if the layer or resolution of the packet is not decoded
+@return true if the packet is needed
+*/
+static bool opj_t2_is_packet_needed(opj_tcd_tile_t *p_tile,
+                                    opj_tcp_t *p_tcp,
+                                    opj_pi_iterator_t *p_pi,
+                                    bool * p_skip_layer_or_res);
+
+/**
+Decode the packets of a tile, using the packet lengths signalled by PLT or PLM markers.
+Packets that are not needed are skipped without reading their headers, and the packets
+of distinct precincts, which are independent byte ranges, are parsed concurrently.
+@param p_t2 T2 handle
+@param p_tile_no number of the tile
+@param p_tile tile for which to decode the packets
+@param src_buf source buffer, positioned at the start of the tile data
+@param p_data_read incremented by the number of bytes read
+@param p_used_lengths set to false if the packet lengths do not match the tile data;
+in this case, no packet has been decoded and src_buf has been rewound
+@param p_manager the user event manager
+*/
+static bool opj_t2_decode_packets_with_lengths(opj_t2_t *p_t2,
+                                                uint32_t p_tile_no,
+                                                opj_tcd_tile_t *p_tile,
+                                                opj_seg_buf_t* src_buf,
+                                                uint64_t * p_data_read,
+                                                bool * p_used_lengths,
+                                                opj_event_mgr_t *p_manager);
+
 static bool opj_t2_skip_packet( opj_t2_t* p_t2,
                                 opj_tcd_tile_t *p_tile,
                                 opj_tcp_t *p_tcp,
@@ -261,7 +300,7 @@ bool opj_t2_encode_packets( opj_t2_t* p_t2,
     opj_tcp_t *l_tcp = &l_cp->tcps[p_tile_no];
     uint32_t l_nb_pocs = l_tcp->numpocs + 1;
 
-    l_pi = opj_pi_initialise_encode(l_image, l_cp, p_tile_no, FINAL_PASS);
+    l_pi = opj_pi_initialise_encode(l_image, l_cp, p_tile_no, FINAL_PASS, p_t2->pi_cache);
     if (!l_pi) {
         return false;
     }
@@ -345,7 +384,7 @@ bool opj_t2_encode_packets_simulate(opj_t2_t* p_t2,
 	if (!p_data_written)
 		return false;
 
-	opj_pi_iterator_t* l_pi = opj_pi_initialise_encode(l_image, l_cp, p_tile_no, THRESH_CALC);
+	opj_pi_iterator_t* l_pi = opj_pi_initialise_encode(l_image, l_cp, p_tile_no, THRESH_CALC, p_t2->pi_cache);
     if (!l_pi) {
         return false;
     }
@@ -423,8 +462,24 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
     opj_pi_iterator_t *l_current_pi = nullptr;
     opj_image_comp_t* l_img_comp = nullptr;
 
+    /* packet headers stored in PPM/PPT markers must be read in sequence */
+    if (!l_cp->ppm && !l_tcp->ppt && l_tcp->m_packet_lengths.m_nb_lengths) {
+        bool l_used_lengths = false;
+        if (!opj_t2_decode_packets_with_lengths(p_t2,
+                                                p_tile_no,
+                                                p_tile,
+                                                src_buf,
+                                                p_data_read,
+                                                &l_used_lengths,
+                                                p_manager)) {
+            return false;
+        }
+        if (l_used_lengths)
+            return true;
+    }
+
     /* create a packet iterator */
-    l_pi = opj_pi_create_decode(l_image, l_cp, p_tile_no);
+    l_pi = opj_pi_create_decode(l_image, l_cp, p_tile_no, p_t2->pi_cache);
     if (!l_pi) {
         return false;
     }
@@ -446,10 +501,8 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
             return false;
         }
         while (opj_pi_next(l_current_pi)) {
-            bool skip_precinct = false;
-            opj_tcd_tilecomp_t* tilec = p_tile->comps + l_current_pi->compno;
-            bool skip_layer_or_res = l_current_pi->layno >= l_tcp->num_layers_to_decode ||
-                                     l_current_pi->resno >= tilec->minimum_num_resolutions;
+            bool skip_layer_or_res = false;
+            bool needed = opj_t2_is_packet_needed(p_tile, l_tcp, l_current_pi, &skip_layer_or_res);
 
             l_img_comp = l_image->comps + l_current_pi->compno;
 
@@ -461,29 +514,7 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
                          l_current_pi->precno,
                          l_current_pi->layno );
 
-
-
-            if (!skip_layer_or_res) {
-                opj_tcd_resolution_t* res = tilec->resolutions + l_current_pi->resno;
-                uint32_t bandno;
-                skip_precinct = true;
-                for (bandno = 0; bandno < res->numbands && skip_precinct; ++bandno) {
-                    opj_tcd_band_t* band = res->bands + bandno;
-					auto num_precincts = band->numPrecincts();
-                    uint32_t precno;
-                    for (precno = 0; precno < num_precincts && skip_precinct; ++precno) {
-                        rect_t prec_rect;
-                        opj_tcd_precinct_t* prec = band->precincts + precno;
-						prec_rect= rect_t(prec->x0, prec->y0, prec->x1, prec->y1);
-                        if (opj_tile_buf_hit_test(tilec->buf,&prec_rect)) {
-                            skip_precinct = false;
-                            break;
-                        }
-                    }
-                }
-            }
-
-            if (!skip_layer_or_res && !skip_precinct) {
+            if (needed) {
                 l_nb_bytes_read = 0;
                 if (! opj_t2_decode_packet(p_t2,
 											&p_tile->comps[l_current_pi->compno].resolutions[l_current_pi->resno],
@@ -518,6 +549,177 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
     return true;
 }
 
+static bool opj_t2_is_packet_needed(opj_tcd_tile_t *p_tile,
+                                    opj_tcp_t *p_tcp,
+                                    opj_pi_iterator_t *p_pi,
+                                    bool * p_skip_layer_or_res)
+{
+    opj_tcd_tilecomp_t* tilec = p_tile->comps + p_pi->compno;
+    opj_tcd_resolution_t* res = nullptr;
+    uint32_t bandno;
+
+    *p_skip_layer_or_res = p_pi->layno >= p_tcp->num_layers_to_decode ||
+                           p_pi->resno >= tilec->minimum_num_resolutions;
+    if (*p_skip_layer_or_res)
+        return false;
+
+    res = tilec->resolutions + p_pi->resno;
+    if (p_pi->precno >= res->pw * res->ph)
+        return false;
+    for (bandno = 0; bandno < res->numbands; ++bandno) {
+        opj_tcd_band_t* band = res->bands + bandno;
+        if (band->precincts[p_pi->precno].inDecodeWindow())
+            return true;
+    }
+    return false;
+}
+
+/**
+Location of a packet in the tile data
+*/
+struct opj_t2_packet_t {
+    uint32_t compno;
+    uint32_t resno;
+    uint32_t precno;
+    uint32_t layno;
+    uint8_t* data;
+    uint32_t len;
+};
+
+static bool opj_t2_decode_packets_with_lengths(opj_t2_t *p_t2,
+                                                uint32_t p_tile_no,
+                                                opj_tcd_tile_t *p_tile,
+                                                opj_seg_buf_t* src_buf,
+                                                uint64_t * p_data_read,
+                                                bool * p_used_lengths,
+                                                opj_event_mgr_t *p_manager)
+{
+    opj_image_t *l_image = p_t2->image;
+    opj_cp_t *l_cp = p_t2->cp;
+    opj_tcp_t *l_tcp = l_cp->tcps + p_tile_no;
+    opj_packet_lengths_t* l_lengths = &l_tcp->m_packet_lengths;
+    uint32_t l_nb_pocs = l_tcp->numpocs + 1;
+    opj_pi_iterator_t *l_pi = nullptr;
+    uint32_t pino, l_packno = 0;
+    uint64_t l_nb_bytes = 0;
+    bool l_consistent = true;
+    std::vector<opj_t2_packet_t> l_packets;
+    std::vector<size_t> l_precincts;
+
+    *p_used_lengths = false;
+    if (opj_seg_buf_get_global_offset(src_buf) != 0)
+        return true;
+
+    l_pi = opj_pi_create_decode(l_image, l_cp, p_tile_no, p_t2->pi_cache);
+    if (!l_pi) {
+        return false;
+    }
+
+    /* locate every packet from its length, keeping the packets that are needed */
+    for (pino = 0; pino <= l_tcp->numpocs && l_consistent; ++pino) {
+        opj_pi_iterator_t *l_current_pi = l_pi + pino;
+        if (l_current_pi->poc.prg == OPJ_PROG_UNKNOWN) {
+            opj_pi_destroy(l_pi, l_nb_pocs);
+            return false;
+        }
+        while (opj_pi_next(l_current_pi)) {
+            uint8_t* l_data = opj_seg_buf_get_global_ptr(src_buf);
+            uint32_t l_len = (l_packno < l_lengths->m_nb_lengths) ? l_lengths->m_lengths[l_packno] : 0;
+            bool l_skip_layer_or_res = false;
+
+            /* a packet cannot span two tile-parts */
+            if (!l_len || l_len > opj_seg_buf_get_cur_seg_len(src_buf) ||
+                    ((l_tcp->csty & J2K_CP_CSTY_SOP) && (l_len < 6 || l_data[0] != 0xff || l_data[1] != 0x91))) {
+                l_consistent = false;
+                break;
+            }
+            if (opj_t2_is_packet_needed(p_tile, l_tcp, l_current_pi, &l_skip_layer_or_res)) {
+                opj_t2_packet_t l_packet = { l_current_pi->compno,
+                                             l_current_pi->resno,
+                                             l_current_pi->precno,
+                                             l_current_pi->layno,
+                                             l_data,
+                                             l_len
+                                           };
+                l_packets.push_back(l_packet);
+            }
+            if (!l_skip_layer_or_res) {
+                opj_image_comp_t* l_img_comp = l_image->comps + l_current_pi->compno;
+                l_img_comp->resno_decoded = opj_max<uint32_t>(l_current_pi->resno, l_img_comp->resno_decoded);
+            }
+            opj_seg_buf_incr_cur_seg_offset(src_buf, l_len);
+            l_nb_bytes += l_len;
+            ++l_packno;
+        }
+    }
+    opj_pi_destroy(l_pi, l_nb_pocs);
+
+    if (!l_consistent || l_packno != l_lengths->m_nb_lengths || l_nb_bytes != src_buf->data_len) {
+        opj_event_msg(p_manager, EVT_WARNING, "Packet lengths in PLT/PLM markers do not match data of tile %d: ignoring them\n", p_tile_no);
+        opj_seg_buf_rewind(src_buf);
+        return true;
+    }
+    *p_used_lengths = true;
+    *p_data_read += l_nb_bytes;
+
+    /* group the packets of each precinct, keeping them in layer order */
+    std::stable_sort(l_packets.begin(), l_packets.end(),
+    [](const opj_t2_packet_t& a, const opj_t2_packet_t& b) {
+        if (a.compno != b.compno)
+            return a.compno < b.compno;
+        if (a.resno != b.resno)
+            return a.resno < b.resno;
+        return a.precno < b.precno;
+    });
+    for (size_t i = 0; i < l_packets.size(); ++i) {
+        if (i == 0 ||
+                l_packets[i].compno != l_packets[i - 1].compno ||
+                l_packets[i].resno != l_packets[i - 1].resno ||
+                l_packets[i].precno != l_packets[i - 1].precno)
+            l_precincts.push_back(i);
+    }
+    l_precincts.push_back(l_packets.size());
+
+    /* each precinct is parsed by a single thread, from its own packet buffers */
+    std::atomic<size_t> l_next_precinct(0);
+    std::atomic<bool> l_success(true);
+    size_t l_nb_precincts = l_precincts.size() - 1;
+    size_t l_num_threads = opj_min<size_t>(opj_max<size_t>(p_t2->numThreads, 1), l_nb_precincts);
+    Scheduler::instance()->parallel_for(l_num_threads, [&](size_t) {
+        opj_seg_buf_t l_packet_buf;
+        size_t l_prec;
+        while (l_success && (l_prec = l_next_precinct++) < l_nb_precincts) {
+            for (size_t i = l_precincts[l_prec]; i < l_precincts[l_prec + 1]; ++i) {
+                opj_t2_packet_t* l_packet = &l_packets[i];
+                opj_pi_iterator_t l_packet_pi;
+                uint64_t l_nb_bytes_read = 0;
+
+                memset(&l_packet_pi, 0, sizeof(opj_pi_iterator_t));
+                l_packet_pi.compno = l_packet->compno;
+                l_packet_pi.resno = l_packet->resno;
+                l_packet_pi.precno = l_packet->precno;
+                l_packet_pi.layno = l_packet->layno;
+                if (!opj_seg_buf_wrap(&l_packet_buf, l_packet->data, l_packet->len) ||
+                        !opj_t2_decode_packet(p_t2,
+                                              &p_tile->comps[l_packet->compno].resolutions[l_packet->resno],
+                                              l_tcp,
+                                              &l_packet_pi,
+                                              &l_packet_buf,
+                                              &l_nb_bytes_read,
+                                              p_manager)) {
+                    l_success = false;
+                    return;
+                }
+                if (l_nb_bytes_read != l_packet->len) {
+                    opj_event_msg(p_manager, EVT_WARNING, "Packet length (%d) in PLT/PLM marker differs from packet size (%d)\n",
+                                  l_packet->len, (uint32_t)l_nb_bytes_read);
+                }
+            }
+        }
+    });
+    return l_success;
+}
+
 /* ----------------------------------------------------------------------- */
 
 /**
@@ -895,7 +1097,7 @@ static bool opj_t2_read_packet_data(opj_tcd_resolution_t* l_res,
 					l_seg->dataindex = l_cblk->dataSize;
 				}
 
-				opj_min_buf_vec_push_back(&l_cblk->seg_buffers, opj_seg_buf_get_global_ptr(src_buf), (uint16_t)l_seg->newlen);
+				opj_min_buf_vec_push_back(&l_cblk->seg_buffers, opj_seg_buf_get_global_ptr(src_buf), l_seg->newlen);
 
 				*(p_data_read)				+= l_seg->newlen;
 				opj_seg_buf_incr_cur_seg_offset(src_buf, l_seg->newlen);
@@ -74,6 +74,10 @@ struct opj_t2_t {
     opj_image_t *image;
     /** pointer to the image coding parameters */
     opj_cp_t *cp;
+    /** Decoding: number of threads used to parse packets */
+    uint32_t numThreads;
+    /** packet sequence cache of the tile coder (not owned), or NULL */
+    opj_pi_cache_t *pi_cache;
 };
 
 /** @name Exported functions */
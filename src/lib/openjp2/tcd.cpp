@@ -58,6 +58,9 @@
 
 #include "opj_includes.h"
 #include "T1Decoder.h"
+#include "dequant.h"
+#include <vector>
+#include <algorithm>
 
 /* ----------------------------------------------------------------------- */
 
@@ -73,7 +76,17 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
                                      size_t sizeof_block,
                                      opj_event_mgr_t* manager);
 
+/**
+Find the precincts and code blocks of each band that overlap the decode window,
+so that T2 and T1 can skip the others without any further hit testing.
 
+@param tilec	tile component, with its tile buffer created
+@param cblkw	nominal code block width
+@param cblkh	nominal code block height
+*/
+static void opj_tcd_init_decode_window(opj_tcd_tilecomp_t* tilec,
+										uint32_t cblkw,
+										uint32_t cblkh);
 
 /**
  * Deallocates the decoding data of the given precinct.
@@ -113,9 +126,24 @@ static bool opj_tcd_t1_decode (opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager);
 
 static bool opj_tcd_dwt_decode (opj_tcd_t *p_tcd);
 
-static bool opj_tcd_mct_decode (opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager);
+/**
+Inverse multi-component transform. When possible, the DC level shift of the
+three transformed components is applied in the same pass over the tile.
+@param p_tcd TCD handle
+@param p_dc_shifted set to true if the DC level shift of components 0 to 2 has been applied
+@param p_manager event manager
+*/
+static bool opj_tcd_mct_decode (opj_tcd_t *p_tcd, bool *p_dc_shifted, opj_event_mgr_t *p_manager);
 
-static bool opj_tcd_dc_level_shift_decode (opj_tcd_t *p_tcd);
+/**
+DC level shift and clamp of tile components first_compno and up
+*/
+static bool opj_tcd_dc_level_shift_decode (opj_tcd_t *p_tcd, uint32_t first_compno);
+
+/**
+Range of the sample values of an image component
+*/
+static void opj_tcd_get_sample_range(const opj_image_comp_t *l_img_comp, int32_t *l_min, int32_t *l_max);
 
 
 static bool opj_tcd_dc_level_shift_encode ( opj_tcd_t *p_tcd );
@@ -126,6 +154,11 @@ static bool opj_tcd_dwt_encode ( opj_tcd_t *p_tcd );
 
 static bool opj_tcd_t1_encode ( opj_tcd_t *p_tcd );
 
+/**
+Release the tile-scoped allocations of the previous tile, creating the arena on first use
+*/
+static bool opj_tcd_reset_arena(opj_tcd_t *p_tcd);
+
 static bool opj_tcd_t2_encode (     opj_tcd_t *p_tcd,
                                     uint8_t * p_dest_data,
                                     uint64_t * p_data_written,
@@ -164,6 +197,25 @@ static void opj_tcd_makelayer_feasible(opj_tcd_t *tcd,
 	uint16_t thresh,
 	bool final);
 
+static bool opj_tcd_pcrd_slope_table(opj_tcd_t *tcd,
+	uint64_t * p_data_written,
+	uint64_t len);
+
+/**
+Feasible truncation point of a code-block, as an entry of the slope table
+*/
+struct opj_tcd_slope_entry_t {
+	uint16_t slope;		/* log slope of the truncation point */
+	uint32_t compno;	/* component of the code-block */
+	uint32_t block;		/* index of the code-block in the tile */
+	uint32_t rate;		/* bytes added since the previous feasible truncation point */
+	double disto;		/* distortion decrease since the previous feasible truncation point */
+};
+
+/* estimated packet header bytes for an empty packet, and for each code-block included in a packet */
+#define OPJ_TCD_EMPTY_PACKET_BYTES 1
+#define OPJ_TCD_CBLK_HEADER_BYTES 3
+
 
 
 
@@ -184,6 +236,12 @@ opj_tcd_t* opj_tcd_create(bool p_is_decoder)
 
     l_tcd->m_is_decoder = p_is_decoder ? 1 : 0;
 
+    l_tcd->pi_cache = opj_pi_cache_create();
+    if (!l_tcd->pi_cache) {
+        opj_free(l_tcd);
+        return nullptr;
+    }
+
     return l_tcd;
 }
 
@@ -397,6 +455,7 @@ bool opj_tcd_pcrd_bisect_feasible(opj_tcd_t *tcd,
 			if (t2 == nullptr) {
 				return false;
 			}
+			t2->pi_cache = tcd->pi_cache;
 			double distotarget =
 				tcd_tile->distotile - ((K * maxSE) / pow(10.0, tcd_tcp->distoratio[layno] / 10.0));
 
@@ -455,6 +514,244 @@ bool opj_tcd_pcrd_bisect_feasible(opj_tcd_t *tcd,
 
 
 
+/*
+Rate control from a table of feasible truncation points sorted by slope.
+
+The truncation points of all code-blocks in the tile are sorted once by
+decreasing rate-distortion slope. Each layer threshold is then found by
+walking down the table from the previous threshold, accumulating the
+code-block bytes and an estimate of the packet header bytes, so no T2
+simulation is needed to search for it. A single simulation per layer
+verifies the threshold; if the estimate turns out too optimistic, the
+threshold is raised by bisection between the estimate and the previous
+layer's threshold.
+*/
+bool opj_tcd_pcrd_slope_table(opj_tcd_t *tcd,
+	uint64_t * p_data_written,
+	uint64_t len)
+{
+	bool single_lossless = tcd->tcp->numlayers == 1 && !opj_tcd_layer_needs_rate_control(0, tcd->tcp, &tcd->cp->m_specific_param.m_enc);
+	const double K = 1;
+	double maxSE = 0;
+
+	opj_cp_t *cp = tcd->cp;
+	opj_tcd_tile_t *tcd_tile = tcd->tile;
+	opj_tcp_t *tcd_tcp = tcd->tcp;
+
+	tcd_tile->numpix = 0;
+	uint32_t state = opj_plugin_get_debug_state();
+
+	std::vector<opj_tcd_slope_entry_t> table;
+	uint64_t num_packets = 0;
+	uint32_t num_blocks = 0;
+	for (uint32_t compno = 0; compno < tcd_tile->numcomps; compno++) {
+		opj_tcd_tilecomp_t *tilec = &tcd_tile->comps[compno];
+		tilec->numpix = 0;
+		for (uint32_t resno = 0; resno < tilec->numresolutions; resno++) {
+			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+			num_packets += (uint64_t)res->pw * res->ph;
+
+			for (uint32_t bandno = 0; bandno < res->numbands; bandno++) {
+				opj_tcd_band_t *band = &res->bands[bandno];
+
+				for (uint32_t precno = 0; precno < res->pw * res->ph; precno++) {
+					opj_tcd_precinct_t *prc = &band->precincts[precno];
+
+					for (uint32_t cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
+						opj_tcd_cblk_enc_t *cblk = &prc->cblks.enc[cblkno];
+
+						uint32_t numPix = ((cblk->x1 - cblk->x0) * (cblk->y1 - cblk->y0));
+						if (!(state &OPJ_PLUGIN_STATE_PRE_TR1)) {
+							encode_synch_with_plugin(tcd,
+								compno,
+								resno,
+								bandno,
+								precno,
+								cblkno,
+								band,
+								cblk,
+								&numPix);
+						}
+
+						if (!single_lossless) {
+							RateControl::convexHull(cblk->passes, cblk->num_passes_encoded);
+
+							// each feasible truncation point adds the passes since the previous one
+							uint32_t prev_rate = 0;
+							double prev_disto = 0;
+							for (uint32_t passno = 0; passno < cblk->num_passes_encoded; passno++) {
+								opj_tcd_pass_t *pass = &cblk->passes[passno];
+								if (!pass->slope)
+									continue;
+								opj_tcd_slope_entry_t entry;
+								entry.slope = pass->slope;
+								entry.compno = compno;
+								entry.block = num_blocks;
+								entry.rate = pass->rate - prev_rate;
+								entry.disto = pass->distortiondec - prev_disto;
+								table.push_back(entry);
+								prev_rate = pass->rate;
+								prev_disto = pass->distortiondec;
+							}
+
+							tcd_tile->numpix += numPix;
+							tilec->numpix += numPix;
+						}
+						num_blocks++;
+					} /* cbklno */
+				} /* precno */
+			} /* bandno */
+		} /* resno */
+
+		if (!single_lossless) {
+			maxSE += (double)(((uint64_t)1 << tcd->image->comps[compno].prec) - 1.0)
+				* (((uint64_t)1 << tcd->image->comps[compno].prec) - 1.0)
+				* tilec->numpix;
+		}
+	} /* compno */
+
+	if (opj_tcd_make_single_lossless_layer(tcd)) {
+		return true;
+	}
+
+	// feasible slopes decrease along the passes of a code-block, so a stable
+	// sort keeps the truncation points of each code-block in pass order
+	std::stable_sort(table.begin(), table.end(),
+		[](const opj_tcd_slope_entry_t& a, const opj_tcd_slope_entry_t& b) {
+			return a.slope > b.slope;
+	});
+
+	opj_t2_t*t2 = opj_t2_create(tcd->image, cp);
+	if (t2 == nullptr) {
+		return false;
+	}
+	t2->pi_cache = tcd->pi_cache;
+
+	uint32_t packet_bytes = OPJ_TCD_EMPTY_PACKET_BYTES;
+	if (tcd_tcp->csty & J2K_CP_CSTY_SOP)
+		packet_bytes += 6;
+	if (tcd_tcp->csty & J2K_CP_CSTY_EPH)
+		packet_bytes += 2;
+
+	const uint64_t max_comp_size = cp->m_specific_param.m_enc.m_max_comp_size;
+	// last layer in which each code-block was counted as contributing
+	std::vector<uint32_t> block_layer(num_blocks, UINT32_MAX);
+	// first table entry not included in any layer yet
+	size_t next = 0;
+	// bytes written by the previous layers, as measured by the last simulation
+	uint64_t written = 0;
+	double cumdisto = 0;
+	// a pass is included in a layer if its slope is strictly above the threshold
+	uint16_t thresh = USHRT_MAX;
+
+	for (uint32_t layno = 0; layno < tcd_tcp->numlayers; layno++) {
+		if (!opj_tcd_layer_needs_rate_control(layno, tcd_tcp, &cp->m_specific_param.m_enc)) {
+			opj_tcd_makelayer_final(tcd, layno);
+			continue;
+		}
+		uint64_t maxlen = tcd_tcp->rates[layno] > 0.0f ? opj_min<uint64_t>(((uint64_t)ceil(tcd_tcp->rates[layno])), len) : len;
+		// the simulation checks the component size limit against the bytes
+		// accumulated from the start of the tile, so it caps the total as well
+		uint64_t cap = max_comp_size ? opj_min<uint64_t>(maxlen, max_comp_size) : maxlen;
+		double distotarget =
+			tcd_tile->distotile - ((K * maxSE) / pow(10.0, tcd_tcp->distoratio[layno] / 10.0));
+		uint16_t prevthresh = thresh;
+		size_t layer_start = next;
+		uint64_t estimate = written + num_packets * packet_bytes;
+		double distoachieved = cumdisto;
+
+		// include truncation points one slope at a time, while the layer fits
+		while (next < table.size()) {
+			uint16_t slope = table[next].slope;
+			uint64_t group_bytes = 0;
+			double group_disto = 0;
+			size_t end = next;
+			for (; end < table.size() && table[end].slope == slope; ++end) {
+				uint64_t bytes = table[end].rate;
+				if (block_layer[table[end].block] != layno)
+					bytes += OPJ_TCD_CBLK_HEADER_BYTES;
+				group_bytes += bytes;
+				group_disto += table[end].disto;
+			}
+			bool fits = cp->m_specific_param.m_enc.m_fixed_quality ?
+				distoachieved < distotarget : estimate + group_bytes <= cap;
+			if (!fits)
+				break;
+			for (; next < end; ++next)
+				block_layer[table[next].block] = layno;
+			estimate += group_bytes;
+			distoachieved += group_disto;
+			thresh = (uint16_t)(slope - 1);
+		}
+
+		opj_tcd_makelayer_feasible(tcd, layno, thresh, false);
+		if (!cp->m_specific_param.m_enc.m_fixed_quality) {
+			if (!opj_t2_encode_packets_simulate(t2,
+				tcd->tcd_tileno,
+				tcd_tile,
+				layno + 1,
+				p_data_written,
+				maxlen,
+				tcd->tp_pos)) {
+				// header estimate was too low: bisect between the estimated
+				// threshold, which fails, and the previous one
+				uint32_t lowerBound = thresh;
+				uint32_t upperBound = prevthresh;
+				// bytes of the previous layers, as measured by their last simulation
+				uint64_t upper_written = written;
+				bool upper_measured = false;
+				while (upperBound - lowerBound > 1) {
+					uint16_t mid = (uint16_t)((lowerBound + upperBound) >> 1);
+					opj_tcd_makelayer_feasible(tcd, layno, mid, false);
+					if (opj_t2_encode_packets_simulate(t2,
+						tcd->tcd_tileno,
+						tcd_tile,
+						layno + 1,
+						p_data_written,
+						maxlen,
+						tcd->tp_pos)) {
+						upperBound = mid;
+						upper_written = *p_data_written;
+						upper_measured = true;
+					}
+					else {
+						lowerBound = mid;
+					}
+				}
+				// no threshold below the previous one fits: measure the layer at the
+				// previous threshold, where it only adds empty packets
+				if (!upper_measured) {
+					opj_tcd_makelayer_feasible(tcd, layno, upperBound, false);
+					if (opj_t2_encode_packets_simulate(t2,
+						tcd->tcd_tileno,
+						tcd_tile,
+						layno + 1,
+						p_data_written,
+						maxlen,
+						tcd->tp_pos)) {
+						upper_written = *p_data_written;
+					}
+				}
+				thresh = (uint16_t)upperBound;
+				*p_data_written = upper_written;
+				// hand the excluded truncation points back to the next layer
+				size_t end = next;
+				next = layer_start;
+				while (next < end && table[next].slope > thresh)
+					++next;
+			}
+			written = *p_data_written;
+		}
+		opj_tcd_makelayer_feasible(tcd, layno, thresh, true);
+		cumdisto += tcd_tile->distolayer[layno];
+	}
+	opj_t2_destroy(t2);
+	return true;
+}
+
+
+
+
 /*
 Simple bisect algorithm to calculate optimal layer truncation points
 */
@@ -576,6 +873,7 @@ bool opj_tcd_pcrd_bisect_simple(  opj_tcd_t *tcd,
 			if (t2 == nullptr) {
 				return false;
 			}
+			t2->pi_cache = tcd->pi_cache;
 			double thresh;
 			for (uint32_t i = 0; i < 128; ++i) {
 				thresh = (upperBound == -1) ? lowerBound : (lowerBound + upperBound) / 2;
@@ -853,6 +1151,8 @@ void opj_tcd_destroy(opj_tcd_t *tcd)
 {
     if (tcd) {
         opj_tcd_free_tile(tcd);
+        opj_arena_destroy(tcd->arena);
+        opj_pi_cache_destroy(tcd->pi_cache);
         opj_free(tcd);
     }
 }
@@ -1237,6 +1537,9 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
             return false;
         }
         l_tilec->buf->data_size_needed = l_tile_data_size;
+        if (!isEncoder) {
+            opj_tcd_init_decode_window(l_tilec, 1 << l_tccp->cblkw, 1 << l_tccp->cblkh);
+        }
 
         ++l_tccp;
         ++l_tilec;
@@ -1257,9 +1560,72 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
 
 bool opj_tcd_init_encode_tile (opj_tcd_t *p_tcd, uint32_t p_tile_no, opj_event_mgr_t* p_manager)
 {
+	p_tcd->m_pre_t2_done = 0;
     return opj_tcd_init_tile(p_tcd, p_tile_no, NULL, true, 1.0F, sizeof(opj_tcd_cblk_enc_t), p_manager);
 }
 
+static void opj_tcd_init_decode_window(opj_tcd_tilecomp_t* tilec,
+										uint32_t cblkw,
+										uint32_t cblkh)
+{
+	bool is_region = opj_tile_buf_is_decode_region(tilec->buf);
+	for (uint32_t resno = 0; resno < tilec->numresolutions; ++resno) {
+		opj_tcd_resolution_t* res = tilec->resolutions + resno;
+		opj_tile_buf_resolution_t* buf_res = tilec->buf->resolutions[tilec->numresolutions - 1 - resno];
+		for (uint32_t bandno = 0; bandno < res->numbands; ++bandno) {
+			opj_tcd_band_t* band = res->bands + bandno;
+			rect_t* win = &buf_res->band_region[bandno].dim;
+			band->win_px0 = res->pw;
+			band->win_py0 = res->ph;
+			band->win_px1 = 0;
+			band->win_py1 = 0;
+			for (uint32_t precno = 0; precno < res->pw * res->ph; ++precno) {
+				opj_tcd_precinct_t* prc = band->precincts + precno;
+				if (!prc->cw || !prc->ch) {
+					prc->win_cx0 = prc->win_cx1 = 0;
+					prc->win_cy0 = prc->win_cy1 = 0;
+				}
+				else if (!is_region) {
+					prc->win_cx0 = 0;
+					prc->win_cy0 = 0;
+					prc->win_cx1 = prc->cw;
+					prc->win_cy1 = prc->ch;
+				}
+				else {
+					// a code block overlaps the window if both its column and its row do,
+					// and the overlapping columns and rows are contiguous
+					prc->win_cx0 = prc->cw;
+					prc->win_cx1 = 0;
+					for (uint32_t i = 0; i < prc->cw; ++i) {
+						int64_t x0 = prc->cblks.dec[i].x0;
+						if (opj_max<int64_t>(x0, win->x0) <= opj_min<int64_t>(x0 + cblkw, win->x1)) {
+							prc->win_cx0 = opj_min<uint32_t>(prc->win_cx0, i);
+							prc->win_cx1 = i + 1;
+						}
+					}
+					prc->win_cy0 = prc->ch;
+					prc->win_cy1 = 0;
+					for (uint32_t j = 0; j < prc->ch; ++j) {
+						int64_t y0 = prc->cblks.dec[j * prc->cw].y0;
+						if (opj_max<int64_t>(y0, win->y0) <= opj_min<int64_t>(y0 + cblkh, win->y1)) {
+							prc->win_cy0 = opj_min<uint32_t>(prc->win_cy0, j);
+							prc->win_cy1 = j + 1;
+						}
+					}
+				}
+				if (prc->inDecodeWindow()) {
+					uint32_t px = precno % res->pw;
+					uint32_t py = precno / res->pw;
+					band->win_px0 = opj_min<uint32_t>(band->win_px0, px);
+					band->win_py0 = opj_min<uint32_t>(band->win_py0, py);
+					band->win_px1 = opj_max<uint32_t>(band->win_px1, px + 1);
+					band->win_py1 = opj_max<uint32_t>(band->win_py1, py + 1);
+				}
+			}
+		}
+	}
+}
+
 bool opj_tcd_init_decode_tile (opj_tcd_t *p_tcd,
                                opj_image_t* output_image,
                                uint32_t p_tile_no,
@@ -1340,12 +1706,14 @@ bool opj_tcd_code_block_dec_allocate (opj_tcd_cblk_dec_t * p_code_block)
         uint32_t l_current_max_segs = p_code_block->numSegmentsAllocated;
 
         /* Note: since seg_buffers simply holds references to another data buffer,
-        we do not need to copy it  to the sanitized block  */
-		p_code_block->seg_buffers.cleanup();
+        we only need to empty it, keeping its storage for the sanitized block  */
+		p_code_block->seg_buffers.clear();
+		opj_vec_t l_seg_buffers = p_code_block->seg_buffers;
 
         memset(p_code_block, 0, sizeof(opj_tcd_cblk_dec_t));
         p_code_block->segs = l_segs;
         p_code_block->numSegmentsAllocated = l_current_max_segs;
+        p_code_block->seg_buffers = l_seg_buffers;
     }
     return true;
 }
@@ -1381,93 +1749,107 @@ uint64_t opj_tcd_get_decoded_tile_size ( opj_tcd_t *p_tcd )
     return l_data_size;
 }
 
-bool opj_tcd_encode_tile(   opj_tcd_t *p_tcd,
-                            uint32_t p_tile_no,
-                            uint8_t *p_dest,
-                            uint64_t * p_data_written,
-                            uint64_t p_max_length,
-                            opj_codestream_info_t *p_cstr_info,
-							opj_event_mgr_t * p_manager)
+bool opj_tcd_pre_t2_encode_tile(opj_tcd_t *p_tcd,
+								uint32_t p_tile_no,
+								uint64_t p_max_length,
+								opj_codestream_info_t *p_cstr_info)
 {
 	uint32_t state = opj_plugin_get_debug_state();
-    if (p_tcd->cur_tp_num == 0) {
 
-        p_tcd->tcd_tileno = p_tile_no;
-        p_tcd->tcp = &p_tcd->cp->tcps[p_tile_no];
+    p_tcd->tcd_tileno = p_tile_no;
+    p_tcd->tcp = &p_tcd->cp->tcps[p_tile_no];
 
-        /* INDEX >> "Precinct_nb_X et Precinct_nb_Y" */
-        if(p_cstr_info)  {
-            uint32_t l_num_packs = 0;
-            uint32_t i;
-            opj_tcd_tilecomp_t *l_tilec_idx = &p_tcd->tile->comps[0];        /* based on component 0 */
-            opj_tccp_t *l_tccp = p_tcd->tcp->tccps; /* based on component 0 */
+    /* INDEX >> "Precinct_nb_X et Precinct_nb_Y" */
+    if(p_cstr_info)  {
+        uint32_t l_num_packs = 0;
+        uint32_t i;
+        opj_tcd_tilecomp_t *l_tilec_idx = &p_tcd->tile->comps[0];        /* based on component 0 */
+        opj_tccp_t *l_tccp = p_tcd->tcp->tccps; /* based on component 0 */
 
-            for (i = 0; i < l_tilec_idx->numresolutions; i++) {
-                opj_tcd_resolution_t *l_res_idx = &l_tilec_idx->resolutions[i];
+        for (i = 0; i < l_tilec_idx->numresolutions; i++) {
+            opj_tcd_resolution_t *l_res_idx = &l_tilec_idx->resolutions[i];
 
-                p_cstr_info->tile[p_tile_no].pw[i] = (int)l_res_idx->pw;
-                p_cstr_info->tile[p_tile_no].ph[i] = (int)l_res_idx->ph;
+            p_cstr_info->tile[p_tile_no].pw[i] = (int)l_res_idx->pw;
+            p_cstr_info->tile[p_tile_no].ph[i] = (int)l_res_idx->ph;
 
-                l_num_packs += l_res_idx->pw * l_res_idx->ph;
-                p_cstr_info->tile[p_tile_no].pdx[i] = (int)l_tccp->prcw[i];
-                p_cstr_info->tile[p_tile_no].pdy[i] = (int)l_tccp->prch[i];
-            }
-            p_cstr_info->tile[p_tile_no].packet = (opj_packet_info_t*) opj_calloc((size_t)p_cstr_info->numcomps * (size_t)p_cstr_info->numlayers * l_num_packs, sizeof(opj_packet_info_t));
-            if (!p_cstr_info->tile[p_tile_no].packet) {
-                /* FIXME event manager error callback */
-                return false;
-            }
+            l_num_packs += l_res_idx->pw * l_res_idx->ph;
+            p_cstr_info->tile[p_tile_no].pdx[i] = (int)l_tccp->prcw[i];
+            p_cstr_info->tile[p_tile_no].pdy[i] = (int)l_tccp->prch[i];
         }
-		/* << INDEX */
-		if (state & OPJ_PLUGIN_STATE_DEBUG) {
-			set_context_stream(p_tcd);
-		}
-
-		// When debugging the encoder, we do all of T1 up to and including DWT in the plugin, and pass this in as image data.
-		// This way, both OPJ and plugin start with same inputs for context formation and MQ coding.
-		bool debugEncode = state & OPJ_PLUGIN_STATE_DEBUG;
-		bool debugMCT = (state & OPJ_PLUGIN_STATE_MCT_ONLY) ? true : false ;
+        p_cstr_info->tile[p_tile_no].packet = (opj_packet_info_t*) opj_calloc((size_t)p_cstr_info->numcomps * (size_t)p_cstr_info->numlayers * l_num_packs, sizeof(opj_packet_info_t));
+        if (!p_cstr_info->tile[p_tile_no].packet) {
+            /* FIXME event manager error callback */
+            return false;
+        }
+    }
+	/* << INDEX */
+	if (state & OPJ_PLUGIN_STATE_DEBUG) {
+		set_context_stream(p_tcd);
+	}
 
-		if (!p_tcd->current_plugin_tile || debugEncode) {
+	// When debugging the encoder, we do all of T1 up to and including DWT in the plugin, and pass this in as image data.
+	// This way, both OPJ and plugin start with same inputs for context formation and MQ coding.
+	bool debugEncode = state & OPJ_PLUGIN_STATE_DEBUG;
+	bool debugMCT = (state & OPJ_PLUGIN_STATE_MCT_ONLY) ? true : false ;
 
-			if (!debugEncode) {
-				/* FIXME _ProfStart(PGROUP_DC_SHIFT); */
-				/*---------------TILE-------------------*/
-				if (!opj_tcd_dc_level_shift_encode(p_tcd)) {
-					return false;
-				}
-				/* FIXME _ProfStop(PGROUP_DC_SHIFT); */
+	if (!p_tcd->current_plugin_tile || debugEncode) {
 
-				/* FIXME _ProfStart(PGROUP_MCT); */
-				if (!opj_tcd_mct_encode(p_tcd)) {
-					return false;
-				}
-				/* FIXME _ProfStop(PGROUP_MCT); */
+		if (!debugEncode) {
+			/* FIXME _ProfStart(PGROUP_DC_SHIFT); */
+			/*---------------TILE-------------------*/
+			if (!opj_tcd_dc_level_shift_encode(p_tcd)) {
+				return false;
 			}
+			/* FIXME _ProfStop(PGROUP_DC_SHIFT); */
 
-			if (!debugEncode || debugMCT) {
-				/* FIXME _ProfStart(PGROUP_DWT); */
-				if (!opj_tcd_dwt_encode(p_tcd)) {
-					return false;
-				}
-				/* FIXME  _ProfStop(PGROUP_DWT); */
+			/* FIXME _ProfStart(PGROUP_MCT); */
+			if (!opj_tcd_mct_encode(p_tcd)) {
+				return false;
 			}
+			/* FIXME _ProfStop(PGROUP_MCT); */
+		}
 
-
-			/* FIXME  _ProfStart(PGROUP_T1); */
-			if (!opj_tcd_t1_encode(p_tcd)) {
+		if (!debugEncode || debugMCT) {
+			/* FIXME _ProfStart(PGROUP_DWT); */
+			if (!opj_tcd_dwt_encode(p_tcd)) {
 				return false;
 			}
-			/* FIXME _ProfStop(PGROUP_T1); */
-
+			/* FIXME  _ProfStop(PGROUP_DWT); */
 		}
 
-		/* FIXME _ProfStart(PGROUP_RATE); */
-		if (!opj_tcd_rate_allocate_encode(p_tcd, p_max_length, p_cstr_info)) {
+
+		/* FIXME  _ProfStart(PGROUP_T1); */
+		if (!opj_tcd_t1_encode(p_tcd)) {
 			return false;
 		}
-		/* FIXME _ProfStop(PGROUP_RATE); */
+		/* FIXME _ProfStop(PGROUP_T1); */
+
+	}
+
+	/* FIXME _ProfStart(PGROUP_RATE); */
+	if (!opj_tcd_rate_allocate_encode(p_tcd, p_max_length, p_cstr_info)) {
+		return false;
+	}
+	/* FIXME _ProfStop(PGROUP_RATE); */
+
+	p_tcd->m_pre_t2_done = 1;
+	return true;
+}
 
+bool opj_tcd_encode_tile(   opj_tcd_t *p_tcd,
+                            uint32_t p_tile_no,
+                            uint8_t *p_dest,
+                            uint64_t * p_data_written,
+                            uint64_t p_max_length,
+                            opj_codestream_info_t *p_cstr_info,
+							opj_event_mgr_t * p_manager)
+{
+    if (p_tcd->cur_tp_num == 0) {
+		if (!p_tcd->m_pre_t2_done &&
+			!opj_tcd_pre_t2_encode_tile(p_tcd, p_tile_no, p_max_length, p_cstr_info)) {
+			return false;
+		}
+		p_tcd->m_pre_t2_done = 0;
     }
     /*--------------TIER2------------------*/
 
@@ -1532,10 +1914,11 @@ bool opj_tcd_decode_tile(opj_tcd_t *p_tcd,
 		if (!opj_tcd_dwt_decode(p_tcd)) {
 			return false;
 		}
-		if (!opj_tcd_mct_decode(p_tcd, p_manager)) {
+		bool dc_shifted = false;
+		if (!opj_tcd_mct_decode(p_tcd, &dc_shifted, p_manager)) {
 			return false;
 		}
-		if (!opj_tcd_dc_level_shift_decode(p_tcd)) {
+		if (!opj_tcd_dc_level_shift_decode(p_tcd, dc_shifted ? 3 : 0)) {
 			return false;
 		}
 	}
@@ -1759,6 +2142,8 @@ static bool opj_tcd_t2_decode (opj_tcd_t *p_tcd,
     if (l_t2 == nullptr) {
         return false;
     }
+    l_t2->numThreads = p_tcd->numThreads;
+    l_t2->pi_cache = p_tcd->pi_cache;
 
     if (! opj_t2_decode_packets(
                 l_t2,
@@ -1776,6 +2161,16 @@ static bool opj_tcd_t2_decode (opj_tcd_t *p_tcd,
     return true;
 }
 
+static bool opj_tcd_reset_arena(opj_tcd_t *p_tcd)
+{
+	if (!p_tcd->arena) {
+		p_tcd->arena = opj_arena_create();
+		return p_tcd->arena != nullptr;
+	}
+	opj_arena_reset(p_tcd->arena);
+	return true;
+}
+
 static bool opj_tcd_t1_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t * p_manager)
 {
     uint32_t compno;
@@ -1783,9 +2178,18 @@ static bool opj_tcd_t1_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t * p_manager)
     opj_tcd_tilecomp_t* l_tile_comp = l_tile->comps;
     opj_tccp_t * l_tccp = p_tcd->tcp->tccps;
 	std::vector<decodeBlockInfo*> blocks;
-	T1Decoder decoder(l_tccp->cblkw, l_tccp->cblkh);
+	uint32_t maxCblkW = 0, maxCblkH = 0;
+	for (compno = 0; compno < l_tile->numcomps; ++compno) {
+		maxCblkW = opj_max<uint32_t>(maxCblkW, l_tccp[compno].cblkw);
+		maxCblkH = opj_max<uint32_t>(maxCblkH, l_tccp[compno].cblkh);
+	}
+	if (!opj_tcd_reset_arena(p_tcd)) {
+		opj_event_msg(p_manager, EVT_ERROR, "Not enough memory for tile data\n");
+		return false;
+	}
+	T1Decoder decoder((uint16_t)maxCblkW, (uint16_t)maxCblkH);
     for (compno = 0; compno < l_tile->numcomps; ++compno) {
-        if (false == opj_t1_prepare_decode_cblks(l_tile_comp, l_tccp,&blocks, p_manager)) {
+        if (false == opj_t1_prepare_decode_cblks(l_tile_comp, l_tccp,&blocks, p_tcd->arena, p_manager)) {
             return false;
         }
         ++l_tile_comp;
@@ -1833,7 +2237,7 @@ static bool opj_tcd_dwt_decode ( opj_tcd_t *p_tcd )
 
     return rc;
 }
-static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
+static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, bool *p_dc_shifted, opj_event_mgr_t *p_manager)
 {
     opj_tcd_tile_t * l_tile = p_tcd->tile;
     opj_tcp_t * l_tcp = p_tcd->tcp;
@@ -1886,7 +2290,32 @@ static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
 
             opj_free(l_data);
         } else {
-            if (l_tcp->tccps->qmfbid == 1) {
+            /* fold the DC level shift into the transform when the three components
+               share their dimensions and wavelet, so that the tile is walked once */
+            bool l_fuse = true;
+            int32_t l_shift[3], l_min[3], l_max[3];
+            for (i = 0; i < 3; ++i) {
+                opj_tcd_tilecomp_t *l_comp = l_tile->comps + i;
+                l_fuse = l_fuse && l_comp->x0 == l_tile->comps[0].x0 && l_comp->y0 == l_tile->comps[0].y0 &&
+                         l_comp->x1 == l_tile->comps[0].x1 && l_comp->y1 == l_tile->comps[0].y1 &&
+                         l_tcp->tccps[i].qmfbid == l_tcp->tccps->qmfbid;
+                l_shift[i] = l_tcp->tccps[i].m_dc_level_shift;
+                opj_tcd_get_sample_range(p_tcd->image->comps + i, l_min + i, l_max + i);
+            }
+            if (l_fuse) {
+                if (l_tcp->tccps->qmfbid == 1) {
+                    opj_mct_decode_dc_shift(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0),
+                                            opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0),
+                                            opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0),
+                                            l_samples, l_shift, l_min, l_max);
+                } else {
+                    opj_mct_decode_real_dc_shift(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0),
+                                                 opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0),
+                                                 opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0),
+                                                 l_samples, l_shift, l_min, l_max);
+                }
+                *p_dc_shifted = true;
+            } else if (l_tcp->tccps->qmfbid == 1) {
                 opj_mct_decode(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0) ,
                                opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0),
                                opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0),
@@ -1906,66 +2335,42 @@ static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
 }
 
 
-static bool opj_tcd_dc_level_shift_decode ( opj_tcd_t *p_tcd )
+static void opj_tcd_get_sample_range(const opj_image_comp_t *l_img_comp, int32_t *l_min, int32_t *l_max)
 {
-    uint32_t compno=0;
-
-#ifdef _OPENMP
-#pragma omp parallel default(none) private(compno) shared(p_tcd)
-	{
-#pragma omp for
-#endif
-
-		for (compno = 0; compno < p_tcd->tile->numcomps; compno++) {
-			int32_t l_min = INT32_MAX, l_max = INT32_MIN;
-
-			opj_tcd_tilecomp_t *l_tile_comp = p_tcd->tile->comps + compno;
-			opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
-			opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
-
-			opj_tcd_resolution_t* l_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
-			uint32_t l_width = (l_res->x1 - l_res->x0);
-			uint32_t l_height = (l_res->y1 - l_res->y0);
-			uint32_t l_stride = (l_tile_comp->x1 - l_tile_comp->x0) - l_width;
-
-		//	assert(l_height == 0 || l_width + l_stride <= l_tile_comp->buf->data_size / l_height); 
-
-			if (l_img_comp->sgnd) {
-				l_min = -(1 << (l_img_comp->prec - 1));
-				l_max = (1 << (l_img_comp->prec - 1)) - 1;
-			}
-			else {
-				l_min = 0;
-				l_max = (1 << l_img_comp->prec) - 1;
-			}
-
-			int32_t* l_current_ptr = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
-
-			if (l_tccp->qmfbid == 1) {
-				for (uint32_t j = 0; j < l_height; ++j) {
-					for (uint32_t i = 0; i < l_width; ++i) {
-						*l_current_ptr = opj_int_clamp(*l_current_ptr + l_tccp->m_dc_level_shift, l_min, l_max);
-						++l_current_ptr;
-					}
-					l_current_ptr += l_stride;
-				}
-			}
-			else {
-				for (uint32_t j = 0; j < l_height; ++j) {
-					for (uint32_t i = 0; i < l_width; ++i) {
-						float l_value = *((float *)l_current_ptr);
-						*l_current_ptr = opj_int_clamp((int32_t)opj_lrintf(l_value) + l_tccp->m_dc_level_shift, l_min, l_max); ;
-						++l_current_ptr;
-					}
-					l_current_ptr += l_stride;
-				}
-			}
-		}
-
-#ifdef _OPENMP
-	}
-#endif
+    if (l_img_comp->sgnd) {
+        *l_min = -(1 << (l_img_comp->prec - 1));
+        *l_max = (1 << (l_img_comp->prec - 1)) - 1;
+    } else {
+        *l_min = 0;
+        *l_max = (1 << l_img_comp->prec) - 1;
+    }
+}
 
+static bool opj_tcd_dc_level_shift_decode ( opj_tcd_t *p_tcd, uint32_t first_compno )
+{
+    for (uint32_t compno = first_compno; compno < p_tcd->tile->numcomps; compno++) {
+        int32_t l_min, l_max;
+
+        opj_tcd_tilecomp_t *l_tile_comp = p_tcd->tile->comps + compno;
+        opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
+        opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+
+        opj_tcd_resolution_t* l_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
+        uint32_t l_width = (l_res->x1 - l_res->x0);
+        uint32_t l_height = (l_res->y1 - l_res->y0);
+        uint32_t l_stride = (l_tile_comp->x1 - l_tile_comp->x0);
+
+        opj_tcd_get_sample_range(l_img_comp, &l_min, &l_max);
+
+        int32_t* l_current_ptr = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
+        for (uint32_t j = 0; j < l_height; ++j) {
+            if (l_tccp->qmfbid == 1)
+                opj_dc_shift_53(l_current_ptr, l_width, l_tccp->m_dc_level_shift, l_min, l_max);
+            else
+                opj_dc_shift_97(l_current_ptr, l_width, l_tccp->m_dc_level_shift, l_min, l_max);
+            l_current_ptr += l_stride;
+        }
+    }
     return true;
 }
 
@@ -2182,12 +2587,12 @@ bool opj_tcd_dwt_encode ( opj_tcd_t *p_tcd )
             opj_tcd_tilecomp_t * tile_comp = p_tcd->tile->comps + compno;
             opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
             if (l_tccp->qmfbid == 1) {
-                if (! opj_dwt_encode_53(tile_comp)) {
+                if (! opj_dwt_encode_53(tile_comp, p_tcd->numThreads)) {
                     rc = false;
                     continue;
                 }
             } else if (l_tccp->qmfbid == 0) {
-                if (! opj_dwt_encode_97(tile_comp)) {
+                if (! opj_dwt_encode_97(tile_comp, p_tcd->numThreads)) {
                     rc = false;
                     continue;
                 }
@@ -2219,11 +2624,26 @@ static bool opj_tcd_t1_encode ( opj_tcd_t *p_tcd )
         l_mct_norms = (const double *) (l_tcp->mct_norms);
     }
 
+    /* the budget of the final layer bounds the useful coding passes,
+       unless that layer is lossless */
+    uint64_t l_max_bytes = 0;
+    opj_encoding_param_t* l_enc = &p_tcd->cp->m_specific_param.m_enc;
+    if (l_enc->m_early_termination && l_enc->m_disto_alloc && !l_enc->m_fixed_quality &&
+            l_tcp->numlayers && l_tcp->rates[l_tcp->numlayers - 1] > 0.0) {
+        l_max_bytes = (uint64_t)ceil(l_tcp->rates[l_tcp->numlayers - 1]);
+    }
+
+    if (!opj_tcd_reset_arena(p_tcd)) {
+        return false;
+    }
+
     return opj_t1_encode_cblks(p_tcd->tile,
 								l_tcp,
 								l_mct_norms,
 								l_mct_numcomps,
-								p_tcd->numThreads);
+								p_tcd->numThreads,
+								l_max_bytes,
+								p_tcd->arena);
 }
 
 static bool opj_tcd_t2_encode (opj_tcd_t *p_tcd,
@@ -2239,6 +2659,7 @@ static bool opj_tcd_t2_encode (opj_tcd_t *p_tcd,
     if (l_t2 == nullptr) {
         return false;
     }
+    l_t2->pi_cache = p_tcd->pi_cache;
 
     if (! opj_t2_encode_packets(
                 l_t2,
@@ -2288,6 +2709,11 @@ static bool opj_tcd_rate_allocate_encode(  opj_tcd_t *p_tcd,
 				return false;
 			}
 			break;
+		case 2:
+			if (!opj_tcd_pcrd_slope_table(p_tcd, &l_nb_written, p_max_dest_size)) {
+				return false;
+			}
+			break;
 		default:
 			if (!opj_tcd_pcrd_bisect_feasible(p_tcd, &l_nb_written, p_max_dest_size)) {
 				return false;
@@ -2419,12 +2845,14 @@ bool opj_tcd_cblk_dec_t::alloc() {
 		uint32_t l_current_max_segs = numSegmentsAllocated;
 
 		/* Note: since seg_buffers simply holds references to another data buffer,
-		we do not need to copy it  to the sanitized block  */
-		seg_buffers.cleanup();
+		we only need to empty it, keeping its storage for the sanitized block  */
+		seg_buffers.clear();
+		opj_vec_t l_seg_buffers = seg_buffers;
 
 		memset(this, 0, sizeof(opj_tcd_cblk_dec_t));
 		segs = l_segs;
 		numSegmentsAllocated = l_current_max_segs;
+		seg_buffers = l_seg_buffers;
 	}
 	return true;
 }
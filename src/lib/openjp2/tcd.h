@@ -190,7 +190,11 @@ struct opj_tcd_precinct_t {
 							ch(0), 
 							block_size(0), 
 							incltree(nullptr), 
-							imsbtree(nullptr) 
+							imsbtree(nullptr),
+							win_cx0(0),
+							win_cy0(0),
+							win_cx1(0),
+							win_cy1(0)
 	{
 		cblks.blocks = nullptr;
 	}
@@ -203,7 +207,11 @@ struct opj_tcd_precinct_t {
 														ch(0),
 														block_size(0),
 														incltree( nullptr),
-														imsbtree(nullptr) {
+														imsbtree(nullptr),
+														win_cx0(0),
+														win_cy0(0),
+														win_cx1(0),
+														win_cy1(0) {
 		cblks.blocks = nullptr;
 	}
 	~opj_tcd_precinct_t();
@@ -223,6 +231,11 @@ struct opj_tcd_precinct_t {
 		delete[] cblks.dec;
 	}
 
+	/* true if some code block of the precinct overlaps the decode window */
+	bool inDecodeWindow() const {
+		return win_cx0 < win_cx1 && win_cy0 < win_cy1;
+	}
+
     uint32_t x0, y0, x1, y1;		/* dimension of the precinct : left upper corner (x0, y0) right low corner (x1,y1) */
     uint32_t cw, ch;				/* number of precinct in width and height */
     union {							/* code-blocks information */
@@ -233,6 +246,8 @@ struct opj_tcd_precinct_t {
     uint32_t block_size;			/* size taken by cblks (in bytes) */
     TagTree *incltree;	    /* inclusion tree */
     TagTree *imsbtree;	    /* IMSB tree */
+    /* code blocks overlapping the decode window: columns [win_cx0, win_cx1) and rows [win_cy0, win_cy1) */
+    uint32_t win_cx0, win_cy0, win_cx1, win_cy1;
 };
 
 // band
@@ -245,7 +260,11 @@ struct opj_tcd_band_t {
 						precincts(nullptr),
 						precincts_data_size(0),
 						numbps(0),
-						stepsize(0) {}
+						stepsize(0),
+						win_px0(0),
+						win_py0(0),
+						win_px1(0),
+						win_py1(0) {}
 
 	opj_tcd_band_t(const opj_tcd_band_t& rhs) : x0(rhs.x0), 
 												  y0(rhs.y0),
@@ -255,7 +274,11 @@ struct opj_tcd_band_t {
 												precincts(nullptr),
 												precincts_data_size(0),
 												numbps(rhs.numbps),
-												stepsize(rhs.stepsize)
+												stepsize(rhs.stepsize),
+												win_px0(0),
+												win_py0(0),
+												win_px1(0),
+												win_py1(0)
 	 {}
 	~opj_tcd_band_t();
 
@@ -268,6 +291,9 @@ struct opj_tcd_band_t {
     uint32_t precincts_data_size;	/* size of data taken by precincts */
     uint32_t numbps;
     float stepsize;
+    /* precincts overlapping the decode window: columns [win_px0, win_px1) and rows [win_py0, win_py1)
+       of the resolution's precinct grid */
+    uint32_t win_px0, win_py0, win_px1, win_py1;
 };
 
 // resolution
@@ -344,8 +370,14 @@ struct opj_tcd_t {
     uint32_t tcd_tileno;
     /** indicate if the tcd is a decoder. */
     uint32_t m_is_decoder : 1;
+    /** indicate if the current tile has already been run through opj_tcd_pre_t2_encode_tile */
+    uint32_t m_pre_t2_done : 1;
     opj_plugin_tile_t* current_plugin_tile;
 	uint32_t numThreads;
+	/** tile-scoped allocations, released in one go before each tile is coded */
+	opj_arena_t* arena;
+	/** packet sequences of the position driven progressions, shared by successive tiles */
+	opj_pi_cache_t* pi_cache;
 };
 
 /** @name Exported functions */
@@ -399,6 +431,20 @@ bool opj_tcd_init_decode_tile(opj_tcd_t *p_tcd,
  */
 uint64_t opj_tcd_get_decoded_tile_size (opj_tcd_t *p_tcd );
 
+/**
+ * Runs DC level shift, MCT, DWT, T1 and rate allocation on a tile, so that only tier 2
+ * remains for opj_tcd_encode_tile. Tiles with their own tile coders can be prepared concurrently.
+ * @param	p_tcd			Tile Coder handle
+ * @param	p_tile_no		Index of the tile to encode.
+ * @param	p_max_length	Maximum length of the first tile part
+ * @param	p_cstr_info		Codestream information structure
+ * @return  true if the coding is successful.
+*/
+bool opj_tcd_pre_t2_encode_tile(opj_tcd_t *p_tcd,
+								uint32_t p_tile_no,
+								uint64_t p_max_length,
+								opj_codestream_info_t *p_cstr_info);
+
 /**
  * Encodes a tile from the raw image into the given buffer.
  * @param	p_tcd			Tile Coder handle
@@ -223,21 +223,6 @@ void opj_tile_buf_destroy_component(opj_tile_buf_component_t* comp)
     delete comp;
 }
 
-bool opj_tile_buf_hit_test(opj_tile_buf_component_t* comp, rect_t* rect)
-{
-    if (!comp || !rect)
-        return false;
-    for (auto& res : comp->resolutions) {
-        rect_t dummy;
-        uint32_t j;
-        for (j = 0; j < res->num_bands; ++j) {
-            if ((res->band_region + j)->dim.clip(rect, &dummy))
-                return true;
-        }
-    }
-    return false;
-}
-
 opj_pt_t opj_tile_buf_get_uninterleaved_range(opj_tile_buf_component_t* comp,
         uint32_t resno,
         bool is_even,
@@ -72,11 +72,6 @@ bool opj_tile_buf_is_decode_region(opj_tile_buf_component_t* buf);
 
 void opj_tile_buf_destroy_component(opj_tile_buf_component_t* comp);
 
-/* Check if rect overlaps with region.
-   rect coordinates must be stored in canvas coordinates
-*/
-bool opj_tile_buf_hit_test(opj_tile_buf_component_t* comp, rect_t* rect);
-
 /* sub-band coordinates */
 opj_pt_t opj_tile_buf_get_uninterleaved_range(opj_tile_buf_component_t* comp,
         uint32_t resno,
@@ -15,6 +15,10 @@
 *
 */
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include "opj_includes.h"
 
 
@@ -132,4 +136,26 @@ void rect_t::grow2(int64_t boundaryx, int64_t boundaryy)
     y0 -= boundaryy;
     x1 += boundaryx;
     y1 += boundaryy;
-}
\ No newline at end of file
+}
+
+bool opj_cpu_has_avx2(void)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const int osxsave_avx = (1 << 27) | (1 << 28);
+    if ((info[2] & osxsave_avx) != osxsave_avx)
+        return false;
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
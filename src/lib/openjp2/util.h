@@ -68,3 +68,8 @@ typedef struct opj_buf {
     bool owns_data;	/* true if buffer manages the buf array */
 } opj_buf_t;
 
+/**
+Check whether the CPU and the OS (saved YMM state) support AVX2.
+Kernels built with AVX2 code generation must only be called if this returns true.
+*/
+bool opj_cpu_has_avx2(void);
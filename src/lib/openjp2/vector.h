@@ -19,8 +19,19 @@
 
 
 #include <vector>
-struct opj_min_buf_t;
 
+/*
+Smart wrapper to low level C array
+*/
+struct opj_min_buf_t {
+    uint8_t *buf;		/* internal array*/
+    uint32_t len;		/* length of array */
+};
+
+/*
+Vector of buffers, stored by value. clear() keeps the storage, so that a
+vector re-filled for every tile stops allocating once it has grown.
+*/
 struct opj_vec_t {
 	opj_vec_t() : data(nullptr) {}
 
@@ -28,11 +39,11 @@ struct opj_vec_t {
 	{
 		if (data)
 			return true;
-		data = new std::vector<opj_min_buf_t*>();
+		data = new std::vector<opj_min_buf_t>();
 		return data ? true : false;
 	}
 
-	bool push_back(opj_min_buf_t* value)
+	bool push_back(const opj_min_buf_t& value)
 	{
 		data->push_back(value);
 		return true;
@@ -46,7 +57,7 @@ struct opj_vec_t {
 		if (index >= data->size()) {
 			return NULL;
 		}
-		return data->operator[](index);
+		return &data->operator[](index);
 	}
 
 	int32_t size()
@@ -58,24 +69,21 @@ struct opj_vec_t {
 
 	void* back()
 	{
-		if (!data)
+		if (!data || data->empty())
 			return NULL;
-		return data->back();
+		return &data->back();
+	}
+
+	void clear()
+	{
+		if (data)
+			data->clear();
 	}
 
 	void cleanup()
 	{
-		if (!data)
-			return;
-		for (auto it = data->begin(); it != data->end(); ++it) {
-			if (*it)
-				opj_free(*it);
-		}
 		delete data;
 		data = NULL;
 	}
-    std::vector<opj_min_buf_t*>* data;		/* array of void* pointers */
+    std::vector<opj_min_buf_t>* data;
 };
-
-
-
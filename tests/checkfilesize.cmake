@@ -0,0 +1,44 @@
+#    Copyright (C) 2016-2017 Grok Image Compression Inc.
+#
+#    This source code is free software: you can redistribute it and/or  modify
+#    it under the terms of the GNU Affero General Public License, version 3,
+#    as published by the Free Software Foundation.
+#
+#    This source code is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU Affero General Public License for more details.
+#
+#    You should have received a copy of the GNU Affero General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# check file size
+#
+# Fails if the size of a file differs from the size of a reference file by
+# more than a given percentage. Used for encodes that are expected to come
+# close to, but not exactly match, a reference encode.
+
+# This script expect three inputs
+# REFFILE: Path to the reference file
+# OUTFILENAME: Path to the file to check
+# TOLERANCE: Largest allowed difference, in percent of the reference size
+
+# file(SIZE) needs CMake 3.14: count the bytes of a hex dump instead
+file(READ ${REFFILE} ref_hex HEX)
+string(LENGTH "${ref_hex}" ref_size)
+math(EXPR ref_size "${ref_size} / 2")
+file(READ ${OUTFILENAME} out_hex HEX)
+string(LENGTH "${out_hex}" out_size)
+math(EXPR out_size "${out_size} / 2")
+
+math(EXPR max_diff "${ref_size} * ${TOLERANCE} / 100")
+math(EXPR diff "${out_size} - ${ref_size}")
+if(diff LESS 0)
+  math(EXPR diff "0 - ${diff}")
+endif()
+
+if(diff GREATER max_diff)
+  message(SEND_ERROR "size differs by more than ${TOLERANCE}%: ${out_size} vs ${ref_size}")
+else()
+  message(STATUS "size within ${TOLERANCE}%: ${out_size} vs ${ref_size}")
+endif()
@@ -0,0 +1,184 @@
+/*
+*    Copyright (C) 2016-2017 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*/
+
+/*
+Benchmark for the 2-D wavelet transforms on a single tile component.
+
+Runs the forward and inverse 5-3 and 9-7 transforms on a synthetic
+width x height tile and reports the tile buffer bandwidth of each one.
+Very wide tiles are where the vertical passes are most sensitive to
+cache and TLB misses, hence the default 16384 x 512 tile.
+
+The 5-3 round trip must be lossless: the program fails if it is not,
+so that it can also run as a regression test on small odd-sized tiles.
+
+usage: dwt_benchmark [width height [numres [threads [iterations [x0 y0]]]]]
+*/
+
+#include "opj_includes.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+struct dwt_bench_tile {
+	opj_tcd_tilecomp_t tilec;
+	opj_tile_buf_component_t buf;
+	std::vector<int32_t> data;
+};
+
+static uint32_t ceildivpow2(uint32_t a, uint32_t b)
+{
+	return (uint32_t)(((uint64_t)a + ((uint64_t)1 << b) - 1) >> b);
+}
+
+static bool init_tile(dwt_bench_tile* t, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, uint32_t numres)
+{
+	opj_tcd_tilecomp_t* tilec = &t->tilec;
+	memset(tilec, 0, sizeof(*tilec));
+	tilec->x0 = x0;
+	tilec->y0 = y0;
+	tilec->x1 = x0 + w;
+	tilec->y1 = y0 + h;
+	tilec->numresolutions = numres;
+	tilec->minimum_num_resolutions = numres;
+	tilec->resolutions = new opj_tcd_resolution_t[numres];
+	for (uint32_t resno = 0; resno < numres; ++resno) {
+		auto res = tilec->resolutions + resno;
+		uint32_t level = numres - 1 - resno;
+		res->x0 = ceildivpow2(tilec->x0, level);
+		res->y0 = ceildivpow2(tilec->y0, level);
+		res->x1 = ceildivpow2(tilec->x1, level);
+		res->y1 = ceildivpow2(tilec->y1, level);
+	}
+	t->data.resize((size_t)w * h);
+	t->buf.data = t->data.data();
+	t->buf.data_size = t->data.size() * sizeof(int32_t);
+	t->buf.owns_data = false;
+	t->buf.tile_dim = rect_t(tilec->x0, tilec->y0, tilec->x1, tilec->y1);
+	t->buf.dim = t->buf.tile_dim;
+	tilec->buf = &t->buf;
+	return true;
+}
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static void report(const char* name, double ms, size_t numpix, uint32_t iterations)
+{
+	double per_iter = ms / iterations;
+	/* every pass reads and writes the whole tile buffer once */
+	double mb = 2.0 * (double)numpix * sizeof(int32_t) / (1024.0 * 1024.0);
+	printf("%-12s %10.2f ms %10.1f MB/s %10.1f Mpix/s\n", name, per_iter,
+		   mb / (per_iter / 1000.0), (double)numpix / (per_iter * 1000.0));
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t w = 16384, h = 512, numres = 6, numThreads = 1, iterations = 3;
+	uint32_t x0 = 0, y0 = 0;
+	if (argc > 2) {
+		w = (uint32_t)atoi(argv[1]);
+		h = (uint32_t)atoi(argv[2]);
+	}
+	if (argc > 3)
+		numres = (uint32_t)atoi(argv[3]);
+	if (argc > 4)
+		numThreads = (uint32_t)atoi(argv[4]);
+	if (argc > 5)
+		iterations = (uint32_t)atoi(argv[5]);
+	if (argc > 7) {
+		x0 = (uint32_t)atoi(argv[6]);
+		y0 = (uint32_t)atoi(argv[7]);
+	}
+	if (!w || !h || !numres || numres > 33 || !numThreads || !iterations) {
+		fprintf(stderr, "usage: %s [width height [numres [threads [iterations [x0 y0]]]]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	dwt_bench_tile tile;
+	init_tile(&tile, x0, y0, w, h, numres);
+	size_t numpix = tile.data.size();
+	std::vector<int32_t> orig(numpix);
+	srand(1);
+	for (auto& v : orig)
+		v = (rand() & 0xFFF) - 0x800;
+
+	printf("tile %ux%u at (%u,%u), %u resolutions, %u threads, %u iterations\n",
+		   w, h, x0, y0, numres, numThreads, iterations);
+
+	int rc = EXIT_SUCCESS;
+	double enc = 0, dec = 0;
+	for (uint32_t i = 0; i < iterations; ++i) {
+		tile.data = orig;
+		tile.buf.data = tile.data.data();
+		auto start = bench_clock::now();
+		if (!opj_dwt_encode_53(&tile.tilec, numThreads))
+			return EXIT_FAILURE;
+		enc += elapsed_ms(start);
+		start = bench_clock::now();
+		if (!opj_dwt_decode_53(&tile.tilec, numres, numThreads))
+			return EXIT_FAILURE;
+		dec += elapsed_ms(start);
+		if (tile.data != orig) {
+			fprintf(stderr, "5-3 round trip is not lossless\n");
+			rc = EXIT_FAILURE;
+		}
+	}
+	report("fwd 5-3", enc, numpix, iterations);
+	report("inv 5-3", dec, numpix, iterations);
+
+	enc = dec = 0;
+	double max_err = 0;
+	for (uint32_t i = 0; i < iterations; ++i) {
+		/* the encoder feeds the 9-7 transform with 11 fractional bits */
+		for (size_t k = 0; k < numpix; ++k)
+			tile.data[k] = orig[k] * (1 << 11);
+		tile.buf.data = tile.data.data();
+		auto start = bench_clock::now();
+		if (!opj_dwt_encode_97(&tile.tilec, numThreads))
+			return EXIT_FAILURE;
+		enc += elapsed_ms(start);
+		/* the inverse 9-7 works in place on floats */
+		for (size_t k = 0; k < numpix; ++k) {
+			float f = (float)tile.data[k];
+			memcpy(&tile.data[k], &f, sizeof(f));
+		}
+		start = bench_clock::now();
+		if (!opj_dwt_decode_97(&tile.tilec, numres, numThreads))
+			return EXIT_FAILURE;
+		dec += elapsed_ms(start);
+		for (size_t k = 0; k < numpix; ++k) {
+			float f;
+			memcpy(&f, &tile.data[k], sizeof(f));
+			max_err = std::max<double>(max_err, fabs(f / (1 << 11) - orig[k]));
+		}
+	}
+	report("fwd 9-7", enc, numpix, iterations);
+	report("inv 9-7", dec, numpix, iterations);
+	printf("9-7 round trip max error %.3f\n", max_err);
+
+	delete[] tile.tilec.resolutions;
+	return rc;
+}